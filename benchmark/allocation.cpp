@@ -0,0 +1,110 @@
+// Compares the size-class arena and the nursery of the garbage collector
+// against a malloc per object, for batches of short-lived objects of the sizes
+// of typical strings
+//
+// Every iteration allocates a batch and then frees all of it, by a collection
+// without roots for the arena and the nursery and by walking the object list
+// for malloc.
+// Large objects still come from malloc, and since the collector frees them
+// together glibc may return the top of its heap to the system on every
+// collection, set MALLOC_TRIM_THRESHOLD_ to see the cost of the arena alone.
+
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+#include "bench_util.hpp"
+#include "memory.hpp"
+
+namespace {
+
+constexpr std::size_t batch_size = 1000;
+
+// The sizes in bytes of the payloads, cycled through in every batch
+constexpr std::size_t small_sizes[] = {3, 8, 12, 5, 24, 17, 40, 64, 9, 100};
+constexpr std::size_t mixed_sizes[] = {3, 8, 120, 5, 600, 17, 3000, 64, 9, 100};
+
+// The allocation path of the collector before the arena, an intrusive list of
+// objects from malloc
+class MallocHeap {
+public:
+  MallocHeap() = default;
+  MallocHeap(const MallocHeap& other) = delete;
+  auto operator=(const MallocHeap& other) -> MallocHeap& = delete;
+  ~MallocHeap()
+  {
+    free_all();
+  }
+
+  auto allocate(std::size_t bytes) -> void*
+  {
+    void* ptr = std::malloc(eml::GarbageCollector::object_size(bytes));
+    if (ptr == nullptr) {
+      throw std::bad_alloc{};
+    }
+    root_ = new (ptr) Node{root_, bytes};
+    return root_ + 1;
+  }
+
+  void free_all() noexcept
+  {
+    while (root_ != nullptr) {
+      Node* next = root_->next;
+      std::free(root_);
+      root_ = next;
+    }
+  }
+
+private:
+  struct Node {
+    Node* next;
+    std::size_t size;
+  };
+
+  Node* root_ = nullptr;
+};
+
+template <std::size_t N>
+void compare(std::string_view name, const std::size_t (&sizes)[N])
+{
+  constexpr std::size_t iterations = 5'000;
+
+  std::cout << name << '\n';
+
+  MallocHeap heap;
+  run_benchmark("  malloc", iterations, batch_size, [&]() {
+    for (std::size_t i = 0; i < batch_size; ++i) {
+      static_cast<std::byte*>(heap.allocate(sizes[i % N]))[0] = std::byte{1};
+    }
+    heap.free_all();
+  });
+
+  eml::GarbageCollector gc{};
+  run_benchmark("  arena", iterations, batch_size, [&]() {
+    for (std::size_t i = 0; i < batch_size; ++i) {
+      gc.allocate(sizes[i % N])->data()[0] = std::byte{1};
+    }
+    gc.collect();
+  });
+  std::cout << "  arena blocks: " << gc.block_count() << '\n';
+
+  eml::GarbageCollectorConfig config;
+  config.generational = true;
+  eml::GarbageCollector generational_gc{config};
+  run_benchmark("  nursery", iterations, batch_size, [&]() {
+    for (std::size_t i = 0; i < batch_size; ++i) {
+      generational_gc.allocate(sizes[i % N])->data()[0] = std::byte{1};
+    }
+    // Large objects skip the nursery, the full collections free them
+    generational_gc.collect_nursery();
+    generational_gc.collect_if_needed();
+  });
+}
+
+} // anonymous namespace
+
+int main()
+{
+  compare("small objects", small_sizes);
+  compare("small and large objects", mixed_sizes);
+}
@@ -0,0 +1,102 @@
+// Runs the stack-based and the register-based back ends and the jits on the
+// same ASTs, and compares their instruction counts and run times
+
+#include <iostream>
+#include <string_view>
+
+#include "bench_util.hpp"
+#include "eml.hpp"
+
+namespace {
+
+constexpr std::string_view scripts[] = {
+    "1 + 2 * 3 - 4 / 5",
+    "((1 + 2) * (3 + 4) - (5 + 6) * (7 - 8)) / ((9 - 1) * (2 + 3) + 4 * 5)",
+    "if (1 < 2) if (3 > 4) 5 else 6 * 7 else 8",
+    "if (1 + 2 < 3 * 4) (if (5 >= 6) 1 else 2) + 3 else (if (7 == 8) 4 else 5)",
+    "!(1 < 2) != (3 * 3 <= 9)",
+};
+
+} // anonymous namespace
+
+int main()
+{
+  constexpr std::size_t iterations = 1'000'000;
+
+  eml::GarbageCollector gc{};
+  eml::Compiler compiler{gc};
+  eml::VM vm;
+  eml::RegisterVM register_vm;
+  std::size_t checksum = 0;
+
+  for (const auto script : scripts) {
+    auto ast = eml::parse(script, gc).and_then(
+        [&compiler](auto&& node) { return compiler.type_check(node); });
+    if (!ast) {
+      std::cerr << "Failed to compile " << script << '\n';
+      return 1;
+    }
+
+    const auto [stack_code, stack_type] = compiler.generate_code(**ast);
+    const auto register_result = compiler.generate_register_code(**ast);
+    if (!register_result) {
+      std::cerr << "Too many registers or constants in " << script << '\n';
+      return 1;
+    }
+    const auto& [register_code, register_type] = *register_result;
+
+    const auto stack_instructions = stack_code.instruction_count();
+    const auto register_instructions = register_code.instructions.size();
+
+    std::cout << script << '\n';
+    std::cout << "instructions: stack " << stack_instructions << ", register "
+              << register_instructions << '\n';
+
+    run_benchmark("  stack vm", iterations, stack_instructions, [&]() {
+      if (vm.interpret(stack_code)) {
+        ++checksum;
+      }
+    });
+    run_benchmark("  register vm", iterations, register_instructions, [&]() {
+      if (register_vm.interpret(register_code)) {
+        ++checksum;
+      }
+    });
+
+    const auto verified = eml::verify(stack_code);
+    if (!verified) {
+      std::cerr << "Failed to verify " << script << '\n';
+      return 1;
+    }
+    const eml::JitBytecode jit_code{*verified};
+    run_benchmark(jit_code.is_native() ? "  jit" : "  jit (interpreted)",
+                  iterations, stack_instructions, [&]() {
+                    if (vm.interpret(jit_code)) {
+                      ++checksum;
+                    }
+                  });
+
+    eml::TracingBytecode tracing_code{*verified};
+    run_benchmark("  tracing jit", iterations, stack_instructions, [&]() {
+      if (vm.interpret(tracing_code)) {
+        ++checksum;
+      }
+    });
+    // Clock reads would dominate the run times above, so the time split is
+    // measured on separate runs
+    tracing_code.measure_time(true);
+    for (std::size_t i = 0; i < iterations / 10; ++i) {
+      if (vm.interpret(tracing_code)) {
+        ++checksum;
+      }
+    }
+    const auto& stats = tracing_code.stats();
+    std::cout << "  traces: " << stats.traces_compiled << ", entries "
+              << stats.trace_entries << ", guard failures "
+              << stats.guard_failures << ", native "
+              << stats.native_time.count() / 1'000'000 << " ms, interpreted "
+              << stats.interpreted_time.count() / 1'000'000 << " ms\n";
+  }
+
+  std::cout << "checksum: " << checksum << '\n';
+}
@@ -0,0 +1,65 @@
+#ifndef EML_BENCH_UTIL_HPP
+#define EML_BENCH_UTIL_HPP
+
+// Utility functions for the benchmarks
+
+#include <chrono>
+#include <cstddef>
+#include <iomanip>
+#include <iostream>
+#include <string_view>
+
+#include "bytecode.hpp"
+
+// Runs f for a number of iterations after a short warm up, and prints the
+// average time of an iteration and of an operation inside the iteration
+template <typename F>
+void run_benchmark(std::string_view name, std::size_t iterations,
+                   std::size_t ops_per_iteration, F f)
+{
+  using clock = std::chrono::steady_clock;
+
+  for (std::size_t i = 0; i < iterations / 10 + 1; ++i) {
+    f();
+  }
+
+  const auto start = clock::now();
+  for (std::size_t i = 0; i < iterations; ++i) {
+    f();
+  }
+  const auto elapsed = clock::now() - start;
+
+  const double ns_per_iteration =
+      std::chrono::duration<double, std::nano>(elapsed).count() /
+      static_cast<double>(iterations);
+  const double ns_per_op =
+      ns_per_iteration / static_cast<double>(ops_per_iteration);
+
+  std::cout << std::left << std::setw(36) << name << std::right << std::fixed
+            << std::setprecision(2) << std::setw(12) << ns_per_iteration
+            << " ns/iter" << std::setprecision(3) << std::setw(10) << ns_per_op
+            << " ns/op\n";
+}
+
+// Write an instruction to the chunk
+inline void write_instruction(eml::Bytecode& chunk, eml::opcode instruction)
+{
+  chunk.write(instruction, eml::line_num{0});
+}
+
+// Write a jump instruction with its offset to the chunk
+inline void write_jump(eml::Bytecode& chunk, eml::opcode instruction,
+                       std::underlying_type_t<eml::opcode> amount)
+{
+  chunk.write(instruction, eml::line_num{0});
+  chunk.write(std::byte{amount}, eml::line_num{0});
+}
+
+// Push a constant number to the chunk
+inline void push_number(eml::Bytecode& chunk, double value)
+{
+  const auto offset = chunk.add_constant(eml::Value{value});
+  chunk.write_with_constant(eml::op_push_f64, *offset, eml::line_num{0});
+}
+
+#endif // EML_BENCH_UTIL_HPP
@@ -0,0 +1,102 @@
+// Measures the cost of instruction dispatch in VM::interpret
+//
+// Build once with -DEML_VM_COMPUTED_GOTO=ON and once with OFF to compare the
+// threaded dispatch against the switch dispatch.
+
+#include <iostream>
+
+#include "bench_util.hpp"
+#include "verifier.hpp"
+#include "vm.hpp"
+
+namespace {
+
+constexpr std::size_t arithmetic_groups = 60;
+constexpr std::size_t branch_blocks = 60;
+
+// 1.5 (+ 2 * 3 - 1 / 2) repeated, the stack depth stays at most 2
+auto make_arithmetic_chunk() -> eml::Bytecode
+{
+  eml::Bytecode code;
+  push_number(code, 1.5);
+  for (std::size_t i = 0; i < arithmetic_groups; ++i) {
+    push_number(code, 2.);
+    write_instruction(code, eml::op_add_f64);
+    push_number(code, 3.);
+    write_instruction(code, eml::op_multiply_f64);
+    push_number(code, 1.);
+    write_instruction(code, eml::op_subtract_f64);
+    push_number(code, 2.);
+    write_instruction(code, eml::op_divide_f64);
+  }
+  code.max_stack_depth = code.compute_max_stack_depth();
+  return code;
+}
+
+constexpr std::size_t arithmetic_ops = 1 + arithmetic_groups * 8;
+
+// A sequence of (if (a < b) c else d) whose results are discarded, with the
+// branches alternate between taken and not taken
+auto make_branch_chunk() -> eml::Bytecode
+{
+  eml::Bytecode code;
+  for (std::size_t i = 0; i < branch_blocks; ++i) {
+    const bool taken = i % 2 == 0;
+    push_number(code, taken ? 1. : 2.);
+    push_number(code, taken ? 2. : 1.);
+    write_instruction(code, eml::op_less_f64);
+    write_jump(code, eml::op_jmp_false, 4);
+    push_number(code, 3.);            // 2
+    write_jump(code, eml::op_jmp, 2); // 2
+    push_number(code, 4.);            // 2
+    write_instruction(code, eml::op_pop);
+  }
+  write_instruction(code, eml::op_true);
+  code.max_stack_depth = code.compute_max_stack_depth();
+  return code;
+}
+
+// Each block executes 7 instructions when the condition holds and 6 otherwise
+constexpr std::size_t branch_ops = branch_blocks / 2 * (7 + 6) + 1;
+
+} // anonymous namespace
+
+int main()
+{
+  std::cout << "Dispatch: "
+            << (eml::build_options.vm_computed_goto ? "computed goto"
+                                                    : "switch")
+            << '\n';
+
+  constexpr std::size_t iterations = 200'000;
+
+  eml::VM vm;
+  double checksum = 0;
+
+  const auto arithmetic = make_arithmetic_chunk();
+  run_benchmark("arithmetic", iterations, arithmetic_ops, [&]() {
+    checksum += vm.interpret(arithmetic)->unsafe_as_number();
+  });
+
+  const auto branches = make_branch_chunk();
+  run_benchmark("comparison and jumps", iterations, branch_ops, [&]() {
+    checksum += vm.interpret(branches)->unsafe_as_boolean() ? 1 : 0;
+  });
+
+  // The same chunks on the unchecked loop of verified chunks
+  const auto verified_arithmetic = eml::verify(arithmetic);
+  run_benchmark("arithmetic (verified)", iterations, arithmetic_ops, [&]() {
+    checksum += vm.interpret(*verified_arithmetic)->unsafe_as_number();
+  });
+
+  const auto verified_branches = eml::verify(branches);
+  run_benchmark("comparison and jumps (verified)", iterations, branch_ops,
+                [&]() {
+                  checksum +=
+                      vm.interpret(*verified_branches)->unsafe_as_boolean()
+                          ? 1
+                          : 0;
+                });
+
+  std::cout << "checksum: " << checksum << '\n';
+}
@@ -0,0 +1,71 @@
+// Compares number literals pushed from the constant pool against number
+// literals stored inline in the instructions
+
+#include <iostream>
+#include <string_view>
+
+#include "bench_util.hpp"
+#include "eml.hpp"
+
+namespace {
+
+constexpr std::string_view scripts[] = {
+    "1 + 2 * 3 - 4 / 5",
+    "((1 + 2) * (3 + 4) - (5 + 6) * (7 - 8)) / ((9 - 1) * (2 + 3) + 4 * 5)",
+    "0.5 * 1.5 + 2.5 * 3.5 - 4.5 * 5.5 + 6.5 / 7.5 - 8.5 * 9.5",
+    "if (0 < 1) (if (-1 < 0) 1000 else 2000) * 0.001 else 1",
+};
+
+} // anonymous namespace
+
+int main()
+{
+  constexpr std::size_t iterations = 1'000'000;
+
+  eml::GarbageCollector gc{};
+  eml::VM vm;
+  std::size_t checksum = 0;
+
+  eml::CompilerConfig pool_config;
+  pool_config.number_encoding = eml::NumberEncoding::constant_pool;
+  pool_config.superinstructions = false;
+  eml::CompilerConfig immediate_config;
+  immediate_config.number_encoding = eml::NumberEncoding::immediate;
+  immediate_config.superinstructions = false;
+
+  eml::Compiler pool_compiler{gc, pool_config};
+  eml::Compiler immediate_compiler{gc, immediate_config};
+
+  for (const auto script : scripts) {
+    auto ast = eml::parse(script, gc).and_then([&pool_compiler](auto&& node) {
+      return pool_compiler.type_check(node);
+    });
+    if (!ast) {
+      std::cerr << "Failed to compile " << script << '\n';
+      return 1;
+    }
+
+    const auto [pool_code, pool_type] = pool_compiler.generate_code(**ast);
+    const auto [immediate_code, immediate_type] =
+        immediate_compiler.generate_code(**ast);
+    const auto instructions = pool_code.instruction_count();
+
+    std::cout << script << '\n';
+    std::cout << "bytes: constant pool " << pool_code.instructions.size()
+              << " + " << pool_code.constants.size() << " constants, inline "
+              << immediate_code.instructions.size() << '\n';
+
+    run_benchmark("  constant pool", iterations, instructions, [&]() {
+      if (vm.interpret(pool_code)) {
+        ++checksum;
+      }
+    });
+    run_benchmark("  inline", iterations, instructions, [&]() {
+      if (vm.interpret(immediate_code)) {
+        ++checksum;
+      }
+    });
+  }
+
+  std::cout << "checksum: " << checksum << '\n';
+}
@@ -0,0 +1,73 @@
+// Prints how much code the peephole optimizer removes from a set of scripts,
+// and compares the run times of the plain and optimized bytecode
+
+#include <iostream>
+#include <string_view>
+
+#include "bench_util.hpp"
+#include "eml.hpp"
+#include "peephole.hpp"
+
+namespace {
+
+// Constant folding would already simplify these scripts, so they are
+// compiled without it to show what the optimizer does on code whose
+// conditions are only known at runtime
+constexpr std::string_view scripts[] = {
+    "if (!(1 < 2)) 3 else 4",
+    "if (!(1 + 2 < 3 * 4)) (if (!(5 >= 6)) 1 else 2) + 3 else 4",
+    "if (true) 1 else 2",
+    "if (false) 1 else if (!(2 == 3)) 4 else 5",
+    "!!(1 <= 2) == !(3 > 4)",
+    "-(-(1 + 2)) * -(-3)",
+};
+
+} // anonymous namespace
+
+int main()
+{
+  constexpr std::size_t iterations = 1'000'000;
+
+  eml::GarbageCollector gc{};
+  eml::CompilerConfig config;
+  config.constant_folding = false;
+  config.superinstructions = false;
+  config.peephole = false;
+  eml::Compiler compiler{gc, config};
+  eml::VM vm;
+  std::size_t checksum = 0;
+
+  eml::PeepholeStats total;
+  for (const auto script : scripts) {
+    auto result = compiler.compile(script);
+    if (!result) {
+      std::cerr << "Failed to compile " << script << '\n';
+      return 1;
+    }
+
+    const auto plain = std::get<eml::Bytecode>(*std::move(result));
+    const auto optimized = eml::optimize_peephole(plain, total);
+
+    std::cout << script << '\n';
+    std::cout << "instructions: plain " << plain.instruction_count()
+              << ", optimized " << optimized.instruction_count()
+              << "; bytes: plain " << plain.instructions.size()
+              << ", optimized " << optimized.instructions.size() << '\n';
+
+    run_benchmark("  plain", iterations, plain.instruction_count(), [&]() {
+      if (vm.interpret(plain)) {
+        ++checksum;
+      }
+    });
+    run_benchmark("  optimized", iterations, optimized.instruction_count(),
+                  [&]() {
+                    if (vm.interpret(optimized)) {
+                      ++checksum;
+                    }
+                  });
+  }
+
+  std::cout << "removed " << total.instructions_removed << " instructions, "
+            << total.bytes_removed << " bytes\n";
+  std::cout << "checksum: " << checksum << '\n';
+}
@@ -0,0 +1,97 @@
+// Compiles and runs large generated scripts: sums with many constants, which
+// need wide constant indices, and deeply nested if expressions, which need
+// wide jumps
+
+#include <iostream>
+#include <string>
+
+#include "bench_util.hpp"
+#include "eml.hpp"
+
+namespace {
+
+// Returns the sum 0.5 + 1.5 + 2.5 + ... with count terms
+auto sum_script(std::size_t count) -> std::string
+{
+  std::string result = "0.5";
+  for (std::size_t i = 1; i < count; ++i) {
+    result += " + " + std::to_string(i) + ".5";
+  }
+  return result;
+}
+
+// Returns depth nested if expressions, each one with a sum of terms terms in
+// its else branch
+auto nested_if_script(std::size_t depth, std::size_t terms) -> std::string
+{
+  const auto branch = sum_script(terms);
+  std::string result = branch;
+  for (std::size_t i = 0; i < depth; ++i) {
+    result = "if (" + std::to_string(i) + " < " + std::to_string(i + 1) +
+             ") (" + result + ") else " + branch;
+  }
+  return result;
+}
+
+auto run(eml::Compiler& compiler, eml::GarbageCollector& gc,
+         const std::string& name, const std::string& script,
+         std::size_t iterations) -> bool
+{
+  auto ast = eml::parse(script, gc).and_then(
+      [&compiler](auto&& node) { return compiler.type_check(node); });
+  if (!ast) {
+    std::cerr << "Failed to compile " << name << '\n';
+    return false;
+  }
+
+  const auto [code, type] = compiler.generate_code(**ast);
+
+  std::cout << name << ": " << code.instruction_count() << " instructions, "
+            << code.instructions.size() << " bytes, " << code.constants.size()
+            << " constants\n";
+
+  run_benchmark("  compile", iterations, code.instruction_count(), [&]() {
+    auto node = eml::parse(script, gc).and_then(
+        [&compiler](auto&& n) { return compiler.type_check(n); });
+    static_cast<void>(compiler.generate_code(**node));
+  });
+
+  eml::VM vm;
+  std::size_t checksum = 0;
+  run_benchmark("  run", iterations * 10, code.instruction_count(), [&]() {
+    if (vm.interpret(code)) {
+      ++checksum;
+    }
+  });
+  return checksum != 0;
+}
+
+// The AST passes are recursive, so the length of the sums is bounded by the
+// stack size. The deepest nested ifs have more than 30000 constants.
+constexpr std::size_t counts[] = {100, 1'000, 10'000};
+constexpr std::size_t depths[] = {10, 100, 1'000};
+
+} // anonymous namespace
+
+int main()
+{
+  eml::GarbageCollector gc{};
+  eml::CompilerConfig config;
+  config.number_encoding = eml::NumberEncoding::constant_pool;
+  config.superinstructions = false;
+  eml::Compiler compiler{gc, config};
+
+  for (const std::size_t count : counts) {
+    if (!run(compiler, gc, "sum of " + std::to_string(count) + " constants",
+             sum_script(count), 100'000 / count)) {
+      return 1;
+    }
+  }
+
+  for (const std::size_t depth : depths) {
+    if (!run(compiler, gc, std::to_string(depth) + " nested ifs",
+             nested_if_script(depth, 30), 10'000 / depth)) {
+      return 1;
+    }
+  }
+}
@@ -0,0 +1,116 @@
+// Prints the opcode pair profile of a set of scripts, and compares the
+// instruction counts and run times of the plain and fused bytecode
+//
+// The scripts are compiled without constant folding, which would fold every
+// one of them to a single push.
+
+#include <algorithm>
+#include <iostream>
+#include <string_view>
+#include <vector>
+
+#include "bench_util.hpp"
+#include "eml.hpp"
+#include "superinstruction.hpp"
+
+namespace {
+
+// Defined before the scripts are compiled, the scripts read them
+constexpr std::string_view definitions[] = {
+    "let width = 3",        "let height = 4.5", "let scale = -2",
+    "let name = \"eml\"", "let enabled = true",
+};
+
+constexpr std::string_view scripts[] = {
+    "1 + 2 * 3 - 4 / 5",
+    "((1 + 2) * (3 + 4) - (5 + 6) * (7 - 8)) / ((9 - 1) * (2 + 3) + 4 * 5)",
+    "if (1 < 2) if (3 > 4) 5 else 6 * 7 else 8",
+    "if (1 + 2 < 3 * 4) (if (5 >= 6) 1 else 2) + 3 else (if (7 == 8) 4 else 5)",
+    "if (-1 <= 2) 3 * -4 + 5 else 6 / 7 - 8",
+    "!(1 < 2) != (3 * 3 <= 9)",
+    "width * height + scale",
+    "if (width < height) width * scale else height / scale",
+    "if (enabled) (if (width >= 2) width - 1 else width + 1) * scale else 0",
+    "if (name == \"eml\") width else height",
+    "-(width + height) * (scale - 1) / 2",
+    "if (width * 2 > height) if (scale <= 0) -scale else scale else width",
+    "if (!enabled) 0 else if (height > width) height - width else 0",
+    "(if (width > 1) width else 1) * (if (height > 1) height else 1)",
+};
+
+void print_profile(const eml::OpcodePairProfile& profile)
+{
+  std::vector<std::pair<std::pair<eml::opcode, eml::opcode>, std::size_t>>
+      pairs(profile.begin(), profile.end());
+  std::sort(pairs.begin(), pairs.end(), [](const auto& lhs, const auto& rhs) {
+    return lhs.second > rhs.second;
+  });
+
+  std::cout << "opcode pair profile:\n";
+  for (const auto& [pair, count] : pairs) {
+    std::cout << "  " << eml::opcode_name(pair.first) << ' '
+              << eml::opcode_name(pair.second) << ": " << count << '\n';
+  }
+  std::cout << '\n';
+}
+
+} // anonymous namespace
+
+int main()
+{
+  constexpr std::size_t iterations = 1'000'000;
+
+  eml::GarbageCollector gc{};
+  eml::CompilerConfig config;
+  config.superinstructions = false;
+  config.constant_folding = false;
+  eml::Compiler compiler{gc, config};
+  eml::VM vm;
+  std::size_t checksum = 0;
+
+  for (const auto definition : definitions) {
+    if (!compiler.compile(definition)) {
+      std::cerr << "Failed to compile " << definition << '\n';
+      return 1;
+    }
+  }
+
+  std::vector<eml::Bytecode> chunks;
+  eml::OpcodePairProfile profile;
+  for (const auto script : scripts) {
+    auto ast = eml::parse(script, gc).and_then(
+        [&compiler](auto&& node) { return compiler.type_check(node); });
+    if (!ast) {
+      std::cerr << "Failed to compile " << script << '\n';
+      return 1;
+    }
+
+    auto [code, type] = compiler.generate_code(**ast);
+    eml::profile_opcode_pairs(code, profile);
+    chunks.push_back(std::move(code));
+  }
+
+  print_profile(profile);
+
+  for (std::size_t i = 0; i < chunks.size(); ++i) {
+    const auto& plain = chunks[i];
+    const auto fused = eml::fuse_superinstructions(plain);
+
+    std::cout << scripts[i] << '\n';
+    std::cout << "instructions: plain " << plain.instruction_count()
+              << ", fused " << fused.instruction_count() << '\n';
+
+    run_benchmark("  plain", iterations, plain.instruction_count(), [&]() {
+      if (vm.interpret(plain)) {
+        ++checksum;
+      }
+    });
+    run_benchmark("  fused", iterations, fused.instruction_count(), [&]() {
+      if (vm.interpret(fused)) {
+        ++checksum;
+      }
+    });
+  }
+
+  std::cout << "checksum: " << checksum << '\n';
+}
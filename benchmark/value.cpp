@@ -0,0 +1,63 @@
+// Measures the memory footprint and the stack throughput of eml::Value
+//
+// Build once with -DEML_NAN_BOXING=ON and once with OFF to compare the
+// NaN-boxed representation against the tagged union.
+
+#include <iostream>
+#include <vector>
+
+#include "bench_util.hpp"
+#include "vm.hpp"
+
+namespace {
+
+constexpr std::size_t stack_depth = 200;
+
+// Pushes stack_depth numbers and then sums all of them
+auto make_deep_stack_chunk() -> eml::Bytecode
+{
+  eml::Bytecode code;
+  for (std::size_t i = 0; i < stack_depth; ++i) {
+    push_number(code, static_cast<double>(i));
+  }
+  for (std::size_t i = 1; i < stack_depth; ++i) {
+    write_instruction(code, eml::op_add_f64);
+  }
+  code.max_stack_depth = code.compute_max_stack_depth();
+  return code;
+}
+
+} // anonymous namespace
+
+int main()
+{
+  std::cout << "Value: "
+            << (eml::build_options.nan_boxing ? "NaN boxing" : "tagged union")
+            << '\n';
+
+  std::cout << "sizeof(Value): " << sizeof(eml::Value) << " bytes\n";
+  std::cout << "256 slots VM stack: " << 256 * sizeof(eml::Value)
+            << " bytes\n";
+  std::cout << "255 entries constant pool: " << 255 * sizeof(eml::Value)
+            << " bytes\n\n";
+
+  constexpr std::size_t iterations = 200'000;
+
+  eml::VM vm;
+  double checksum = 0;
+
+  const auto deep_stack = make_deep_stack_chunk();
+  run_benchmark("deep stack push and add", iterations, 2 * stack_depth - 1,
+                [&]() {
+                  checksum += vm.interpret(deep_stack)->unsafe_as_number();
+                });
+
+  constexpr std::size_t values_count = 1'000'000;
+  const std::vector<eml::Value> values(values_count, eml::Value{1.0});
+  run_benchmark("copy 1M values", 100, values_count, [&]() {
+    std::vector<eml::Value> copy = values;
+    checksum += static_cast<double>(copy.size());
+  });
+
+  std::cout << "checksum: " << checksum << '\n';
+}
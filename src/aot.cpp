@@ -0,0 +1,479 @@
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <set>
+#include <sstream>
+
+#include "aot.hpp"
+
+namespace eml {
+
+namespace {
+
+using TypeStack = std::vector<StackType>;
+
+// Returns a C++ expression of the exact number
+auto number_literal(double number) -> std::string
+{
+  std::stringstream ss;
+  if (std::isfinite(number)) {
+    ss << '(' << std::hexfloat << number << ')';
+  } else {
+    ss << "eml_number(0x" << std::hex << bit_cast<std::uint64_t>(number)
+       << "ull)";
+  }
+  return ss.str();
+}
+
+// Returns a C++ string literal of text
+auto string_literal(std::string_view text) -> std::string
+{
+  std::stringstream ss;
+  ss << '"';
+  for (const char c : text) {
+    if (c == '"' || c == '\\') {
+      ss << '\\' << c;
+    } else if (c < ' ' || c > '~') {
+      ss << "\\" << std::oct << std::setw(3) << std::setfill('0')
+         << static_cast<unsigned>(static_cast<unsigned char>(c)) << std::dec;
+    } else {
+      ss << c;
+    }
+  }
+  ss << '"';
+  return ss.str();
+}
+
+// Generates the C++ function of a script
+//
+// Every stack slot becomes one local variable per type that it holds, nN for
+// numbers and bN for booleans. Unit values need no variable.
+class FunctionGenerator {
+public:
+  FunctionGenerator(const AotScript& script, std::string function_name)
+      : script_{script}, code_{script.code.code()},
+        function_name_{std::move(function_name)},
+        stack_at_(code_.instructions.size() + 1),
+        is_target_(code_.instructions.size() + 1, false)
+  {
+  }
+
+  // Returns the source of the function, or the reason it can not be
+  // generated
+  auto generate() -> expected<std::string, AotError>
+  {
+    const auto& instructions = code_.instructions;
+    std::optional<TypeStack> stack = TypeStack{};
+    for (std::size_t offset = 0; offset < instructions.size();) {
+      bind(offset, stack);
+      if (std::to_integer<std::size_t>(instructions[offset]) >= opcode_count) {
+        EML_ASSERT(!stack, "Only unreachable code can hold garbage");
+        break;
+      }
+      const auto op = static_cast<opcode>(instructions[offset]);
+      const auto next = offset + instruction_size(op);
+      if (stack) {
+        if (auto error = instruction(op, &instructions[offset] + 1, next,
+                                     *stack);
+            error) {
+          return unexpected{AotError{script_.name, std::move(*error)}};
+        }
+        if (op == op_jmp || op == op_jmp_wide) {
+          stack.reset();
+        }
+      }
+      offset = next;
+    }
+    bind(instructions.size(), stack);
+    EML_ASSERT(stack.has_value(), "The end of a chunk is always reachable");
+
+    if (stack->empty()) {
+      body_ << "  return {eml_aot_none, 0};\n";
+    } else {
+      const auto slot = stack->size() - 1;
+      switch (stack->back()) {
+      case StackType::number:
+        body_ << "  return {eml_aot_number, eml_bits(" << use('n', slot)
+              << ")};\n";
+        break;
+      case StackType::boolean:
+        body_ << "  return {eml_aot_boolean, " << use('b', slot)
+              << " ? 1u : 0u};\n";
+        break;
+      case StackType::unit:
+        body_ << "  return {eml_aot_unit, 0};\n";
+        break;
+      case StackType::reference:
+        EML_UNREACHABLE();
+      }
+    }
+
+    std::stringstream ss;
+    ss << "// " << string_literal(script_.name) << '\n';
+    ss << "auto " << function_name_ << "() -> eml_aot_value\n{\n";
+    for (const auto& variable : variables_) {
+      ss << "  " << (variable.front() == 'n' ? "double " : "bool ") << variable
+         << (variable.front() == 'n' ? " = 0;\n" : " = false;\n");
+    }
+    ss << body_.str() << "}\n";
+    return ss.str();
+  }
+
+private:
+  // Emits the label of offset if some jump goes there, and picks up the stack
+  // of the jumps when the previous instruction does not fall through
+  void bind(std::size_t offset, std::optional<TypeStack>& stack)
+  {
+    if (is_target_[offset]) {
+      body_ << "L" << offset << ":;\n";
+    }
+    if (!stack && stack_at_[offset]) {
+      stack = stack_at_[offset];
+    }
+  }
+
+  // Returns the name of the variable of a slot
+  auto use(char type, std::size_t slot) -> std::string
+  {
+    auto name = type + std::to_string(slot);
+    variables_.insert(name);
+    return name;
+  }
+
+  void jump(std::string_view condition, std::size_t target,
+            const TypeStack& stack)
+  {
+    body_ << "  ";
+    if (!condition.empty()) {
+      body_ << "if (" << condition << ") ";
+    }
+    body_ << "goto L" << target << ";\n";
+    is_target_[target] = true;
+    stack_at_[target] = stack;
+  }
+
+  void push_number(TypeStack& stack, double number)
+  {
+    body_ << "  " << use('n', stack.size()) << " = " << number_literal(number)
+          << ";\n";
+    stack.push_back(StackType::number);
+  }
+
+  void push_boolean(TypeStack& stack, bool boolean)
+  {
+    body_ << "  " << use('b', stack.size()) << " = "
+          << (boolean ? "true" : "false") << ";\n";
+    stack.push_back(StackType::boolean);
+  }
+
+  // Emits lhs = lhs op rhs on the number in slot lhs
+  void arithmetic(std::size_t lhs, std::string_view op, const std::string& rhs)
+  {
+    const auto name = use('n', lhs);
+    body_ << "  " << name << " = " << name << ' ' << op << ' ' << rhs
+          << ";\n";
+  }
+
+  // Returns the comparison of the two numbers on top of the stack
+  auto comparison(std::string_view op, std::size_t depth) -> std::string
+  {
+    return use('n', depth - 2) + ' ' + std::string{op} + ' ' +
+           use('n', depth - 1);
+  }
+
+  // Generates one instruction, returns the reason it can not be generated if
+  // it is not supported
+  auto instruction(opcode op, const std::byte* operand, std::size_t next,
+                   TypeStack& stack) -> std::optional<std::string>
+  {
+    const auto depth = stack.size();
+    const auto jump_target = [&]() -> std::size_t {
+      return next + read_jump_offset(op, operand);
+    };
+
+    switch (op) {
+    case op_return:
+      return "Return is not supported";
+    case op_push_f64:
+    case op_push_f64_wide: {
+      const std::size_t index = op == op_push_f64
+                                    ? std::to_integer<std::size_t>(*operand)
+                                    : read_u32(operand);
+      const auto constant = code_.constants[index];
+      if (constant.is_number()) {
+        push_number(stack, constant.unsafe_as_number());
+      } else if (constant.is_boolean()) {
+        push_boolean(stack, constant.unsafe_as_boolean());
+      } else if (constant.is_unit()) {
+        stack.push_back(StackType::unit);
+      } else {
+        return "Objects of the garbage collector can not be compiled ahead of "
+               "time";
+      }
+    } break;
+    case op_push_f64_imm:
+      push_number(stack, read_f64(operand));
+      break;
+    case op_push_f64_small:
+      push_number(stack,
+                  static_cast<double>(std::to_integer<std::int8_t>(*operand)));
+      break;
+    case op_push_f64_zero:
+      push_number(stack, 0.);
+      break;
+    case op_push_f64_one:
+      push_number(stack, 1.);
+      break;
+    case op_push_f64_minus_one:
+      push_number(stack, -1.);
+      break;
+    case op_push_negate_f64:
+      push_number(stack, -read_f64(operand));
+      break;
+    case op_pop:
+      stack.pop_back();
+      break;
+    case op_true:
+      push_boolean(stack, true);
+      break;
+    case op_false:
+      push_boolean(stack, false);
+      break;
+    case op_unit:
+      stack.push_back(StackType::unit);
+      break;
+    case op_negate_f64: {
+      const auto name = use('n', depth - 1);
+      body_ << "  " << name << " = -" << name << ";\n";
+    } break;
+    case op_not: {
+      const auto name = use('b', depth - 1);
+      body_ << "  " << name << " = !" << name << ";\n";
+    } break;
+    case op_add_f64:
+      arithmetic(depth - 2, "+", use('n', depth - 1));
+      stack.pop_back();
+      break;
+    case op_subtract_f64:
+      arithmetic(depth - 2, "-", use('n', depth - 1));
+      stack.pop_back();
+      break;
+    case op_multiply_f64:
+      arithmetic(depth - 2, "*", use('n', depth - 1));
+      stack.pop_back();
+      break;
+    case op_divide_f64:
+      arithmetic(depth - 2, "/", use('n', depth - 1));
+      stack.pop_back();
+      break;
+    case op_push_add_f64:
+      arithmetic(depth - 1, "+", number_literal(read_f64(operand)));
+      break;
+    case op_push_subtract_f64:
+      arithmetic(depth - 1, "-", number_literal(read_f64(operand)));
+      break;
+    case op_push_multiply_f64:
+      arithmetic(depth - 1, "*", number_literal(read_f64(operand)));
+      break;
+    case op_push_divide_f64:
+      arithmetic(depth - 1, "/", number_literal(read_f64(operand)));
+      break;
+    case op_equal:
+    case op_not_equal:
+    case op_equal_f64:
+    case op_not_equal_f64:
+    case op_equal_bool:
+    case op_not_equal_bool:
+    case op_equal_string:
+    case op_not_equal_string: {
+      const auto type = stack.back();
+      const auto result = use('b', depth - 2);
+      const bool equal = op == op_equal || op == op_equal_f64 ||
+                         op == op_equal_bool || op == op_equal_string;
+      const std::string_view equality = equal ? "==" : "!=";
+      body_ << "  " << result << " = ";
+      if (type == StackType::number) {
+        body_ << comparison(equality, depth);
+      } else if (type == StackType::boolean) {
+        body_ << result << ' ' << equality << ' ' << use('b', depth - 1);
+      } else if (type == StackType::unit) {
+        body_ << (equal ? "true" : "false");
+      } else {
+        return "Objects of the garbage collector can not be compiled ahead of "
+               "time";
+      }
+      body_ << ";\n";
+      stack.pop_back();
+      stack.back() = StackType::boolean;
+    } break;
+    case op_less_f64:
+    case op_less_equal_f64:
+    case op_greater_f64:
+    case op_greater_equal_f64:
+      body_ << "  " << use('b', depth - 2) << " = "
+            << comparison(comparison_operator(op), depth) << ";\n";
+      stack.pop_back();
+      stack.back() = StackType::boolean;
+      break;
+    case op_jmp:
+    case op_jmp_wide:
+      jump("", jump_target(), stack);
+      break;
+    case op_jmp_false:
+    case op_jmp_false_wide: {
+      const auto condition = "!" + use('b', depth - 1);
+      stack.pop_back();
+      jump(condition, jump_target(), stack);
+    } break;
+    case op_jmp_false_push_f64:
+    case op_jmp_false_push_f64_wide: {
+      const auto condition = "!" + use('b', depth - 1);
+      stack.pop_back();
+      jump(condition, jump_target(), stack);
+      push_number(stack, read_f64(operand + jump_offset_size(
+                                                operand_kind_of(op))));
+    } break;
+    case op_push2_f64:
+      push_number(stack, read_f64(operand));
+      push_number(stack, read_f64(operand + sizeof(double)));
+      break;
+    case op_less_f64_jmp_false:
+    case op_less_equal_f64_jmp_false:
+    case op_greater_f64_jmp_false:
+    case op_greater_equal_f64_jmp_false:
+    case op_less_f64_jmp_false_wide:
+    case op_less_equal_f64_jmp_false_wide:
+    case op_greater_f64_jmp_false_wide:
+    case op_greater_equal_f64_jmp_false_wide: {
+      const auto condition =
+          "!(" + comparison(comparison_operator(op), depth) + ")";
+      stack.resize(depth - 2);
+      jump(condition, jump_target(), stack);
+    } break;
+    }
+    return {};
+  }
+
+  static auto comparison_operator(opcode op) -> std::string_view
+  {
+    switch (narrow_form(op)) {
+    case op_less_f64:
+    case op_less_f64_jmp_false:
+      return "<";
+    case op_less_equal_f64:
+    case op_less_equal_f64_jmp_false:
+      return "<=";
+    case op_greater_f64:
+    case op_greater_f64_jmp_false:
+      return ">";
+    case op_greater_equal_f64:
+    case op_greater_equal_f64_jmp_false:
+      return ">=";
+    default:
+      EML_UNREACHABLE();
+    }
+  }
+
+  const AotScript& script_;
+  const Bytecode& code_;
+  std::string function_name_;
+  std::stringstream body_;
+  std::set<std::string> variables_;
+
+  // The stack that jumps carry to their targets
+  std::vector<std::optional<TypeStack>> stack_at_;
+  std::vector<bool> is_target_;
+};
+
+constexpr std::string_view prelude = R"(// Generated by the ahead-of-time compiler of Embedded ML, do not edit.
+//
+// Compile without -ffast-math and with -ffp-contract=off, the scripts then
+// produce the same results as the Embedded ML VM bit for bit.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+enum eml_aot_type : std::uint32_t {
+  eml_aot_none = 0,
+  eml_aot_unit = 1,
+  eml_aot_number = 2,
+  eml_aot_boolean = 3,
+};
+
+struct eml_aot_value {
+  std::uint32_t type;
+  std::uint64_t bits;
+};
+
+struct eml_aot_entry {
+  const char* name;
+  eml_aot_value (*function)();
+};
+
+namespace {
+
+[[maybe_unused]] auto eml_bits(double number) -> std::uint64_t
+{
+  std::uint64_t bits;
+  std::memcpy(&bits, &number, sizeof(bits));
+  return bits;
+}
+
+[[maybe_unused]] auto eml_number(std::uint64_t bits) -> double
+{
+  double number;
+  std::memcpy(&number, &bits, sizeof(number));
+  return number;
+}
+
+)";
+
+} // anonymous namespace
+
+auto compile_to_cpp(const std::vector<AotScript>& scripts,
+                    std::string_view table_name)
+    -> expected<std::string, AotError>
+{
+  std::stringstream ss;
+  ss << prelude;
+
+  for (std::size_t i = 0; i < scripts.size(); ++i) {
+    FunctionGenerator generator{scripts[i], "script_" + std::to_string(i)};
+    auto function = generator.generate();
+    if (!function) {
+      return unexpected{std::move(function.error())};
+    }
+    ss << *function << '\n';
+  }
+  ss << "} // anonymous namespace\n\n";
+
+  ss << "extern \"C\" const eml_aot_entry " << table_name << "[] = {\n";
+  for (std::size_t i = 0; i < scripts.size(); ++i) {
+    ss << "    {" << string_literal(scripts[i].name) << ", &script_" << i
+       << "},\n";
+  }
+  if (scripts.empty()) {
+    ss << "    {nullptr, nullptr},\n";
+  }
+  ss << "};\n\n";
+  ss << "extern \"C\" const std::size_t " << table_name
+     << "_size = " << scripts.size() << ";\n";
+  return ss.str();
+}
+
+auto value_of(AotValue value) -> std::optional<Value>
+{
+  switch (value.type) {
+  case aot_unit:
+    return Value{};
+  case aot_number:
+    return Value{bit_cast<double>(value.bits)};
+  case aot_boolean:
+    return Value{value.bits != 0};
+  default:
+    return {};
+  }
+}
+
+} // namespace eml
@@ -0,0 +1,97 @@
+#ifndef EML_AOT_HPP
+#define EML_AOT_HPP
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "expected.hpp"
+#include "verifier.hpp"
+
+/**
+ * @file aot.hpp
+ * @brief The ahead-of-time compiler from verified bytecode to C++ source
+ */
+
+namespace eml {
+
+/**
+ * @brief A script to compile ahead of time
+ */
+struct AotScript {
+  std::string name;
+  VerifiedBytecode code;
+};
+
+/**
+ * @brief The reason a script can not be compiled ahead of time
+ */
+struct AotError {
+  std::string script; ///< @brief Name of the script
+  std::string msg;
+
+  AotError(std::string script_in, std::string msg_in)
+      : script{std::move(script_in)}, msg{std::move(msg_in)}
+  {
+  }
+};
+
+/// @brief Type tags of @ref AotValue
+enum aot_type : std::uint32_t {
+  aot_none = 0, ///< @brief The script does not produce a value
+  aot_unit = 1,
+  aot_number = 2,
+  aot_boolean = 3,
+};
+
+/**
+ * @brief The result of a compiled script
+ *
+ * Has the same layout as the `eml_aot_value` struct of the generated code.
+ * Numbers are stored as their bits, booleans as 0 or 1.
+ */
+struct AotValue {
+  std::uint32_t type;
+  std::uint64_t bits;
+};
+
+/**
+ * @brief An entry of the registration table of the generated code
+ *
+ * Has the same layout as the `eml_aot_entry` struct of the generated code.
+ */
+struct AotEntry {
+  const char* name;
+  AotValue (*function)();
+};
+
+/**
+ * @brief Compiles scripts to a standalone C++ translation unit
+ *
+ * Every script becomes a function whose stack slots are local variables and
+ * whose jumps are gotos. The translation unit only depends on the standard
+ * library, and exports a registration table of @ref AotEntry named
+ * table_name, with its number of entries in `<table_name>_size`, both with C
+ * linkage.
+ *
+ * Compile the generated code without `-ffast-math` and with
+ * `-ffp-contract=off`, its results then match the @ref VM bit for bit.
+ *
+ * @return The source code, or the first script that can not be compiled
+ * ahead of time, since the generated code can not hold references to objects
+ * of the garbage collector
+ */
+[[nodiscard]] auto compile_to_cpp(const std::vector<AotScript>& scripts,
+                                  std::string_view table_name = "eml_scripts")
+    -> expected<std::string, AotError>;
+
+/**
+ * @brief Converts the result of a compiled script to a value
+ */
+[[nodiscard]] auto value_of(AotValue value) -> std::optional<Value>;
+
+} // namespace eml
+
+#endif // EML_AOT_HPP
@@ -176,6 +176,23 @@ struct AstNode {
   virtual void accept(AstConstVisitor& visitor) const = 0;
   virtual void accept(AstVisitor& visitor) = 0;
 
+  /**
+   * @brief Gets the position in the source of the token that the node comes
+   * from, the operator of an operation
+   */
+  auto position() const noexcept -> FilePos
+  {
+    return position_;
+  }
+
+  /**
+   * @brief Sets the position of the AST node in the source
+   */
+  void set_position(FilePos position) noexcept
+  {
+    position_ = position;
+  }
+
   /**
    * @brief Gets the type of the AST node
    * @warning If the expression does not have a type, the result is undefined
@@ -204,6 +221,7 @@ struct AstNode {
 
 private:
   std::optional<Type> type_ = std::nullopt;
+  FilePos position_;
 };
 
 namespace detail {
@@ -248,6 +266,12 @@ public:
     return *binding_.to;
   }
 
+  /// @brief Gets the owning pointer of the bound expression, to replace it
+  auto to_ptr() noexcept -> std::unique_ptr<Expr>&
+  {
+    return binding_.to;
+  }
+
   void accept(AstVisitor& visitor) override
   {
     visitor(*this);
@@ -414,6 +438,24 @@ public:
     return *else_;
   }
 
+  /// @brief Gets the owning pointer of the condition, to replace it
+  auto cond_ptr() noexcept -> Expr_ptr&
+  {
+    return cond_;
+  }
+
+  /// @brief Gets the owning pointer of the if branch, to replace it
+  auto If_ptr() noexcept -> Expr_ptr&
+  {
+    return if_;
+  }
+
+  /// @brief Gets the owning pointer of the else branch, to replace it
+  auto Else_ptr() noexcept -> Expr_ptr&
+  {
+    return else_;
+  }
+
   void accept(AstVisitor& visitor) override
   {
     visitor(*this);
@@ -485,6 +527,12 @@ public:
   {
     return *operand_;
   }
+
+  /// @brief Gets the owning pointer of the operand, to replace it
+  auto operand_ptr() noexcept -> Expr_ptr&
+  {
+    return operand_;
+  }
 };
 
 /**
@@ -536,6 +584,18 @@ public:
   {
     return *rhs_;
   }
+
+  /// @brief Gets the owning pointer of the left operand, to replace it
+  auto lhs_ptr() noexcept -> Expr_ptr&
+  {
+    return lhs_;
+  }
+
+  /// @brief Gets the owning pointer of the right operand, to replace it
+  auto rhs_ptr() noexcept -> Expr_ptr&
+  {
+    return rhs_;
+  }
 };
 
 /**
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <sstream>
 #include <string_view>
 
@@ -5,29 +6,80 @@
 
 namespace eml {
 
-std::string Bytecode::disassemble() const
+auto Bytecode::compute_max_stack_depth() const -> std::optional<std::size_t>
 {
-  size_t offset = 0;
+  // Depth of the stack before every byte offset that some path reaches. Jumps
+  // only go forward, so a single pass in the order of the offsets sees every
+  // path into an instruction before the instruction itself.
+  std::vector<std::optional<std::size_t>> depth_at(instructions.size() + 1);
+  std::vector<bool> is_boundary(instructions.size() + 1, false);
+  depth_at[0] = 0;
 
-  std::string result;
+  const auto join = [&depth_at](std::size_t offset, std::size_t depth) {
+    depth_at[offset] = std::max(depth_at[offset].value_or(0), depth);
+  };
 
-  for (auto ip = instructions.begin(); ip != instructions.end(); ++ip) {
-    result += disassemble_instruction(ip, offset);
-    const auto instruction = *ip;
-    switch (static_cast<opcode>(instruction)) {
-    case op_push_f64: {
-      ++ip;
-    } break;
-    case op_jmp: {
-      ++ip;
-    } break;
-    case op_jmp_false: {
-      ++ip;
-    } break;
-    default:; // Nothing special
+  std::size_t max_depth = 0;
+  std::size_t offset = 0;
+  while (offset < instructions.size()) {
+    is_boundary[offset] = true;
+
+    if (std::to_integer<std::size_t>(instructions[offset]) >= opcode_count) {
+      return {};
+    }
+    const auto op = static_cast<opcode>(instructions[offset]);
+    const auto next = offset + instruction_size(op);
+    if (next > instructions.size()) {
+      return {};
+    }
+
+    const auto* operand = &instructions[offset] + 1;
+    const auto depth = depth_at[offset];
+    offset = next;
+    if (!depth) { // Unreachable
+      continue;
+    }
+
+    const auto [pops, pushes] = stack_effect_of(op);
+    if (pops > *depth) {
+      return {};
     }
+    const auto depth_after = *depth - pops + pushes;
+    max_depth = std::max(max_depth, depth_after);
 
-    ++offset;
+    if (is_jump_operand(operand_kind_of(op))) {
+      const auto distance = read_jump_offset(op, operand);
+      if (distance > instructions.size() - next) {
+        return {};
+      }
+      // The jump leaves before the pushes
+      join(next + distance, depth_after - pushes);
+    }
+
+    if (op != op_jmp && op != op_jmp_wide) {
+      join(next, depth_after);
+    }
+  }
+  is_boundary[instructions.size()] = true;
+
+  for (std::size_t i = 0; i < depth_at.size(); ++i) {
+    if (depth_at[i] && !is_boundary[i]) {
+      return {};
+    }
+  }
+
+  return max_depth;
+}
+
+std::string Bytecode::disassemble() const
+{
+  std::string result;
+
+  for (auto ip = instructions.begin(); ip != instructions.end();
+       ip += static_cast<std::ptrdiff_t>(
+           instruction_size(static_cast<opcode>(*ip)))) {
+    const auto offset = static_cast<std::size_t>(ip - instructions.begin());
+    result += disassemble_instruction(ip, offset);
   }
 
   return result;
@@ -41,6 +93,7 @@ auto Bytecode::disassemble_instruction(instruction_iterator ip,
   auto print_hex_dump = [&ss](auto current_ip, std::size_t count) {
     // Over max bytes of hex will cause misalignment in output
     constexpr std::size_t max_byte = 5;
+    count = std::min(count, max_byte);
     for (auto i = std::size_t{0}; i < count; ++i) {
       const auto code = std::to_integer<unsigned>(*current_ip);
       ss << std::hex << std::setfill('0') << std::setw(2) << code << ' ';
@@ -62,17 +115,80 @@ auto Bytecode::disassemble_instruction(instruction_iterator ip,
   auto disassemble_instruction_with_one_const_float_parem =
       [&](auto& current_ip, std::string_view name) {
         print_hex_dump(current_ip, 2);
-        const auto v = read_constant(++current_ip);
+        const auto v = read_constant(*++current_ip);
         ss << name << ' ' << static_cast<std::uint32_t>(*current_ip) << " //"
            << to_string(eml::NumberType{}, v, PrintType::no) << '\n';
       };
 
+  // Print instruction with one inline float argument
+  auto disassemble_instruction_with_one_imm_float_parem =
+      [&](auto& current_ip, std::string_view name) {
+        print_hex_dump(current_ip, instruction_size(op_push_f64_imm));
+        const auto v = read_f64(&*++current_ip);
+        ss << name << ' '
+           << to_string(eml::NumberType{}, Value{v}, PrintType::no) << '\n';
+      };
+
+  // Print instruction with one small integer argument
+  auto disassemble_instruction_with_one_small_int_parem =
+      [&](auto& current_ip, std::string_view name) {
+        print_hex_dump(current_ip, 2);
+        ss << name << ' '
+           << static_cast<int>(std::to_integer<std::int8_t>(*++current_ip))
+           << '\n';
+      };
+
+  // Print instruction with one wide constant argument
+  auto disassemble_instruction_with_one_wide_const_parem =
+      [&](auto& current_ip, std::string_view name) {
+        print_hex_dump(current_ip, instruction_size(op_push_f64_wide));
+        const auto index = read_u32(&*++current_ip);
+        const auto v = read_constant(index);
+        ss << name << ' ' << index << " //"
+           << to_string(eml::NumberType{}, v, PrintType::no) << '\n';
+      };
+
   // Print instruction with one constant argument
   auto disassemble_jmp = [&](auto& current_ip, std::string_view name) {
     print_hex_dump(current_ip, 2);
     ss << name << ' ' << static_cast<int>(*++current_ip) << '\n';
   };
 
+  // Print instruction with one wide jump argument
+  auto disassemble_wide_jmp = [&](auto& current_ip, std::string_view name) {
+    print_hex_dump(current_ip, instruction_size(op_jmp_wide));
+    ss << name << ' ' << read_u32(&*++current_ip) << '\n';
+  };
+
+  // Print instruction with two inline float arguments
+  auto disassemble_instruction_with_two_imm_float_parem =
+      [&](auto& current_ip, std::string_view name) {
+        print_hex_dump(current_ip, instruction_size(op_push2_f64));
+        const auto* operand = &*++current_ip;
+        ss << name << ' '
+           << to_string(eml::NumberType{}, Value{read_f64(operand)},
+                        PrintType::no)
+           << ", "
+           << to_string(eml::NumberType{},
+                        Value{read_f64(operand + sizeof(double))},
+                        PrintType::no)
+           << '\n';
+      };
+
+  // Print jump instruction with an inline float argument after its offset
+  auto disassemble_jmp_imm_float = [&](auto& current_ip,
+                                       std::string_view name) {
+    const auto op = static_cast<opcode>(*current_ip);
+    print_hex_dump(current_ip, instruction_size(op));
+    const auto* operand = &*++current_ip;
+    ss << name << ' ' << read_jump_offset(op, operand) << ", "
+       << to_string(eml::NumberType{},
+                    Value{read_f64(operand +
+                                   jump_offset_size(operand_kind_of(op)))},
+                    PrintType::no)
+       << '\n';
+  };
+
   // Dump file in source line
   constexpr std::size_t linum_digits = 4;
   if (offset != 0 && lines[offset].value == lines[offset - 1].value) {
@@ -89,6 +205,24 @@ auto Bytecode::disassemble_instruction(instruction_iterator ip,
   case op_push_f64: {
     disassemble_instruction_with_one_const_float_parem(ip, "push");
   } break;
+  case op_push_f64_wide:
+    disassemble_instruction_with_one_wide_const_parem(ip, "push_wide");
+    break;
+  case op_push_f64_imm:
+    disassemble_instruction_with_one_imm_float_parem(ip, "push_imm");
+    break;
+  case op_push_f64_small:
+    disassemble_instruction_with_one_small_int_parem(ip, "push_small");
+    break;
+  case op_push_f64_zero:
+    disassemble_simple_instruction(ip, "push<0> // push 0");
+    break;
+  case op_push_f64_one:
+    disassemble_simple_instruction(ip, "push<1> // push 1");
+    break;
+  case op_push_f64_minus_one:
+    disassemble_simple_instruction(ip, "push<-1> // push -1");
+    break;
   case op_pop:
     disassemble_simple_instruction(ip, "pop");
     break;
@@ -125,6 +259,24 @@ auto Bytecode::disassemble_instruction(instruction_iterator ip,
   case op_not_equal:
     disassemble_simple_instruction(ip, "ne // not equal to");
     break;
+  case op_equal_f64:
+    disassemble_simple_instruction(ip, "eq<f64> // equal to");
+    break;
+  case op_not_equal_f64:
+    disassemble_simple_instruction(ip, "ne<f64> // not equal to");
+    break;
+  case op_equal_bool:
+    disassemble_simple_instruction(ip, "eq<bool> // equal to");
+    break;
+  case op_not_equal_bool:
+    disassemble_simple_instruction(ip, "ne<bool> // not equal to");
+    break;
+  case op_equal_string:
+    disassemble_simple_instruction(ip, "eq<string> // equal to");
+    break;
+  case op_not_equal_string:
+    disassemble_simple_instruction(ip, "ne<string> // not equal to");
+    break;
   case op_less_f64:
     disassemble_simple_instruction(ip, "lt<f64> // less than");
     break;
@@ -143,6 +295,60 @@ auto Bytecode::disassemble_instruction(instruction_iterator ip,
   case op_jmp_false:
     disassemble_jmp(ip, "jump_false");
     break;
+  case op_jmp_wide:
+    disassemble_wide_jmp(ip, "jump_wide");
+    break;
+  case op_jmp_false_wide:
+    disassemble_wide_jmp(ip, "jump_false_wide");
+    break;
+  case op_push_add_f64:
+    disassemble_instruction_with_one_imm_float_parem(ip, "push_add<f64>");
+    break;
+  case op_push_subtract_f64:
+    disassemble_instruction_with_one_imm_float_parem(ip, "push_sub<f64>");
+    break;
+  case op_push_multiply_f64:
+    disassemble_instruction_with_one_imm_float_parem(ip, "push_mult<f64>");
+    break;
+  case op_push_divide_f64:
+    disassemble_instruction_with_one_imm_float_parem(ip, "push_div<f64>");
+    break;
+  case op_push_negate_f64:
+    disassemble_instruction_with_one_imm_float_parem(ip, "push_negate<f64>");
+    break;
+  case op_less_f64_jmp_false:
+    disassemble_jmp(ip, "lt_jump_false<f64>");
+    break;
+  case op_less_equal_f64_jmp_false:
+    disassemble_jmp(ip, "le_jump_false<f64>");
+    break;
+  case op_greater_f64_jmp_false:
+    disassemble_jmp(ip, "gt_jump_false<f64>");
+    break;
+  case op_greater_equal_f64_jmp_false:
+    disassemble_jmp(ip, "ge_jump_false<f64>");
+    break;
+  case op_less_f64_jmp_false_wide:
+    disassemble_wide_jmp(ip, "lt_jump_false_wide<f64>");
+    break;
+  case op_less_equal_f64_jmp_false_wide:
+    disassemble_wide_jmp(ip, "le_jump_false_wide<f64>");
+    break;
+  case op_greater_f64_jmp_false_wide:
+    disassemble_wide_jmp(ip, "gt_jump_false_wide<f64>");
+    break;
+  case op_greater_equal_f64_jmp_false_wide:
+    disassemble_wide_jmp(ip, "ge_jump_false_wide<f64>");
+    break;
+  case op_push2_f64:
+    disassemble_instruction_with_two_imm_float_parem(ip, "push2<f64>");
+    break;
+  case op_jmp_false_push_f64:
+    disassemble_jmp_imm_float(ip, "jump_false_push<f64>");
+    break;
+  case op_jmp_false_push_f64_wide:
+    disassemble_jmp_imm_float(ip, "jump_false_push_wide<f64>");
+    break;
   }
 
   return ss.str();
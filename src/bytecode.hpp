@@ -1,7 +1,15 @@
 #ifndef EML_BYTECODE_HPP
 #define EML_BYTECODE_HPP
 
+#include <algorithm>
+#include <cmath>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <optional>
+#include <string_view>
 #include <type_traits>
 #include <vector>
 
@@ -15,49 +23,329 @@ namespace eml {
 
 /**
  * @brief The instruction set of the Embedded ML vm
+ *
+ * The opcodes are listed in opcode_table.inc
  */
 enum opcode : std::underlying_type_t<std::byte> {
-  op_return,
-  op_push_f64, /*Pushes a float_64 constant with index [arg] to the stack*/
-  op_pop,      /*Pops and discards the top value of the stack*/
-
-  op_true,  /*Pushes true to the stack*/
-  op_false, /*Pushes false to the stack*/
-  op_unit,  /*Pushes unit to the stack*/
-
-  /*Unary Arithmatics*/
-  op_negate_f64,
-  op_not,
-
-  /*Binary Arithmatics*/
-  op_add_f64,
-  op_subtract_f64,
-  op_multiply_f64,
-  op_divide_f64,
-
-  /*Comparisons*/
-  op_equal,
-  op_not_equal,
-  op_less_f64,
-  op_less_equal_f64,
-  op_greater_f64,
-  op_greater_equal_f64,
-
-  /* Jumps */
-  op_jmp,       // Unconditionally jump instruction pointer [arg] forward
-  op_jmp_false, // Pop and if false then jump the instruction pointer [arg]
-                // forward.
+#define OPCODE_TABLE_ENTRY(op, kind, pops, pushes) op,
+#include "opcode_table.inc"
+#undef OPCODE_TABLE_ENTRY
+};
+
+/// @brief The number of opcodes in the instruction set
+constexpr std::size_t opcode_count = 0
+#define OPCODE_TABLE_ENTRY(op, kind, pops, pushes) +1
+#include "opcode_table.inc"
+#undef OPCODE_TABLE_ENTRY
+    ;
+
+/**
+ * @brief The kind of the operand that follows an opcode in the instructions
+ */
+enum class operand_kind {
+  none,          ///< @brief The instruction does not have an operand
+  constant,      ///< @brief A one byte index into the constant pool
+  constant_wide, ///< @brief A four bytes index into the constant pool
+  jump,          ///< @brief A one byte forward jump offset
+  jump_wide,     ///< @brief A four bytes forward jump offset
+  f64,           ///< @brief An eight byte inline float_64
+  small_int,     ///< @brief A one byte signed integer
+  f64_pair,      ///< @brief Two eight byte inline float_64
+  jump_f64,      ///< @brief A one byte jump offset and an inline float_64
+  jump_wide_f64, ///< @brief A four bytes jump offset and an inline float_64
+};
+
+/**
+ * @brief Returns the kind of the operand of an opcode
+ */
+constexpr auto operand_kind_of(opcode op) noexcept -> operand_kind
+{
+  switch (op) {
+#define OPCODE_TABLE_ENTRY(code, kind, pops, pushes)                           \
+  case code:                                                                   \
+    return operand_kind::kind;
+#include "opcode_table.inc"
+#undef OPCODE_TABLE_ENTRY
+  }
+  return operand_kind::none; // Unreachable
+}
 
+/**
+ * @brief The effect of an instruction on the stack
+ */
+struct StackEffect {
+  std::size_t pops;   ///< @brief Number of values the instruction pops
+  std::size_t pushes; ///< @brief Number of values it pushes after popping
 };
 
+/**
+ * @brief Returns the effect of an opcode on the stack
+ */
+constexpr auto stack_effect_of(opcode op) noexcept -> StackEffect
+{
+  switch (op) {
+#define OPCODE_TABLE_ENTRY(code, kind, pops, pushes)                           \
+  case code:                                                                   \
+    return StackEffect{pops, pushes};
+#include "opcode_table.inc"
+#undef OPCODE_TABLE_ENTRY
+  }
+  return StackEffect{0, 0}; // Unreachable
+}
+
+/**
+ * @brief Returns the size in bytes of an operand
+ */
+constexpr auto operand_size(operand_kind kind) noexcept -> std::size_t
+{
+  switch (kind) {
+  case operand_kind::none:
+    return 0;
+  case operand_kind::constant:
+  case operand_kind::jump:
+  case operand_kind::small_int:
+    return 1;
+  case operand_kind::constant_wide:
+  case operand_kind::jump_wide:
+    return sizeof(std::uint32_t);
+  case operand_kind::f64:
+    return sizeof(double);
+  case operand_kind::f64_pair:
+    return 2 * sizeof(double);
+  case operand_kind::jump_f64:
+    return 1 + sizeof(double);
+  case operand_kind::jump_wide_f64:
+    return sizeof(std::uint32_t) + sizeof(double);
+  }
+  return 0; // Unreachable
+}
+
+/**
+ * @brief Returns whether an operand starts with a forward jump offset
+ */
+constexpr auto is_jump_operand(operand_kind kind) noexcept -> bool
+{
+  return kind == operand_kind::jump || kind == operand_kind::jump_wide ||
+         kind == operand_kind::jump_f64 || kind == operand_kind::jump_wide_f64;
+}
+
+/**
+ * @brief Returns the size in bytes of the jump offset of an operand
+ */
+constexpr auto jump_offset_size(operand_kind kind) noexcept -> std::size_t
+{
+  return kind == operand_kind::jump || kind == operand_kind::jump_f64
+             ? 1
+             : sizeof(std::uint32_t);
+}
+
+/**
+ * @brief Returns the variant of an opcode with a four bytes operand, or the
+ * opcode itself if it does not have one
+ */
+constexpr auto wide_form(opcode op) noexcept -> opcode
+{
+  switch (op) {
+  case op_push_f64:
+    return op_push_f64_wide;
+  case op_jmp:
+    return op_jmp_wide;
+  case op_jmp_false:
+    return op_jmp_false_wide;
+  case op_less_f64_jmp_false:
+    return op_less_f64_jmp_false_wide;
+  case op_less_equal_f64_jmp_false:
+    return op_less_equal_f64_jmp_false_wide;
+  case op_greater_f64_jmp_false:
+    return op_greater_f64_jmp_false_wide;
+  case op_greater_equal_f64_jmp_false:
+    return op_greater_equal_f64_jmp_false_wide;
+  case op_jmp_false_push_f64:
+    return op_jmp_false_push_f64_wide;
+  default:
+    return op;
+  }
+}
+
+/**
+ * @brief Returns the variant of an opcode with a one byte operand, the inverse
+ * of @ref wide_form
+ */
+constexpr auto narrow_form(opcode op) noexcept -> opcode
+{
+  switch (op) {
+  case op_push_f64_wide:
+    return op_push_f64;
+  case op_jmp_wide:
+    return op_jmp;
+  case op_jmp_false_wide:
+    return op_jmp_false;
+  case op_less_f64_jmp_false_wide:
+    return op_less_f64_jmp_false;
+  case op_less_equal_f64_jmp_false_wide:
+    return op_less_equal_f64_jmp_false;
+  case op_greater_f64_jmp_false_wide:
+    return op_greater_f64_jmp_false;
+  case op_greater_equal_f64_jmp_false_wide:
+    return op_greater_equal_f64_jmp_false;
+  case op_jmp_false_push_f64_wide:
+    return op_jmp_false_push_f64;
+  default:
+    return op;
+  }
+}
+
+/// @brief The largest operand that fits in the narrow form of an instruction
+constexpr std::uint32_t max_narrow_operand = 0xff;
+
+/**
+ * @brief Returns the size in bytes of an instruction, including its operands
+ */
+constexpr auto instruction_size(opcode op) noexcept -> std::size_t
+{
+  return 1 + operand_size(operand_kind_of(op));
+}
+
+/**
+ * @brief Returns the name of an opcode
+ */
+constexpr auto opcode_name(opcode op) noexcept -> std::string_view
+{
+  switch (op) {
+#define OPCODE_TABLE_ENTRY(code, kind, pops, pushes)                           \
+  case code:                                                                   \
+    return #code;
+#include "opcode_table.inc"
+#undef OPCODE_TABLE_ENTRY
+  }
+  return "unknown"; // Unreachable
+}
+
 /// @brief The underlying numerical type of the @ref opcode enum
 using opcode_num_type = std::underlying_type_t<opcode>;
 
+/**
+ * @brief Reads a four bytes operand stored inline in the instructions
+ *
+ * The bytes are in host order and do not need to be aligned.
+ */
+inline auto read_u32(const std::byte* bytes) noexcept -> std::uint32_t
+{
+  std::uint32_t value;
+  std::memcpy(&value, bytes, sizeof(std::uint32_t));
+  return value;
+}
+
+/**
+ * @brief Reads a float_64 stored inline in the instructions
+ *
+ * The bytes are in host order and do not need to be aligned.
+ */
+inline auto read_f64(const std::byte* bytes) noexcept -> double
+{
+  double value;
+  std::memcpy(&value, bytes, sizeof(double));
+  return value;
+}
+
+/**
+ * @brief Reads the offset of a jump, from the start of the operand of op
+ */
+inline auto read_jump_offset(opcode op, const std::byte* operand) noexcept
+    -> std::size_t
+{
+  return jump_offset_size(operand_kind_of(op)) == 1
+             ? std::to_integer<std::size_t>(*operand)
+             : read_u32(operand);
+}
+
 /// @brief Line number
 struct line_num {
   std::size_t value;
 };
 
+/**
+ * @brief The source line of every byte of a chunk
+ *
+ * Consecutive bytes from the same line share one run, so the table grows with
+ * the number of line changes instead of with the size of the code. Looking up
+ * the line of a byte is a binary search over the runs.
+ */
+class LineTable {
+public:
+  /// @brief The bytes from begin to the begin of the next run come from line
+  struct Run {
+    std::uint32_t begin;
+    std::uint32_t line;
+  };
+
+  /**
+   * @brief Appends the line of the next byte of the chunk
+   */
+  void push_back(line_num line)
+  {
+    EML_ASSERT(size_ < std::numeric_limits<std::uint32_t>::max() &&
+                   line.value <= std::numeric_limits<std::uint32_t>::max(),
+               "Offsets and lines must fit in four bytes");
+    if (runs_.empty() || runs_.back().line != line.value) {
+      runs_.push_back(Run{static_cast<std::uint32_t>(size_),
+                          static_cast<std::uint32_t>(line.value)});
+    }
+    ++size_;
+  }
+
+  /**
+   * @brief Returns the line of the byte at offset
+   */
+  [[nodiscard]] auto operator[](std::size_t offset) const -> line_num
+  {
+    EML_ASSERT(offset < size_, "The offset must be in the chunk");
+    return find(runs_.data(), runs_.data() + runs_.size(), offset);
+  }
+
+  /**
+   * @brief Returns the line of the byte at offset in the runs from first to
+   * last, the first run must begin at offset 0
+   */
+  [[nodiscard]] static auto find(const Run* first, const Run* last,
+                                 std::size_t offset) -> line_num
+  {
+    const auto next =
+        std::upper_bound(first, last, offset, [](std::size_t lhs, Run rhs) {
+          return lhs < rhs.begin;
+        });
+    return line_num{std::prev(next)->line};
+  }
+
+  /**
+   * @brief Returns the runs of bytes from the same line, in order
+   */
+  [[nodiscard]] auto runs() const noexcept -> const std::vector<Run>&
+  {
+    return runs_;
+  }
+
+  /**
+   * @brief Returns the number of bytes that have a line
+   */
+  [[nodiscard]] auto size() const noexcept -> std::size_t
+  {
+    return size_;
+  }
+
+  /**
+   * @brief Returns the number of runs of bytes from the same line
+   */
+  [[nodiscard]] auto run_count() const noexcept -> std::size_t
+  {
+    return runs_.size();
+  }
+
+private:
+  std::vector<Run> runs_;
+  std::size_t size_ = 0;
+};
+
 class VM;
 
 /**
@@ -66,7 +354,15 @@ class VM;
 struct Bytecode {
   std::vector<std::byte> instructions; // Instructions
   std::vector<Value> constants;
-  std::vector<line_num> lines; // Source line information
+  LineTable lines; // Source line information
+
+  /**
+   * @brief The maximum depth of the stack while running the chunk, if known
+   *
+   * Set by the compiler, and cleared by every write to the instructions. See
+   * @ref compute_max_stack_depth.
+   */
+  std::optional<std::size_t> max_stack_depth;
 
   /**
    * @brief Write an instruction to the instructions
@@ -76,6 +372,7 @@ struct Bytecode {
    */
   auto write(opcode code, line_num line) -> std::ptrdiff_t
   {
+    max_stack_depth.reset();
     instructions.push_back(static_cast<std::byte>(code));
     lines.push_back(line);
     return static_cast<std::ptrdiff_t>(instructions.size() - 1);
@@ -89,11 +386,97 @@ struct Bytecode {
    */
   auto write(std::byte code, line_num line) -> std::ptrdiff_t
   {
+    max_stack_depth.reset();
     instructions.push_back(code);
     lines.push_back(line);
     return static_cast<std::ptrdiff_t>(instructions.size() - 1);
   }
 
+  /**
+   * @brief Write a float_64 inline to the instructions
+   * @param value The number to write
+   * @param line The line this instruction in source
+   */
+  void write(double value, line_num line)
+  {
+    std::byte bytes[sizeof(double)];
+    std::memcpy(bytes, &value, sizeof(double));
+    for (const auto byte : bytes) {
+      write(byte, line);
+    }
+  }
+
+  /**
+   * @brief Write a four bytes operand to the instructions
+   * @param value The operand to write
+   * @param line The line this instruction in source
+   */
+  void write(std::uint32_t value, line_num line)
+  {
+    std::byte bytes[sizeof(std::uint32_t)];
+    std::memcpy(bytes, &value, sizeof(std::uint32_t));
+    for (const auto byte : bytes) {
+      write(byte, line);
+    }
+  }
+
+  /**
+   * @brief Write an instruction with a constant index operand
+   *
+   * Uses the @ref wide_form of the instruction if the index does not fit in
+   * one byte.
+   */
+  void write_with_constant(opcode op, std::uint32_t index, line_num line)
+  {
+    if (index <= max_narrow_operand) {
+      write(op, line);
+      write(static_cast<std::byte>(index), line);
+    } else {
+      write(wide_form(op), line);
+      write(index, line);
+    }
+  }
+
+  /**
+   * @brief Write a four bytes operand to the instructions at a certain index
+   * @param value The operand to write
+   * @param index The place to write the operand
+   */
+  void write_at(std::uint32_t value, std::ptrdiff_t index)
+  {
+    max_stack_depth.reset();
+    std::memcpy(&instructions[static_cast<std::size_t>(index)], &value,
+                sizeof(std::uint32_t));
+  }
+
+  /**
+   * @brief Write the shortest instruction that pushes a number
+   *
+   * 0, 1 and -1 have their own opcodes, other integers that fit in a signed
+   * byte use @ref op_push_f64_small, and the rest are stored inline with @ref
+   * op_push_f64_imm.
+   */
+  void write_number(double value, line_num line)
+  {
+    constexpr auto small_min = std::numeric_limits<std::int8_t>::min();
+    constexpr auto small_max = std::numeric_limits<std::int8_t>::max();
+
+    if (value == 0 && !std::signbit(value)) { // -0 is not 0
+      write(op_push_f64_zero, line);
+    } else if (value == 1) {
+      write(op_push_f64_one, line);
+    } else if (value == -1) {
+      write(op_push_f64_minus_one, line);
+    } else if (value >= small_min && value <= small_max &&
+               value == std::trunc(value) && value != 0) {
+      write(op_push_f64_small, line);
+      write(static_cast<std::byte>(static_cast<std::int8_t>(value)), line);
+    } else {
+      write(op_push_f64_imm, line);
+      write(value, line);
+    }
+  }
+
   /**
    * @brief Write a byte to the instructions at a certain index
    * @param code The byte to write
@@ -101,6 +484,7 @@ struct Bytecode {
    */
   void write_at(std::byte code, std::ptrdiff_t index)
   {
+    max_stack_depth.reset();
     instructions[static_cast<std::size_t>(index)] = code;
   }
 
@@ -118,23 +502,52 @@ struct Bytecode {
    * Adds a constant value v to the chunk. Returns the index where it was
    * appended so that we can locate that same constant later.
    */
-  [[nodiscard]] std::optional<opcode_num_type> add_constant(Value v)
+  [[nodiscard]] std::optional<std::uint32_t> add_constant(Value v)
   {
-    if (constants.size() >= std::numeric_limits<opcode_num_type>::max()) {
+    if (constants.size() >= std::numeric_limits<std::uint32_t>::max()) {
       return {};
     }
     constants.push_back(v);
-    return static_cast<opcode_num_type>(constants.size() - 1);
+    return static_cast<std::uint32_t>(constants.size() - 1);
   }
 
+  /**
+   * @brief Returns the number of instructions in the chunk
+   */
+  auto instruction_count() const noexcept -> std::size_t
+  {
+    std::size_t count = 0;
+    for (std::size_t i = 0; i < instructions.size();
+         i += instruction_size(static_cast<opcode>(instructions[i]))) {
+      ++count;
+    }
+    return count;
+  }
+
+  /**
+   * @brief Computes the maximum depth of the stack while running the chunk
+   *
+   * Follows both paths of every conditional jump. Where paths join, the deeper
+   * one counts.
+   *
+   * @return The maximum depth, or nullopt if the chunk is malformed: an
+   * instruction pops from an empty stack, an opcode or an operand is out of
+   * the instructions, or a jump does not land on an instruction
+   */
+  [[nodiscard]] auto compute_max_stack_depth() const
+      -> std::optional<std::size_t>;
+
   auto disassemble() const -> std::string;
 
 private:
   friend VM;
   using instruction_iterator = decltype(instructions)::const_iterator;
-  auto read_constant(const instruction_iterator& ip) const -> Value
+  auto read_constant(std::byte index) const -> Value
+  {
+    return constants.at(std::to_integer<std::size_t>(index));
+  }
+  auto read_constant(std::uint32_t index) const -> Value
   {
-    const auto index = static_cast<std::underlying_type_t<opcode>>(*ip);
     return constants.at(index);
   }
 
@@ -142,6 +555,16 @@ private:
                                std::size_t offset) const -> std::string;
 };
 
+/**
+ * @brief Marks the constants of a chunk as live
+ */
+inline void mark(GarbageCollector& gc, Bytecode& code) noexcept
+{
+  for (auto& constant : code.constants) {
+    mark(gc, constant);
+  }
+}
+
 } // namespace eml
 
 #endif // EML_BYTECODE_HPP
@@ -0,0 +1,446 @@
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <new>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "bytecode_file.hpp"
+#include "verifier.hpp"
+
+#ifdef EML_USE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace eml {
+
+namespace {
+
+constexpr std::array<char, 8> magic = {'E', 'M', 'L', 'C',
+                                       'O', 'D', 'E', '\0'};
+constexpr std::uint32_t endianness_mark = 0x01020304;
+constexpr std::uint32_t nan_boxing_flag = 1;
+constexpr auto unknown_depth = static_cast<std::uint64_t>(-1);
+
+// Every section starts on a cache line
+constexpr std::size_t section_alignment = 64;
+
+struct Section {
+  std::uint64_t offset; // From the start of the file
+  std::uint64_t count;  // Number of elements, not bytes
+};
+
+struct FileHeader {
+  std::array<char, 8> magic;
+  std::uint32_t version;
+  std::uint32_t endianness;
+  std::uint32_t value_size;
+  std::uint32_t flags;
+  std::uint32_t pointer_size;
+  std::uint32_t type; // Index of the result type in Type
+  std::uint64_t file_size;
+  std::uint64_t max_stack_depth; // unknown_depth if the chunk is malformed
+  Section constants;
+  Section instructions;
+  Section runs;
+  Section strings; // In bytes
+  Section relocations;
+};
+
+// The constant at index refers to the string object at offset in the strings
+// section
+struct Relocation {
+  std::uint64_t constant;
+  std::uint64_t object;
+};
+
+static_assert(std::is_trivially_copyable_v<FileHeader> &&
+                  std::is_trivially_copyable_v<Relocation> &&
+                  std::is_trivially_copyable_v<Value>,
+              "The sections are copied into the file byte by byte");
+static_assert(alignof(Value) <= section_alignment &&
+                  alignof(Obj) <= section_alignment,
+              "Sections must be aligned for their elements");
+
+constexpr auto align_up(std::size_t size, std::size_t alignment) noexcept
+    -> std::size_t
+{
+  return (size + alignment - 1) / alignment * alignment;
+}
+
+constexpr auto host_flags() noexcept -> std::uint32_t
+{
+  return build_options.nan_boxing ? nan_boxing_flag : 0;
+}
+
+template <std::size_t... index>
+auto type_from_index(std::size_t i, std::index_sequence<index...>) -> Type
+{
+  const Type types[] = {Type{std::in_place_index<index>}...};
+  return types[i];
+}
+
+auto header_of(const std::byte* data) noexcept -> const FileHeader&
+{
+  return *reinterpret_cast<const FileHeader*>(data);
+}
+
+auto section_fits(const Section& section, std::size_t element_size,
+                  std::size_t file_size) -> bool
+{
+  return section.offset % section_alignment == 0 &&
+         section.offset <= file_size &&
+         section.count <= (file_size - section.offset) / element_size;
+}
+
+// Returns whether the bits of a constant that no relocation refers to form a
+// number, a boolean or unit. Anything else, such as a reference with a forged
+// pointer, cannot come from serialize.
+auto is_plain_constant(const Value& constant) noexcept -> bool
+{
+#ifdef EML_NAN_BOXING
+  return constant.is_number() || constant.is_boolean() || constant.is_unit();
+#else
+  // The tag is read as an integer, since the file may hold any bits
+  using Tag = std::underlying_type_t<decltype(Value::type)>;
+  const auto* const bytes = reinterpret_cast<const std::byte*>(&constant);
+  Tag tag{};
+  std::memcpy(&tag, bytes + offsetof(Value, type), sizeof(tag));
+  if (tag == static_cast<Tag>(Value::type::Boolean)) {
+    unsigned char boolean{};
+    std::memcpy(&boolean, bytes + offsetof(Value, val), sizeof(boolean));
+    return boolean <= 1;
+  }
+  return tag == static_cast<Tag>(Value::type::Unit) ||
+         tag == static_cast<Tag>(Value::type::Number);
+#endif
+}
+
+// Returns the offset of the object of every distinct string constant in the
+// strings section, and the size of the section
+auto layout_strings(const Bytecode& code)
+    -> std::pair<std::unordered_map<const Obj*, std::size_t>, std::size_t>
+{
+  std::unordered_map<const Obj*, std::size_t> offsets;
+  std::size_t size = 0;
+  for (const auto& constant : code.constants) {
+    if (!constant.is_reference()) {
+      continue;
+    }
+    const auto* object = constant.unsafe_as_reference().get();
+    if (offsets.count(object) == 0) {
+      size = align_up(size, alignof(Obj));
+      offsets.emplace(object, size);
+      size += GarbageCollector::object_size(object->size());
+    }
+  }
+  return {std::move(offsets), size};
+}
+
+} // anonymous namespace
+
+auto serialize(const Bytecode& code, const Type& type)
+    -> std::vector<std::byte>
+{
+  const auto& runs = code.lines.runs();
+  const auto [string_offsets, strings_size] = layout_strings(code);
+  std::vector<Relocation> relocations;
+  for (std::size_t i = 0; i < code.constants.size(); ++i) {
+    if (code.constants[i].is_reference()) {
+      const auto* object = code.constants[i].unsafe_as_reference().get();
+      relocations.push_back(Relocation{i, string_offsets.at(object)});
+    }
+  }
+
+  FileHeader header{};
+  header.magic = magic;
+  header.version = bytecode_file_version;
+  header.endianness = endianness_mark;
+  header.value_size = sizeof(Value);
+  header.flags = host_flags();
+  header.pointer_size = sizeof(void*);
+  header.type = static_cast<std::uint32_t>(type.index());
+  header.max_stack_depth = code.compute_max_stack_depth().value_or(
+      unknown_depth);
+
+  std::size_t size = sizeof(FileHeader);
+  const auto add_section = [&size](std::size_t count,
+                                   std::size_t element_size) {
+    size = align_up(size, section_alignment);
+    const Section section{size, count};
+    size += count * element_size;
+    return section;
+  };
+  header.constants = add_section(code.constants.size(), sizeof(Value));
+  header.instructions = add_section(code.instructions.size(), 1);
+  header.runs = add_section(runs.size(), sizeof(LineTable::Run));
+  header.strings = add_section(strings_size, 1);
+  header.relocations = add_section(relocations.size(), sizeof(Relocation));
+  header.file_size = size;
+
+  std::vector<std::byte> file(size);
+  std::memcpy(file.data(), &header, sizeof(FileHeader));
+
+  // The loader points the string constants to their objects, until then they
+  // are units
+  for (std::size_t i = 0; i < code.constants.size(); ++i) {
+    const auto constant =
+        code.constants[i].is_reference() ? Value{} : code.constants[i];
+    std::memcpy(file.data() + header.constants.offset + i * sizeof(Value),
+                &constant, sizeof(Value));
+  }
+  if (!code.instructions.empty()) {
+    std::memcpy(file.data() + header.instructions.offset,
+                code.instructions.data(), code.instructions.size());
+  }
+  if (!runs.empty()) {
+    std::memcpy(file.data() + header.runs.offset, runs.data(),
+                runs.size() * sizeof(LineTable::Run));
+  }
+  for (const auto& [object, offset] : string_offsets) {
+    const auto copy = GarbageCollector::emplace(
+        file.data() + header.strings.offset + offset, object->size());
+    std::memcpy(copy->data(), object->data(), object->size());
+  }
+  if (!relocations.empty()) {
+    std::memcpy(file.data() + header.relocations.offset, relocations.data(),
+                relocations.size() * sizeof(Relocation));
+  }
+  return file;
+}
+
+auto save_bytecode(const Bytecode& code, const Type& type,
+                   const std::string& path)
+    -> expected<void, BytecodeFileError>
+{
+  const auto file = serialize(code, type);
+  std::ofstream out{path, std::ios::binary | std::ios::trunc};
+  out.write(reinterpret_cast<const char*>(file.data()),
+            static_cast<std::streamsize>(file.size()));
+  if (!out) {
+    return unexpected{BytecodeFileError{"Cannot write " + path}};
+  }
+  return {};
+}
+
+auto load_bytecode(const std::string& path)
+    -> expected<MappedBytecode, BytecodeFileError>
+{
+#ifdef EML_USE_MMAP
+  const int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return unexpected{BytecodeFileError{"Cannot open " + path}};
+  }
+  struct stat info {};
+  if (::fstat(fd, &info) != 0 || info.st_size <= 0) {
+    ::close(fd);
+    return unexpected{BytecodeFileError{path + " is not a bytecode file"}};
+  }
+  const auto size = static_cast<std::size_t>(info.st_size);
+
+  // Copy-on-write, so the relocations only touch the pages they change
+  void* data =
+      ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (data == MAP_FAILED) {
+    return unexpected{BytecodeFileError{"Cannot map " + path}};
+  }
+
+  MappedBytecode result{static_cast<std::byte*>(data), size, true};
+  if (auto error = result.load(); error) {
+    return unexpected{std::move(*error)};
+  }
+  return result;
+#else
+  std::ifstream in{path, std::ios::binary | std::ios::ate};
+  if (!in) {
+    return unexpected{BytecodeFileError{"Cannot open " + path}};
+  }
+  const auto size = static_cast<std::size_t>(in.tellg());
+  std::vector<std::byte> file(size);
+  in.seekg(0);
+  in.read(reinterpret_cast<char*>(file.data()),
+          static_cast<std::streamsize>(size));
+  if (!in) {
+    return unexpected{BytecodeFileError{"Cannot read " + path}};
+  }
+  return load_bytecode(file.data(), size);
+#endif
+}
+
+auto load_bytecode(const std::byte* data, std::size_t size)
+    -> expected<MappedBytecode, BytecodeFileError>
+{
+  auto* const copy = static_cast<std::byte*>(
+      ::operator new(size, std::align_val_t{section_alignment}));
+  MappedBytecode result{copy, size, false};
+  if (size > 0) {
+    std::memcpy(copy, data, size);
+  }
+  if (auto error = result.load(); error) {
+    return unexpected{std::move(*error)};
+  }
+  return result;
+}
+
+MappedBytecode::~MappedBytecode()
+{
+  if (data_ == nullptr) {
+    return;
+  }
+#ifdef EML_USE_MMAP
+  if (mapped_) {
+    ::munmap(data_, size_);
+    return;
+  }
+#endif
+  ::operator delete(data_, std::align_val_t{section_alignment});
+}
+
+auto MappedBytecode::load() -> std::optional<BytecodeFileError>
+{
+  if (size_ < sizeof(FileHeader) ||
+      std::memcmp(data_, magic.data(), magic.size()) != 0) {
+    return BytecodeFileError{"Not a bytecode file"};
+  }
+  const auto& header = header_of(data_);
+  if (header.version != bytecode_file_version) {
+    return BytecodeFileError{"Unsupported bytecode file version " +
+                             std::to_string(header.version)};
+  }
+  if (header.endianness != endianness_mark ||
+      header.value_size != sizeof(Value) || header.flags != host_flags() ||
+      header.pointer_size != sizeof(void*)) {
+    return BytecodeFileError{"The bytecode file comes from another platform "
+                             "or build configuration"};
+  }
+  if (header.file_size != size_ ||
+      header.type >= std::variant_size_v<Type> ||
+      !section_fits(header.constants, sizeof(Value), size_) ||
+      !section_fits(header.instructions, 1, size_) ||
+      !section_fits(header.runs, sizeof(LineTable::Run), size_) ||
+      !section_fits(header.strings, 1, size_) ||
+      !section_fits(header.relocations, sizeof(Relocation), size_)) {
+    return BytecodeFileError{"The bytecode file is truncated or corrupt"};
+  }
+
+  // Line lookups need runs that cover the instructions from offset 0
+  const auto* runs =
+      reinterpret_cast<const LineTable::Run*>(data_ + header.runs.offset);
+  const bool runs_cover = (header.runs.count == 0) ==
+                          (header.instructions.count == 0);
+  bool runs_sorted = header.runs.count == 0 || runs[0].begin == 0;
+  for (std::size_t i = 0; runs_sorted && i < header.runs.count; ++i) {
+    runs_sorted = runs[i].begin < header.instructions.count &&
+                  (i == 0 || runs[i - 1].begin < runs[i].begin);
+  }
+  if (!runs_cover || !runs_sorted) {
+    return BytecodeFileError{"The line table of the bytecode file is corrupt"};
+  }
+
+  auto* const constants =
+      reinterpret_cast<Value*>(data_ + header.constants.offset);
+  const auto* relocations =
+      reinterpret_cast<const Relocation*>(data_ + header.relocations.offset);
+  std::vector<bool> relocated(header.constants.count, false);
+  for (std::size_t i = 0; i < header.relocations.count; ++i) {
+    const auto [constant, object] = relocations[i];
+    const auto strings_size = header.strings.count;
+    if (constant >= header.constants.count || object % alignof(Obj) != 0 ||
+        object > strings_size ||
+        strings_size - object < GarbageCollector::object_size(0)) {
+      return BytecodeFileError{"A relocation of the bytecode file is corrupt"};
+    }
+    auto* const string =
+        reinterpret_cast<Obj*>(data_ + header.strings.offset + object);
+    if (string->size() >
+        strings_size - object - GarbageCollector::object_size(0)) {
+      return BytecodeFileError{"A string of the bytecode file is corrupt"};
+    }
+    constants[constant] = Value{GcPointer{string}};
+    relocated[constant] = true;
+  }
+
+  for (std::size_t i = 0; i < header.constants.count; ++i) {
+    if (!relocated[i] && !is_plain_constant(constants[i])) {
+      return BytecodeFileError{"A constant of the bytecode file is corrupt"};
+    }
+  }
+
+  // The vm runs the image without checks, on a stack of the depth of the
+  // header
+  const auto max_depth = verify_instructions(
+      data_ + header.instructions.offset, header.instructions.count, constants,
+      header.constants.count);
+  if (!max_depth) {
+    return BytecodeFileError{"The instructions of the bytecode file do not "
+                             "verify: " +
+                             max_depth.error().msg};
+  }
+  if (header.max_stack_depth != *max_depth) {
+    return BytecodeFileError{"The stack depth of the bytecode file is wrong"};
+  }
+  return {};
+}
+
+auto MappedBytecode::instructions() const noexcept -> const std::byte*
+{
+  return data_ + header_of(data_).instructions.offset;
+}
+
+auto MappedBytecode::instruction_size() const noexcept -> std::size_t
+{
+  return header_of(data_).instructions.count;
+}
+
+auto MappedBytecode::constants() const noexcept -> const Value*
+{
+  return reinterpret_cast<const Value*>(data_ +
+                                        header_of(data_).constants.offset);
+}
+
+auto MappedBytecode::constant_count() const noexcept -> std::size_t
+{
+  return header_of(data_).constants.count;
+}
+
+auto MappedBytecode::max_stack_depth() const noexcept -> std::size_t
+{
+  return static_cast<std::size_t>(header_of(data_).max_stack_depth);
+}
+
+auto MappedBytecode::line(std::size_t offset) const -> line_num
+{
+  const auto& header = header_of(data_);
+  EML_ASSERT(offset < header.instructions.count,
+             "The offset must be in the chunk");
+  const auto* runs =
+      reinterpret_cast<const LineTable::Run*>(data_ + header.runs.offset);
+  return LineTable::find(runs, runs + header.runs.count, offset);
+}
+
+auto MappedBytecode::type() const -> Type
+{
+  return type_from_index(header_of(data_).type,
+                         std::make_index_sequence<std::variant_size_v<Type>>{});
+}
+
+auto MappedBytecode::thaw() const -> Bytecode
+{
+  Bytecode code;
+  code.instructions.assign(instructions(),
+                           instructions() + instruction_size());
+  code.constants.assign(constants(), constants() + constant_count());
+  for (std::size_t offset = 0; offset < instruction_size(); ++offset) {
+    code.lines.push_back(line(offset));
+  }
+  code.max_stack_depth = max_stack_depth();
+  return code;
+}
+
+} // namespace eml
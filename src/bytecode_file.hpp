@@ -0,0 +1,164 @@
+#ifndef EML_BYTECODE_FILE_HPP
+#define EML_BYTECODE_FILE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "bytecode.hpp"
+#include "expected.hpp"
+#include "type.hpp"
+
+/**
+ * @file bytecode_file.hpp
+ * @brief A binary container of compiled chunks that loads without compiling
+ */
+
+namespace eml {
+
+/**
+ * @brief The version of the bytecode file format, files of another version do
+ * not load
+ */
+constexpr std::uint32_t bytecode_file_version = 2;
+
+/**
+ * @brief The reason a bytecode file could not be saved or loaded
+ */
+struct BytecodeFileError {
+  std::string msg;
+
+  explicit BytecodeFileError(std::string msg_in) : msg{std::move(msg_in)} {}
+};
+
+class MappedBytecode;
+
+/**
+ * @brief Returns the bytecode file of a chunk and the type of its result
+ *
+ * The file starts with a header, followed by sections aligned to 64 bytes:
+ * - the constants, as an array of @ref Value
+ * - the instructions
+ * - the runs of the line table
+ * - the string constants, laid out as objects of the garbage collector
+ * - the relocations, the constants that refer to a string object
+ *
+ * The constants and the header use the layout of the host, so a file only
+ * loads on builds with the same endianness, pointer size and @ref Value
+ * representation, which the header records.
+ */
+[[nodiscard]] auto serialize(const Bytecode& code, const Type& type)
+    -> std::vector<std::byte>;
+
+/**
+ * @brief Writes the bytecode file of a chunk to path
+ */
+[[nodiscard]] auto save_bytecode(const Bytecode& code, const Type& type,
+                                 const std::string& path)
+    -> expected<void, BytecodeFileError>;
+
+/**
+ * @brief Maps a bytecode file into memory
+ *
+ * On POSIX systems the file is mapped copy-on-write, and only the constants
+ * that refer to strings are written to, so loading costs a page-in instead of
+ * a compilation. Elsewhere the file is read into memory.
+ *
+ * The loader checks the header, the bounds of every section, the relocations
+ * and that the other constants are numbers, booleans or unit. It also passes
+ * the instructions to @ref verify_instructions and checks the stack depth of
+ * the header, so files of malformed chunks do not load.
+ */
+[[nodiscard]] auto load_bytecode(const std::string& path)
+    -> expected<MappedBytecode, BytecodeFileError>;
+
+/**
+ * @brief Loads a bytecode file from a copy of the size bytes at data
+ */
+[[nodiscard]] auto load_bytecode(const std::byte* data, std::size_t size)
+    -> expected<MappedBytecode, BytecodeFileError>;
+
+/**
+ * @brief A loaded bytecode file, which the @ref VM runs in place
+ *
+ * The strings of the constants live in the file image, so values that refer
+ * to them must not outlive it.
+ */
+class MappedBytecode {
+public:
+  ~MappedBytecode();
+
+  MappedBytecode(const MappedBytecode& other) = delete;
+  auto operator=(const MappedBytecode& other) -> MappedBytecode& = delete;
+
+  MappedBytecode(MappedBytecode&& other) noexcept
+      : data_{std::exchange(other.data_, nullptr)},
+        size_{std::exchange(other.size_, 0)}, mapped_{other.mapped_}
+  {
+  }
+  auto operator=(MappedBytecode&& other) noexcept -> MappedBytecode&
+  {
+    std::swap(data_, other.data_);
+    std::swap(size_, other.size_);
+    std::swap(mapped_, other.mapped_);
+    return *this;
+  }
+
+  /// @brief Returns the first byte of the instructions
+  [[nodiscard]] auto instructions() const noexcept -> const std::byte*;
+
+  /// @brief Returns the number of bytes of the instructions
+  [[nodiscard]] auto instruction_size() const noexcept -> std::size_t;
+
+  /// @brief Returns the first constant of the constant pool
+  [[nodiscard]] auto constants() const noexcept -> const Value*;
+
+  /// @brief Returns the number of constants in the constant pool
+  [[nodiscard]] auto constant_count() const noexcept -> std::size_t;
+
+  /// @brief Returns the maximum depth of the stack while running the chunk
+  [[nodiscard]] auto max_stack_depth() const noexcept -> std::size_t;
+
+  /// @brief Returns the source line of the byte at offset
+  [[nodiscard]] auto line(std::size_t offset) const -> line_num;
+
+  /// @brief Returns the type of the result of the chunk
+  [[nodiscard]] auto type() const -> Type;
+
+  /// @brief Returns the number of bytes of the file
+  [[nodiscard]] auto size_in_bytes() const noexcept -> std::size_t
+  {
+    return size_;
+  }
+
+  /**
+   * @brief Copies the chunk into a mutable chunk, whose string constants
+   * still refer to the file image
+   */
+  [[nodiscard]] auto thaw() const -> Bytecode;
+
+private:
+  friend auto load_bytecode(const std::string& path)
+      -> expected<MappedBytecode, BytecodeFileError>;
+  friend auto load_bytecode(const std::byte* data, std::size_t size)
+      -> expected<MappedBytecode, BytecodeFileError>;
+
+  MappedBytecode(std::byte* data, std::size_t size, bool mapped) noexcept
+      : data_{data}, size_{size}, mapped_{mapped}
+  {
+  }
+
+  // Checks the file and points the string constants to their objects
+  [[nodiscard]] auto load() -> std::optional<BytecodeFileError>;
+
+  std::byte* data_;
+  std::size_t size_;
+  bool mapped_; // Whether data_ comes from mmap or from operator new
+};
+
+} // namespace eml
+
+#endif // EML_BYTECODE_FILE_HPP
@@ -0,0 +1,244 @@
+#include <unordered_map>
+
+#include "bytecode_rewriter.hpp"
+
+namespace eml {
+
+auto DecodedBytecode::jump_targets() const -> std::vector<bool>
+{
+  std::vector<bool> result(instructions.size() + 1, false);
+  for (const auto& instruction : instructions) {
+    if (is_jump_operand(operand_kind_of(instruction.op))) {
+      result[instruction.target] = true;
+    }
+  }
+  result.pop_back(); // The end of the chunk is not an instruction
+  return result;
+}
+
+auto DecodedBytecode::pushed_number(const DecodedInstruction& instruction) const
+    -> std::optional<double>
+{
+  switch (instruction.op) {
+  case op_push_f64: {
+    const auto& constant = constants.at(instruction.operand);
+    if (constant.is_number()) {
+      return constant.unsafe_as_number();
+    }
+    return {};
+  }
+  case op_push_f64_imm:
+  case op_push_f64_small:
+    return instruction.immediate;
+  case op_push_f64_zero:
+    return 0.;
+  case op_push_f64_one:
+    return 1.;
+  case op_push_f64_minus_one:
+    return -1.;
+  default:
+    return {};
+  }
+}
+
+void DecodedBytecode::erase(const std::vector<bool>& removed)
+{
+  EML_ASSERT(removed.size() == instructions.size(),
+             "Needs a flag for every instruction");
+
+  // New index of every old instruction index, or of the next kept instruction
+  // for a removed one
+  std::vector<std::size_t> new_index(instructions.size() + 1);
+  std::size_t kept = 0;
+  for (std::size_t i = 0; i < instructions.size(); ++i) {
+    new_index[i] = kept;
+    if (!removed[i]) {
+      ++kept;
+    }
+  }
+  new_index[instructions.size()] = kept;
+
+  std::vector<DecodedInstruction> result;
+  result.reserve(kept);
+  for (std::size_t i = 0; i < instructions.size(); ++i) {
+    if (!removed[i]) {
+      auto instruction = instructions[i];
+      if (is_jump_operand(operand_kind_of(instruction.op))) {
+        instruction.target = new_index[instruction.target];
+      }
+      result.push_back(instruction);
+    }
+  }
+
+  instructions = std::move(result);
+}
+
+auto decode(const Bytecode& code) -> DecodedBytecode
+{
+  DecodedBytecode result;
+  result.constants = code.constants;
+
+  // Byte offset to instruction index
+  std::unordered_map<std::size_t, std::size_t> index_of;
+  std::vector<std::size_t> jump_offsets; // Byte offset each jump goes to
+
+  for (std::size_t offset = 0; offset < code.instructions.size();) {
+    const auto op = static_cast<opcode>(code.instructions[offset]);
+    const auto size = instruction_size(op);
+    const auto* operand = &code.instructions[offset] + 1;
+
+    DecodedInstruction instruction;
+    instruction.op = narrow_form(op);
+    instruction.line = code.lines[offset];
+
+    switch (operand_kind_of(op)) {
+    case operand_kind::none:
+      break;
+    case operand_kind::constant:
+      instruction.operand = std::to_integer<std::uint32_t>(*operand);
+      break;
+    case operand_kind::constant_wide:
+      instruction.operand = read_u32(operand);
+      break;
+    case operand_kind::jump:
+      jump_offsets.push_back(offset + size +
+                             std::to_integer<std::size_t>(*operand));
+      break;
+    case operand_kind::jump_wide:
+      jump_offsets.push_back(offset + size + read_u32(operand));
+      break;
+    case operand_kind::f64:
+      instruction.immediate = read_f64(operand);
+      break;
+    case operand_kind::small_int:
+      instruction.immediate = std::to_integer<std::int8_t>(*operand);
+      break;
+    case operand_kind::f64_pair:
+      instruction.immediate = read_f64(operand);
+      instruction.second_immediate = read_f64(operand + sizeof(double));
+      break;
+    case operand_kind::jump_f64:
+    case operand_kind::jump_wide_f64:
+      jump_offsets.push_back(offset + size + read_jump_offset(op, operand));
+      instruction.immediate =
+          read_f64(operand + jump_offset_size(operand_kind_of(op)));
+      break;
+    }
+
+    index_of.emplace(offset, result.instructions.size());
+    result.instructions.push_back(instruction);
+    offset += size;
+  }
+  index_of.emplace(code.instructions.size(), result.instructions.size());
+
+  auto jump_offset = jump_offsets.begin();
+  for (auto& instruction : result.instructions) {
+    if (is_jump_operand(operand_kind_of(instruction.op))) {
+      const auto target = index_of.find(*jump_offset++);
+      EML_ASSERT(target != index_of.end(),
+                 "Jumps must land on an instruction boundary");
+      instruction.target = target->second;
+    }
+  }
+
+  return result;
+}
+
+auto encode(const DecodedBytecode& code) -> Bytecode
+{
+  const auto& instructions = code.instructions;
+
+  // Whether every instruction uses its wide form. Constants are wide if their
+  // index does not fit in one byte. Jumps start narrow and are widened until
+  // every distance fits: widening a jump only makes other distances longer, so
+  // this reaches a fixed point.
+  std::vector<bool> wide(instructions.size(), false);
+  for (std::size_t i = 0; i < instructions.size(); ++i) {
+    wide[i] = operand_kind_of(instructions[i].op) == operand_kind::constant &&
+              instructions[i].operand > max_narrow_operand;
+  }
+
+  const auto opcode_at = [&](std::size_t i) {
+    return wide[i] ? wide_form(instructions[i].op) : instructions[i].op;
+  };
+
+  // Byte offset of every instruction
+  std::vector<std::size_t> offsets(instructions.size() + 1);
+  for (bool changed = true; changed;) {
+    std::size_t offset = 0;
+    for (std::size_t i = 0; i < instructions.size(); ++i) {
+      offsets[i] = offset;
+      offset += instruction_size(opcode_at(i));
+    }
+    offsets.back() = offset;
+
+    changed = false;
+    for (std::size_t i = 0; i < instructions.size(); ++i) {
+      if (!wide[i] &&
+          is_jump_operand(operand_kind_of(instructions[i].op)) &&
+          offsets[instructions[i].target] - offsets[i + 1] >
+              max_narrow_operand) {
+        wide[i] = true;
+        changed = true;
+      }
+    }
+  }
+
+  Bytecode result;
+  result.constants = code.constants;
+  result.instructions.reserve(offsets.back());
+
+  for (std::size_t i = 0; i < instructions.size(); ++i) {
+    const auto& instruction = instructions[i];
+    const auto op = opcode_at(i);
+    result.write(op, instruction.line);
+
+    switch (operand_kind_of(op)) {
+    case operand_kind::none:
+      break;
+    case operand_kind::constant:
+      result.write(static_cast<std::byte>(instruction.operand),
+                   instruction.line);
+      break;
+    case operand_kind::constant_wide:
+      result.write(instruction.operand, instruction.line);
+      break;
+    case operand_kind::jump:
+    case operand_kind::jump_wide:
+    case operand_kind::jump_f64:
+    case operand_kind::jump_wide_f64: {
+      EML_ASSERT(offsets[instruction.target] >= offsets[i + 1],
+                 "Jumps can only go forward");
+      const auto distance = offsets[instruction.target] - offsets[i + 1];
+      if (op == instruction.op) {
+        result.write(static_cast<std::byte>(distance), instruction.line);
+      } else {
+        EML_ASSERT(distance <= std::numeric_limits<std::uint32_t>::max(),
+                   "Jump distance must fit in four bytes");
+        result.write(static_cast<std::uint32_t>(distance), instruction.line);
+      }
+      if (operand_kind_of(op) != operand_kind::jump &&
+          operand_kind_of(op) != operand_kind::jump_wide) {
+        result.write(instruction.immediate, instruction.line);
+      }
+    } break;
+    case operand_kind::f64:
+      result.write(instruction.immediate, instruction.line);
+      break;
+    case operand_kind::small_int:
+      result.write(static_cast<std::byte>(
+                       static_cast<std::int8_t>(instruction.immediate)),
+                   instruction.line);
+      break;
+    case operand_kind::f64_pair:
+      result.write(instruction.immediate, instruction.line);
+      result.write(instruction.second_immediate, instruction.line);
+      break;
+    }
+  }
+
+  result.max_stack_depth = result.compute_max_stack_depth();
+  return result;
+}
+
+} // namespace eml
@@ -0,0 +1,84 @@
+#ifndef EML_BYTECODE_REWRITER_HPP
+#define EML_BYTECODE_REWRITER_HPP
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "bytecode.hpp"
+
+/**
+ * @file bytecode_rewriter.hpp
+ * @brief Decodes bytecode into a list of instructions that optimization passes
+ * can rewrite, and encodes it back
+ *
+ * In the decoded form, jumps refer to the index of their target instruction
+ * instead of to a byte offset. Passes can then insert, replace and remove
+ * instructions without patching jump offsets themselves.
+ *
+ * Decoded instructions always use the narrow form of their opcode, encoding
+ * picks the narrow or the wide form depending on the size of the operand.
+ */
+
+namespace eml {
+
+/**
+ * @brief An instruction decoded from a @ref Bytecode chunk
+ */
+struct DecodedInstruction {
+  opcode op = op_return;
+  std::uint32_t operand = 0;   ///< @brief The constant index, if any
+  double immediate = 0;        ///< @brief The inline number, if any
+  double second_immediate = 0; ///< @brief The second inline number, if any
+  std::size_t target = 0; ///< @brief The instruction index a jump goes to
+  line_num line{0};       ///< @brief The source line of the instruction
+};
+
+/**
+ * @brief A bytecode chunk decoded into a list of instructions
+ *
+ * The target of a jump is the index of an instruction, or the number of
+ * instructions if the jump goes to the end of the chunk.
+ */
+struct DecodedBytecode {
+  std::vector<DecodedInstruction> instructions;
+  std::vector<Value> constants;
+
+  /**
+   * @brief Returns, for every instruction, whether some jump lands on it
+   */
+  [[nodiscard]] auto jump_targets() const -> std::vector<bool>;
+
+  /**
+   * @brief Returns the number an instruction pushes, if it pushes a number
+   *
+   * Covers every encoding of a number push: constant pool, inline and short
+   * forms.
+   */
+  [[nodiscard]] auto pushed_number(const DecodedInstruction& instruction) const
+      -> std::optional<double>;
+
+  /**
+   * @brief Removes the instructions whose flag is set in removed
+   *
+   * The jumps to a removed instruction are retargeted to the first kept
+   * instruction after it.
+   */
+  void erase(const std::vector<bool>& removed);
+};
+
+/**
+ * @brief Decodes a bytecode chunk into a list of instructions
+ */
+[[nodiscard]] auto decode(const Bytecode& code) -> DecodedBytecode;
+
+/**
+ * @brief Encodes a list of instructions back into a bytecode chunk
+ *
+ * The chunk comes with its @ref Bytecode::max_stack_depth.
+ */
+[[nodiscard]] auto encode(const DecodedBytecode& code) -> Bytecode;
+
+} // namespace eml
+
+#endif // EML_BYTECODE_REWRITER_HPP
@@ -40,8 +40,8 @@ void repl()
 
     if (!source.empty()) {
       compiler.compile(source)
-          .map([&vm](auto tuple) {
-            const auto [bytecode, type] = tuple;
+          .map([&vm](const auto& tuple) {
+            const auto& [bytecode, type] = tuple;
             const auto result = vm.interpret(bytecode);
             if (result) {
               std::cout << eml::to_string(type, *result) << '\n';
@@ -1,5 +1,10 @@
 #include "ast.hpp"
+#include "bytecode_rewriter.hpp"
 #include "compiler.hpp"
+#include "control_flow.hpp"
+#include "peephole.hpp"
+#include "superinstruction.hpp"
+#include "vm.hpp"
 
 namespace eml {
 
@@ -11,6 +16,7 @@ struct CodeGenerator;
 struct TypeDispatcher {
   CodeGenerator& generator;
   Value v;
+  line_num line;
 
   void operator()(const NumberType& /*t*/);
 
@@ -26,14 +32,22 @@ struct TypeDispatcher {
 struct CodeGenerator : AstConstVisitor {
   friend TypeDispatcher;
 
-  explicit CodeGenerator(Bytecode& chunk, const Compiler& compiler)
-      : chunk_{chunk}, compiler_{compiler}
+  explicit CodeGenerator(Bytecode& chunk, const Compiler& compiler,
+                         GarbageCollector& gc, NumberEncoding number_encoding)
+      : chunk_{chunk}, compiler_{compiler}, gc_{gc},
+        number_encoding_{number_encoding}
   {
   }
 
+  // The line of the token that node comes from
+  static auto line_of(const AstNode& node) -> line_num
+  {
+    return line_num{node.position().line};
+  }
+
   void operator()(const LiteralExpr& constant) override
   {
-    TypeDispatcher visitor{*this, constant.value()};
+    TypeDispatcher visitor{*this, constant.value(), line_of(constant)};
     std::visit(visitor, constant.type());
   }
 
@@ -42,14 +56,14 @@ struct CodeGenerator : AstConstVisitor {
     EML_ASSERT(id.value() != std::nullopt,
                "Identifier expression passed to the code generator are "
                "garanteed to have a value");
-    TypeDispatcher visitor{*this, *id.value()};
+    TypeDispatcher visitor{*this, *id.value(), line_of(id)};
     std::visit(visitor, id.type());
   }
 
   void unary_common(const UnaryOpExpr& expr, opcode op)
   {
     expr.operand().accept(*this);
-    chunk_.write(op, line_num{0});
+    chunk_.write(op, line_of(expr));
   }
 
   void operator()(const UnaryNegateExpr& expr) override
@@ -66,7 +80,7 @@ struct CodeGenerator : AstConstVisitor {
   {
     expr.lhs().accept(*this);
     expr.rhs().accept(*this);
-    chunk_.write(op, line_num{0});
+    chunk_.write(op, line_of(expr));
   }
 
   void operator()(const PlusOpExpr& expr) override
@@ -85,13 +99,32 @@ struct CodeGenerator : AstConstVisitor {
   {
     binary_common(expr, op_divide_f64);
   }
+  // Emits the equality for the type of the operands, which the type checker
+  // proved to be the same, so the vm does not switch on the type at runtime
+  void equality_common(const BinaryOpExpr& expr, bool equal)
+  {
+    const auto& type = expr.lhs().type();
+    if (std::holds_alternative<UnitType>(type)) {
+      // Units are always equal and evaluating them has no effect
+      chunk_.write(equal ? op_true : op_false, line_of(expr));
+    } else if (std::holds_alternative<NumberType>(type)) {
+      binary_common(expr, equal ? op_equal_f64 : op_not_equal_f64);
+    } else if (std::holds_alternative<BoolType>(type)) {
+      binary_common(expr, equal ? op_equal_bool : op_not_equal_bool);
+    } else if (std::holds_alternative<StringType>(type)) {
+      binary_common(expr, equal ? op_equal_string : op_not_equal_string);
+    } else {
+      EML_UNREACHABLE();
+    }
+  }
+
   void operator()(const EqOpExpr& expr) override
   {
-    binary_common(expr, op_equal);
+    equality_common(expr, true);
   }
   void operator()(const NeqOpExpr& expr) override
   {
-    binary_common(expr, op_not_equal);
+    equality_common(expr, false);
   }
   void operator()(const LessOpExpr& expr) override
   {
@@ -115,14 +148,20 @@ struct CodeGenerator : AstConstVisitor {
     throw "TODO";
   }
 
-  // Emits [instruction] followed by a placeholder for a jump offset. The
-  // placeholder can be patched by calling [jumpPatch]. Returns the index of the
-  // placeholder.
+  // Emits the wide form of [instruction] followed by a placeholder for a jump
+  // offset. The placeholder can be patched by calling [jumpPatch]. Returns the
+  // index of the placeholder.
+  //
+  // The distance of a jump is unknown until it is patched, so jumps are always
+  // emitted wide, and generate_code shrinks the ones that fit in one byte
+  // afterwards.
   auto write_jump(eml::opcode jump_instruction, line_num linum)
       -> std::ptrdiff_t
   {
-    chunk_.write(jump_instruction, linum);
-    const auto jump = chunk_.write(std::byte{}, linum);
+    chunk_.write(wide_form(jump_instruction), linum);
+    const auto jump = chunk_.next_instruction_index();
+    chunk_.write(std::uint32_t{0}, linum);
+    has_jumps_ = true;
     return jump;
   }
 
@@ -131,7 +170,11 @@ struct CodeGenerator : AstConstVisitor {
   void jump_patch(std::ptrdiff_t index)
   {
     const auto jump_to = chunk_.next_instruction_index();
-    chunk_.write_at(static_cast<std::byte>(jump_to - index - 1), index);
+    const auto distance = jump_to - index -
+                          static_cast<std::ptrdiff_t>(sizeof(std::uint32_t));
+    EML_ASSERT(distance <= std::numeric_limits<std::uint32_t>::max(),
+               "Jump distance must fit in four bytes");
+    chunk_.write_at(static_cast<std::uint32_t>(distance), index);
   }
 
   void operator()(const IfExpr& expr) override
@@ -142,11 +185,11 @@ struct CodeGenerator : AstConstVisitor {
                "Type of different branches must match");
 
     expr.cond().accept(*this);
-    const auto else_jump_pos = write_jump(eml::op_jmp_false, line_num{0});
+    const auto else_jump_pos = write_jump(eml::op_jmp_false, line_of(expr));
 
     expr.If().accept(*this);
 
-    const auto if_jump_pos = write_jump(eml::op_jmp, line_num{0});
+    const auto if_jump_pos = write_jump(eml::op_jmp, line_of(expr));
 
     jump_patch(else_jump_pos);
 
@@ -159,36 +202,47 @@ struct CodeGenerator : AstConstVisitor {
 
   Bytecode& chunk_; // Not null
   const Compiler& compiler_;
+  GarbageCollector& gc_;
+  NumberEncoding number_encoding_;
+  bool has_jumps_ = false;
 };
 
 void TypeDispatcher::operator()(const NumberType&)
 {
+  if (generator.number_encoding_ == NumberEncoding::immediate) {
+    generator.chunk_.write_number(v.unsafe_as_number(), line);
+    return;
+  }
+
   const auto offset = generator.chunk_.add_constant(v);
+  EML_ASSERT(offset.has_value(), "Too many constants in one chunk");
 
-  generator.chunk_.write(eml::op_push_f64, line_num{0});
-  generator.chunk_.write(std::byte{*offset}, line_num{0});
+  generator.chunk_.write_with_constant(eml::op_push_f64, *offset, line);
 }
 
 void TypeDispatcher::operator()(const StringType&)
 {
-  const auto offset = generator.chunk_.add_constant(v);
+  // Verified and jit compiled chunks copy the constants where no collection
+  // can update them, so they must not be in the nursery
+  const auto offset = generator.chunk_.add_constant(
+      Value{generator.gc_.tenure(v.unsafe_as_reference())});
+  EML_ASSERT(offset.has_value(), "Too many constants in one chunk");
 
-  generator.chunk_.write(eml::op_push_f64, line_num{0});
-  generator.chunk_.write(std::byte{*offset}, line_num{0});
+  generator.chunk_.write_with_constant(eml::op_push_f64, *offset, line);
 }
 
 void TypeDispatcher::operator()(const BoolType&)
 {
   if (v.unsafe_as_boolean()) {
-    generator.chunk_.write(eml::op_true, line_num{0});
+    generator.chunk_.write(eml::op_true, line);
   } else {
-    generator.chunk_.write(eml::op_false, line_num{0});
+    generator.chunk_.write(eml::op_false, line);
   }
 }
 
 void TypeDispatcher::operator()(const UnitType&)
 {
-  generator.chunk_.write(eml::op_unit, line_num{0});
+  generator.chunk_.write(eml::op_unit, line);
 }
 
 void TypeDispatcher::operator()(const ErrorType& /*t*/)
@@ -202,9 +256,45 @@ auto Compiler::generate_code(const AstNode& expr) const
     -> std::tuple<Bytecode, Type>
 {
   Bytecode code;
-  CodeGenerator code_generator{code, *this};
+  CodeGenerator code_generator{code, *this, garbage_collector_,
+                               options_.number_encoding};
   expr.accept(code_generator);
+  if (options_.peephole) {
+    code = optimize_peephole(code);
+  }
+  if (options_.control_flow) {
+    code = optimize_control_flow(code);
+  }
+  if (options_.superinstructions) {
+    code = fuse_superinstructions(code);
+  } else if (code_generator.has_jumps_ && !options_.peephole &&
+             !options_.control_flow) {
+    // Encoding picks the narrow form of every jump that fits in one byte
+    code = encode(decode(code));
+  }
+  if (!code.max_stack_depth) {
+    code.max_stack_depth = code.compute_max_stack_depth();
+  }
   return std::tuple(code, expr.type());
 }
 
+auto Compiler::evaluate_constant(Expr_ptr& expr) const -> std::optional<Value>
+{
+  if (options_.constant_folding) {
+    fold_constants(expr);
+  }
+  if (const auto* literal = dynamic_cast<const LiteralExpr*>(expr.get());
+      literal != nullptr) {
+    return literal->value();
+  }
+
+  // Jumps only go forward, so every instruction runs at most once
+  const auto [code, type] = generate_code(*expr);
+  if (decode(code).instructions.size() > options_.evaluation_budget) {
+    return {};
+  }
+  VM vm{};
+  return vm.interpret(code);
+}
+
 } // namespace eml
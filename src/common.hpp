@@ -18,6 +18,22 @@
  * defines that control how EML works.
  */
 
+// Computed goto (labels as values) is a GCC extension also supported by Clang
+#if defined(EML_VM_COMPUTED_GOTO) && (defined(__GNUC__) || defined(__clang__))
+#define EML_VM_USE_COMPUTED_GOTO
+#endif
+
+// The jit emits x86-64 machine code and maps it with the Linux mmap api
+#if defined(EML_JIT) && defined(__x86_64__) && defined(__linux__)
+#define EML_USE_JIT
+#endif
+
+// Bytecode files are mapped with the POSIX mmap api where it exists, and read
+// into memory elsewhere
+#if defined(__unix__) || defined(__APPLE__)
+#define EML_USE_MMAP
+#endif
+
 namespace eml {
 
 struct BuildOptions {
@@ -32,6 +48,24 @@ struct BuildOptions {
 #else
   constexpr static bool debug_print_ast = false;
 #endif
+
+#ifdef EML_VM_USE_COMPUTED_GOTO
+  constexpr static bool vm_computed_goto = true;
+#else
+  constexpr static bool vm_computed_goto = false;
+#endif
+
+#ifdef EML_NAN_BOXING
+  constexpr static bool nan_boxing = true;
+#else
+  constexpr static bool nan_boxing = false;
+#endif
+
+#ifdef EML_USE_JIT
+  constexpr static bool jit = true;
+#else
+  constexpr static bool jit = false;
+#endif
 };
 static constexpr BuildOptions build_options;
 
@@ -0,0 +1,118 @@
+#include <algorithm>
+
+#include "ast.hpp"
+#include "compile_cache.hpp"
+#include "compiler.hpp"
+
+namespace eml {
+
+auto CompileCache::size_of(const Entry& entry) noexcept -> std::size_t
+{
+  std::size_t size = sizeof(Entry) + entry.source.size() +
+                     entry.code.size_in_bytes();
+  for (const auto& dependency : entry.dependencies) {
+    size += sizeof(Dependency) + dependency.name.size();
+  }
+  return size;
+}
+
+void CompileCache::insert(Entry entry)
+{
+  const auto size = size_of(entry);
+  if (size > capacity_) {
+    return;
+  }
+  if (const auto found = index_.find(entry.source); found != index_.end()) {
+    erase(found->second);
+  }
+
+  while (size_in_bytes_ + size > capacity_) {
+    erase(std::prev(entries_.end()));
+    ++stats_.evictions;
+  }
+
+  entries_.push_front(std::move(entry));
+  index_.emplace(entries_.front().source, entries_.begin());
+  size_in_bytes_ += size;
+}
+
+void CompileCache::clear() noexcept
+{
+  index_.clear();
+  entries_.clear();
+  size_in_bytes_ = 0;
+}
+
+void CompileCache::erase(iterator entry)
+{
+  size_in_bytes_ -= size_of(*entry);
+  index_.erase(entry->source);
+  entries_.erase(entry);
+}
+
+auto Compiler::compile_uncached(std::string_view src) -> CompileResult
+{
+  // Nothing refers to objects of the garbage collector from outside the roots
+  // before the parser starts
+  garbage_collector_.get().collect_if_needed();
+  return eml::parse(src, garbage_collector_)
+      .and_then([this](auto ast) { return type_check(ast); })
+      .map([this](auto&& ast) {
+        if (options_.constant_folding) {
+          fold_constants(ast);
+        }
+        return generate_code(*ast);
+      });
+}
+
+auto Compiler::compile(std::string_view src) -> CompileResult
+{
+  if (!cache_.enabled()) {
+    return compile_uncached(src);
+  }
+  return compile_shared(src).map([](auto&& result) {
+    const auto& [code, type] = result;
+    return std::tuple{code.thaw(), type};
+  });
+}
+
+auto Compiler::compile_shared(std::string_view src) -> SharedCompileResult
+{
+  const auto version_of = [this](const std::string& name) {
+    const auto found = global_versions_.find(name);
+    return found == global_versions_.end() ? std::uint64_t{0} : found->second;
+  };
+  if (cache_.enabled()) {
+    if (const auto* entry = cache_.find(src, version_of); entry != nullptr) {
+      return std::tuple{entry->code, entry->type};
+    }
+  }
+
+  std::vector<std::string> reads;
+  const auto generation = global_generation_;
+  global_reads_ = cache_.enabled() ? &reads : nullptr;
+  auto result = compile_uncached(src);
+  global_reads_ = nullptr;
+  if (!result) {
+    return unexpected{std::move(result.error())};
+  }
+
+  auto& [code, type] = *result;
+  auto frozen = freeze(code);
+
+  // Hits would skip the definitions of the source
+  if (cache_.enabled() && global_generation_ == generation) {
+    std::sort(reads.begin(), reads.end());
+    reads.erase(std::unique(reads.begin(), reads.end()), reads.end());
+    std::vector<CompileCache::Dependency> dependencies;
+    for (auto& name : reads) {
+      const auto version = version_of(name);
+      dependencies.push_back({std::move(name), version});
+    }
+    cache_.insert(CompileCache::Entry{std::string{src}, frozen, type,
+                                      std::move(dependencies)});
+  }
+  return std::tuple{std::move(frozen), std::move(type)};
+}
+
+} // namespace eml
@@ -0,0 +1,165 @@
+#ifndef EML_COMPILE_CACHE_HPP
+#define EML_COMPILE_CACHE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "frozen_bytecode.hpp"
+#include "type.hpp"
+
+/**
+ * @file compile_cache.hpp
+ * @brief A cache of compiled chunks keyed by their source text
+ */
+
+namespace eml {
+
+/**
+ * @brief What the compile cache did since it was created
+ */
+struct CompileCacheStats {
+  std::size_t hits = 0;
+  std::size_t misses = 0;
+  /// @brief Entries dropped to stay under the capacity
+  std::size_t evictions = 0;
+  /// @brief Entries dropped because a global that they read changed
+  std::size_t invalidations = 0;
+};
+
+/**
+ * @brief A size-bounded cache of compiled chunks with least recently used
+ * eviction
+ *
+ * Entries are found by the exact source text. Every entry records the version
+ * of each global that its compilation read, and a lookup only hits if all of
+ * them still have the same version, so redefining a global invalidates the
+ * chunks that inlined its value.
+ */
+class CompileCache {
+public:
+  /// @brief A global that the compilation read, version 0 if it was undefined
+  struct Dependency {
+    std::string name;
+    std::uint64_t version;
+  };
+
+  /// @brief A compiled chunk with the source and the globals that it came from
+  struct Entry {
+    std::string source;
+    FrozenBytecode code;
+    Type type;
+    std::vector<Dependency> dependencies;
+  };
+
+  /**
+   * @brief Constructs a cache that holds at most capacity bytes of entries, a
+   * capacity of 0 disables the cache
+   */
+  explicit CompileCache(std::size_t capacity) noexcept : capacity_{capacity} {}
+
+  // The index refers into the entries, moving the list keeps them valid but
+  // copying it does not
+  CompileCache(const CompileCache& other) = delete;
+  auto operator=(const CompileCache& other) -> CompileCache& = delete;
+  CompileCache(CompileCache&& other) noexcept = default;
+  auto operator=(CompileCache&& other) noexcept -> CompileCache& = default;
+  ~CompileCache() = default;
+
+  /// @brief Returns whether the cache stores entries at all
+  [[nodiscard]] auto enabled() const noexcept -> bool
+  {
+    return capacity_ != 0;
+  }
+
+  /**
+   * @brief Returns the entry of source and marks it as recently used, or
+   * nullptr if there is none or if it is stale
+   *
+   * version_of(name) returns the current version of a global. Stale entries
+   * are removed.
+   */
+  template <class VersionOf>
+  [[nodiscard]] auto find(std::string_view source, VersionOf version_of)
+      -> const Entry*
+  {
+    const auto found = index_.find(source);
+    if (found == index_.end()) {
+      ++stats_.misses;
+      return nullptr;
+    }
+
+    const auto entry = found->second;
+    for (const auto& dependency : entry->dependencies) {
+      if (version_of(dependency.name) != dependency.version) {
+        ++stats_.invalidations;
+        ++stats_.misses;
+        erase(entry);
+        return nullptr;
+      }
+    }
+
+    ++stats_.hits;
+    entries_.splice(entries_.begin(), entries_, entry);
+    return &*entry;
+  }
+
+  /**
+   * @brief Adds an entry, evicting the least recently used entries to make
+   * room for it
+   *
+   * Entries larger than the capacity are not cached.
+   */
+  void insert(Entry entry);
+
+  /// @brief Removes every entry, the statistics stay
+  void clear() noexcept;
+
+  /// @brief Marks the constants of every entry as live
+  void mark(GarbageCollector& gc) const noexcept
+  {
+    for (const auto& entry : entries_) {
+      eml::mark(gc, entry.code);
+    }
+  }
+
+  /// @brief Returns the number of entries
+  [[nodiscard]] auto size() const noexcept -> std::size_t
+  {
+    return entries_.size();
+  }
+
+  /// @brief Returns the number of bytes that the entries take
+  [[nodiscard]] auto size_in_bytes() const noexcept -> std::size_t
+  {
+    return size_in_bytes_;
+  }
+
+  [[nodiscard]] auto stats() const noexcept -> const CompileCacheStats&
+  {
+    return stats_;
+  }
+
+private:
+  using iterator = std::list<Entry>::iterator;
+
+  [[nodiscard]] static auto size_of(const Entry& entry) noexcept
+      -> std::size_t;
+
+  void erase(iterator entry);
+
+  std::size_t capacity_;
+  std::size_t size_in_bytes_ = 0;
+  std::list<Entry> entries_; // The most recently used first
+  // Keys point into the source of their entry
+  std::unordered_map<std::string_view, iterator> index_;
+  CompileCacheStats stats_;
+};
+
+} // namespace eml
+
+#endif // EML_COMPILE_CACHE_HPP
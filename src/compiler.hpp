@@ -6,10 +6,12 @@
 #include <vector>
 
 #include "bytecode.hpp"
+#include "compile_cache.hpp"
 #include "error.hpp"
 #include "expected.hpp"
 #include "memory.hpp"
 #include "module.hpp"
+#include "register_bytecode.hpp"
 #include "type.hpp"
 #include "value.hpp"
 
@@ -22,11 +24,38 @@
 
 namespace eml {
 
+struct Expr;
+
+/**
+ * @brief How the code generator encodes number literals
+ */
+enum class NumberEncoding {
+  constant_pool, ///< @brief Number literals are pushed from the constant pool
+  immediate, ///< @brief Number literals are stored inline in the instructions
+};
+
 /**
  * @brief Runtime configurations that decides how the eml compiler should behave
  */
 struct CompilerConfig {
   SameScopeShadowing shadowing_policy = SameScopeShadowing::warning;
+  /// @brief How number literals are encoded in the generated bytecode
+  NumberEncoding number_encoding = NumberEncoding::immediate;
+  /// @brief Fuses common instruction sequences into superinstructions
+  bool superinstructions = true;
+  /// @brief Rewrites wasteful instruction sequences, see @ref optimize_peephole
+  bool peephole = true;
+  /// @brief Threads jumps, removes unreachable code and merges branch tails,
+  /// see @ref optimize_control_flow
+  bool control_flow = true;
+  /// @brief Folds constant subexpressions before generating code
+  bool constant_folding = true;
+  /// @brief The maximum number of instructions that the compiler runs to
+  /// evaluate the value of a definition
+  std::size_t evaluation_budget = 10000;
+  /// @brief The maximum number of bytes of compiled chunks that the compiler
+  /// caches by their source, 0 disables the cache, see @ref CompileCache
+  std::size_t compile_cache_capacity = 0;
 };
 
 /**
@@ -39,42 +68,118 @@ public:
       expected<std::unique_ptr<AstNode>, std::vector<CompilationError>>;
   using CompileResult =
       expected<std::tuple<Bytecode, Type>, std::vector<CompilationError>>;
+  using SharedCompileResult =
+      expected<std::tuple<FrozenBytecode, Type>, std::vector<CompilationError>>;
 
   /**
    * @brief Constructs a compiler object
    * @arg gc The garbage collector that the EML compiler used
    * @arg options Runtime configuration of the compiler. If unprovided, have
    * sensible defaults
+   *
+   * The compiler registers its globals and its cached chunks as roots of gc.
    */
-  explicit Compiler(GarbageCollector& gc, CompilerConfig options = {}) noexcept
-      : options_{options}, garbage_collector_{gc}
+  explicit Compiler(GarbageCollector& gc, CompilerConfig options = {})
+      : options_{options}, garbage_collector_{gc},
+        cache_{options.compile_cache_capacity},
+        roots_{gc.add_roots(
+            [this](GarbageCollector& collector) { mark_roots(collector); })}
   {
   }
 
+  // The roots refer to the compiler
+  Compiler(const Compiler& other) = delete;
+  auto operator=(const Compiler& other) -> Compiler& = delete;
+  Compiler(Compiler&& other) = delete;
+  auto operator=(Compiler&& other) -> Compiler& = delete;
+  ~Compiler() = default;
+
   /**
    * @brief compiles the source into bytecode
    *
+   * Compiling is a safe point of the garbage collector, which may free the
+   * string constants of earlier chunks that are not registered as roots, see
+   * @ref GarbageCollector::add_roots.
+   *
+   * If the compile cache is enabled, a source compiled before in the same
+   * global environment skips scanning, parsing, type checking and code
+   * generation, and is copied out of the cache.
+   *
    * @return A bytecode chunk if the compilation process succeed, a vector of
    * errors otherwise
    */
-  auto compile(std::string_view src) -> CompileResult
+  auto compile(std::string_view src) -> CompileResult;
+
+  /**
+   * @brief Compiles the source into a frozen chunk
+   *
+   * Same as @ref compile, but a cached chunk is shared instead of copied.
+   * Sources whose compilation defines globals are never cached, since a hit
+   * would skip the definitions.
+   */
+  auto compile_shared(std::string_view src) -> SharedCompileResult;
+
+  /**
+   * @brief Returns the statistics of the compile cache
+   */
+  [[nodiscard]] auto compile_cache_stats() const noexcept
+      -> const CompileCacheStats&
   {
-    return eml::parse(src, garbage_collector_)
-        .and_then([this](auto ast) { return type_check(ast); })
-        .map([this](const auto& ast) { return generate_code(*ast); });
+    return cache_.stats();
   }
 
+  /**
+   * @brief Folds the constant subexpressions of a type checked AST
+   *
+   * Replaces operations on literals by their results, removes the branches of
+   * if expressions whose condition is constant, and applies the algebraic
+   * identities that hold for every IEEE 754 number, such as `x * 1` or
+   * `x - 0`. The folded AST evaluates to the same value bit for bit.
+   */
+  void fold_constants(std::unique_ptr<AstNode>& node) const;
+
+  /// @copydoc fold_constants(std::unique_ptr<AstNode>&) const
+  void fold_constants(std::unique_ptr<Expr>& expr) const;
+
+  /**
+   * @brief Evaluates a type checked closed expression at compile time
+   *
+   * Folds the expression, and runs it on an internal vm if it does not fold
+   * to a literal.
+   *
+   * @return The value of the expression, or nullopt if the evaluation needs
+   * more than @ref CompilerConfig::evaluation_budget instructions
+   */
+  [[nodiscard]] auto evaluate_constant(std::unique_ptr<Expr>& expr) const
+      -> std::optional<Value>;
+
   /**
    * @brief Compiles the AST Expr node expr into bytecode
    */
   auto generate_code(const eml::AstNode& expr) const
       -> std::tuple<Bytecode, Type>;
 
+  /**
+   * @brief Compiles the AST Expr node expr into register-based bytecode
+   *
+   * This is an alternative back end to @ref generate_code, the result runs on
+   * the @ref RegisterVM.
+   *
+   * @return The code, or nullopt if the expression needs more than
+   * @ref max_registers registers, more than @ref max_register_constants
+   * constants or a jump longer than @ref max_register_jump instructions, in
+   * which case it only runs on the stack back end
+   */
+  auto generate_register_code(const eml::AstNode& expr) const
+      -> std::optional<std::tuple<RegisterBytecode, Type>>;
+
   /**
    * @brief  Adds a global constants to a byte code chunk
    */
   void add_global(const std::string& identifier, Type t, Value v)
   {
+    global_versions_[identifier] = ++global_generation_;
+
     auto query_result = constexpr_env_.find(identifier);
     if (query_result != constexpr_env_.end()) { // Shadowing
 
@@ -96,6 +201,9 @@ public:
   [[nodiscard]] auto get_global(std::string_view identifier) const
       -> std::optional<const std::pair<Type, Value>>
   {
+    if (global_reads_ != nullptr) {
+      global_reads_->emplace_back(identifier);
+    }
     const auto pos = constexpr_env_.find(std::string{identifier});
     if (pos != constexpr_env_.end()) {
       return {pos->second};
@@ -113,11 +221,33 @@ public:
   auto type_check(std::unique_ptr<AstNode>& ptr) -> TypeCheckResult;
 
 private:
+  auto compile_uncached(std::string_view src) -> CompileResult;
+
+  void mark_roots(GarbageCollector& gc) noexcept
+  {
+    for (auto& global : constexpr_env_) {
+      mark(gc, global.second.second);
+    }
+    cache_.mark(gc);
+  }
+
   CompilerConfig options_;
   std::reference_wrapper<GarbageCollector> garbage_collector_;
 
   std::unordered_map<std::string, std::pair<Type, Value>>
       constexpr_env_; // Identifier to (type, value index) mapping for globals
+
+  // Every add_global bumps the generation, and the version of a global is the
+  // generation that defined it
+  std::uint64_t global_generation_ = 0;
+  std::unordered_map<std::string, std::uint64_t> global_versions_;
+
+  // Where get_global records the globals that it looks up, while compiling a
+  // source for the cache
+  std::vector<std::string>* global_reads_ = nullptr;
+
+  CompileCache cache_;
+  GcRoots roots_;
 };
 
 } // namespace eml
@@ -0,0 +1,266 @@
+#include <functional>
+
+#include "ast.hpp"
+#include "compiler.hpp"
+#include "string.hpp"
+
+namespace eml {
+
+namespace {
+
+// Returns the value of an expression if it is a literal
+auto constant_of(const Expr& expr) -> std::optional<Value>
+{
+  if (const auto* literal = dynamic_cast<const LiteralExpr*>(&expr);
+      literal != nullptr) {
+    return literal->value();
+  }
+  return {};
+}
+
+// Returns whether an expression is the literal number, -0 is not 0
+auto is_number(const Expr& expr, double number) -> bool
+{
+  const auto value = constant_of(expr);
+  return value && value->is_number() &&
+         bit_cast<std::uint64_t>(value->unsafe_as_number()) ==
+             bit_cast<std::uint64_t>(number);
+}
+
+// Returns whether an expression is the literal boolean
+auto is_boolean(const Expr& expr, bool boolean) -> bool
+{
+  const auto value = constant_of(expr);
+  return value && value->is_boolean() && value->unsafe_as_boolean() == boolean;
+}
+
+// Replaces the constant subexpressions of a type checked AST by literals
+//
+// Folded values are computed with the same double operations as the vm. The
+// algebraic identities only drop operations that return one of their operands
+// bit for bit, for example x + -0 but not x + 0, which turns -0 into 0, so the
+// folded code produces exactly the same results as the original one.
+struct ConstantFolder : AstVisitor {
+  // Folds expr and replaces it if it simplified
+  void fold(Expr_ptr& expr)
+  {
+    expr->accept(*this);
+    if (replacement_ != nullptr) {
+      expr = std::move(replacement_);
+    }
+  }
+
+  // Replaces the folded expr by a literal at the same position
+  void replace_with(const Expr& expr, Value value, Type type)
+  {
+    replacement_ = LiteralExpr::create(value, type);
+    replacement_->set_position(expr.position());
+  }
+
+  void replace_with(Expr_ptr& expr)
+  {
+    replacement_ = std::move(expr);
+  }
+
+  void operator()(LiteralExpr& /*expr*/) override {}
+
+  void operator()(IdentifierExpr& id) override
+  {
+    // Globals are constants
+    if (id.value()) {
+      replace_with(id, *id.value(), id.type());
+    }
+  }
+
+  void operator()(UnaryNegateExpr& expr) override
+  {
+    fold(expr.operand_ptr());
+    if (const auto operand = constant_of(expr.operand()); operand) {
+      replace_with(expr, Value{-operand->unsafe_as_number()}, NumberType{});
+    } else if (auto* inner = dynamic_cast<UnaryNegateExpr*>(&expr.operand());
+               inner != nullptr) {
+      replace_with(inner->operand_ptr()); // -(-x) is x
+    }
+  }
+
+  void operator()(UnaryNotExpr& expr) override
+  {
+    fold(expr.operand_ptr());
+    if (const auto operand = constant_of(expr.operand()); operand) {
+      replace_with(expr, Value{!operand->unsafe_as_boolean()}, BoolType{});
+    } else if (auto* inner = dynamic_cast<UnaryNotExpr*>(&expr.operand());
+               inner != nullptr) {
+      replace_with(inner->operand_ptr()); // !!x is x
+    }
+  }
+
+  // Folds the operands, returns true if the operation was replaced by a
+  // literal
+  template <typename Result, typename Op>
+  auto binary_common(BinaryOpExpr& expr, Type type, Op op) -> bool
+  {
+    fold(expr.lhs_ptr());
+    fold(expr.rhs_ptr());
+    const auto lhs = constant_of(expr.lhs());
+    const auto rhs = constant_of(expr.rhs());
+    if (lhs && rhs) {
+      replace_with(expr,
+                   Value{static_cast<Result>(op(lhs->unsafe_as_number(),
+                                                rhs->unsafe_as_number()))},
+                   type);
+      return true;
+    }
+    return false;
+  }
+
+  template <typename Op> auto arithmetic(BinaryOpExpr& expr, Op op) -> bool
+  {
+    return binary_common<double>(expr, NumberType{}, op);
+  }
+
+  template <typename Op> void comparison(BinaryOpExpr& expr, Op op)
+  {
+    binary_common<bool>(expr, BoolType{}, op);
+  }
+
+  void operator()(PlusOpExpr& expr) override
+  {
+    if (arithmetic(expr, std::plus<double>{})) {
+      return;
+    }
+    if (is_number(expr.rhs(), -0.)) {
+      replace_with(expr.lhs_ptr());
+    } else if (is_number(expr.lhs(), -0.)) {
+      replace_with(expr.rhs_ptr());
+    }
+  }
+
+  void operator()(MinusOpExpr& expr) override
+  {
+    if (!arithmetic(expr, std::minus<double>{}) && is_number(expr.rhs(), 0.)) {
+      replace_with(expr.lhs_ptr());
+    }
+  }
+
+  void operator()(MultOpExpr& expr) override
+  {
+    if (arithmetic(expr, std::multiplies<double>{})) {
+      return;
+    }
+    if (is_number(expr.rhs(), 1.)) {
+      replace_with(expr.lhs_ptr());
+    } else if (is_number(expr.lhs(), 1.)) {
+      replace_with(expr.rhs_ptr());
+    }
+  }
+
+  void operator()(DivOpExpr& expr) override
+  {
+    if (!arithmetic(expr, std::divides<double>{}) &&
+        is_number(expr.rhs(), 1.)) {
+      replace_with(expr.lhs_ptr());
+    }
+  }
+
+  void equality_common(BinaryOpExpr& expr, bool equal)
+  {
+    fold(expr.lhs_ptr());
+    fold(expr.rhs_ptr());
+
+    // Units are always equal and evaluating them has no effect
+    if (std::holds_alternative<UnitType>(expr.lhs().type())) {
+      replace_with(expr, Value{equal}, BoolType{});
+      return;
+    }
+
+    const auto lhs = constant_of(expr.lhs());
+    const auto rhs = constant_of(expr.rhs());
+    if (lhs && rhs) {
+      const bool equal_values =
+          lhs->is_reference()
+              ? equal_strings(lhs->unsafe_as_reference(),
+                              rhs->unsafe_as_reference())
+              : *lhs == *rhs;
+      replace_with(expr, Value{equal_values == equal}, BoolType{});
+    } else if (is_boolean(expr.rhs(), equal)) { // x == true, x != false
+      replace_with(expr.lhs_ptr());
+    } else if (is_boolean(expr.lhs(), equal)) {
+      replace_with(expr.rhs_ptr());
+    }
+  }
+
+  void operator()(EqOpExpr& expr) override
+  {
+    equality_common(expr, true);
+  }
+
+  void operator()(NeqOpExpr& expr) override
+  {
+    equality_common(expr, false);
+  }
+
+  void operator()(LessOpExpr& expr) override
+  {
+    comparison(expr, std::less<double>{});
+  }
+
+  void operator()(LeOpExpr& expr) override
+  {
+    comparison(expr, std::less_equal<double>{});
+  }
+
+  void operator()(GreaterOpExpr& expr) override
+  {
+    comparison(expr, std::greater<double>{});
+  }
+
+  void operator()(GeExpr& expr) override
+  {
+    comparison(expr, std::greater_equal<double>{});
+  }
+
+  void operator()(IfExpr& expr) override
+  {
+    fold(expr.cond_ptr());
+    fold(expr.If_ptr());
+    fold(expr.Else_ptr());
+
+    if (const auto cond = constant_of(expr.cond()); cond) {
+      replace_with(cond->unsafe_as_boolean() ? expr.If_ptr()
+                                             : expr.Else_ptr());
+    } else if (auto* negated = dynamic_cast<UnaryNotExpr*>(&expr.cond());
+               negated != nullptr) {
+      // if (!c) a else b is if (c) b else a
+      auto inner = std::move(negated->operand_ptr());
+      expr.cond_ptr() = std::move(inner);
+      std::swap(expr.If_ptr(), expr.Else_ptr());
+    }
+  }
+
+  void operator()(LambdaExpr& /*expr*/) override {}
+
+  void operator()(Definition& def) override
+  {
+    fold(def.to_ptr());
+  }
+
+  Expr_ptr replacement_;
+};
+
+} // anonymous namespace
+
+void Compiler::fold_constants(std::unique_ptr<AstNode>& node) const
+{
+  ConstantFolder folder;
+  node->accept(folder);
+  if (folder.replacement_ != nullptr) {
+    node = std::move(folder.replacement_);
+  }
+}
+
+void Compiler::fold_constants(Expr_ptr& expr) const
+{
+  ConstantFolder{}.fold(expr);
+}
+
+} // namespace eml
@@ -0,0 +1,189 @@
+#include <algorithm>
+
+#include "bytecode_rewriter.hpp"
+#include "control_flow.hpp"
+
+namespace eml {
+
+namespace {
+
+auto is_jump(const DecodedInstruction& instruction) -> bool
+{
+  return is_jump_operand(operand_kind_of(instruction.op));
+}
+
+// Retargets the jumps that land on an op_jmp, and removes the op_jmp to the
+// next instruction, returns whether it changed anything
+auto thread_jumps(DecodedBytecode& code, ControlFlowStats& stats) -> bool
+{
+  auto& instructions = code.instructions;
+  const auto size = instructions.size();
+
+  std::vector<bool> removed(size, false);
+  bool changed = false;
+  for (std::size_t i = 0; i < size; ++i) {
+    auto& instruction = instructions[i];
+    if (!is_jump(instruction)) {
+      continue;
+    }
+
+    // Jumps only go forward, so the chain ends
+    auto target = instruction.target;
+    while (target < size && instructions[target].op == op_jmp) {
+      target = instructions[target].target;
+    }
+    if (target != instruction.target) {
+      instruction.target = target;
+      ++stats.jumps_threaded;
+      changed = true;
+    }
+
+    if (instruction.op == op_jmp && target == i + 1) {
+      removed[i] = true;
+      changed = true;
+    }
+  }
+
+  code.erase(removed);
+  return changed;
+}
+
+// Removes the instructions that no path reaches, returns whether it removed
+// any
+auto remove_unreachable(DecodedBytecode& code) -> bool
+{
+  const auto& instructions = code.instructions;
+  const auto size = instructions.size();
+
+  std::vector<bool> reachable(size + 1, false);
+  reachable[0] = true;
+  for (std::size_t i = 0; i < size; ++i) {
+    if (!reachable[i]) {
+      continue;
+    }
+    if (is_jump(instructions[i])) {
+      reachable[instructions[i].target] = true;
+    }
+    if (instructions[i].op != op_jmp) {
+      reachable[i + 1] = true;
+    }
+  }
+
+  std::vector<bool> removed(size);
+  bool changed = false;
+  for (std::size_t i = 0; i < size; ++i) {
+    removed[i] = !reachable[i];
+    changed = changed || removed[i];
+  }
+
+  code.erase(removed);
+  return changed;
+}
+
+auto same_instruction(const DecodedInstruction& lhs,
+                      const DecodedInstruction& rhs) -> bool
+{
+  return lhs.op == rhs.op && lhs.operand == rhs.operand &&
+         bit_cast<std::uint64_t>(lhs.immediate) ==
+             bit_cast<std::uint64_t>(rhs.immediate) &&
+         bit_cast<std::uint64_t>(lhs.second_immediate) ==
+             bit_cast<std::uint64_t>(rhs.second_immediate);
+}
+
+// Returns the number of instructions before the op_jmp at index jump that are
+// the same as the instructions before its target
+//
+// Other jumps can land on the first of these instructions, but not in the
+// middle of them, since they are replaced by the jump.
+auto tail_size(const DecodedBytecode& code,
+               const std::vector<bool>& jump_targets, std::size_t jump)
+    -> std::size_t
+{
+  const auto& instructions = code.instructions;
+  const auto target = instructions[jump].target;
+
+  std::size_t size = 0;
+  while (size < jump && target - size - 1 > jump) {
+    const auto& instruction = instructions[jump - size - 1];
+    if (is_jump(instruction) ||
+        !same_instruction(instruction, instructions[target - size - 1]) ||
+        (size > 0 && jump_targets[jump - size])) {
+      break;
+    }
+    ++size;
+  }
+  return size;
+}
+
+// Makes every op_jmp whose branch has the same tail as the code before its
+// target jump to that code, returns whether it found one
+//
+// The tails are removed by a single erase at the end. A tail that a merged
+// jump now lands on is kept, so the tails of later jumps must not overlap it.
+// The skipped jumps are merged on the next round.
+auto merge_tails(DecodedBytecode& code, ControlFlowStats& stats) -> bool
+{
+  auto& instructions = code.instructions;
+  const auto jump_targets = code.jump_targets();
+
+  std::vector<bool> removed(instructions.size(), false);
+  std::vector<bool> kept(instructions.size(), false);
+  bool changed = false;
+  for (std::size_t i = 0; i < instructions.size(); ++i) {
+    if (instructions[i].op != op_jmp) {
+      continue;
+    }
+    const auto size = tail_size(code, jump_targets, i);
+    const auto tail = static_cast<std::ptrdiff_t>(i - size);
+    const auto tail_end = kept.begin() + static_cast<std::ptrdiff_t>(i);
+    if (size == 0 ||
+        std::find(kept.begin() + tail, tail_end, true) != tail_end) {
+      continue;
+    }
+
+    auto& target = instructions[i].target;
+    target -= size;
+    std::fill_n(kept.begin() + static_cast<std::ptrdiff_t>(target), size,
+                true);
+    std::fill_n(removed.begin() + tail, size, true);
+    ++stats.tails_merged;
+    changed = true;
+  }
+
+  if (changed) {
+    code.erase(removed);
+  }
+  return changed;
+}
+
+} // anonymous namespace
+
+auto optimize_control_flow(const Bytecode& code) -> Bytecode
+{
+  ControlFlowStats stats;
+  return optimize_control_flow(code, stats);
+}
+
+auto optimize_control_flow(const Bytecode& code, ControlFlowStats& stats)
+    -> Bytecode
+{
+  auto decoded = decode(code);
+  if (decoded.instructions.empty()) {
+    return code;
+  }
+
+  bool changed = true;
+  while (changed) {
+    ++stats.rounds;
+    changed = thread_jumps(decoded, stats);
+    changed = remove_unreachable(decoded) || changed;
+    changed = merge_tails(decoded, stats) || changed;
+  }
+
+  auto result = encode(decoded);
+  stats.instructions_removed +=
+      code.instruction_count() - result.instruction_count();
+  return result;
+}
+
+} // namespace eml
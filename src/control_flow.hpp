@@ -0,0 +1,53 @@
+#ifndef EML_CONTROL_FLOW_HPP
+#define EML_CONTROL_FLOW_HPP
+
+#include <cstddef>
+
+#include "bytecode.hpp"
+
+/**
+ * @file control_flow.hpp
+ * @brief Optimization of the jumps and the branch layout of bytecode chunks
+ */
+
+namespace eml {
+
+/**
+ * @brief What the control flow optimizer changed
+ */
+struct ControlFlowStats {
+  /// @brief Jumps retargeted past the unconditional jumps they landed on
+  std::size_t jumps_threaded = 0;
+  /// @brief Branch tails replaced by a jump to an identical tail
+  std::size_t tails_merged = 0;
+  std::size_t instructions_removed = 0;
+  /// @brief Times the optimizations ran over the whole chunk before none of
+  /// them applied
+  std::size_t rounds = 0;
+};
+
+/**
+ * @brief Optimizes the jumps of a chunk
+ *
+ * - A jump that lands on an `op_jmp` goes to the final target of the chain
+ *   directly, so the nested if expressions at the end of a branch take one
+ *   jump instead of one per level.
+ * - Instructions that no path reaches are removed, as well as unconditional
+ *   jumps to the next instruction.
+ * - When the instructions before an `op_jmp` are the same as the instructions
+ *   that fall through to its target, the jump goes to the start of those
+ *   instructions instead, so the two branches share their tail.
+ *
+ * The optimizations are repeated until none of them applies.
+ */
+[[nodiscard]] auto optimize_control_flow(const Bytecode& code) -> Bytecode;
+
+/**
+ * @brief Optimizes the jumps of a chunk and adds what changed to stats
+ */
+[[nodiscard]] auto optimize_control_flow(const Bytecode& code,
+                                         ControlFlowStats& stats) -> Bytecode;
+
+} // namespace eml
+
+#endif // EML_CONTROL_FLOW_HPP
@@ -10,8 +10,15 @@
  * @brief This file provides the public api of EML
  */
 
+#include "aot.hpp"
+#include "bytecode_file.hpp"
 #include "compiler.hpp"
+#include "frozen_bytecode.hpp"
+#include "jit.hpp"
 #include "memory.hpp"
+#include "register_vm.hpp"
+#include "static_compiler.hpp"
+#include "verifier.hpp"
 #include "vm.hpp"
 
 /**
@@ -0,0 +1,207 @@
+#include <atomic>
+#include <cstring>
+#include <new>
+#include <type_traits>
+
+#include "frozen_bytecode.hpp"
+
+namespace eml {
+
+static_assert(std::is_trivially_copyable_v<Value>,
+              "Constants are copied into the image byte by byte");
+static_assert(std::is_trivially_copyable_v<LineTable::Run>,
+              "Line runs are copied into the image byte by byte");
+
+namespace {
+
+constexpr auto unknown_depth = static_cast<std::size_t>(-1);
+
+constexpr auto align_up(std::size_t size, std::size_t alignment) noexcept
+    -> std::size_t
+{
+  return (size + alignment - 1) / alignment * alignment;
+}
+
+} // anonymous namespace
+
+// The image is laid out as
+//   Header
+//   the constants, aligned for Value
+//   the instructions
+//   the line runs, aligned for LineTable::Run
+// and the offsets below are from the start of the header
+struct FrozenBytecode::Header {
+  std::atomic<std::size_t> references;
+  std::size_t size_in_bytes;
+  std::size_t max_stack_depth; // unknown_depth if the chunk is malformed
+  std::size_t constant_count;
+  std::size_t instruction_size;
+  std::size_t run_count;
+  std::size_t instructions_offset;
+  std::size_t runs_offset;
+
+  static constexpr auto constants_offset() noexcept -> std::size_t
+  {
+    return align_up(sizeof(Header), alignof(Value));
+  }
+
+  [[nodiscard]] auto bytes() noexcept -> std::byte*
+  {
+    return reinterpret_cast<std::byte*>(this);
+  }
+
+  [[nodiscard]] auto bytes() const noexcept -> const std::byte*
+  {
+    return reinterpret_cast<const std::byte*>(this);
+  }
+};
+
+auto freeze(const Bytecode& code) -> FrozenBytecode
+{
+  const auto& runs = code.lines.runs();
+  const auto constant_bytes = code.constants.size() * sizeof(Value);
+  const auto constants_offset = FrozenBytecode::Header::constants_offset();
+  const auto instructions_offset = constants_offset + constant_bytes;
+  const auto runs_offset =
+      align_up(instructions_offset + code.instructions.size(),
+               alignof(LineTable::Run));
+  const auto size = runs_offset + runs.size() * sizeof(LineTable::Run);
+
+  // The cached depth is a public field that anyone may have left stale, and
+  // the vm trusts the depth of the image, so recompute it like thaw does
+  const auto max_stack_depth = code.compute_max_stack_depth();
+
+  auto* const block = static_cast<std::byte*>(::operator new(
+      size, std::align_val_t{FrozenBytecode::alignment}));
+  auto* const header = new (block) FrozenBytecode::Header{{1},
+                                          size,
+                                          max_stack_depth.value_or(
+                                              unknown_depth),
+                                          code.constants.size(),
+                                          code.instructions.size(),
+                                          runs.size(),
+                                          instructions_offset,
+                                          runs_offset};
+
+  // memcpy does not take null pointers, even for 0 bytes
+  if (!code.constants.empty()) {
+    std::memcpy(block + constants_offset, code.constants.data(),
+                constant_bytes);
+  }
+  if (!code.instructions.empty()) {
+    std::memcpy(block + instructions_offset, code.instructions.data(),
+                code.instructions.size());
+  }
+  if (!runs.empty()) {
+    std::memcpy(block + runs_offset, runs.data(),
+                runs.size() * sizeof(LineTable::Run));
+  }
+  return FrozenBytecode{header};
+}
+
+FrozenBytecode::~FrozenBytecode()
+{
+  if (header_ == nullptr ||
+      header_->references.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+    return;
+  }
+  header_->~Header();
+  ::operator delete(header_, std::align_val_t{alignment});
+}
+
+FrozenBytecode::FrozenBytecode(const FrozenBytecode& other) noexcept
+    : header_{other.header_}
+{
+  if (header_ != nullptr) {
+    header_->references.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+auto FrozenBytecode::operator=(const FrozenBytecode& other) noexcept
+    -> FrozenBytecode&
+{
+  FrozenBytecode{other}.swap(*this);
+  return *this;
+}
+
+auto FrozenBytecode::instructions() const noexcept -> const std::byte*
+{
+  EML_ASSERT(header_ != nullptr, "The handle must refer to an image");
+  return header_->bytes() + header_->instructions_offset;
+}
+
+auto FrozenBytecode::instruction_size() const noexcept -> std::size_t
+{
+  EML_ASSERT(header_ != nullptr, "The handle must refer to an image");
+  return header_->instruction_size;
+}
+
+auto FrozenBytecode::constants() const noexcept -> const Value*
+{
+  EML_ASSERT(header_ != nullptr, "The handle must refer to an image");
+  return reinterpret_cast<const Value*>(header_->bytes() +
+                                       Header::constants_offset());
+}
+
+auto FrozenBytecode::constant_count() const noexcept -> std::size_t
+{
+  EML_ASSERT(header_ != nullptr, "The handle must refer to an image");
+  return header_->constant_count;
+}
+
+auto FrozenBytecode::max_stack_depth() const noexcept
+    -> std::optional<std::size_t>
+{
+  EML_ASSERT(header_ != nullptr, "The handle must refer to an image");
+  if (header_->max_stack_depth == unknown_depth) {
+    return {};
+  }
+  return header_->max_stack_depth;
+}
+
+auto FrozenBytecode::runs() const noexcept -> const LineTable::Run*
+{
+  return reinterpret_cast<const LineTable::Run*>(header_->bytes() +
+                                                 header_->runs_offset);
+}
+
+auto FrozenBytecode::line(std::size_t offset) const -> line_num
+{
+  EML_ASSERT(header_ != nullptr, "The handle must refer to an image");
+  EML_ASSERT(offset < header_->instruction_size,
+             "The offset must be in the chunk");
+  return LineTable::find(runs(), runs() + header_->run_count, offset);
+}
+
+auto FrozenBytecode::data() const noexcept -> const std::byte*
+{
+  return header_ == nullptr ? nullptr : header_->bytes();
+}
+
+auto FrozenBytecode::size_in_bytes() const noexcept -> std::size_t
+{
+  return header_ == nullptr ? 0 : header_->size_in_bytes;
+}
+
+auto FrozenBytecode::use_count() const noexcept -> std::size_t
+{
+  return header_ == nullptr
+             ? 0
+             : header_->references.load(std::memory_order_relaxed);
+}
+
+auto FrozenBytecode::thaw() const -> Bytecode
+{
+  EML_ASSERT(header_ != nullptr, "The handle must refer to an image");
+  Bytecode code;
+  const auto* const first = instructions();
+  code.instructions.assign(first, first + header_->instruction_size);
+  code.constants.assign(constants(), constants() + header_->constant_count);
+  for (std::size_t offset = 0; offset < header_->instruction_size; ++offset) {
+    code.lines.push_back(line(offset));
+  }
+  code.max_stack_depth = max_stack_depth();
+  return code;
+}
+
+} // namespace eml
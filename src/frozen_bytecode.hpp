@@ -0,0 +1,147 @@
+#ifndef EML_FROZEN_BYTECODE_HPP
+#define EML_FROZEN_BYTECODE_HPP
+
+#include <cstddef>
+#include <optional>
+#include <utility>
+
+#include "bytecode.hpp"
+
+/**
+ * @file frozen_bytecode.hpp
+ * @brief Immutable bytecode images that share one allocation
+ */
+
+namespace eml {
+
+class FrozenBytecode;
+
+/**
+ * @brief Packs a chunk into one immutable allocation
+ *
+ * The image holds a header, the constants, the instructions and the line runs
+ * of the chunk back to back in one block aligned to a cache line, so running
+ * it touches one contiguous region instead of three vectors. The maximum depth
+ * of the stack is computed once here; the depth cached in the chunk is not
+ * trusted.
+ *
+ * Strings in the constants stay owned by the @ref GarbageCollector that
+ * allocated them; the image only refers to them, so hosts that keep the image
+ * across compilations register it as a root, see @ref mark.
+ */
+[[nodiscard]] auto freeze(const Bytecode& code) -> FrozenBytecode;
+
+/**
+ * @brief A shared handle to a frozen chunk
+ *
+ * Copying the handle bumps a reference count instead of copying the chunk,
+ * so any number of vms and threads can hold the same image. The image is
+ * freed with its last handle. A moved-from handle is empty.
+ */
+class FrozenBytecode {
+public:
+  /// @brief The alignment of the allocation of an image
+  static constexpr std::size_t alignment = 64;
+
+  FrozenBytecode() noexcept = default;
+  ~FrozenBytecode();
+
+  FrozenBytecode(const FrozenBytecode& other) noexcept;
+  auto operator=(const FrozenBytecode& other) noexcept -> FrozenBytecode&;
+
+  FrozenBytecode(FrozenBytecode&& other) noexcept
+      : header_{std::exchange(other.header_, nullptr)}
+  {
+  }
+  auto operator=(FrozenBytecode&& other) noexcept -> FrozenBytecode&
+  {
+    FrozenBytecode{std::move(other)}.swap(*this);
+    return *this;
+  }
+
+  void swap(FrozenBytecode& other) noexcept
+  {
+    std::swap(header_, other.header_);
+  }
+
+  /// @brief Returns whether the handle refers to an image
+  [[nodiscard]] explicit operator bool() const noexcept
+  {
+    return header_ != nullptr;
+  }
+
+  /// @brief Returns the first byte of the instructions
+  [[nodiscard]] auto instructions() const noexcept -> const std::byte*;
+
+  /// @brief Returns the number of bytes of the instructions
+  [[nodiscard]] auto instruction_size() const noexcept -> std::size_t;
+
+  /// @brief Returns the first constant of the constant pool
+  [[nodiscard]] auto constants() const noexcept -> const Value*;
+
+  /// @brief Returns the number of constants in the constant pool
+  [[nodiscard]] auto constant_count() const noexcept -> std::size_t;
+
+  /**
+   * @brief Returns the maximum depth of the stack while running the chunk, or
+   * nullopt if the chunk is malformed
+   */
+  [[nodiscard]] auto max_stack_depth() const noexcept
+      -> std::optional<std::size_t>;
+
+  /// @brief Returns the source line of the byte at offset
+  [[nodiscard]] auto line(std::size_t offset) const -> line_num;
+
+  /**
+   * @brief Returns the start of the allocation, aligned to @ref alignment
+   */
+  [[nodiscard]] auto data() const noexcept -> const std::byte*;
+
+  /**
+   * @brief Returns the number of bytes of the allocation, header included
+   */
+  [[nodiscard]] auto size_in_bytes() const noexcept -> std::size_t;
+
+  /**
+   * @brief Returns the number of handles that share the image
+   */
+  [[nodiscard]] auto use_count() const noexcept -> std::size_t;
+
+  /**
+   * @brief Copies the image back into a mutable chunk
+   */
+  [[nodiscard]] auto thaw() const -> Bytecode;
+
+private:
+  struct Header;
+
+  friend auto freeze(const Bytecode& code) -> FrozenBytecode;
+
+  explicit FrozenBytecode(Header* header) noexcept : header_{header} {}
+
+  [[nodiscard]] auto runs() const noexcept -> const LineTable::Run*;
+
+  Header* header_ = nullptr;
+};
+
+/**
+ * @brief Marks the constants of a frozen chunk as live
+ *
+ * The constants are the only part of a frozen chunk that changes, when the
+ * collector moves the objects that they refer to. Every handle sees the moved
+ * objects, since they share the image.
+ */
+inline void mark(GarbageCollector& gc, const FrozenBytecode& code) noexcept
+{
+  if (!code) {
+    return;
+  }
+  auto* const constants = const_cast<Value*>(code.constants());
+  for (std::size_t i = 0; i < code.constant_count(); ++i) {
+    mark(gc, constants[i]);
+  }
+}
+
+} // namespace eml
+
+#endif // EML_FROZEN_BYTECODE_HPP
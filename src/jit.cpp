@@ -0,0 +1,1085 @@
+#include <algorithm>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include "common.hpp"
+#include "jit.hpp"
+#include "string.hpp"
+
+#ifdef EML_USE_JIT
+#include <sys/mman.h>
+#endif
+
+namespace eml {
+
+#ifdef EML_USE_JIT
+
+namespace {
+
+// Signature of the translated chunks, returns the payload of the result
+using NativeFunction = std::uint64_t (*)();
+
+// The first stack slots live in xmm0-xmm13, xmm14 and xmm15 are scratch
+constexpr std::size_t register_slots = 14;
+constexpr std::uint8_t scratch_xmm = 14;
+constexpr std::uint8_t immediate_xmm = 15;
+
+// Deeper stacks would need a larger native stack frame than we want to take
+constexpr std::size_t max_native_stack_depth = 4096;
+
+// Size of a stack slot in the native stack frame
+constexpr std::size_t slot_size = 8;
+
+// Where a stack slot lives: an xmm register or a cell of the native stack
+// frame addressed by rbx
+struct Location {
+  bool in_register;
+  std::uint8_t xmm;
+  std::int32_t displacement;
+};
+
+auto register_location(std::uint8_t xmm) -> Location
+{
+  return Location{true, xmm, 0};
+}
+
+// The cell of the frame that a stack slot spills to
+auto frame_location(std::size_t slot) -> Location
+{
+  return Location{false, 0, static_cast<std::int32_t>(slot * slot_size)};
+}
+
+auto location_of(std::size_t slot) -> Location
+{
+  if (slot < register_slots) {
+    return register_location(static_cast<std::uint8_t>(slot));
+  }
+  return frame_location(slot);
+}
+
+// Returns the payload of a constant, the native code keeps numbers as their
+// bits, booleans as 0 or 1, unit as 0 and references as pointers
+auto payload_of(Value v) -> std::uint64_t
+{
+  if (v.is_number()) {
+    return bit_cast<std::uint64_t>(v.unsafe_as_number());
+  }
+  if (v.is_boolean()) {
+    return v.unsafe_as_boolean() ? std::uint64_t{1} : std::uint64_t{0};
+  }
+  if (v.is_reference()) {
+    return reinterpret_cast<std::uintptr_t>(v.unsafe_as_reference().get());
+  }
+  return 0;
+}
+
+auto value_of(StackType type, std::uint64_t payload) -> Value
+{
+  switch (type) {
+  case StackType::number:
+    return Value{bit_cast<double>(payload)};
+  case StackType::boolean:
+    return Value{payload != 0};
+  case StackType::reference:
+    return Value{GcPointer{reinterpret_cast<Obj*>(payload)}};
+  case StackType::unit:
+    return Value{};
+  }
+  EML_UNREACHABLE();
+}
+
+// Runtime functions that the native code calls to compare references
+using RuntimeEquality = std::uint64_t (*)(std::uint64_t, std::uint64_t);
+
+auto equal_references(std::uint64_t lhs, std::uint64_t rhs) -> std::uint64_t
+{
+  return value_of(StackType::reference, lhs) ==
+                 value_of(StackType::reference, rhs)
+             ? std::uint64_t{1}
+             : std::uint64_t{0};
+}
+
+auto equal_string_references(std::uint64_t lhs, std::uint64_t rhs)
+    -> std::uint64_t
+{
+  return equal_strings(
+             value_of(StackType::reference, lhs).unsafe_as_reference(),
+             value_of(StackType::reference, rhs).unsafe_as_reference())
+             ? std::uint64_t{1}
+             : std::uint64_t{0};
+}
+
+// Condition codes of the jcc and setcc instructions
+enum condition_code : std::uint8_t {
+  cc_below = 0x2,
+  cc_above_equal = 0x3,
+  cc_equal = 0x4,
+  cc_not_equal = 0x5,
+  cc_below_equal = 0x6,
+  cc_above = 0x7,
+  cc_parity = 0xa,
+  cc_not_parity = 0xb,
+};
+
+// Emits the few x86-64 instructions that the jit needs
+class Assembler {
+public:
+  [[nodiscard]] auto code() const noexcept -> const std::vector<std::uint8_t>&
+  {
+    return code_;
+  }
+
+  [[nodiscard]] auto size() const noexcept -> std::size_t
+  {
+    return code_.size();
+  }
+
+  void emit(std::initializer_list<std::uint8_t> bytes)
+  {
+    code_.insert(code_.end(), bytes);
+  }
+
+  void emit_u32(std::uint32_t value)
+  {
+    for (int i = 0; i < 4; ++i) {
+      code_.push_back(static_cast<std::uint8_t>(value >> (8 * i)));
+    }
+  }
+
+  void emit_u64(std::uint64_t value)
+  {
+    for (int i = 0; i < 8; ++i) {
+      code_.push_back(static_cast<std::uint8_t>(value >> (8 * i)));
+    }
+  }
+
+  // Emits the scalar SSE instruction `prefix 0F op xmm, rm`
+  void sse(std::uint8_t prefix, std::uint8_t op, std::uint8_t xmm,
+           Location rm)
+  {
+    code_.push_back(prefix);
+    std::uint8_t rex = 0x40;
+    if (xmm >= 8) {
+      rex |= 0x4; // REX.R
+    }
+    if (rm.in_register && rm.xmm >= 8) {
+      rex |= 0x1; // REX.B
+    }
+    if (rex != 0x40) {
+      code_.push_back(rex);
+    }
+    emit({0x0f, op});
+    modrm(xmm, rm);
+  }
+
+  // movsd xmm, rm
+  void load_xmm(std::uint8_t xmm, Location rm)
+  {
+    if (!rm.in_register || rm.xmm != xmm) {
+      sse(0xf2, 0x10, xmm, rm);
+    }
+  }
+
+  // movsd rm, xmm
+  void store_xmm(Location rm, std::uint8_t xmm)
+  {
+    if (!rm.in_register || rm.xmm != xmm) {
+      sse(0xf2, 0x11, xmm, rm);
+    }
+  }
+
+  // mov rax, rm or movq rax, rm
+  void load_rax(Location rm)
+  {
+    if (rm.in_register) {
+      emit({0x66, rex_w(rm.xmm), 0x0f, 0x7e});
+      code_.push_back(static_cast<std::uint8_t>(0xc0 | (rm.xmm & 7) << 3));
+    } else {
+      emit({0x48, 0x8b});
+      modrm(0, rm);
+    }
+  }
+
+  // mov rm, rax or movq rm, rax
+  void store_rax(Location rm)
+  {
+    if (rm.in_register) {
+      emit({0x66, rex_w(rm.xmm), 0x0f, 0x6e});
+      code_.push_back(static_cast<std::uint8_t>(0xc0 | (rm.xmm & 7) << 3));
+    } else {
+      emit({0x48, 0x89});
+      modrm(0, rm);
+    }
+  }
+
+  // mov rax, imm64
+  void mov_rax(std::uint64_t value)
+  {
+    if (value <= 0xffffffff) {
+      code_.push_back(0xb8); // mov eax, imm32 clears the upper half
+      emit_u32(static_cast<std::uint32_t>(value));
+    } else {
+      emit({0x48, 0xb8});
+      emit_u64(value);
+    }
+  }
+
+  // setcc al
+  void setcc_al(condition_code cc)
+  {
+    emit({0x0f, static_cast<std::uint8_t>(0x90 | cc), 0xc0});
+  }
+
+  // setcc cl
+  void setcc_cl(condition_code cc)
+  {
+    emit({0x0f, static_cast<std::uint8_t>(0x90 | cc), 0xc1});
+  }
+
+  // jcc rel32, returns the position of the displacement to patch
+  auto jcc(condition_code cc) -> std::size_t
+  {
+    emit({0x0f, static_cast<std::uint8_t>(0x80 | cc)});
+    return placeholder();
+  }
+
+  // jmp rel32, returns the position of the displacement to patch
+  auto jmp() -> std::size_t
+  {
+    code_.push_back(0xe9);
+    return placeholder();
+  }
+
+  // Makes the jump whose displacement is at position land at the end of code
+  void bind(std::size_t position)
+  {
+    const auto distance =
+        static_cast<std::uint32_t>(code_.size() - (position + 4));
+    for (std::size_t i = 0; i < 4; ++i) {
+      code_[position + i] = static_cast<std::uint8_t>(distance >> (8 * i));
+    }
+  }
+
+private:
+  static auto rex_w(std::uint8_t xmm) -> std::uint8_t
+  {
+    return xmm >= 8 ? 0x4c : 0x48;
+  }
+
+  // Emits the ModRM byte of reg and rm, memory operands are [rbx + disp32]
+  void modrm(std::uint8_t reg, Location rm)
+  {
+    if (rm.in_register) {
+      code_.push_back(
+          static_cast<std::uint8_t>(0xc0 | (reg & 7) << 3 | (rm.xmm & 7)));
+    } else {
+      code_.push_back(static_cast<std::uint8_t>(0x80 | (reg & 7) << 3 | 3));
+      emit_u32(static_cast<std::uint32_t>(rm.displacement));
+    }
+  }
+
+  auto placeholder() -> std::size_t
+  {
+    const auto position = code_.size();
+    emit_u32(0);
+    return position;
+  }
+
+  std::vector<std::uint8_t> code_;
+};
+
+using TypeStack = std::vector<StackType>;
+
+// Returns the condition code that holds when cc does not
+auto negated(condition_code cc) -> condition_code
+{
+  return static_cast<condition_code>(cc ^ 1);
+}
+
+// Emits the native code of bytecode instructions, the subclasses decide how
+// jumps are translated
+class Emitter {
+public:
+  Emitter(const Bytecode& code, std::size_t frame_slots)
+      : code_{code}, frame_slots_{frame_slots}
+  {
+  }
+  virtual ~Emitter() = default;
+
+  Emitter(const Emitter& other) = delete;
+  auto operator=(const Emitter& other) -> Emitter& = delete;
+  Emitter(Emitter&& other) = delete;
+  auto operator=(Emitter&& other) -> Emitter& = delete;
+
+  [[nodiscard]] auto machine_code() const -> const std::vector<std::uint8_t>&
+  {
+    return asm_.code();
+  }
+
+protected:
+  // Translates a jump of the bytecode, cc is the condition under which the
+  // jump is taken, or nullopt if it is unconditional, and target_stack is the
+  // stack at the target
+  //
+  // stack is the stack at next, a translator that continues at the target
+  // replaces it with target_stack.
+  virtual void branch(std::optional<condition_code> cc, std::size_t target,
+                      std::size_t next, const TypeStack& target_stack,
+                      TypeStack& stack) = 0;
+
+  // Size of the native stack frame, keeps rsp aligned to 16 bytes
+  [[nodiscard]] auto frame_size() const -> std::uint32_t
+  {
+    return static_cast<std::uint32_t>((frame_slots_ * slot_size + 15) / 16 *
+                                      16);
+  }
+
+  void prologue()
+  {
+    asm_.emit({0x53});             // push rbx
+    asm_.emit({0x48, 0x81, 0xec}); // sub rsp, frame_size
+    asm_.emit_u32(frame_size());
+    asm_.emit({0x48, 0x89, 0xe3}); // mov rbx, rsp
+  }
+
+  void epilogue()
+  {
+    asm_.emit({0x48, 0x81, 0xc4}); // add rsp, frame_size
+    asm_.emit_u32(frame_size());
+    asm_.emit({0x5b, 0xc3}); // pop rbx; ret
+  }
+
+  // Translates one instruction, returns false if it is not supported
+  auto instruction(opcode op, const std::byte* operand, std::size_t next,
+                   TypeStack& stack) -> bool
+  {
+    const auto depth = stack.size();
+    const auto jump_target = [&]() -> std::size_t {
+      return next + read_jump_offset(op, operand);
+    };
+
+    switch (op) {
+    case op_return:
+      return false;
+    case op_push_f64:
+    case op_push_f64_wide: {
+      const std::size_t index = op == op_push_f64
+                                    ? std::to_integer<std::size_t>(*operand)
+                                    : read_u32(operand);
+      const auto constant = code_.constants[index];
+      push(stack, stack_type_of(constant), payload_of(constant));
+    } break;
+    case op_push_f64_imm:
+      push_number(stack, read_f64(operand));
+      break;
+    case op_push_f64_small:
+      push_number(stack,
+                  static_cast<double>(std::to_integer<std::int8_t>(*operand)));
+      break;
+    case op_push_f64_zero:
+      push_number(stack, 0.);
+      break;
+    case op_push_f64_one:
+      push_number(stack, 1.);
+      break;
+    case op_push_f64_minus_one:
+      push_number(stack, -1.);
+      break;
+    case op_push_negate_f64:
+      push_number(stack, -read_f64(operand));
+      break;
+    case op_pop:
+      stack.pop_back();
+      break;
+    case op_true:
+      push(stack, StackType::boolean, 1);
+      break;
+    case op_false:
+      push(stack, StackType::boolean, 0);
+      break;
+    case op_unit:
+      push(stack, StackType::unit, 0);
+      break;
+    case op_negate_f64:
+      asm_.load_rax(location_of(depth - 1));
+      asm_.emit({0x48, 0x0f, 0xba, 0xf8, 0x3f}); // btc rax, 63
+      asm_.store_rax(location_of(depth - 1));
+      break;
+    case op_not:
+      asm_.load_rax(location_of(depth - 1));
+      asm_.emit({0x83, 0xf0, 0x01}); // xor eax, 1
+      asm_.store_rax(location_of(depth - 1));
+      break;
+    case op_add_f64:
+    case op_subtract_f64:
+    case op_multiply_f64:
+    case op_divide_f64:
+      arithmetic(op, depth - 2, location_of(depth - 1));
+      stack.pop_back();
+      break;
+    case op_push_add_f64:
+    case op_push_subtract_f64:
+    case op_push_multiply_f64:
+    case op_push_divide_f64:
+      asm_.mov_rax(bit_cast<std::uint64_t>(read_f64(operand)));
+      asm_.store_rax(register_location(immediate_xmm));
+      arithmetic(op, depth - 1, register_location(immediate_xmm));
+      break;
+    case op_equal:
+    case op_not_equal:
+    case op_equal_f64:
+    case op_not_equal_f64:
+    case op_equal_bool:
+    case op_not_equal_bool:
+      // The verifier knows the types of the operands of the generic forms too
+      equality(op == op_equal || op == op_equal_f64 || op == op_equal_bool,
+               stack, &equal_references);
+      stack.pop_back();
+      stack.back() = StackType::boolean;
+      break;
+    case op_equal_string:
+    case op_not_equal_string:
+      equality(op == op_equal_string, stack, &equal_string_references);
+      stack.pop_back();
+      stack.back() = StackType::boolean;
+      break;
+    case op_less_f64:
+    case op_less_equal_f64:
+    case op_greater_f64:
+    case op_greater_equal_f64:
+      asm_.setcc_al(compare(op, depth));
+      asm_.emit({0x0f, 0xb6, 0xc0}); // movzx eax, al
+      asm_.store_rax(location_of(depth - 2));
+      stack.pop_back();
+      stack.back() = StackType::boolean;
+      break;
+    case op_jmp:
+    case op_jmp_wide:
+      branch(std::nullopt, jump_target(), next, stack, stack);
+      break;
+    case op_jmp_false:
+    case op_jmp_false_wide:
+      asm_.load_rax(location_of(depth - 1));
+      asm_.emit({0x85, 0xc0}); // test eax, eax
+      stack.pop_back();
+      branch(cc_equal, jump_target(), next, stack, stack);
+      break;
+    case op_jmp_false_push_f64:
+    case op_jmp_false_push_f64_wide: {
+      asm_.load_rax(location_of(depth - 1));
+      asm_.emit({0x85, 0xc0}); // test eax, eax
+      stack.pop_back();
+      const auto target_stack = stack;
+      // Pushing before the branch keeps the flags, and the side exits of a
+      // trace at next find the number in its slot
+      push_number(stack, read_f64(operand + jump_offset_size(
+                                                operand_kind_of(op))));
+      branch(cc_equal, jump_target(), next, target_stack, stack);
+    } break;
+    case op_push2_f64:
+      push_number(stack, read_f64(operand));
+      push_number(stack, read_f64(operand + sizeof(double)));
+      break;
+    case op_less_f64_jmp_false:
+    case op_less_equal_f64_jmp_false:
+    case op_greater_f64_jmp_false:
+    case op_greater_equal_f64_jmp_false:
+    case op_less_f64_jmp_false_wide:
+    case op_less_equal_f64_jmp_false_wide:
+    case op_greater_f64_jmp_false_wide:
+    case op_greater_equal_f64_jmp_false_wide: {
+      // Jumps when the comparison does not hold, which includes unordered
+      const auto cc = negated(compare(op, depth));
+      stack.resize(depth - 2);
+      branch(cc, jump_target(), next, stack, stack);
+    } break;
+    }
+    return true;
+  }
+
+  void push(TypeStack& stack, StackType type, std::uint64_t payload)
+  {
+    asm_.mov_rax(payload);
+    asm_.store_rax(location_of(stack.size()));
+    stack.push_back(type);
+  }
+
+  void push_number(TypeStack& stack, double number)
+  {
+    push(stack, StackType::number, bit_cast<std::uint64_t>(number));
+  }
+
+  // Applies the arithmetic of op to the number in slot lhs and rhs
+  void arithmetic(opcode op, std::size_t lhs, Location rhs)
+  {
+    std::uint8_t sse_op = 0;
+    switch (op) {
+    case op_add_f64:
+    case op_push_add_f64:
+      sse_op = 0x58; // addsd
+      break;
+    case op_subtract_f64:
+    case op_push_subtract_f64:
+      sse_op = 0x5c; // subsd
+      break;
+    case op_multiply_f64:
+    case op_push_multiply_f64:
+      sse_op = 0x59; // mulsd
+      break;
+    case op_divide_f64:
+    case op_push_divide_f64:
+      sse_op = 0x5e; // divsd
+      break;
+    default:
+      EML_UNREACHABLE();
+    }
+
+    const auto location = location_of(lhs);
+    if (location.in_register) {
+      asm_.sse(0xf2, sse_op, location.xmm, rhs);
+    } else {
+      asm_.load_xmm(scratch_xmm, location);
+      asm_.sse(0xf2, sse_op, scratch_xmm, rhs);
+      asm_.store_xmm(location, scratch_xmm);
+    }
+  }
+
+  // ucomisd of the slots lhs and rhs
+  void ucomisd(std::size_t lhs, std::size_t rhs)
+  {
+    auto location = location_of(lhs);
+    if (!location.in_register) {
+      asm_.load_xmm(scratch_xmm, location);
+      location = register_location(scratch_xmm);
+    }
+    asm_.sse(0x66, 0x2e, location.xmm, location_of(rhs));
+  }
+
+  // Compares the two numbers on top of the stack, returns the condition code
+  // that holds when the comparison of op holds
+  //
+  // Comparisons are arranged as "above" tests, which are false on unordered
+  // operands, the same as the comparisons of C++ on NaN.
+  auto compare(opcode op, std::size_t depth) -> condition_code
+  {
+    const auto lhs = depth - 2;
+    const auto rhs = depth - 1;
+    switch (op) {
+    case op_less_f64:
+    case op_less_f64_jmp_false:
+    case op_less_f64_jmp_false_wide:
+      ucomisd(rhs, lhs);
+      return cc_above;
+    case op_less_equal_f64:
+    case op_less_equal_f64_jmp_false:
+    case op_less_equal_f64_jmp_false_wide:
+      ucomisd(rhs, lhs);
+      return cc_above_equal;
+    case op_greater_f64:
+    case op_greater_f64_jmp_false:
+    case op_greater_f64_jmp_false_wide:
+      ucomisd(lhs, rhs);
+      return cc_above;
+    case op_greater_equal_f64:
+    case op_greater_equal_f64_jmp_false:
+    case op_greater_equal_f64_jmp_false_wide:
+      ucomisd(lhs, rhs);
+      return cc_above_equal;
+    default:
+      EML_UNREACHABLE();
+    }
+  }
+
+  // Stores whether the two values on top of the stack are equal into the
+  // slot of the left one, references are compared by compare_references
+  void equality(bool equal, const TypeStack& stack,
+                RuntimeEquality compare_references)
+  {
+    const auto lhs = stack.size() - 2;
+    const auto rhs = stack.size() - 1;
+    switch (stack.back()) {
+    case StackType::number:
+      // Equal requires ZF set and PF clear, unordered operands set both
+      ucomisd(lhs, rhs);
+      if (equal) {
+        asm_.setcc_al(cc_equal);
+        asm_.setcc_cl(cc_not_parity);
+        asm_.emit({0x20, 0xc8}); // and al, cl
+      } else {
+        asm_.setcc_al(cc_not_equal);
+        asm_.setcc_cl(cc_parity);
+        asm_.emit({0x08, 0xc8}); // or al, cl
+      }
+      asm_.emit({0x0f, 0xb6, 0xc0}); // movzx eax, al
+      break;
+    case StackType::boolean:
+      asm_.load_rax(location_of(rhs));
+      asm_.emit({0x48, 0x89, 0xc1}); // mov rcx, rax
+      asm_.load_rax(location_of(lhs));
+      asm_.emit({0x48, 0x39, 0xc8}); // cmp rax, rcx
+      asm_.setcc_al(equal ? cc_equal : cc_not_equal);
+      asm_.emit({0x0f, 0xb6, 0xc0}); // movzx eax, al
+      break;
+    case StackType::unit:
+      asm_.mov_rax(equal ? std::uint64_t{1} : std::uint64_t{0});
+      break;
+    case StackType::reference:
+      call_equality(compare_references, lhs, rhs);
+      if (!equal) {
+        asm_.emit({0x83, 0xf0, 0x01}); // xor eax, 1
+      }
+      // The call clobbered the registers, so the result goes to the frame
+      // and the slots below get reloaded
+      asm_.store_rax(frame_location(lhs));
+      for (std::size_t slot = 0; slot <= lhs && slot < register_slots;
+           ++slot) {
+        asm_.load_xmm(static_cast<std::uint8_t>(slot), frame_location(slot));
+      }
+      return;
+    }
+    asm_.store_rax(location_of(lhs));
+  }
+
+  // Calls function with the slots lhs and rhs, the result is in rax
+  //
+  // Every xmm register is caller saved, so the slots in registers are spilled
+  // to their cells in the frame first.
+  void call_equality(RuntimeEquality function, std::size_t lhs,
+                     std::size_t rhs)
+  {
+    for (std::size_t slot = 0; slot <= rhs && slot < register_slots; ++slot) {
+      asm_.store_xmm(frame_location(slot), static_cast<std::uint8_t>(slot));
+    }
+    asm_.load_rax(frame_location(rhs));
+    asm_.emit({0x48, 0x89, 0xc6}); // mov rsi, rax
+    asm_.load_rax(frame_location(lhs));
+    asm_.emit({0x48, 0x89, 0xc7}); // mov rdi, rax
+    asm_.mov_rax(reinterpret_cast<std::uintptr_t>(function));
+    asm_.emit({0xff, 0xd0}); // call rax
+  }
+
+  const Bytecode& code_;
+  std::size_t frame_slots_;
+  Assembler asm_;
+};
+
+// Translates a whole verified chunk, the native function returns the payload
+// of the result
+class ChunkTranslator : public Emitter {
+public:
+  explicit ChunkTranslator(const VerifiedBytecode& code)
+      : Emitter{code.code(), code.max_stack_depth()},
+        max_depth_{code.max_stack_depth()},
+        stack_at_(code.code().instructions.size() + 1),
+        jumps_to_(code.code().instructions.size() + 1)
+  {
+  }
+
+  // Returns the stack at the end of the chunk, or nullopt if the chunk can
+  // not be translated
+  auto translate() -> std::optional<TypeStack>
+  {
+    if (max_depth_ > max_native_stack_depth) {
+      return {};
+    }
+
+    prologue();
+
+    const auto& instructions = code_.instructions;
+    std::optional<TypeStack> stack = TypeStack{};
+    for (std::size_t offset = 0; offset < instructions.size();) {
+      bind(offset, stack);
+      if (std::to_integer<std::size_t>(instructions[offset]) >= opcode_count) {
+        EML_ASSERT(!stack, "Only unreachable code can hold garbage");
+        break;
+      }
+      const auto op = static_cast<opcode>(instructions[offset]);
+      const auto next = offset + instruction_size(op);
+      if (stack) {
+        if (!instruction(op, &instructions[offset] + 1, next, *stack)) {
+          return {};
+        }
+        if (op == op_jmp || op == op_jmp_wide) {
+          stack.reset();
+        }
+      }
+      offset = next;
+    }
+    bind(instructions.size(), stack);
+    EML_ASSERT(stack.has_value(), "The end of a chunk is always reachable");
+
+    if (!stack->empty()) {
+      asm_.load_rax(location_of(stack->size() - 1));
+    }
+    epilogue();
+    return stack;
+  }
+
+private:
+  void branch(std::optional<condition_code> cc, std::size_t target,
+              std::size_t /*next*/, const TypeStack& target_stack,
+              TypeStack& /*stack*/) override
+  {
+    jumps_to_[target].push_back(cc ? asm_.jcc(*cc) : asm_.jmp());
+    stack_at_[target] = target_stack;
+  }
+
+  // Resolves the jumps to offset, and picks up the stack they carry when the
+  // previous instruction does not fall through
+  void bind(std::size_t offset, std::optional<TypeStack>& stack)
+  {
+    for (const auto position : jumps_to_[offset]) {
+      asm_.bind(position);
+    }
+    if (!stack && stack_at_[offset]) {
+      stack = stack_at_[offset];
+    }
+  }
+
+  std::size_t max_depth_;
+
+  // The stack that jumps carry to their targets
+  std::vector<std::optional<TypeStack>> stack_at_;
+  // Positions of the displacements of the jumps to every offset
+  std::vector<std::vector<std::size_t>> jumps_to_;
+};
+
+// A guard of a trace, the interpreter resumes at offset with stack when the
+// guard fails
+struct SideExit {
+  std::size_t offset;
+  TypeStack stack;
+  std::size_t jump_position; // Position of the displacement of the guard
+};
+
+// Translates a trace, the native function writes the result or the stack of
+// a side exit to its argument, and returns 0 when the trace runs to the end
+// or the index of the failed side exit plus one
+class TraceTranslator : public Emitter {
+public:
+  TraceTranslator(const VerifiedBytecode& code, const Trace& trace)
+      : Emitter{code.code(), code.max_stack_depth() + 1},
+        max_depth_{code.max_stack_depth()},
+        output_cell_{frame_location(code.max_stack_depth())}, trace_{trace}
+  {
+  }
+
+  // Returns the stack at the end of the trace, or nullopt if the trace is not
+  // a path through the chunk or can not be translated
+  auto translate() -> std::optional<TypeStack>
+  {
+    if (max_depth_ > max_native_stack_depth) {
+      return {};
+    }
+
+    prologue();
+    asm_.emit({0x48, 0x89, 0xbb}); // mov [rbx + output_cell], rdi
+    asm_.emit_u32(static_cast<std::uint32_t>(output_cell_.displacement));
+
+    const auto& instructions = code_.instructions;
+    const auto& offsets = trace_.offsets;
+    TypeStack stack;
+    std::size_t expected_offset = 0;
+    for (std::size_t i = 0; i < offsets.size(); ++i) {
+      const auto offset = offsets[i];
+      if (offset != expected_offset || offset >= instructions.size() ||
+          std::to_integer<std::size_t>(instructions[offset]) >= opcode_count) {
+        return {};
+      }
+      const auto op = static_cast<opcode>(instructions[offset]);
+      const auto next = offset + instruction_size(op);
+      if (next > instructions.size()) {
+        return {};
+      }
+
+      following_ = i + 1 < offsets.size() ? offsets[i + 1]
+                                          : instructions.size();
+      successor_ = next;
+      if (!instruction(op, &instructions[offset] + 1, next, stack) ||
+          !successor_) {
+        return {};
+      }
+      expected_offset = *successor_;
+    }
+    if (expected_offset != instructions.size()) {
+      return {};
+    }
+
+    load_output_pointer();
+    if (!stack.empty()) {
+      asm_.load_rax(location_of(stack.size() - 1));
+      asm_.emit({0x48, 0x89, 0x01}); // mov [rcx], rax
+    }
+    asm_.emit({0x31, 0xc0}); // xor eax, eax
+    epilogue();
+
+    for (std::size_t i = 0; i < exits_.size(); ++i) {
+      const auto& exit = exits_[i];
+      asm_.bind(exit.jump_position);
+      load_output_pointer();
+      for (std::size_t slot = 0; slot < exit.stack.size(); ++slot) {
+        asm_.load_rax(location_of(slot));
+        asm_.emit({0x48, 0x89, 0x81}); // mov [rcx + slot * 8], rax
+        asm_.emit_u32(static_cast<std::uint32_t>(slot * slot_size));
+      }
+      asm_.mov_rax(i + 1);
+      epilogue();
+    }
+    return stack;
+  }
+
+  [[nodiscard]] auto exits() const noexcept -> const std::vector<SideExit>&
+  {
+    return exits_;
+  }
+
+private:
+  // Turns the jumps of the bytecode into guards that check that the run
+  // follows the trace
+  void branch(std::optional<condition_code> cc, std::size_t target,
+              std::size_t next, const TypeStack& target_stack,
+              TypeStack& stack) override
+  {
+    if (!cc) {
+      successor_ = target;
+      return;
+    }
+    if (target == next) {
+      return;
+    }
+
+    if (following_ == target) {
+      exits_.push_back(SideExit{next, stack, asm_.jcc(negated(*cc))});
+      stack = target_stack;
+    } else if (following_ == next) {
+      exits_.push_back(SideExit{target, target_stack, asm_.jcc(*cc)});
+    } else {
+      successor_.reset();
+      return;
+    }
+    successor_ = following_;
+  }
+
+  // mov rcx, [rbx + output_cell]
+  void load_output_pointer()
+  {
+    asm_.emit({0x48, 0x8b, 0x8b});
+    asm_.emit_u32(static_cast<std::uint32_t>(output_cell_.displacement));
+  }
+
+  std::size_t max_depth_;
+  // The cell of the frame that holds the argument of the native function
+  Location output_cell_;
+  const Trace& trace_;
+
+  // The offset of the instruction after the current one in the trace
+  std::size_t following_ = 0;
+  // The offset that the current instruction continues at on the trace, or
+  // nullopt if the trace does not follow the current instruction
+  std::optional<std::size_t> successor_;
+  std::vector<SideExit> exits_;
+};
+
+// Machine code in a buffer that is never writable and executable at the same
+// time
+class ExecutableBuffer {
+public:
+  // Copies machine code to a new executable buffer
+  static auto create(const std::vector<std::uint8_t>& machine_code)
+      -> std::optional<ExecutableBuffer>
+  {
+    const auto size = machine_code.size();
+    void* buffer = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buffer == MAP_FAILED) {
+      return {};
+    }
+    std::memcpy(buffer, machine_code.data(), size);
+    if (mprotect(buffer, size, PROT_READ | PROT_EXEC) != 0) {
+      munmap(buffer, size);
+      return {};
+    }
+    return ExecutableBuffer{buffer, size};
+  }
+
+  ~ExecutableBuffer()
+  {
+    if (buffer_ != nullptr) {
+      munmap(buffer_, size_);
+    }
+  }
+
+  ExecutableBuffer(const ExecutableBuffer& other) = delete;
+  auto operator=(const ExecutableBuffer& other) -> ExecutableBuffer& = delete;
+  ExecutableBuffer(ExecutableBuffer&& other) noexcept
+      : buffer_{std::exchange(other.buffer_, nullptr)}, size_{other.size_}
+  {
+  }
+  auto operator=(ExecutableBuffer&& other) -> ExecutableBuffer& = delete;
+
+  template <typename Function> [[nodiscard]] auto function() const -> Function
+  {
+    return reinterpret_cast<Function>(buffer_);
+  }
+
+private:
+  ExecutableBuffer(void* buffer, std::size_t size)
+      : buffer_{buffer}, size_{size}
+  {
+  }
+
+  void* buffer_;
+  std::size_t size_;
+};
+
+// Signature of the translated traces
+using TraceFunction = std::uint64_t (*)(std::uint64_t* output);
+
+} // anonymous namespace
+
+/**
+ * @brief The native code of a chunk in an executable buffer
+ */
+struct NativeCode {
+  ExecutableBuffer buffer;
+  std::optional<StackType> result_type;
+
+  [[nodiscard]] auto run() const -> std::optional<Value>
+  {
+    const auto payload = buffer.function<NativeFunction>()();
+    if (!result_type) {
+      return {};
+    }
+    return value_of(*result_type, payload);
+  }
+};
+
+/**
+ * @brief The native code of a trace in an executable buffer
+ */
+struct NativeTrace {
+  ExecutableBuffer buffer;
+  std::optional<StackType> result_type;
+  std::vector<SideExit> exits;
+  std::vector<std::uint64_t> output; // The result or the stack of a side exit
+};
+
+JitBytecode::JitBytecode(VerifiedBytecode code) : code_{std::move(code)}
+{
+  ChunkTranslator translator{code_};
+  const auto stack = translator.translate();
+  if (!stack) {
+    return;
+  }
+  if (auto buffer = ExecutableBuffer::create(translator.machine_code());
+      buffer) {
+    native_ = std::make_unique<NativeCode>(NativeCode{
+        std::move(*buffer),
+        stack->empty() ? std::nullopt : std::optional{stack->back()}});
+  }
+}
+
+auto JitBytecode::run_native() const -> std::optional<Value>
+{
+  return native_->run();
+}
+
+auto TracingBytecode::install_trace(const Trace& trace) -> bool
+{
+  TraceTranslator translator{code_, trace};
+  const auto stack = translator.translate();
+  if (!stack) {
+    return false;
+  }
+  auto buffer = ExecutableBuffer::create(translator.machine_code());
+  if (!buffer) {
+    return false;
+  }
+
+  trace_ = std::make_unique<NativeTrace>(NativeTrace{
+      std::move(*buffer),
+      stack->empty() ? std::nullopt : std::optional{stack->back()},
+      translator.exits(),
+      std::vector<std::uint64_t>(std::max(code_.max_stack_depth(),
+                                          std::size_t{1}))});
+  guard_failures_of_trace_ = 0;
+  ++stats_.traces_compiled;
+  return true;
+}
+
+auto TracingBytecode::run_trace(Value* stack, std::optional<Value>& result)
+    -> std::optional<TraceExit>
+{
+  auto& output = trace_->output;
+  const auto exit = trace_->buffer.function<TraceFunction>()(output.data());
+  if (exit == 0) {
+    if (trace_->result_type) {
+      result = value_of(*trace_->result_type, output.front());
+    } else {
+      result.reset();
+    }
+    return {};
+  }
+
+  const auto& side_exit = trace_->exits[exit - 1];
+  for (std::size_t slot = 0; slot < side_exit.stack.size(); ++slot) {
+    stack[slot] = value_of(side_exit.stack[slot], output[slot]);
+  }
+  return TraceExit{side_exit.offset, side_exit.stack.size()};
+}
+
+#else
+
+// Without a jit every chunk falls back to the interpreter
+struct NativeCode {
+};
+
+struct NativeTrace {
+};
+
+JitBytecode::JitBytecode(VerifiedBytecode code) : code_{std::move(code)} {}
+
+auto JitBytecode::run_native() const -> std::optional<Value>
+{
+  EML_UNREACHABLE();
+}
+
+auto TracingBytecode::install_trace(const Trace& /*trace*/) -> bool
+{
+  return false;
+}
+
+auto TracingBytecode::run_trace(Value* /*stack*/,
+                                std::optional<Value>& /*result*/)
+    -> std::optional<TraceExit>
+{
+  EML_UNREACHABLE();
+}
+
+#endif
+
+JitBytecode::~JitBytecode() = default;
+JitBytecode::JitBytecode(JitBytecode&& other) noexcept = default;
+auto JitBytecode::operator=(JitBytecode&& other) noexcept
+    -> JitBytecode& = default;
+
+TracingBytecode::TracingBytecode(VerifiedBytecode code,
+                                 std::size_t hot_threshold)
+    : code_{std::move(code)}, hot_threshold_{hot_threshold}
+{
+}
+
+TracingBytecode::~TracingBytecode() = default;
+TracingBytecode::TracingBytecode(TracingBytecode&& other) noexcept = default;
+auto TracingBytecode::operator=(TracingBytecode&& other) noexcept
+    -> TracingBytecode& = default;
+
+void TracingBytecode::discard_trace() noexcept
+{
+  trace_.reset();
+  guard_failures_of_trace_ = 0;
+  runs_without_trace_ = 0;
+}
+
+} // namespace eml
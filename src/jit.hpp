@@ -0,0 +1,194 @@
+#ifndef EML_JIT_HPP
+#define EML_JIT_HPP
+
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "verifier.hpp"
+
+/**
+ * @file jit.hpp
+ * @brief The baseline and the tracing compilers from verified bytecode to
+ * native code
+ */
+
+namespace eml {
+
+struct NativeCode;
+
+/**
+ * @brief A verified chunk together with its native code
+ *
+ * The constructor translates the chunk into x86-64 machine code in an
+ * executable buffer. Every stack slot has a fixed home, the first ones in SSE
+ * registers and the deeper ones in the native stack frame, so numbers never
+ * leave the SSE registers between instructions, and jumps become native
+ * branches. Reference equality calls back into the runtime.
+ *
+ * Chunks that the jit can not translate fall back to the interpreter: the
+ * jit is only available on x86-64 Linux with the `EML_JIT` option, and
+ * refuses chunks whose stack is too deep for a native stack frame.
+ * @ref VM::interpret runs the native code when there is one, with the same
+ * results as the interpreter bit for bit.
+ */
+class JitBytecode {
+public:
+  explicit JitBytecode(VerifiedBytecode code);
+  ~JitBytecode();
+
+  JitBytecode(const JitBytecode& other) = delete;
+  auto operator=(const JitBytecode& other) -> JitBytecode& = delete;
+  JitBytecode(JitBytecode&& other) noexcept;
+  auto operator=(JitBytecode&& other) noexcept -> JitBytecode&;
+
+  /// @brief Returns the verified chunk
+  [[nodiscard]] auto code() const noexcept -> const VerifiedBytecode&
+  {
+    return code_;
+  }
+
+  /// @brief Returns whether the chunk was translated to native code
+  [[nodiscard]] auto is_native() const noexcept -> bool
+  {
+    return native_ != nullptr;
+  }
+
+private:
+  friend class VM;
+
+  // Runs the native code
+  // Warning: Calling it on a chunk without native code is undefined.
+  [[nodiscard]] auto run_native() const -> std::optional<Value>;
+
+  VerifiedBytecode code_;
+  std::unique_ptr<NativeCode> native_;
+};
+
+/**
+ * @brief The byte offsets of the instructions that one run of a chunk went
+ * through, in order
+ */
+struct Trace {
+  std::vector<std::size_t> offsets;
+};
+
+/**
+ * @brief The counters of a @ref TracingBytecode
+ */
+struct TraceStats {
+  std::size_t interpreted_runs = 0; ///< @brief Runs without a trace to enter
+  std::size_t traces_compiled = 0;
+  std::size_t trace_entries = 0;
+  std::size_t guard_failures = 0;
+  /// @brief Time spent in the native code of traces, see
+  /// @ref TracingBytecode::measure_time
+  std::chrono::nanoseconds native_time{};
+  /// @brief Time spent in the interpreter, including after side exits
+  std::chrono::nanoseconds interpreted_time{};
+};
+
+struct NativeTrace;
+
+/**
+ * @brief A verified chunk that compiles the path it runs through once the
+ * path gets hot
+ *
+ * @ref VM::interpret interprets the chunk until it has run hot_threshold
+ * times, then records the instructions that the next run executes and
+ * compiles that linear trace to native code. The conditional jumps of the
+ * bytecode become guards in the trace: when a later run takes another branch,
+ * the native code side exits and the interpreter resumes at the branch with
+ * the stack of the trace. A trace whose guards failed hot_threshold times is
+ * discarded, and the chunk gets recorded again once it is hot.
+ *
+ * Without the jit (see @ref JitBytecode) chunks always run on the
+ * interpreter.
+ */
+class TracingBytecode {
+public:
+  /// @brief The default number of runs after which a chunk is hot
+  static constexpr std::size_t default_hot_threshold = 8;
+
+  explicit TracingBytecode(VerifiedBytecode code,
+                           std::size_t hot_threshold = default_hot_threshold);
+  ~TracingBytecode();
+
+  TracingBytecode(const TracingBytecode& other) = delete;
+  auto operator=(const TracingBytecode& other) -> TracingBytecode& = delete;
+  TracingBytecode(TracingBytecode&& other) noexcept;
+  auto operator=(TracingBytecode&& other) noexcept -> TracingBytecode&;
+
+  /// @brief Returns the verified chunk
+  [[nodiscard]] auto code() const noexcept -> const VerifiedBytecode&
+  {
+    return code_;
+  }
+
+  /// @brief Returns whether the chunk has a compiled trace
+  [[nodiscard]] auto has_trace() const noexcept -> bool
+  {
+    return trace_ != nullptr;
+  }
+
+  [[nodiscard]] auto stats() const noexcept -> const TraceStats&
+  {
+    return stats_;
+  }
+
+  /**
+   * @brief Compiles a trace of the chunk and uses it for the following runs
+   *
+   * The trace must be a path from the first instruction to the end of the
+   * chunk, for example a trace recorded by an earlier process.
+   *
+   * @return false if the trace is not a path through the chunk or can not be
+   * compiled
+   */
+  auto install_trace(const Trace& trace) -> bool;
+
+  /// @brief Drops the compiled trace, the chunk runs on the interpreter again
+  void discard_trace() noexcept;
+
+  /**
+   * @brief Enables the time counters of the stats
+   *
+   * Reading the clock takes longer than running a small chunk on a trace, so
+   * the times are only measured on demand.
+   */
+  void measure_time(bool enabled) noexcept
+  {
+    measure_time_ = enabled;
+  }
+
+private:
+  friend class VM;
+
+  // Where the interpreter resumes after a side exit
+  struct TraceExit {
+    std::size_t offset;
+    std::size_t depth; // Number of values on the stack
+  };
+
+  // Runs the native code of the trace
+  //
+  // Returns nullopt and stores the result of the chunk into result when the
+  // trace runs to the end. Returns where the interpreter resumes and writes
+  // the stack to stack when a guard fails.
+  // Warning: Calling it on a chunk without trace is undefined.
+  auto run_trace(Value* stack, std::optional<Value>& result)
+      -> std::optional<TraceExit>;
+
+  VerifiedBytecode code_;
+  std::size_t hot_threshold_;
+  std::unique_ptr<NativeTrace> trace_;
+  std::size_t runs_without_trace_ = 0;
+  std::size_t guard_failures_of_trace_ = 0;
+  bool measure_time_ = false;
+  TraceStats stats_;
+};
+
+} // namespace eml
+
+#endif // EML_JIT_HPP
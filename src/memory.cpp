@@ -1,45 +1,325 @@
+#include <algorithm>
 #include <cstdlib>
+#include <cstring>
 #include <new>
+#include <utility>
 
 #include "memory.hpp"
 
 namespace eml {
 
+struct GcRoots::Registry {
+  std::vector<std::pair<std::size_t, GarbageCollector::RootTracer>> tracers;
+  std::size_t next_id = 0;
+};
+
+GcRoots::~GcRoots()
+{
+  if (registry_ == nullptr) {
+    return;
+  }
+  auto& tracers = registry_->tracers;
+  tracers.erase(std::find_if(tracers.begin(), tracers.end(),
+                             [this](const auto& entry) {
+                               return entry.first == id_;
+                             }));
+}
+
+auto GcRoots::operator=(GcRoots&& other) noexcept -> GcRoots&
+{
+  std::swap(registry_, other.registry_);
+  std::swap(id_, other.id_);
+  return *this;
+}
+
+namespace {
+
+// Objects in the nursery start at multiples of this
+constexpr std::size_t nursery_alignment = alignof(std::max_align_t);
+
+auto allocate_block(std::size_t size) -> std::byte*
+{
+  return static_cast<std::byte*>(
+      ::operator new(size, std::align_val_t{alignof(std::max_align_t)}));
+}
+
+} // anonymous namespace
+
+GarbageCollector::GarbageCollector(GarbageCollectorConfig config)
+    : config_{config}, roots_{std::make_shared<GcRoots::Registry>()}
+{
+  if (config_.generational) {
+    nursery_.reset(allocate_block(config_.nursery_size));
+  }
+}
+
 GarbageCollector::~GarbageCollector()
 {
-  Obj* object = root_;
+  Obj* object = large_objects_;
   while (object != nullptr) {
     Obj* next = object->next();
-
-    // const std::size_t allocate_size = sizeof(Obj) - 1 + object->size();
-
     object->~Obj();
     std::free(object);
-
     object = next;
   }
 }
 
 GarbageCollector::GarbageCollector(GarbageCollector&& other) noexcept
-    : root_{other.root_}
+    : config_{other.config_},
+      small_objects_{std::move(other.small_objects_)},
+      large_objects_{std::exchange(other.large_objects_, nullptr)},
+      nursery_{std::move(other.nursery_)},
+      nursery_used_{std::exchange(other.nursery_used_, 0)},
+      nursery_heap_size_{std::exchange(other.nursery_heap_size_, 0)},
+      roots_{std::move(other.roots_)},
+      heap_size_{std::exchange(other.heap_size_, 0)},
+      next_collection_{other.next_collection_},
+      collections_{other.collections_},
+      nursery_collections_{other.nursery_collections_}
 {
-  other.root_ = nullptr;
 }
 
 auto GarbageCollector::operator=(GarbageCollector&& other) noexcept
     -> GarbageCollector&
 {
-  std::swap(root_, other.root_);
+  std::swap(config_, other.config_);
+  std::swap(small_objects_, other.small_objects_);
+  std::swap(large_objects_, other.large_objects_);
+  std::swap(nursery_, other.nursery_);
+  std::swap(nursery_used_, other.nursery_used_);
+  std::swap(nursery_heap_size_, other.nursery_heap_size_);
+  std::swap(roots_, other.roots_);
+  std::swap(heap_size_, other.heap_size_);
+  std::swap(next_collection_, other.next_collection_);
+  std::swap(collections_, other.collections_);
+  std::swap(nursery_collections_, other.nursery_collections_);
   return *this;
 }
 
+void GarbageCollector::BlockDeleter::operator()(std::byte* block) const
+    noexcept
+{
+  ::operator delete(block, std::align_val_t{alignof(std::max_align_t)});
+}
+
+auto GarbageCollector::size_class_of(std::size_t size) noexcept
+    -> std::size_t
+{
+  EML_ASSERT(size <= max_small_object_size, "The object must be small");
+  return static_cast<std::size_t>(
+      std::lower_bound(size_classes.begin(), size_classes.end(), size) -
+      size_classes.begin());
+}
+
 auto GarbageCollector::allocate(std::size_t bytes) -> GcPointer
 {
-  const std::size_t allocate_size = sizeof(Obj) - 1 + bytes;
-  void* ptr = std::malloc(allocate_size);
-  auto* object = new (ptr) Obj{bytes, root_};
-  root_ = object;
+  const auto size = object_size(bytes);
+  if (size > max_small_object_size) {
+    auto* object = allocate_large(bytes);
+    heap_size_ += size;
+    return GcPointer{object};
+  }
+
+  // Once the nursery is full, objects go to the blocks until the next
+  // collection, since allocating never collects
+  auto* object = allocate_young(bytes);
+  if (object != nullptr) {
+    nursery_heap_size_ += size;
+  } else {
+    object = allocate_small(bytes);
+  }
+  heap_size_ += size;
   return GcPointer{object};
 }
 
+auto GarbageCollector::allocate_young(std::size_t bytes) noexcept -> Obj*
+{
+  const auto size = object_size(bytes);
+  const auto padded_size =
+      (size + nursery_alignment - 1) / nursery_alignment * nursery_alignment;
+  if (nursery_ == nullptr ||
+      padded_size > config_.nursery_size - nursery_used_) {
+    return nullptr;
+  }
+  void* storage = nursery_.get() + nursery_used_;
+  nursery_used_ += padded_size;
+  return new (storage) Obj{bytes, nullptr, 0};
+}
+
+auto GarbageCollector::promote(Obj* object) -> Obj*
+{
+  if (object->flags_ & Obj::forwarded) {
+    return object->next_;
+  }
+  Obj* copy = allocate_small(object->size());
+  std::memcpy(copy->data(), object->data(), object->size());
+  heap_size_ += object_size(object->size());
+  object->flags_ |= Obj::forwarded;
+  object->next_ = copy;
+  return copy;
+}
+
+void GarbageCollector::reset_nursery() noexcept
+{
+  heap_size_ -= nursery_heap_size_;
+  nursery_heap_size_ = 0;
+  nursery_used_ = 0;
+}
+
+auto GarbageCollector::allocate_small(std::size_t bytes) -> Obj*
+{
+  const auto index = size_class_of(object_size(bytes));
+  auto& size_class = small_objects_[index];
+
+  if (Obj* cell = size_class.free_cells; cell != nullptr) {
+    size_class.free_cells = cell->next_;
+    return new (cell) Obj{bytes, nullptr, 0};
+  }
+
+  const auto cell_size = size_classes[index];
+  auto& blocks = size_class.blocks;
+  if (blocks.empty() || blocks.back().used + cell_size > block_size) {
+    auto* cells = allocate_block(block_size);
+    blocks.push_back(Block{std::unique_ptr<std::byte, BlockDeleter>{cells}, 0});
+  }
+  auto& block = blocks.back();
+  void* cell = block.cells.get() + block.used;
+  block.used += cell_size;
+  return new (cell) Obj{bytes, nullptr, 0};
+}
+
+auto GarbageCollector::allocate_large(std::size_t bytes) -> Obj*
+{
+  void* ptr = std::malloc(object_size(bytes));
+  if (ptr == nullptr) {
+    throw std::bad_alloc{};
+  }
+  auto* object = new (ptr) Obj{bytes, large_objects_, 0};
+  large_objects_ = object;
+  return object;
+}
+
+auto GarbageCollector::block_count() const noexcept -> std::size_t
+{
+  std::size_t count = 0;
+  for (const auto& size_class : small_objects_) {
+    count += size_class.blocks.size();
+  }
+  return count;
+}
+
+auto GarbageCollector::emplace(void* storage, std::size_t bytes) -> GcPointer
+{
+  return GcPointer{new (storage) Obj{bytes, nullptr, Obj::unowned}};
+}
+
+auto GarbageCollector::add_roots(RootTracer tracer) -> GcRoots
+{
+  const auto id = roots_->next_id++;
+  roots_->tracers.emplace_back(id, std::move(tracer));
+  return GcRoots{roots_, id};
+}
+
+void GarbageCollector::collect()
+{
+  // Objects do not refer to other objects, so marking the roots marks
+  // everything that is live. Marking promotes the live objects of the
+  // nursery, and their copies are marked as well.
+  for (const auto& entry : roots_->tracers) {
+    entry.second(*this);
+  }
+
+  sweep_small();
+  sweep_large();
+  reset_nursery();
+
+  ++collections_;
+  next_collection_ =
+      std::max(initial_threshold, heap_size_ * heap_growth_factor);
+}
+
+void GarbageCollector::collect_nursery()
+{
+  if (nursery_ == nullptr) {
+    return;
+  }
+
+  collecting_nursery_ = true;
+  for (const auto& entry : roots_->tracers) {
+    entry.second(*this);
+  }
+  collecting_nursery_ = false;
+
+  reset_nursery();
+  ++nursery_collections_;
+}
+
+void GarbageCollector::sweep_small() noexcept
+{
+  for (std::size_t index = 0; index < size_classes.size(); ++index) {
+    const auto cell_size = size_classes[index];
+    auto& size_class = small_objects_[index];
+    auto& blocks = size_class.blocks;
+
+    // The free cells are threaded again, without the cells of the blocks
+    // that are released
+    size_class.free_cells = nullptr;
+    auto kept = blocks.begin();
+    for (auto& block : blocks) {
+      Obj* free_cells = size_class.free_cells;
+      bool live = false;
+      for (std::size_t offset = 0; offset < block.used; offset += cell_size) {
+        auto* object = reinterpret_cast<Obj*>(block.cells.get() + offset);
+        if (object->flags_ & Obj::marked) {
+          object->flags_ &= static_cast<std::uint8_t>(~Obj::marked);
+          live = true;
+          continue;
+        }
+        if ((object->flags_ & Obj::free_cell) == 0) {
+          heap_size_ -= object_size(object->size());
+          object->flags_ = Obj::free_cell;
+        }
+        object->next_ = free_cells;
+        free_cells = object;
+      }
+
+      // Keeps the last block for bump allocation even if it is empty
+      if (live || &block == &blocks.back()) {
+        size_class.free_cells = free_cells;
+        *kept++ = std::move(block);
+      }
+    }
+    blocks.erase(kept, blocks.end());
+  }
+}
+
+void GarbageCollector::sweep_large() noexcept
+{
+  // The list runs from the newest object to the oldest. Unlinking the dead
+  // objects reverses them, so they are freed from the oldest and malloc
+  // merges them before the top of its heap grows, instead of trimming the
+  // heap on every free.
+  Obj* dead = nullptr;
+  Obj** link = &large_objects_;
+  while (*link != nullptr) {
+    Obj* object = *link;
+    if (object->flags_ & Obj::marked) {
+      object->flags_ &= static_cast<std::uint8_t>(~Obj::marked);
+      link = &object->next_;
+    } else {
+      *link = object->next_;
+      object->next_ = dead;
+      dead = object;
+    }
+  }
+
+  while (dead != nullptr) {
+    Obj* next = dead->next_;
+    heap_size_ -= object_size(dead->size());
+    dead->~Obj();
+    std::free(dead);
+    dead = next;
+  }
+}
+
 } // namespace eml
@@ -2,7 +2,12 @@
 #define EML_MEMORY_HPP
 
 #include <cstddef>
+#include <cstdint>
+#include <array>
 #include <cstring>
+#include <functional>
+#include <memory>
+#include <vector>
 
 #include "common.hpp"
 
@@ -60,12 +65,21 @@ public:
   }
 
 private:
+  // Bits of flags_
+  static constexpr std::uint8_t marked = 1;  // Reached in this collection
+  static constexpr std::uint8_t unowned = 2; // Not allocated by a collector
+  static constexpr std::uint8_t free_cell = 4; // A cell without an object
+  static constexpr std::uint8_t forwarded = 8; // Promoted out of the nursery
+
   std::size_t size_; // Does not care about strings greater than this
+  // The next large object or free cell, or the promoted copy of a forwarded
+  // object
   Obj* next_ = nullptr;
+  std::uint8_t flags_;
   std::byte data_[1];
 
-  constexpr explicit Obj(std::size_t size, Obj* next)
-      : size_{size}, next_{next}, data_{}
+  constexpr explicit Obj(std::size_t size, Obj* next, std::uint8_t flags)
+      : size_{size}, next_{next}, flags_{flags}, data_{}
   {
   }
 
@@ -88,13 +102,18 @@ public:
     return obj_;
   }
 
+  [[nodiscard]] constexpr auto get() const noexcept -> Obj*
+  {
+    return obj_;
+  }
+
   [[nodiscard]] constexpr auto operator*() const noexcept -> Obj&
   {
     return *obj_;
   }
 
-  [[nodiscard]] constexpr auto operator==(const GcPointer& other) noexcept
-      -> bool
+  [[nodiscard]] constexpr auto operator==(const GcPointer& other) const
+      noexcept -> bool
   {
     return obj_ == other.obj_;
   }
@@ -103,9 +122,96 @@ private:
   Obj* obj_;
 };
 
+/**
+ * @brief Registers the roots of an owner with a collector while it lives
+ *
+ * Returned by @ref GarbageCollector::add_roots. Destroying the handle removes
+ * the roots.
+ */
+class GcRoots {
+public:
+  GcRoots() noexcept = default;
+  ~GcRoots();
+
+  GcRoots(const GcRoots& other) = delete;
+  auto operator=(const GcRoots& other) -> GcRoots& = delete;
+  GcRoots(GcRoots&& other) noexcept = default;
+  auto operator=(GcRoots&& other) noexcept -> GcRoots&;
+
+private:
+  friend GarbageCollector;
+  struct Registry;
+
+  GcRoots(std::shared_ptr<Registry> registry, std::size_t id) noexcept
+      : registry_{std::move(registry)}, id_{id}
+  {
+  }
+
+  std::shared_ptr<Registry> registry_;
+  std::size_t id_ = 0;
+};
+
+/**
+ * @brief Runtime configuration of a @ref GarbageCollector
+ */
+struct GarbageCollectorConfig {
+  /// @brief Allocates new objects in a nursery that is collected on its own,
+  /// see @ref GarbageCollector::collect_nursery
+  ///
+  /// Collections move the objects out of the nursery and only update the
+  /// references that the roots mark, so in this mode every reference into the
+  /// nursery that outlives a compilation must be marked, not only one per
+  /// object. The compiler tenures the constants of the chunks that it
+  /// generates, see @ref GarbageCollector::tenure, so the copies of them in
+  /// verified and jit compiled chunks stay valid.
+  bool generational = false;
+  /// @brief The number of bytes of the nursery
+  std::size_t nursery_size = std::size_t{256} * 1024;
+};
+
+/**
+ * @brief A mark-and-sweep collector of the objects of eml
+ *
+ * The collector finds the live objects from the roots that their owners
+ * register with @ref add_roots: the @ref Compiler registers its globals and
+ * its cached chunks, and hosts register the chunks and values that they keep
+ * across compilations.
+ *
+ * Objects up to @ref max_small_object_size bytes are bump allocated in cells
+ * of a few size classes, carved out of blocks of @ref block_size bytes, and
+ * the cells of dead objects are reused. Larger objects have their own
+ * allocation.
+ *
+ * In generational mode, small objects start in a nursery instead, by bumping
+ * a pointer. Collecting the nursery copies the objects that the roots reach
+ * into the blocks, updates the references to them, and then reuses the whole
+ * nursery, so its cost follows the live objects and not the dead ones.
+ * Objects hold no references to other objects, so the roots are the only
+ * references into the nursery: they take the place of a remembered set, and
+ * storing a reference needs no write barrier.
+ *
+ * Allocating never collects, since the parser holds references to the objects
+ * that it just allocated. Instead, the compiler calls @ref collect_if_needed
+ * before every compilation, which collects once the heap grew past a threshold
+ * that follows the size of the live heap.
+ */
 class GarbageCollector {
 public:
-  explicit GarbageCollector() = default;
+  /// @brief The heap size of the first collection
+  static constexpr std::size_t initial_threshold = std::size_t{1} << 20;
+  /// @brief The next collection happens when the heap grew by this factor
+  /// since the previous one
+  static constexpr std::size_t heap_growth_factor = 2;
+
+  /// @brief The number of bytes of a block of small objects
+  static constexpr std::size_t block_size = std::size_t{64} * 1024;
+  /// @brief The largest object, header included, that lives in a block
+  static constexpr std::size_t max_small_object_size = 2048;
+
+  /// @brief Marks the objects that an owner refers to, with @ref mark
+  using RootTracer = std::function<void(GarbageCollector&)>;
+
+  explicit GarbageCollector(GarbageCollectorConfig config = {});
 
   ~GarbageCollector();
 
@@ -116,13 +222,196 @@ public:
 
   auto allocate(std::size_t bytes) -> GcPointer;
 
+  /**
+   * @brief Returns the number of bytes of an object with bytes of data
+   */
+  [[nodiscard]] static constexpr auto object_size(std::size_t bytes) noexcept
+      -> std::size_t
+  {
+    return sizeof(Obj) - 1 + bytes;
+  }
+
+  /**
+   * @brief Constructs an object with bytes of data in storage that no
+   * collector owns
+   *
+   * storage must hold @ref object_size(bytes) bytes aligned for an Obj. The
+   * object lives as long as storage, for example in the image of a bytecode
+   * file, and no collector ever frees it.
+   */
+  static auto emplace(void* storage, std::size_t bytes) -> GcPointer;
+
+  /**
+   * @brief Registers a tracer that marks roots in every collection, until the
+   * returned handle is destroyed
+   */
+  [[nodiscard]] auto add_roots(RootTracer tracer) -> GcRoots;
+
+  /**
+   * @brief Marks an object as live during a collection
+   *
+   * Promotes the object if it is in the nursery and points object to the
+   * promoted copy.
+   */
+  void mark(GcPointer& object) noexcept
+  {
+    if (in_nursery(object)) {
+      object = GcPointer{promote(object.get())};
+      if (collecting_nursery_) {
+        return;
+      }
+    }
+    if ((object->flags_ & Obj::unowned) == 0 && !collecting_nursery_) {
+      object->flags_ |= Obj::marked;
+    }
+  }
+
+  /**
+   * @brief Frees every object that no root reaches
+   */
+  void collect();
+
+  /**
+   * @brief Collects if the heap grew past the threshold since the last
+   * collection, returns whether it collected
+   *
+   * Only call it where every live object is reachable from a root.
+   */
+  auto collect_if_needed() -> bool
+  {
+    if (heap_size_ >= next_collection_) {
+      collect();
+      return true;
+    }
+    if (nursery_ != nullptr && nursery_used_ >= config_.nursery_size / 2) {
+      collect_nursery();
+      return true;
+    }
+    return false;
+  }
+
+  /**
+   * @brief Promotes the objects of the nursery that a root reaches and empties
+   * the nursery, does nothing outside of generational mode
+   *
+   * Only call it where every live reference is reachable from a root.
+   */
+  void collect_nursery();
+
+  /**
+   * @brief Returns the object, or its promoted copy if it is in the nursery
+   *
+   * Tenured objects never move, so references to them that no root marks stay
+   * valid as long as the object lives. Later collections point the marked
+   * references to the nursery object at the same copy.
+   */
+  [[nodiscard]] auto tenure(GcPointer object) -> GcPointer
+  {
+    return in_nursery(object) ? GcPointer{promote(object.get())} : object;
+  }
+
+  /// @brief Returns whether an object is in the nursery
+  [[nodiscard]] auto in_nursery(GcPointer object) const noexcept -> bool
+  {
+    const auto* const address =
+        reinterpret_cast<const std::byte*>(object.get());
+    return nursery_ != nullptr &&
+           std::less_equal<>{}(nursery_.get(), address) &&
+           std::less<>{}(address, nursery_.get() + nursery_used_);
+  }
+
+  /// @brief Returns the number of bytes of the objects in the nursery
+  [[nodiscard]] auto nursery_heap_size() const noexcept -> std::size_t
+  {
+    return nursery_heap_size_;
+  }
+
+  /// @brief Returns the number of bytes of the objects on the heap
+  [[nodiscard]] auto heap_size() const noexcept -> std::size_t
+  {
+    return heap_size_;
+  }
+
+  /// @brief Returns the heap size that triggers the next collection
+  [[nodiscard]] auto next_collection() const noexcept -> std::size_t
+  {
+    return next_collection_;
+  }
+
+  /// @brief Returns the number of full collections so far
+  [[nodiscard]] auto collections() const noexcept -> std::size_t
+  {
+    return collections_;
+  }
+
+  /// @brief Returns the number of nursery collections so far
+  [[nodiscard]] auto nursery_collections() const noexcept -> std::size_t
+  {
+    return nursery_collections_;
+  }
+
   auto is_equal(const GarbageCollector& other) const noexcept -> bool
   {
     return this == &other;
   }
 
+  /// @brief Returns the number of blocks of small objects
+  [[nodiscard]] auto block_count() const noexcept -> std::size_t;
+
 private:
-  Obj* root_ = nullptr; // List of allocated objects
+  // The cell sizes of the small objects, multiples of 16 that grow by about a
+  // quarter
+  static constexpr std::array<std::size_t, 23> size_classes = {
+      32,  48,  64,  80,  96,   112,  128,  160,  192,  224,  256, 320,
+      384, 448, 512, 640, 768, 896, 1024, 1280, 1536, 1792, 2048};
+
+  struct BlockDeleter {
+    void operator()(std::byte* block) const noexcept;
+  };
+
+  // The cells of a block are used from the start, up to used bytes
+  struct Block {
+    std::unique_ptr<std::byte, BlockDeleter> cells;
+    std::size_t used;
+  };
+
+  struct SizeClass {
+    std::vector<Block> blocks; // Bump allocates in the last block
+    Obj* free_cells = nullptr; // Reused before bump allocating
+  };
+
+  [[nodiscard]] static auto size_class_of(std::size_t size) noexcept
+      -> std::size_t;
+
+  auto allocate_small(std::size_t bytes) -> Obj*;
+  auto allocate_large(std::size_t bytes) -> Obj*;
+  auto allocate_young(std::size_t bytes) noexcept -> Obj*;
+
+  // Returns the copy of a nursery object outside of the nursery, copying it on
+  // the first call. Running out of memory halfway through a collection leaves
+  // references to both copies, so mark terminates instead of throwing.
+  auto promote(Obj* object) -> Obj*;
+
+  // Forgets the objects of the nursery, after the live ones were promoted
+  void reset_nursery() noexcept;
+
+  // Frees the unmarked objects and clears the marks of the others
+  void sweep_small() noexcept;
+  void sweep_large() noexcept;
+
+  GarbageCollectorConfig config_;
+  std::array<SizeClass, size_classes.size()> small_objects_;
+  Obj* large_objects_ = nullptr;
+  // Null outside of generational mode
+  std::unique_ptr<std::byte, BlockDeleter> nursery_;
+  std::size_t nursery_used_ = 0; // Bytes of the nursery, padding included
+  std::size_t nursery_heap_size_ = 0;
+  bool collecting_nursery_ = false;
+  std::shared_ptr<GcRoots::Registry> roots_;
+  std::size_t heap_size_ = 0; // Including the nursery
+  std::size_t next_collection_ = initial_threshold;
+  std::size_t collections_ = 0;
+  std::size_t nursery_collections_ = 0;
 };
 
 } // namespace eml
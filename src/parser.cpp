@@ -185,6 +185,14 @@ auto higher(Precedence p) -> Precedence
       static_cast<std::underlying_type_t<Precedence>>(p) + 1);
 }
 
+// Sets the position of a node to the position of the token it comes from
+template <typename Node>
+auto at(FilePos position, std::unique_ptr<Node> node) -> std::unique_ptr<Node>
+{
+  node->set_position(position);
+  return node;
+}
+
 auto parse_block(Parser& parser) -> Expr_ptr
 {
   auto expr = parse_expression(parser);
@@ -206,6 +214,7 @@ auto parse_grouping(Parser& parser) -> Expr_ptr
 // if else
 auto parse_branch(Parser& parser) -> Expr_ptr
 {
+  const auto position = parser.previous.position;
   parser.consume(eml::token_type::left_paren,
                  "condition of an if expression must in a group");
   auto cond = parse_grouping(parser);
@@ -217,13 +226,15 @@ auto parse_branch(Parser& parser) -> Expr_ptr
 
   auto Else = parse_expression(parser);
 
-  return IfExpr::create(std::move(cond), std::move(If), std::move(Else));
+  return at(position,
+            IfExpr::create(std::move(cond), std::move(If), std::move(Else)));
 }
 
 auto parse_number(Parser& parser) -> Expr_ptr
 {
   const double number = strtod(parser.previous.text.data(), nullptr);
-  return LiteralExpr::create(Value{number}, NumberType{});
+  return at(parser.previous.position,
+            LiteralExpr::create(Value{number}, NumberType{}));
 }
 
 auto parse_string(Parser& parser) -> Expr_ptr
@@ -233,11 +244,13 @@ auto parse_string(Parser& parser) -> Expr_ptr
   text.remove_suffix(1);
 
   auto s_obj = eml::make_string(text, parser.garbage_collector);
-  return LiteralExpr::create(Value{s_obj}, StringType{});
+  return at(parser.previous.position,
+            LiteralExpr::create(Value{s_obj}, StringType{}));
 }
 
 auto parse_definition(Parser& parser) -> std::unique_ptr<AstNode>
 {
+  const auto position = parser.current_itr->position;
   parser.advance();
   const auto id = parser.current_itr->text;
   parser.advance();
@@ -246,25 +259,27 @@ auto parse_definition(Parser& parser) -> std::unique_ptr<AstNode>
 
   parser.advance();
 
-  return Definition::create(id, std::move(expr));
+  return at(position, Definition::create(id, std::move(expr)));
 }
 
 auto parse_identifier(Parser& parser) -> std::unique_ptr<Expr>
 {
-  return IdentifierExpr::create(std::string{parser.previous.text});
+  return at(parser.previous.position,
+            IdentifierExpr::create(std::string{parser.previous.text}));
 }
 
 auto parse_literal(Parser& parser) -> Expr_ptr
 {
+  const auto position = parser.previous.position;
   switch (parser.previous.type) {
   case token_type::keyword_unit:
-    return LiteralExpr::create(Value{}, UnitType{});
+    return at(position, LiteralExpr::create(Value{}, UnitType{}));
 
   case token_type::keyword_true:
-    return LiteralExpr::create(Value{true}, BoolType{});
+    return at(position, LiteralExpr::create(Value{true}, BoolType{}));
 
   case token_type::keyword_false:
-    return LiteralExpr::create(Value{false}, BoolType{});
+    return at(position, LiteralExpr::create(Value{false}, BoolType{}));
 
   default:
     EML_UNREACHABLE();
@@ -319,6 +334,7 @@ auto parse_expression(Parser& parser) -> Expr_ptr
 
 auto parse_lambda(Parser& parser) -> Expr_ptr
 {
+  const auto position = parser.previous.position;
   std::vector<std::string> args;
 
   for (; parser.current_itr->type == token_type::identifier; parser.advance()) {
@@ -333,12 +349,14 @@ auto parse_lambda(Parser& parser) -> Expr_ptr
 
   auto expr_ptr = parse_expression(parser);
 
-  return LambdaExpr::create(std::move(args), std::move(expr_ptr));
+  return at(position,
+            LambdaExpr::create(std::move(args), std::move(expr_ptr)));
 }
 
 auto parse_unary(Parser& parser) -> Expr_ptr
 {
   const token_type operator_type = parser.previous.type;
+  const auto position = parser.previous.position;
 
   // Compile the operand.
   auto operand_ptr = parse_precedence(parser, prec_unary);
@@ -346,25 +364,18 @@ auto parse_unary(Parser& parser) -> Expr_ptr
   // Emit the operator instruction.
   switch (operator_type) {
   case token_type::bang:
-    return UnaryNotExpr::create(std::move(operand_ptr));
+    return at(position, UnaryNotExpr::create(std::move(operand_ptr)));
   case token_type::minus:
-    return UnaryNegateExpr::create(std::move(operand_ptr));
+    return at(position, UnaryNegateExpr::create(std::move(operand_ptr)));
   default:
     EML_UNREACHABLE();
   }
 }
 
-auto parse_binary(Parser& parser, Expr_ptr left_ptr) -> Expr_ptr
+// Creates the node of a binary operation
+auto make_binary(token_type operator_type, Expr_ptr left_ptr, Expr_ptr rhs_ptr)
+    -> Expr_ptr
 {
-  // Remember the operator.
-  token_type operator_type = parser.previous.type;
-
-  // Compile the right operand.
-  const ParseRule rule = get_rule(operator_type);
-
-  auto rhs_ptr = parse_precedence(parser, higher(rule.precedence));
-
-  // Emit the operator instruction.
   switch (operator_type) {
   case token_type::plus:
     return PlusOpExpr::create(std::move(left_ptr), std::move(rhs_ptr));
@@ -400,6 +411,21 @@ auto parse_binary(Parser& parser, Expr_ptr left_ptr) -> Expr_ptr
   }
 }
 
+auto parse_binary(Parser& parser, Expr_ptr left_ptr) -> Expr_ptr
+{
+  // Remember the operator.
+  token_type operator_type = parser.previous.type;
+  const auto position = parser.previous.position;
+
+  // Compile the right operand.
+  const ParseRule rule = get_rule(operator_type);
+
+  auto rhs_ptr = parse_precedence(parser, higher(rule.precedence));
+
+  return at(position, make_binary(operator_type, std::move(left_ptr),
+                                  std::move(rhs_ptr)));
+}
+
 // Get parse Rules
 constexpr auto get_rule(token_type type) -> ParseRule
 {
@@ -0,0 +1,195 @@
+#include <numeric>
+
+#include "bytecode_rewriter.hpp"
+#include "peephole.hpp"
+
+namespace eml {
+
+namespace {
+
+auto is_jump(const DecodedInstruction& instruction) -> bool
+{
+  return is_jump_operand(operand_kind_of(instruction.op));
+}
+
+// Removes redundant instructions and jumps, returns whether it changed
+// anything
+auto simplify(DecodedBytecode& code) -> bool
+{
+  auto& instructions = code.instructions;
+  const auto size = instructions.size();
+  const auto jump_targets = code.jump_targets();
+
+  std::vector<bool> removed(size, false);
+  bool changed = false;
+  for (std::size_t i = 0; i < size; ++i) {
+    auto& instruction = instructions[i];
+    if (is_jump(instruction) && instruction.target == i + 1) {
+      if (instruction.op == op_jmp) {
+        removed[i] = true;
+        changed = true;
+      } else if (instruction.op == op_jmp_false) {
+        instruction.op = op_pop; // Still consumes the condition
+        changed = true;
+      }
+      continue;
+    }
+
+    // Someone jumps into the middle of the sequence
+    if (i + 1 == size || jump_targets[i + 1]) {
+      continue;
+    }
+
+    auto& next = instructions[i + 1];
+    if (instruction.op == op_true && next.op == op_jmp_false) {
+      removed[i] = removed[i + 1] = true;
+    } else if (instruction.op == op_false && next.op == op_jmp_false) {
+      removed[i] = true;
+      next.op = op_jmp;
+    } else if (instruction.op == next.op &&
+               (instruction.op == op_not || instruction.op == op_negate_f64)) {
+      removed[i] = removed[i + 1] = true;
+    } else {
+      continue;
+    }
+    changed = true;
+    ++i;
+  }
+
+  code.erase(removed);
+  return changed;
+}
+
+// The code of if (!c) a else b, with the instruction indices
+//   not_index:      op_not
+//   not_index + 1:  op_jmp_false else_begin
+//                   the then branch
+//   else_begin - 1: op_jmp end
+//   else_begin:     the else branch
+//   end:
+struct NegatedBranch {
+  std::size_t not_index;
+  std::size_t else_begin;
+  std::size_t end;
+};
+
+// Finds the negated branch that starts at index i, if the branches are only
+// entered through it
+//
+// Jumps only go forward, so only the jumps before the branch and in the then
+// branch can land somewhere they should not.
+auto find_negated_branch(const DecodedBytecode& code, std::size_t i)
+    -> std::optional<NegatedBranch>
+{
+  const auto& instructions = code.instructions;
+  if (i + 1 >= instructions.size() || instructions[i].op != op_not ||
+      instructions[i + 1].op != op_jmp_false) {
+    return {};
+  }
+
+  const auto then_begin = i + 2;
+  const auto else_begin = instructions[i + 1].target;
+  if (else_begin <= then_begin || instructions[else_begin - 1].op != op_jmp) {
+    return {};
+  }
+  const auto end = instructions[else_begin - 1].target;
+
+  for (std::size_t k = 0; k + 1 < else_begin; ++k) {
+    if (k == i + 1 || !is_jump(instructions[k])) {
+      continue;
+    }
+    const auto target = instructions[k].target;
+    const bool into_branch = k < i ? target > i && target < end
+                                   : target >= else_begin && target < end;
+    if (into_branch) {
+      return {};
+    }
+  }
+  return NegatedBranch{i, else_begin, end};
+}
+
+// Jumps on the operand of the not and swaps the branches, so the code becomes
+//   op_jmp_false then_begin
+//   the else branch
+//   op_jmp end
+//   the then branch
+//   end:
+void invert(DecodedBytecode& code, const NegatedBranch& branch)
+{
+  auto& instructions = code.instructions;
+  const auto jump = branch.not_index + 1;
+  const auto then_begin = jump + 1;
+  const auto then_jump = branch.else_begin - 1;
+  const auto else_size = branch.end - branch.else_begin;
+
+  // The then branch comes last, so its jumps to its end go to the end
+  for (std::size_t k = then_begin; k < then_jump; ++k) {
+    if (is_jump(instructions[k]) && instructions[k].target == then_jump) {
+      instructions[k].target = branch.end;
+    }
+  }
+
+  std::vector<std::size_t> new_index(instructions.size() + 1);
+  std::iota(new_index.begin(), new_index.end(), std::size_t{0});
+  for (std::size_t k = branch.else_begin; k < branch.end; ++k) {
+    new_index[k] = then_begin + (k - branch.else_begin);
+  }
+  new_index[then_jump] = then_begin + else_size;
+  for (std::size_t k = then_begin; k < then_jump; ++k) {
+    new_index[k] = then_begin + else_size + 1 + (k - then_begin);
+  }
+
+  std::vector<DecodedInstruction> result(instructions.size());
+  for (std::size_t k = 0; k < instructions.size(); ++k) {
+    auto instruction = instructions[k];
+    if (is_jump(instruction)) {
+      instruction.target = new_index[instruction.target];
+    }
+    result[new_index[k]] = instruction;
+  }
+  result[jump].target = then_begin + else_size + 1;
+  instructions = std::move(result);
+
+  std::vector<bool> removed(instructions.size(), false);
+  removed[branch.not_index] = true;
+  code.erase(removed);
+}
+
+// Inverts the first negated branch, returns whether it found one
+auto invert_negated_branch(DecodedBytecode& code) -> bool
+{
+  for (std::size_t i = 0; i < code.instructions.size(); ++i) {
+    if (const auto branch = find_negated_branch(code, i); branch) {
+      invert(code, *branch);
+      return true;
+    }
+  }
+  return false;
+}
+
+} // anonymous namespace
+
+auto optimize_peephole(const Bytecode& code) -> Bytecode
+{
+  PeepholeStats stats;
+  return optimize_peephole(code, stats);
+}
+
+auto optimize_peephole(const Bytecode& code, PeepholeStats& stats) -> Bytecode
+{
+  auto decoded = decode(code);
+  while (simplify(decoded) || invert_negated_branch(decoded)) {
+  }
+  auto result = encode(decoded);
+
+  // Swapping branches can turn a narrow jump into a wide one
+  if (result.instructions.size() > code.instructions.size()) {
+    return code;
+  }
+  stats.instructions_removed +=
+      code.instruction_count() - result.instruction_count();
+  stats.bytes_removed += code.instructions.size() - result.instructions.size();
+  return result;
+}
+
+} // namespace eml
@@ -0,0 +1,49 @@
+#ifndef EML_PEEPHOLE_HPP
+#define EML_PEEPHOLE_HPP
+
+#include <cstddef>
+
+#include "bytecode.hpp"
+
+/**
+ * @file peephole.hpp
+ * @brief Peephole optimization of finished bytecode chunks
+ */
+
+namespace eml {
+
+/**
+ * @brief How much code the peephole optimizer removed
+ */
+struct PeepholeStats {
+  std::size_t instructions_removed = 0;
+  std::size_t bytes_removed = 0;
+};
+
+/**
+ * @brief Rewrites the wasteful instruction sequences of a chunk
+ *
+ * The rewrites are:
+ * - `op_not; op_jmp_false` of an if expression jumps on the operand of the
+ *   not, with the two branches swapped
+ * - `op_true; op_jmp_false` is removed and `op_false; op_jmp_false` becomes
+ *   an `op_jmp`
+ * - a jump to the next instruction is removed, or becomes an `op_pop` if it
+ *   is conditional
+ * - double `op_not` and double `op_negate_f64` are removed
+ *
+ * The rewrites are repeated until none of them applies. Jump offsets and line
+ * numbers are recomputed for the resulting chunk.
+ */
+[[nodiscard]] auto optimize_peephole(const Bytecode& code) -> Bytecode;
+
+/**
+ * @brief Rewrites the wasteful instruction sequences of a chunk and adds the
+ * amount of removed code to stats
+ */
+[[nodiscard]] auto optimize_peephole(const Bytecode& code,
+                                     PeepholeStats& stats) -> Bytecode;
+
+} // namespace eml
+
+#endif // EML_PEEPHOLE_HPP
@@ -0,0 +1,104 @@
+#include <iomanip>
+#include <sstream>
+#include <string_view>
+
+#include "register_bytecode.hpp"
+
+namespace eml {
+
+namespace {
+
+auto mnemonic(reg_opcode op) -> std::string_view
+{
+  switch (op) {
+  case reg_opcode::move:
+    return "move";
+  case reg_opcode::negate_f64:
+    return "negate<f64>";
+  case reg_opcode::not_op:
+    return "not";
+  case reg_opcode::add_f64:
+    return "add<f64>";
+  case reg_opcode::subtract_f64:
+    return "sub<f64>";
+  case reg_opcode::multiply_f64:
+    return "mult<f64>";
+  case reg_opcode::divide_f64:
+    return "div<f64>";
+  case reg_opcode::equal_f64:
+    return "eq<f64>";
+  case reg_opcode::not_equal_f64:
+    return "ne<f64>";
+  case reg_opcode::equal_bool:
+    return "eq<bool>";
+  case reg_opcode::not_equal_bool:
+    return "ne<bool>";
+  case reg_opcode::equal_string:
+    return "eq<string>";
+  case reg_opcode::not_equal_string:
+    return "ne<string>";
+  case reg_opcode::less_f64:
+    return "lt<f64>";
+  case reg_opcode::less_equal_f64:
+    return "le<f64>";
+  case reg_opcode::greater_f64:
+    return "gt<f64>";
+  case reg_opcode::greater_equal_f64:
+    return "ge<f64>";
+  case reg_opcode::jmp:
+    return "jump";
+  case reg_opcode::jmp_false:
+    return "jump_false";
+  case reg_opcode::ret:
+    return "return";
+  }
+  return "unknown"; // Unreachable
+}
+
+void print_operand(std::ostream& os, reg_operand operand)
+{
+  os << (is_constant_operand(operand) ? 'k' : 'r') << operand_index(operand);
+}
+
+} // anonymous namespace
+
+auto RegisterBytecode::disassemble() const -> std::string
+{
+  std::stringstream ss;
+
+  constexpr std::size_t offset_digits = 4;
+  for (std::size_t i = 0; i < instructions.size(); ++i) {
+    const auto& instruction = instructions[i];
+    ss << std::setfill('0') << std::setw(offset_digits) << i << "    "
+       << mnemonic(instruction.op) << ' ';
+
+    switch (instruction.op) {
+    case reg_opcode::move:
+    case reg_opcode::negate_f64:
+    case reg_opcode::not_op:
+      ss << 'r' << static_cast<unsigned>(instruction.dst) << ", ";
+      print_operand(ss, instruction.lhs);
+      break;
+    case reg_opcode::jmp:
+      ss << instruction.lhs;
+      break;
+    case reg_opcode::jmp_false:
+      print_operand(ss, instruction.lhs);
+      ss << ", " << instruction.rhs;
+      break;
+    case reg_opcode::ret:
+      print_operand(ss, instruction.lhs);
+      break;
+    default: // Binary operations
+      ss << 'r' << static_cast<unsigned>(instruction.dst) << ", ";
+      print_operand(ss, instruction.lhs);
+      ss << ", ";
+      print_operand(ss, instruction.rhs);
+    }
+    ss << '\n';
+  }
+
+  return ss.str();
+}
+
+} // namespace eml
@@ -0,0 +1,139 @@
+#ifndef EML_REGISTER_BYTECODE_HPP
+#define EML_REGISTER_BYTECODE_HPP
+
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "value.hpp"
+
+/**
+ * @file register_bytecode.hpp
+ * @brief This file contains the register-based alternative of the EML bytecode
+ */
+
+namespace eml {
+
+/**
+ * @brief The instruction set of the register-based Embedded ML vm
+ *
+ * Instructions are in three-address form `op dst, lhs, rhs`. The `lhs` and
+ * `rhs` operands refer either to a register or to a constant of the chunk.
+ */
+enum class reg_opcode : std::uint8_t {
+  move,       // dst = lhs
+  negate_f64, // dst = -lhs
+  not_op,     // dst = !lhs
+
+  add_f64,      // dst = lhs + rhs
+  subtract_f64, // dst = lhs - rhs
+  multiply_f64, // dst = lhs * rhs
+  divide_f64,   // dst = lhs / rhs
+
+  equal_f64,         // dst = lhs == rhs
+  not_equal_f64,     // dst = lhs != rhs
+  equal_bool,        // dst = lhs == rhs
+  not_equal_bool,    // dst = lhs != rhs
+  equal_string,      // dst = lhs == rhs, compares the contents
+  not_equal_string,  // dst = lhs != rhs, compares the contents
+  less_f64,          // dst = lhs < rhs
+  less_equal_f64,    // dst = lhs <= rhs
+  greater_f64,       // dst = lhs > rhs
+  greater_equal_f64, // dst = lhs >= rhs
+
+  jmp,       // Jumps [lhs] instructions forward
+  jmp_false, // If lhs is false, jumps [rhs] instructions forward
+  ret,       // Stops the execution with lhs as the result
+};
+
+/// @brief An operand of a register instruction, refers to a register or to a
+/// constant
+using reg_operand = std::uint16_t;
+
+/// @brief The bit of an operand that marks it as a constant
+constexpr reg_operand reg_constant_flag = 0x8000;
+
+/// @brief Maximum number of registers of a chunk
+constexpr std::size_t max_registers = 256;
+
+/// @brief Maximum number of constants of a chunk
+constexpr std::size_t max_register_constants = reg_constant_flag;
+
+/// @brief Maximum distance of a jump, in instructions
+constexpr std::size_t max_register_jump =
+    std::numeric_limits<reg_operand>::max();
+
+/// @brief Creates an operand that refers to a register
+constexpr auto register_operand(std::uint8_t index) noexcept -> reg_operand
+{
+  return index;
+}
+
+/// @brief Creates an operand that refers to a constant
+constexpr auto constant_operand(std::uint16_t index) noexcept -> reg_operand
+{
+  return static_cast<reg_operand>(index | reg_constant_flag);
+}
+
+/// @brief Returns true if the operand refers to a constant
+constexpr auto is_constant_operand(reg_operand operand) noexcept -> bool
+{
+  return (operand & reg_constant_flag) != 0;
+}
+
+/// @brief Returns the index of the register or constant an operand refers to
+constexpr auto operand_index(reg_operand operand) noexcept -> std::uint16_t
+{
+  return static_cast<std::uint16_t>(operand & ~reg_constant_flag);
+}
+
+/**
+ * @brief An instruction of the register-based vm
+ */
+struct RegisterInstruction {
+  reg_opcode op;
+  std::uint8_t dst;
+  reg_operand lhs;
+  reg_operand rhs;
+};
+
+/**
+ * @brief A chunk of register-based eml bytecode
+ */
+struct RegisterBytecode {
+  std::vector<RegisterInstruction> instructions;
+  std::vector<Value> constants;
+  std::size_t register_count = 0; // Number of registers the chunk uses
+
+  /**
+   * @brief Write an instruction to the instructions
+   * @return The index of the instruction in instructions
+   */
+  auto write(reg_opcode op, std::uint8_t dst = 0, reg_operand lhs = 0,
+             reg_operand rhs = 0) -> std::ptrdiff_t
+  {
+    instructions.push_back(RegisterInstruction{op, dst, lhs, rhs});
+    return static_cast<std::ptrdiff_t>(instructions.size() - 1);
+  }
+
+  /**
+   * @brief Adds a constant value v to the chunk and returns an operand that
+   * refers to it
+   */
+  [[nodiscard]] auto add_constant(Value v) -> std::optional<reg_operand>
+  {
+    if (constants.size() >= max_register_constants) {
+      return {};
+    }
+    constants.push_back(v);
+    return constant_operand(static_cast<std::uint16_t>(constants.size() - 1));
+  }
+
+  auto disassemble() const -> std::string;
+};
+
+} // namespace eml
+
+#endif // EML_REGISTER_BYTECODE_HPP
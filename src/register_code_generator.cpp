@@ -0,0 +1,258 @@
+#include "ast.hpp"
+#include "compiler.hpp"
+
+namespace eml {
+
+namespace {
+
+// Generates register-based bytecode.
+//
+// Registers are allocated like a stack: the temporaries of an expression are
+// released as soon as their parent consumes them, so the parent can reuse the
+// register of its first operand as its destination. Literals and identifiers
+// never occupy a register, they are referred by constant operands.
+struct RegisterCodeGenerator : AstConstVisitor {
+  RegisterCodeGenerator(RegisterBytecode& chunk, GarbageCollector& gc)
+      : chunk_{chunk}, gc_{gc}
+  {
+  }
+
+  // Generates the code of an expression and returns the operand that holds its
+  // result
+  auto operand_of(const AstNode& node) -> reg_operand
+  {
+    node.accept(*this);
+    EML_ASSERT(result_.has_value(), "Expression must produce a result");
+    return *result_;
+  }
+
+  auto result() const -> std::optional<reg_operand>
+  {
+    return result_;
+  }
+
+  // Whether the expression needs more registers, constants or a longer jump
+  // than a chunk holds, the generated code is then meaningless
+  auto overflowed() const noexcept -> bool
+  {
+    return overflowed_;
+  }
+
+  void operator()(const LiteralExpr& constant) override
+  {
+    result_ = add_constant(constant.value());
+  }
+
+  void operator()([[maybe_unused]] const IdentifierExpr& id) override
+  {
+    EML_ASSERT(id.value() != std::nullopt,
+               "Identifier expression passed to the code generator are "
+               "garanteed to have a value");
+    result_ = add_constant(*id.value());
+  }
+
+  void unary_common(const UnaryOpExpr& expr, reg_opcode op)
+  {
+    const auto base = next_register_;
+    const auto operand = operand_of(expr.operand());
+    next_register_ = base;
+
+    const auto dst = allocate_register();
+    chunk_.write(op, dst, operand);
+    result_ = register_operand(dst);
+  }
+
+  void operator()(const UnaryNegateExpr& expr) override
+  {
+    unary_common(expr, reg_opcode::negate_f64);
+  }
+
+  void operator()(const UnaryNotExpr& expr) override
+  {
+    unary_common(expr, reg_opcode::not_op);
+  }
+
+  void binary_common(const BinaryOpExpr& expr, reg_opcode op)
+  {
+    const auto base = next_register_;
+    const auto lhs = operand_of(expr.lhs());
+    const auto rhs = operand_of(expr.rhs());
+    next_register_ = base;
+
+    const auto dst = allocate_register();
+    chunk_.write(op, dst, lhs, rhs);
+    result_ = register_operand(dst);
+  }
+
+  void operator()(const PlusOpExpr& expr) override
+  {
+    binary_common(expr, reg_opcode::add_f64);
+  }
+  void operator()(const MinusOpExpr& expr) override
+  {
+    binary_common(expr, reg_opcode::subtract_f64);
+  }
+  void operator()(const MultOpExpr& expr) override
+  {
+    binary_common(expr, reg_opcode::multiply_f64);
+  }
+  void operator()(const DivOpExpr& expr) override
+  {
+    binary_common(expr, reg_opcode::divide_f64);
+  }
+  // Emits the equality for the type of the operands, like the stack back end
+  void equality_common(const BinaryOpExpr& expr, bool equal)
+  {
+    const auto& type = expr.lhs().type();
+    if (std::holds_alternative<UnitType>(type)) {
+      // Units are always equal and evaluating them has no effect
+      result_ = add_constant(Value{equal});
+    } else if (std::holds_alternative<NumberType>(type)) {
+      binary_common(expr, equal ? reg_opcode::equal_f64
+                                : reg_opcode::not_equal_f64);
+    } else if (std::holds_alternative<BoolType>(type)) {
+      binary_common(expr, equal ? reg_opcode::equal_bool
+                                : reg_opcode::not_equal_bool);
+    } else if (std::holds_alternative<StringType>(type)) {
+      binary_common(expr, equal ? reg_opcode::equal_string
+                                : reg_opcode::not_equal_string);
+    } else {
+      EML_UNREACHABLE();
+    }
+  }
+
+  void operator()(const EqOpExpr& expr) override
+  {
+    equality_common(expr, true);
+  }
+  void operator()(const NeqOpExpr& expr) override
+  {
+    equality_common(expr, false);
+  }
+  void operator()(const LessOpExpr& expr) override
+  {
+    binary_common(expr, reg_opcode::less_f64);
+  }
+  void operator()(const LeOpExpr& expr) override
+  {
+    binary_common(expr, reg_opcode::less_equal_f64);
+  }
+  void operator()(const GreaterOpExpr& expr) override
+  {
+    binary_common(expr, reg_opcode::greater_f64);
+  }
+  void operator()(const GeExpr& expr) override
+  {
+    binary_common(expr, reg_opcode::greater_equal_f64);
+  }
+
+  void operator()(const LambdaExpr& /*expr*/) override
+  {
+    throw "TODO";
+  }
+
+  // Replaces the offset of a previous jump instruction with the distance to the
+  // next instruction
+  void jump_patch(std::ptrdiff_t index)
+  {
+    auto& jump = chunk_.instructions[static_cast<std::size_t>(index)];
+    const auto instructions = chunk_.instructions.size();
+    const auto full_distance =
+        instructions - static_cast<std::size_t>(index) - 1;
+    if (full_distance > max_register_jump) {
+      overflowed_ = true;
+    }
+    const auto distance = static_cast<reg_operand>(full_distance);
+    if (jump.op == reg_opcode::jmp) {
+      jump.lhs = distance;
+    } else {
+      jump.rhs = distance;
+    }
+  }
+
+  void operator()(const IfExpr& expr) override
+  {
+    EML_ASSERT(eml::match(expr.cond().type(), BoolType{}),
+               "Type of condition must be boolean");
+    EML_ASSERT(eml::match(expr.If().type(), expr.Else().type()),
+               "Type of different branches must match");
+
+    const auto base = next_register_;
+    const auto cond = operand_of(expr.cond());
+    next_register_ = base;
+
+    const auto dst = allocate_register();
+    const auto else_jump_pos = chunk_.write(reg_opcode::jmp_false, 0, cond);
+
+    chunk_.write(reg_opcode::move, dst, operand_of(expr.If()));
+    next_register_ = base + 1;
+
+    const auto if_jump_pos = chunk_.write(reg_opcode::jmp);
+
+    jump_patch(else_jump_pos);
+
+    chunk_.write(reg_opcode::move, dst, operand_of(expr.Else()));
+    next_register_ = base + 1;
+
+    jump_patch(if_jump_pos);
+
+    result_ = register_operand(dst);
+  }
+
+  void operator()(const Definition& /*def*/) override
+  {
+    result_ = std::nullopt;
+  }
+
+  auto add_constant(Value v) -> reg_operand
+  {
+    // Like the stack back end, strings leave the nursery when they become
+    // constants
+    if (v.is_reference()) {
+      v = Value{gc_.tenure(v.unsafe_as_reference())};
+    }
+    const auto operand = chunk_.add_constant(v);
+    if (!operand) {
+      overflowed_ = true;
+      return constant_operand(0);
+    }
+    return *operand;
+  }
+
+  auto allocate_register() -> std::uint8_t
+  {
+    if (next_register_ >= max_registers) {
+      overflowed_ = true;
+      ++next_register_;
+      return 0;
+    }
+    const auto index = static_cast<std::uint8_t>(next_register_++);
+    chunk_.register_count = std::max(chunk_.register_count, next_register_);
+    return index;
+  }
+
+  RegisterBytecode& chunk_;
+  GarbageCollector& gc_;
+  std::size_t next_register_ = 0;
+  std::optional<reg_operand> result_;
+  bool overflowed_ = false;
+};
+
+} // anonymous namespace
+
+auto Compiler::generate_register_code(const AstNode& expr) const
+    -> std::optional<std::tuple<RegisterBytecode, Type>>
+{
+  RegisterBytecode code;
+  RegisterCodeGenerator code_generator{code, garbage_collector_};
+  expr.accept(code_generator);
+  if (code_generator.overflowed()) {
+    return std::nullopt;
+  }
+  if (const auto result = code_generator.result(); result) {
+    code.write(reg_opcode::ret, 0, *result);
+  }
+  return std::tuple(code, expr.type());
+}
+
+} // namespace eml
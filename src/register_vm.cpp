@@ -0,0 +1,138 @@
+#include <functional>
+
+#include "common.hpp"
+#include "register_vm.hpp"
+#include "string.hpp"
+
+namespace eml {
+
+auto RegisterVM::interpret(const RegisterBytecode& code)
+    -> std::optional<Value>
+{
+  registers_.resize(code.register_count);
+
+  Value* const registers = registers_.data();
+  const Value* const constants = code.constants.data();
+
+  const auto read = [registers, constants](reg_operand operand) -> Value {
+    return is_constant_operand(operand) ? constants[operand_index(operand)]
+                                        : registers[operand];
+  };
+
+  // Helper for arithmatic and comparison operations
+  const auto binary_operation = [&](const RegisterInstruction& instruction,
+                                    auto op) {
+    const Value left = read(instruction.lhs);
+    const Value right = read(instruction.rhs);
+
+    EML_ASSERT(left.is_number(),
+               "The left operands of a binary operation must be a number.");
+    EML_ASSERT(right.is_number(),
+               "The right operands of a binary operation must be a number.");
+
+    registers[instruction.dst] =
+        Value{op(left.unsafe_as_number(), right.unsafe_as_number())};
+  };
+
+  const auto boolean_equality = [&](const RegisterInstruction& instruction,
+                                    auto op) {
+    const Value left = read(instruction.lhs);
+    const Value right = read(instruction.rhs);
+
+    EML_ASSERT(left.is_boolean() && right.is_boolean(),
+               "The operands of a boolean equality must be booleans.");
+
+    registers[instruction.dst] =
+        Value{op(left.unsafe_as_boolean(), right.unsafe_as_boolean())};
+  };
+
+  const auto string_equality =
+      [&](const RegisterInstruction& instruction) -> bool {
+    const Value left = read(instruction.lhs);
+    const Value right = read(instruction.rhs);
+
+    EML_ASSERT(left.is_reference() && right.is_reference(),
+               "The operands of a string equality must be strings.");
+
+    return equal_strings(left.unsafe_as_reference(),
+                         right.unsafe_as_reference());
+  };
+
+  const RegisterInstruction* ip = code.instructions.data();
+  const RegisterInstruction* const end = ip + code.instructions.size();
+
+  while (ip != end) {
+    const RegisterInstruction& instruction = *ip++;
+    switch (instruction.op) {
+    case reg_opcode::move:
+      registers[instruction.dst] = read(instruction.lhs);
+      break;
+    case reg_opcode::negate_f64: {
+      const Value v = read(instruction.lhs);
+      EML_ASSERT(v.is_number(), "Operand of unary - must be a number.");
+      registers[instruction.dst] = Value{-v.unsafe_as_number()};
+    } break;
+    case reg_opcode::not_op: {
+      const Value v = read(instruction.lhs);
+      EML_ASSERT(v.is_boolean(), "Operand of unary ! must be a boolean.");
+      registers[instruction.dst] = Value{!v.unsafe_as_boolean()};
+    } break;
+    case reg_opcode::add_f64:
+      binary_operation(instruction, std::plus<double>{});
+      break;
+    case reg_opcode::subtract_f64:
+      binary_operation(instruction, std::minus<double>{});
+      break;
+    case reg_opcode::multiply_f64:
+      binary_operation(instruction, std::multiplies<double>{});
+      break;
+    case reg_opcode::divide_f64:
+      binary_operation(instruction, std::divides<double>{});
+      break;
+    case reg_opcode::equal_f64:
+      binary_operation(instruction, std::equal_to<double>{});
+      break;
+    case reg_opcode::not_equal_f64:
+      binary_operation(instruction, std::not_equal_to<double>{});
+      break;
+    case reg_opcode::equal_bool:
+      boolean_equality(instruction, std::equal_to<bool>{});
+      break;
+    case reg_opcode::not_equal_bool:
+      boolean_equality(instruction, std::not_equal_to<bool>{});
+      break;
+    case reg_opcode::equal_string:
+      registers[instruction.dst] = Value{string_equality(instruction)};
+      break;
+    case reg_opcode::not_equal_string:
+      registers[instruction.dst] = Value{!string_equality(instruction)};
+      break;
+    case reg_opcode::less_f64:
+      binary_operation(instruction, std::less<double>{});
+      break;
+    case reg_opcode::less_equal_f64:
+      binary_operation(instruction, std::less_equal<double>{});
+      break;
+    case reg_opcode::greater_f64:
+      binary_operation(instruction, std::greater<double>{});
+      break;
+    case reg_opcode::greater_equal_f64:
+      binary_operation(instruction, std::greater_equal<double>{});
+      break;
+    case reg_opcode::jmp:
+      ip += instruction.lhs;
+      break;
+    case reg_opcode::jmp_false:
+      if (!read(instruction.lhs).unsafe_as_boolean()) {
+        ip += instruction.rhs;
+      }
+      break;
+    case reg_opcode::ret:
+      return read(instruction.lhs);
+    }
+  }
+
+  return {};
+}
+
+} // namespace eml
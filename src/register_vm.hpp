@@ -0,0 +1,36 @@
+#ifndef EML_REGISTER_VM_HPP
+#define EML_REGISTER_VM_HPP
+
+#include <optional>
+#include <vector>
+
+#include "register_bytecode.hpp"
+
+namespace eml {
+
+/**
+ * @brief The virtual machine that runs register-based bytecode
+ * @see RegisterBytecode
+ */
+class RegisterVM {
+public:
+  RegisterVM() noexcept
+  {
+    registers_.reserve(max_registers);
+  }
+
+  /**
+   * @brief Interpret the register-based code in the vm
+   * @return The operand of the executed `ret` instruction, or nothing if the
+   * code finishes without returning
+   */
+  [[nodiscard]] auto interpret(const RegisterBytecode& code)
+      -> std::optional<Value>;
+
+private:
+  std::vector<Value> registers_{}; // Registers of the vm
+};
+
+} // namespace eml
+
+#endif // EML_REGISTER_VM_HPP
@@ -172,7 +172,7 @@ struct Scanner {
       }
 
       // Look for a fractional part
-      if (peek() == '.' && (std::isdigit(peek_next()) != 0)) {
+      if (peek() == '.' && eml::isdigit(peek_next())) {
         // Consume the "."
         advance();
 
@@ -0,0 +1,595 @@
+#ifndef EML_STATIC_COMPILER_HPP
+#define EML_STATIC_COMPILER_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string_view>
+
+#include "bytecode.hpp"
+#include "scanner.hpp"
+#include "verifier.hpp"
+
+/**
+ * @file static_compiler.hpp
+ * @brief The compiler of EML scripts into bytecode during the C++ compilation
+ */
+
+namespace eml {
+
+/// @brief The default number of bytes of instructions in a @ref StaticBytecode
+constexpr std::size_t default_static_capacity = 256;
+
+/**
+ * @brief A global constant that scripts compiled by @ref compile_static can
+ * refer to by name
+ */
+struct StaticGlobal {
+  std::string_view name;
+  StackType type;
+  double number = 0;
+  bool boolean = false;
+
+  constexpr StaticGlobal(std::string_view name_in, double number_in) noexcept
+      : name{name_in}, type{StackType::number}, number{number_in}
+  {
+  }
+
+  constexpr StaticGlobal(std::string_view name_in, bool boolean_in) noexcept
+      : name{name_in}, type{StackType::boolean}, boolean{boolean_in}
+  {
+  }
+};
+
+/**
+ * @brief The first error that @ref compile_static found in a script
+ */
+struct StaticError {
+  std::string_view msg; ///< @brief Empty if the script compiled
+  FilePos position;
+};
+
+/**
+ * @brief A chunk compiled by @ref compile_static, stored in a fixed-size array
+ *
+ * The chunk is a literal type, so it can live in a `constexpr` variable and
+ * run on the @ref VM without any setup. It never uses the constant pool.
+ */
+template <std::size_t capacity = default_static_capacity>
+struct StaticBytecode {
+  std::array<std::byte, capacity> instructions{};
+  std::size_t size = 0; ///< @brief Number of bytes used in instructions
+  std::size_t max_stack_depth = 0;
+  StackType type = StackType::unit; ///< @brief Type of the result
+  StaticError error{};
+
+  /// @brief Returns whether the script compiled
+  constexpr explicit operator bool() const noexcept
+  {
+    return error.msg.empty();
+  }
+
+  /// @brief Copies the instructions into a dynamic chunk
+  [[nodiscard]] auto to_bytecode() const -> Bytecode
+  {
+    Bytecode code;
+    code.instructions.assign(instructions.begin(),
+                             instructions.begin() +
+                                 static_cast<std::ptrdiff_t>(size));
+    for (std::size_t i = 0; i < size; ++i) {
+      code.lines.push_back(line_num{0});
+    }
+    code.max_stack_depth = max_stack_depth;
+    return code;
+  }
+};
+
+namespace detail {
+
+// The operands of instructions are in host order, which the constant
+// evaluator can not observe, so the byte order comes from the compiler
+#if defined(__BYTE_ORDER__) && defined(__ORDER_LITTLE_ENDIAN__)
+constexpr bool host_is_little_endian =
+    __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__;
+#else
+constexpr bool host_is_little_endian = true;
+#endif
+
+// Returns whether the sign bit of a number is set
+constexpr auto sign_bit_of(double number) noexcept -> bool
+{
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_signbit(number) != 0;
+#else
+  return number < 0; // -0 is pushed as 0
+#endif
+}
+
+// Returns the bits of a finite non-negative double
+//
+// std::memcpy is not usable in constant expressions, so the exponent and the
+// mantissa are found by scaling the number with powers of two, which is exact.
+constexpr auto bits_of(double number) noexcept -> std::uint64_t
+{
+  constexpr double two_to_52 = 4503599627370496.;
+  constexpr double min_normal = std::numeric_limits<double>::min();
+  if (number < min_normal) { // Subnormal numbers are multiples of 2^-1074
+    return static_cast<std::uint64_t>(number * (1 / min_normal) * two_to_52);
+  }
+  std::uint64_t exponent = 1023;
+  while (number >= 2) {
+    number /= 2;
+    ++exponent;
+  }
+  while (number < 1) {
+    number *= 2;
+    --exponent;
+  }
+  const auto mantissa = static_cast<std::uint64_t>((number - 1) * two_to_52);
+  return (exponent << 52) | mantissa;
+}
+
+enum StaticPrecedence : std::uint8_t {
+  prec_none,
+  prec_assignment, // =
+  prec_lambda,     // "\"
+  prec_or,         // or
+  prec_and,        // and
+  prec_equality,   // == !=
+  prec_comparison, // < > <= >=
+  prec_term,       // + -
+  prec_factor,     // * /
+  prec_unary,      // ! -
+  prec_call,       // . () []
+  prec_primary
+};
+
+constexpr auto precedence_of(token_type type) noexcept -> StaticPrecedence
+{
+  switch (type) {
+#define TOKEN_TABLE_ENTRY(type, type_name, prefix, infix, precedence)          \
+  case token_type::type:                                                       \
+    return prec_##precedence;
+#include "token_table.inc"
+#undef TOKEN_TABLE_ENTRY
+  }
+  return prec_none; // Unreachable
+}
+
+// A single pass compiler from source to bytecode
+//
+// The parser is the same Pratt parser as the one of parse(), but every
+// parselet emits its code and returns the type of its expression instead of
+// building an AST, so the whole compilation fits in a constant expression.
+template <std::size_t capacity, std::size_t global_count>
+class StaticCompiler {
+public:
+  constexpr StaticCompiler(
+      std::string_view source,
+      const std::array<StaticGlobal, global_count>& globals) noexcept
+      : current_{source}, globals_{globals}
+  {
+    if (current_->type == token_type::error) {
+      error_at(*current_, current_->text);
+    }
+  }
+
+  constexpr auto compile() noexcept -> StaticBytecode<capacity>
+  {
+    chunk_.type = expression(prec_assignment);
+    consume(token_type::eof, "Expect end of expression");
+    return chunk_;
+  }
+
+private:
+  constexpr auto failed() const noexcept -> bool
+  {
+    return !chunk_.error.msg.empty();
+  }
+
+  constexpr void error_at(const Token& token, std::string_view msg) noexcept
+  {
+    if (!failed()) {
+      chunk_.error = StaticError{msg, token.position};
+    }
+  }
+
+  constexpr void advance() noexcept
+  {
+    previous_ = *current_;
+    ++current_;
+    if (current_->type == token_type::error) {
+      error_at(*current_, current_->text);
+    }
+  }
+
+  constexpr void consume(token_type type, std::string_view msg) noexcept
+  {
+    if (current_->type == type) {
+      advance();
+      return;
+    }
+    error_at(*current_, msg);
+  }
+
+  // The state of the chunk before some code, to drop that code later
+  struct Mark {
+    std::size_t size;
+    std::size_t depth;
+    std::size_t max_stack_depth;
+  };
+
+  constexpr auto mark() const noexcept -> Mark
+  {
+    return Mark{chunk_.size, depth_, chunk_.max_stack_depth};
+  }
+
+  constexpr void rewind(Mark mark) noexcept
+  {
+    chunk_.size = mark.size;
+    depth_ = mark.depth;
+    chunk_.max_stack_depth = mark.max_stack_depth;
+  }
+
+  constexpr void emit(std::byte byte) noexcept
+  {
+    if (chunk_.size == capacity) {
+      error_at(previous_, "The script does not fit in the static chunk");
+      return;
+    }
+    chunk_.instructions[chunk_.size++] = byte;
+  }
+
+  // Emits an instruction and updates the depth of the stack
+  constexpr void emit(opcode op, std::size_t pops, std::size_t pushes) noexcept
+  {
+    emit(std::byte{op});
+    depth_ = depth_ - pops + pushes;
+    if (depth_ > chunk_.max_stack_depth) {
+      chunk_.max_stack_depth = depth_;
+    }
+  }
+
+  // Writes an operand of size bytes in host order at index
+  constexpr void write_operand(std::size_t index, std::uint64_t value,
+                               std::size_t size) noexcept
+  {
+    for (std::size_t i = 0; i < size; ++i) {
+      const auto shift = host_is_little_endian ? i : size - 1 - i;
+      chunk_.instructions[index + i] =
+          static_cast<std::byte>((value >> (8 * shift)) & 0xff);
+    }
+  }
+
+  constexpr void emit_operand(std::uint64_t value, std::size_t size) noexcept
+  {
+    if (capacity - chunk_.size < size) {
+      error_at(previous_, "The script does not fit in the static chunk");
+      return;
+    }
+    write_operand(chunk_.size, value, size);
+    chunk_.size += size;
+  }
+
+  // Emits a wide jump with a placeholder offset, returns the index of the
+  // placeholder
+  constexpr auto emit_jump(opcode op, std::size_t pops) noexcept -> std::size_t
+  {
+    emit(op, pops, 0);
+    const auto index = chunk_.size;
+    emit_operand(0, sizeof(std::uint32_t));
+    return index;
+  }
+
+  // Makes the jump whose placeholder is at index land on the current end
+  constexpr void patch_jump(std::size_t index) noexcept
+  {
+    if (!failed()) {
+      write_operand(index, chunk_.size - index - sizeof(std::uint32_t),
+                    sizeof(std::uint32_t));
+    }
+  }
+
+  // Emits the shortest instruction that pushes a non-negative number, the
+  // same way as Bytecode::write_number
+  constexpr void emit_number(double number) noexcept
+  {
+    if (number == 0) {
+      emit(op_push_f64_zero, 0, 1);
+    } else if (number == 1) {
+      emit(op_push_f64_one, 0, 1);
+    } else if (number <= std::numeric_limits<std::int8_t>::max() &&
+               number == static_cast<double>(static_cast<int>(number))) {
+      emit(op_push_f64_small, 0, 1);
+      emit(static_cast<std::byte>(static_cast<int>(number)));
+    } else {
+      emit(op_push_f64_imm, 0, 1);
+      emit_operand(bits_of(number), sizeof(double));
+    }
+  }
+
+  constexpr auto expression(StaticPrecedence precedence) noexcept -> StackType
+  {
+    advance();
+    const auto start = mark();
+    auto type = prefix();
+    while (!failed() && precedence <= precedence_of(current_->type)) {
+      advance();
+      type = binary(type, start);
+    }
+    return type;
+  }
+
+  constexpr auto prefix() noexcept -> StackType
+  {
+    switch (previous_.type) {
+    case token_type::left_paren: {
+      const auto type = expression(prec_assignment);
+      consume(token_type::right_paren,
+              "Expect `)` at the end of the expression");
+      return type;
+    }
+    case token_type::left_brace: {
+      const auto type = expression(prec_assignment);
+      consume(token_type::right_brace, "A block must end with \'}\'");
+      return type;
+    }
+    case token_type::minus:
+    case token_type::bang:
+      return unary();
+    case token_type::keyword_if:
+      return branch();
+    case token_type::number_literal:
+      return number();
+    case token_type::identifier:
+      return global();
+    case token_type::keyword_true:
+      emit(op_true, 0, 1);
+      return StackType::boolean;
+    case token_type::keyword_false:
+      emit(op_false, 0, 1);
+      return StackType::boolean;
+    case token_type::keyword_unit:
+      emit(op_unit, 0, 1);
+      return StackType::unit;
+    case token_type::string_literal:
+      error_at(previous_, "Strings need the garbage collector and can not be "
+                          "compiled statically");
+      return StackType::unit;
+    case token_type::backslash:
+      error_at(previous_, "Functions are not implemented yet!");
+      return StackType::unit;
+    case token_type::keyword_let:
+      error_at(previous_, "Definitions can not be compiled statically");
+      return StackType::unit;
+    default:
+      error_at(previous_, "expect a prefix operator");
+      return StackType::unit;
+    }
+  }
+
+  constexpr auto unary() noexcept -> StackType
+  {
+    const auto op = previous_;
+    const auto operand = expression(prec_unary);
+    const auto expected = op.type == token_type::minus ? StackType::number
+                                                       : StackType::boolean;
+    if (operand != expected) {
+      error_at(op, "Unmatched types around of unary operator");
+    }
+    emit(op.type == token_type::minus ? op_negate_f64 : op_not, 1, 1);
+    return expected;
+  }
+
+  constexpr auto binary(StackType lhs, Mark lhs_start) noexcept -> StackType
+  {
+    const auto op = previous_;
+    const auto precedence = precedence_of(op.type);
+    const auto rhs = expression(static_cast<StaticPrecedence>(precedence + 1));
+
+    const auto arithmetic = [&](opcode code) {
+      if (lhs != StackType::number || rhs != StackType::number) {
+        error_at(op, "Unmatched types around binary operator");
+      }
+      emit(code, 2, 1);
+      return StackType::number;
+    };
+    const auto comparison = [&](opcode code) {
+      if (lhs != StackType::number || rhs != StackType::number) {
+        error_at(op, "Unmatched types around binary operator");
+      }
+      emit(code, 2, 1);
+      return StackType::boolean;
+    };
+    // Unit values are always equal, so their code is dropped like the code
+    // generator does
+    const auto equality = [&](bool equal) {
+      if (lhs != rhs) {
+        error_at(op, "Unmatched types around comparison operator");
+      }
+      switch (lhs) {
+      case StackType::number:
+        emit(equal ? op_equal_f64 : op_not_equal_f64, 2, 1);
+        break;
+      case StackType::boolean:
+        emit(equal ? op_equal_bool : op_not_equal_bool, 2, 1);
+        break;
+      default:
+        rewind(lhs_start);
+        emit(equal ? op_true : op_false, 0, 1);
+        break;
+      }
+      return StackType::boolean;
+    };
+
+    switch (op.type) {
+    case token_type::plus:
+      return arithmetic(op_add_f64);
+    case token_type::minus:
+      return arithmetic(op_subtract_f64);
+    case token_type::star:
+      return arithmetic(op_multiply_f64);
+    case token_type::slash:
+      return arithmetic(op_divide_f64);
+    case token_type::double_equal:
+      return equality(true);
+    case token_type::bang_equal:
+      return equality(false);
+    case token_type::less:
+      return comparison(op_less_f64);
+    case token_type::less_equal:
+      return comparison(op_less_equal_f64);
+    case token_type::greator:
+      return comparison(op_greater_f64);
+    case token_type::greater_equal:
+      return comparison(op_greater_equal_f64);
+    default:
+      error_at(op, "expect a infix operator");
+      return lhs;
+    }
+  }
+
+  constexpr auto branch() noexcept -> StackType
+  {
+    consume(token_type::left_paren,
+            "condition of an if expression must in a group");
+    const auto condition = expression(prec_assignment);
+    consume(token_type::right_paren, "Expect `)` at the end of the expression");
+    if (condition != StackType::boolean) {
+      error_at(previous_, "I want a Bool in condition of if expression");
+    }
+    const auto else_jump = emit_jump(op_jmp_false_wide, 1);
+
+    const auto if_type = expression(prec_assignment);
+    const auto end_jump = emit_jump(op_jmp_wide, 0);
+    depth_ -= 1; // The else branch starts without the value of the if branch
+    patch_jump(else_jump);
+
+    consume(token_type::keyword_else, "if expression must have an else branch");
+    const auto else_type = expression(prec_assignment);
+    patch_jump(end_jump);
+
+    if (if_type != else_type) {
+      error_at(previous_, "Type mismatch in branching!");
+    }
+    return if_type;
+  }
+
+  // Converts a number literal to the nearest double
+  //
+  // strtod is not usable in constant expressions. When the significant digits
+  // fit in the 53 bits mantissa and the power of ten is exact, a single
+  // multiplication or division rounds correctly, other literals are rejected.
+  constexpr auto number() noexcept -> StackType
+  {
+    constexpr std::uint64_t max_exact = std::uint64_t{1} << 53;
+    constexpr int max_exact_power = 22;
+
+    std::uint64_t digits = 0;
+    int exponent = 0;
+    int pending_zeros = 0; // Trailing zeros not yet added to digits
+    bool fraction = false;
+    bool exact = true;
+    for (const char c : previous_.text) {
+      if (c == '.') {
+        fraction = true;
+        continue;
+      }
+      if (fraction) {
+        --exponent;
+      }
+      if (c == '0') {
+        ++pending_zeros;
+        continue;
+      }
+      for (; pending_zeros > 0; --pending_zeros) {
+        exact = exact && digits <= max_exact / 10;
+        digits *= 10;
+      }
+      exact = exact && digits <= (max_exact - 9) / 10;
+      digits = digits * 10 + static_cast<std::uint64_t>(c - '0');
+    }
+    exponent += pending_zeros;
+
+    if (!exact || exponent > max_exact_power || exponent < -max_exact_power) {
+      error_at(previous_, "The number literal has too many significant digits "
+                          "to be compiled statically");
+      return StackType::number;
+    }
+
+    double power = 1;
+    for (int i = 0; i < (exponent < 0 ? -exponent : exponent); ++i) {
+      power *= 10;
+    }
+    const auto significand = static_cast<double>(digits);
+    emit_number(exponent < 0 ? significand / power : significand * power);
+    return StackType::number;
+  }
+
+  // Globals are constants, so they are pushed like literals. Later globals
+  // shadow earlier ones with the same name, like Compiler::add_global.
+  constexpr auto global() noexcept -> StackType
+  {
+    for (auto i = global_count; i > 0; --i) {
+      const auto& global = globals_[i - 1];
+      if (global.name != previous_.text) {
+        continue;
+      }
+      if (global.type == StackType::boolean) {
+        emit(global.boolean ? op_true : op_false, 0, 1);
+      } else if (global.number - global.number != 0) { // NaN or infinity
+        error_at(previous_, "Number globals must be finite to be compiled "
+                            "statically");
+      } else if (sign_bit_of(global.number)) {
+        emit_number(-global.number);
+        emit(op_negate_f64, 1, 1);
+      } else {
+        emit_number(global.number);
+      }
+      return global.type;
+    }
+    error_at(previous_, "Undefined identifier");
+    return StackType::unit;
+  }
+
+  Scanner::iterator current_;
+  Token previous_;
+  const std::array<StaticGlobal, global_count>& globals_;
+  StaticBytecode<capacity> chunk_{};
+  std::size_t depth_ = 0;
+};
+
+} // namespace detail
+
+/**
+ * @brief Compiles a script during the C++ compilation
+ *
+ * The script is scanned, parsed, type checked and lowered into bytecode in
+ * one pass, so `constexpr auto chunk = eml::compile_static("1 + 2 * x",
+ * globals);` bakes the chunk into the binary. Check the result with
+ * `static_assert(chunk)` to turn script errors into C++ compilation errors.
+ *
+ * The script can use numbers, booleans, unit, the arithmetic, comparison and
+ * logical operators, if expressions, and the globals. Strings need the garbage
+ * collector, and number literals with more significant digits than a double
+ * holds can not be converted exactly, so both are compilation errors.
+ *
+ * @tparam capacity The maximum number of bytes of instructions
+ * @return The chunk, or a chunk whose @ref StaticBytecode::error tells the
+ * first error
+ */
+template <std::size_t capacity = default_static_capacity,
+          std::size_t global_count = 0>
+constexpr auto
+compile_static(std::string_view source,
+               const std::array<StaticGlobal, global_count>& globals = {})
+    -> StaticBytecode<capacity>
+{
+  return detail::StaticCompiler<capacity, global_count>{source, globals}
+      .compile();
+}
+
+} // namespace eml
+
+#endif // EML_STATIC_COMPILER_HPP
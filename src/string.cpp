@@ -1,3 +1,5 @@
+#include <cstring>
+
 #include "string.hpp"
 
 namespace eml {
@@ -10,4 +12,13 @@ auto make_string(std::string_view s, GarbageCollector& gc) -> GcPointer
   return result;
 }
 
+auto equal_strings(GcPointer lhs, GcPointer rhs) noexcept -> bool
+{
+  if (lhs == rhs) {
+    return true;
+  }
+  return lhs->size() == rhs->size() &&
+         std::memcmp(lhs->data(), rhs->data(), lhs->size()) == 0;
+}
+
 } // namespace eml
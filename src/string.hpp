@@ -18,6 +18,12 @@ namespace eml {
 
 auto make_string(std::string_view s, GarbageCollector& gc) -> GcPointer;
 
+/**
+ * @brief Returns whether two strings have the same contents
+ */
+[[nodiscard]] auto equal_strings(GcPointer lhs, GcPointer rhs) noexcept
+    -> bool;
+
 } // namespace eml
 
 #endif // EML_STRING_HPP
@@ -0,0 +1,144 @@
+#include <iterator>
+#include <optional>
+
+#include "bytecode_rewriter.hpp"
+#include "superinstruction.hpp"
+
+namespace eml {
+
+namespace {
+
+struct FusionRule {
+  opcode first;
+  opcode second;
+  opcode fused;
+};
+
+// The most frequent pairs of the profile of the scripts in
+// benchmark/superinstructions.cpp: two pushes in a row, a push at the start of
+// the then branch of an if expression, an arithmetic operation with a literal
+// or a global as its right operand, and a comparison followed by the
+// conditional jump of an if expression.
+//
+// op_push_f64 in a rule stands for a push of a number in any of its encodings,
+// the fused instruction stores the number inline.
+//
+// When two rules overlap on an instruction, the rule that comes first in the
+// table wins, so push a; push b; add fuses into push a; push_add b instead of
+// push2 a, b; add.
+constexpr FusionRule fusion_rules[] = {
+    {op_push_f64, op_add_f64, op_push_add_f64},
+    {op_push_f64, op_subtract_f64, op_push_subtract_f64},
+    {op_push_f64, op_multiply_f64, op_push_multiply_f64},
+    {op_push_f64, op_divide_f64, op_push_divide_f64},
+    {op_push_f64, op_negate_f64, op_push_negate_f64},
+    {op_less_f64, op_jmp_false, op_less_f64_jmp_false},
+    {op_less_equal_f64, op_jmp_false, op_less_equal_f64_jmp_false},
+    {op_greater_f64, op_jmp_false, op_greater_f64_jmp_false},
+    {op_greater_equal_f64, op_jmp_false, op_greater_equal_f64_jmp_false},
+    {op_push_f64, op_push_f64, op_push2_f64},
+    {op_jmp_false, op_push_f64, op_jmp_false_push_f64},
+};
+
+// Returns the index of the rule that fuses first and second
+auto find_fusion(opcode first, opcode second) -> std::optional<std::size_t>
+{
+  for (std::size_t i = 0; i < std::size(fusion_rules); ++i) {
+    if (fusion_rules[i].first == first && fusion_rules[i].second == second) {
+      return i;
+    }
+  }
+  return {};
+}
+
+} // anonymous namespace
+
+void profile_opcode_pairs(const Bytecode& code, OpcodePairProfile& profile)
+{
+  const auto decoded = decode(code);
+  const auto jump_targets = decoded.jump_targets();
+  const auto opcode_of = [&decoded](const auto& instruction) {
+    return decoded.pushed_number(instruction) ? op_push_f64 : instruction.op;
+  };
+  for (std::size_t i = 1; i < decoded.instructions.size(); ++i) {
+    if (!jump_targets[i]) {
+      ++profile[{opcode_of(decoded.instructions[i - 1]),
+                 opcode_of(decoded.instructions[i])}];
+    }
+  }
+}
+
+auto fuse_superinstructions(const Bytecode& code) -> Bytecode
+{
+  auto decoded = decode(code);
+  auto& instructions = decoded.instructions;
+  const auto jump_targets = decoded.jump_targets();
+
+  // The opcode of an instruction in the rules, or nullopt for the pushes of
+  // constants that are not numbers, which are never fused
+  const auto opcode_of = [&decoded](const DecodedInstruction& instruction)
+      -> std::optional<opcode> {
+    if (decoded.pushed_number(instruction)) {
+      return op_push_f64;
+    }
+    if (instruction.op == op_push_f64) {
+      return {};
+    }
+    return instruction.op;
+  };
+  // The rule that fuses the instructions at i and i + 1, if any
+  const auto fusion_at = [&](std::size_t i) -> std::optional<std::size_t> {
+    // Someone jumps into the middle of the sequence
+    if (i + 1 >= instructions.size() || jump_targets[i + 1]) {
+      return {};
+    }
+    const auto first = opcode_of(instructions[i]);
+    const auto second = opcode_of(instructions[i + 1]);
+    if (!first || !second) {
+      return {};
+    }
+    return find_fusion(*first, *second);
+  };
+
+  std::vector<bool> removed(instructions.size(), false);
+  for (std::size_t i = 0; i + 1 < instructions.size(); ++i) {
+    const auto rule = fusion_at(i);
+    if (!rule) {
+      continue;
+    }
+    if (const auto next_rule = fusion_at(i + 1);
+        next_rule && *next_rule < *rule) {
+      continue;
+    }
+
+    auto& instruction = instructions[i];
+    const auto& next = instructions[i + 1];
+    const auto number = decoded.pushed_number(instruction);
+    const auto next_number = decoded.pushed_number(next);
+    instruction.op = fusion_rules[*rule].fused;
+    switch (operand_kind_of(instruction.op)) {
+    case operand_kind::f64:
+      instruction.immediate = *number;
+      break;
+    case operand_kind::jump:
+      instruction.target = next.target;
+      break;
+    case operand_kind::f64_pair:
+      instruction.immediate = *number;
+      instruction.second_immediate = *next_number;
+      break;
+    case operand_kind::jump_f64:
+      instruction.immediate = *next_number;
+      break;
+    default:
+      break;
+    }
+    removed[i + 1] = true;
+    ++i;
+  }
+
+  decoded.erase(removed);
+  return encode(decoded);
+}
+
+} // namespace eml
@@ -0,0 +1,39 @@
+#ifndef EML_SUPERINSTRUCTION_HPP
+#define EML_SUPERINSTRUCTION_HPP
+
+#include <cstddef>
+#include <map>
+#include <utility>
+
+#include "bytecode.hpp"
+
+/**
+ * @file superinstruction.hpp
+ * @brief Fusion of common instruction sequences into superinstructions
+ */
+
+namespace eml {
+
+/**
+ * @brief Number of occurrences of every pair of adjacent opcodes
+ */
+using OpcodePairProfile = std::map<std::pair<opcode, opcode>, std::size_t>;
+
+/**
+ * @brief Adds the adjacent opcode pairs of a chunk to a profile
+ *
+ * Pairs whose second instruction is a jump target are not counted, since they
+ * cannot be fused. Pushes of a number count as @ref op_push_f64 whatever their
+ * encoding, like in the fusion rules.
+ */
+void profile_opcode_pairs(const Bytecode& code, OpcodePairProfile& profile);
+
+/**
+ * @brief Replaces the common instruction sequences in a chunk with
+ * superinstructions
+ */
+[[nodiscard]] auto fuse_superinstructions(const Bytecode& code) -> Bytecode;
+
+} // namespace eml
+
+#endif // EML_SUPERINSTRUCTION_HPP
@@ -232,14 +232,17 @@ struct TypeChecker : AstVisitor {
       def.set_binding_type(def.to().type());
     }
 
-    // TODO(Lesley Lai): implement constant folding
-    const auto v = dynamic_cast<const LiteralExpr*>(&def.to());
+    if (has_error) {
+      return;
+    }
 
-    if (v == nullptr) {
-      error("Constant folding is unimplemented yet");
+    // Globals are constants, evaluated once when they are defined
+    const auto value = compiler.evaluate_constant(def.to_ptr());
+    if (!value) {
+      error("The definition exceeds the compile-time evaluation budget");
     } else {
       compiler.add_global(std::string{def.identifier()}, *def.binding_type(),
-                          v->value());
+                          *value);
     }
   }
 
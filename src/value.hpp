@@ -8,6 +8,7 @@
 
 #include <iomanip>
 #include <iostream>
+#include <cstdint>
 #include <limits>
 #include <optional>
 #include <type_traits>
@@ -18,6 +19,147 @@
 
 namespace eml {
 
+#ifdef EML_NAN_BOXING
+
+static_assert(sizeof(void*) == 8,
+              "NaN boxing requires a platform with 64 bits pointers");
+
+/**
+ * @brief A NaN-boxed value that fits in a single 64 bits word
+ *
+ * Numbers are stored as is. All the other values live in the payload of quiet
+ * NaNs that the floating point hardware never produces: unit and booleans are
+ * small tags, and references set the sign bit and keep the pointer in the
+ * lower 48 bits.
+ */
+struct Value {
+  static_assert(std::numeric_limits<double>::is_iec559,
+                "Embedded ML require IEEE 754 floating point number is in use");
+
+  constexpr Value() noexcept : bits_{unit_bits} {}
+  // Every NaN becomes the canonical one, since NaNs with other payloads could
+  // read back as the tags of the other values
+  explicit Value(double v) noexcept
+      : bits_{v != v ? canonical_nan : bit_cast<std::uint64_t>(v)}
+  {
+  }
+  constexpr explicit Value(bool b) noexcept : bits_{b ? true_bits : false_bits}
+  {
+  }
+  explicit Value(GcPointer o) noexcept
+      : bits_{sign_bit | quiet_nan | reinterpret_cast<std::uintptr_t>(o.get())}
+  {
+    EML_ASSERT((reinterpret_cast<std::uintptr_t>(o.get()) &
+                (sign_bit | quiet_nan)) == 0,
+               "The pointer does not fit in the payload of a NaN");
+  }
+
+  constexpr Value(const Value& value) noexcept = default;
+  Value& operator=(const Value& value) noexcept = default;
+
+  constexpr Value(Value&& value) noexcept = default;
+  Value& operator=(Value&& value) noexcept = default;
+  ~Value() = default;
+
+  /**
+   * @brief Returns whether the value is a unit value
+   */
+  constexpr auto is_unit() const noexcept -> bool
+  {
+    return bits_ == unit_bits;
+  }
+
+  /**
+   * @brief Returns whether the value is a double
+   */
+  constexpr auto is_number() const noexcept -> bool
+  {
+    return (bits_ & quiet_nan) != quiet_nan;
+  }
+
+  /**
+   * @brief Returns the value as a number
+   * @warning The result is undefined if the value is actually not a double
+   */
+  auto unsafe_as_number() const noexcept -> double
+  {
+    return bit_cast<double>(bits_);
+  }
+
+  /**
+   * @brief Returns whether the value is a bool
+   */
+  constexpr auto is_boolean() const noexcept -> bool
+  {
+    return (bits_ | 1) == true_bits;
+  }
+
+  /**
+   * @brief Returns the value as a boolean
+   * @warning The result is undefined if the value is actually not a boolean
+   */
+  constexpr auto unsafe_as_boolean() const noexcept -> bool
+  {
+    return bits_ == true_bits;
+  }
+
+  /**
+   * @brief Returns whether the value is a reference
+   */
+  constexpr auto is_reference() const noexcept -> bool
+  {
+    return (bits_ & (sign_bit | quiet_nan)) == (sign_bit | quiet_nan);
+  }
+
+  /**
+   * @brief Extracts the underlying reference from the Value
+   * @warning The result is undefined if the value is actually not a reference
+   */
+  auto unsafe_as_reference() const noexcept -> GcPointer
+  {
+    return GcPointer{reinterpret_cast<Obj*>(bits_ & ~(sign_bit | quiet_nan))};
+  }
+
+  /**
+   * @brief Returns the underlying 64 bits representation of the Value
+   */
+  constexpr auto bits() const noexcept -> std::uint64_t
+  {
+    return bits_;
+  }
+
+private:
+  static constexpr std::uint64_t sign_bit = 0x8000000000000000;
+  static constexpr std::uint64_t quiet_nan = 0x7ffc000000000000;
+  static constexpr std::uint64_t canonical_nan = 0x7ff8000000000000;
+
+  static constexpr std::uint64_t unit_bits = quiet_nan | 1;
+  static constexpr std::uint64_t false_bits = quiet_nan | 2;
+  static constexpr std::uint64_t true_bits = quiet_nan | 3;
+
+  std::uint64_t bits_;
+};
+
+inline auto operator==(const Value& lhs, const Value& rhs)
+{
+  EML_ASSERT(lhs.is_number() == rhs.is_number() &&
+                 lhs.is_boolean() == rhs.is_boolean() &&
+                 lhs.is_reference() == rhs.is_reference(),
+             "equality test should only happen on the same type");
+
+  if (lhs.is_number()) {
+    return lhs.unsafe_as_number() == rhs.unsafe_as_number();
+  }
+  return lhs.bits() == rhs.bits();
+}
+
+inline auto operator!=(const Value& lhs, const Value& rhs)
+{
+  return !(lhs == rhs);
+}
+
+#else
+
 struct Value {
   static_assert(std::numeric_limits<double>::is_iec559,
                 "Embedded ML require IEEE 754 floating point number is in use");
@@ -144,9 +286,24 @@ constexpr auto operator!=(const Value& lhs, const Value& rhs)
   return !(lhs == rhs);
 }
 
+#endif
+
 auto to_string(const Type& t, const Value& v,
                PrintType print_type = PrintType::yes) -> std::string;
 
+/**
+ * @brief Marks the object that a value refers to as live, if any, and points
+ * the value to the promoted copy of a nursery object
+ */
+inline void mark(GarbageCollector& gc, Value& v) noexcept
+{
+  if (v.is_reference()) {
+    auto object = v.unsafe_as_reference();
+    gc.mark(object);
+    v = Value{object};
+  }
+}
+
 } // namespace eml
 
 #endif // EML_VALUE_HPP
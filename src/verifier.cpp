@@ -0,0 +1,289 @@
+#include <algorithm>
+#include <optional>
+#include <vector>
+
+#include "verifier.hpp"
+
+namespace eml {
+
+auto stack_type_of(Value v) noexcept -> StackType
+{
+  if (v.is_number()) {
+    return StackType::number;
+  }
+  if (v.is_boolean()) {
+    return StackType::boolean;
+  }
+  if (v.is_reference()) {
+    return StackType::reference;
+  }
+  return StackType::unit;
+}
+
+namespace {
+
+using StackState = std::vector<StackType>;
+
+struct Verifier {
+  const std::byte* instructions;
+  std::size_t size;
+  const Value* constants;
+  std::size_t constant_count;
+
+  // Stack before every byte offset that some path reaches
+  std::vector<std::optional<StackState>> state_at;
+  std::vector<bool> is_boundary;
+  std::size_t max_depth = 0;
+
+  Verifier(const std::byte* instructions_in, std::size_t size_in,
+           const Value* constants_in, std::size_t constant_count_in)
+      : instructions{instructions_in}, size{size_in},
+        constants{constants_in}, constant_count{constant_count_in},
+        state_at(size_in + 1), is_boundary(size_in + 1, false)
+  {
+  }
+
+  // Merges the stack of a path into the stack at offset, returns false if they
+  // differ
+  auto join(std::size_t offset, const StackState& stack) -> bool
+  {
+    auto& state = state_at[offset];
+    if (!state) {
+      state = stack;
+      return true;
+    }
+    return *state == stack;
+  }
+
+  // Verifies the instruction at offset, updates stack to the stack after it
+  // and returns the offset of the next instruction
+  auto instruction(std::size_t offset, StackState& stack)
+      -> expected<std::size_t, VerificationError>
+  {
+    const auto error = [offset](std::string msg) {
+      return unexpected{VerificationError{std::move(msg), offset}};
+    };
+
+    const auto pop = [&](std::optional<StackType> expected_type)
+        -> std::optional<StackType> {
+      if (stack.empty() || (expected_type && stack.back() != *expected_type)) {
+        return {};
+      }
+      const auto type = stack.back();
+      stack.pop_back();
+      return type;
+    };
+
+    if (std::to_integer<std::size_t>(instructions[offset]) >= opcode_count) {
+      return error("Unknown opcode");
+    }
+    const auto op = static_cast<opcode>(instructions[offset]);
+    const auto next = offset + instruction_size(op);
+    if (next > size) {
+      return error("The operand of the last instruction is incomplete");
+    }
+    const auto* operand = &instructions[offset] + 1;
+
+    const auto unary = [&](StackType in, StackType out) -> bool {
+      if (!pop(in)) {
+        return false;
+      }
+      stack.push_back(out);
+      return true;
+    };
+
+    const auto binary = [&](StackType in, StackType out) -> bool {
+      if (!pop(in) || !pop(in)) {
+        return false;
+      }
+      stack.push_back(out);
+      return true;
+    };
+
+    bool well_typed = true;
+    switch (op) {
+    case op_return:
+      return error("The vm does not support return");
+    case op_push_f64:
+    case op_push_f64_wide: {
+      const std::size_t index = op == op_push_f64
+                                    ? std::to_integer<std::size_t>(*operand)
+                                    : read_u32(operand);
+      if (index >= constant_count) {
+        return error("Constant index out of range");
+      }
+      stack.push_back(stack_type_of(constants[index]));
+    } break;
+    case op_push_f64_imm:
+    case op_push_f64_small:
+    case op_push_f64_zero:
+    case op_push_f64_one:
+    case op_push_f64_minus_one:
+    case op_push_negate_f64:
+      stack.push_back(StackType::number);
+      break;
+    case op_true:
+    case op_false:
+      stack.push_back(StackType::boolean);
+      break;
+    case op_unit:
+      stack.push_back(StackType::unit);
+      break;
+    case op_pop:
+      well_typed = pop(std::nullopt).has_value();
+      break;
+    case op_negate_f64:
+    case op_push_add_f64:
+    case op_push_subtract_f64:
+    case op_push_multiply_f64:
+    case op_push_divide_f64:
+      well_typed = unary(StackType::number, StackType::number);
+      break;
+    case op_not:
+      well_typed = unary(StackType::boolean, StackType::boolean);
+      break;
+    case op_add_f64:
+    case op_subtract_f64:
+    case op_multiply_f64:
+    case op_divide_f64:
+      well_typed = binary(StackType::number, StackType::number);
+      break;
+    case op_equal:
+    case op_not_equal: {
+      const auto rhs = pop(std::nullopt);
+      well_typed = rhs && pop(*rhs);
+      stack.push_back(StackType::boolean);
+    } break;
+    case op_equal_f64:
+    case op_not_equal_f64:
+    case op_less_f64:
+    case op_less_equal_f64:
+    case op_greater_f64:
+    case op_greater_equal_f64:
+      well_typed = binary(StackType::number, StackType::boolean);
+      break;
+    case op_equal_bool:
+    case op_not_equal_bool:
+      well_typed = binary(StackType::boolean, StackType::boolean);
+      break;
+    case op_equal_string:
+    case op_not_equal_string:
+      well_typed = binary(StackType::reference, StackType::boolean);
+      break;
+    case op_jmp:
+    case op_jmp_wide:
+      break;
+    case op_jmp_false:
+    case op_jmp_false_wide:
+      well_typed = pop(StackType::boolean).has_value();
+      break;
+    case op_less_f64_jmp_false:
+    case op_less_equal_f64_jmp_false:
+    case op_greater_f64_jmp_false:
+    case op_greater_equal_f64_jmp_false:
+    case op_less_f64_jmp_false_wide:
+    case op_less_equal_f64_jmp_false_wide:
+    case op_greater_f64_jmp_false_wide:
+    case op_greater_equal_f64_jmp_false_wide:
+      well_typed = pop(StackType::number) && pop(StackType::number);
+      break;
+    case op_push2_f64:
+      stack.push_back(StackType::number);
+      stack.push_back(StackType::number);
+      break;
+    case op_jmp_false_push_f64:
+    case op_jmp_false_push_f64_wide:
+      well_typed = unary(StackType::boolean, StackType::number);
+      break;
+    }
+
+    if (!well_typed) {
+      return error("Operands on the stack have the wrong types");
+    }
+    max_depth = std::max(max_depth, stack.size());
+
+    if (is_jump_operand(operand_kind_of(op))) {
+      const auto distance = read_jump_offset(op, operand);
+      if (distance > size - next) {
+        return error("Jump out of the chunk");
+      }
+      // The jump leaves before the pushes
+      const StackState jump_stack(
+          stack.begin(), stack.end() - static_cast<std::ptrdiff_t>(
+                                           stack_effect_of(op).pushes));
+      if (!join(next + distance, jump_stack)) {
+        return error("The stack at the jump target differs between paths");
+      }
+    }
+
+    if (op != op_jmp && op != op_jmp_wide && !join(next, stack)) {
+      return error("The stack at the next instruction differs between paths");
+    }
+
+    return next;
+  }
+
+  auto run() -> std::optional<VerificationError>
+  {
+    state_at[0] = StackState{};
+
+    for (std::size_t offset = 0; offset < size;) {
+      is_boundary[offset] = true;
+
+      // Jumps only go forward, so every path to offset is already joined
+      if (!state_at[offset]) {
+        // Unreachable instructions are only decoded to find the boundaries
+        const auto op = std::to_integer<std::size_t>(instructions[offset]);
+        if (op >= opcode_count) {
+          break;
+        }
+        offset += instruction_size(static_cast<opcode>(op));
+        continue;
+      }
+
+      StackState stack = *state_at[offset];
+      const auto next = instruction(offset, stack);
+      if (!next) {
+        return next.error();
+      }
+      offset = *next;
+    }
+    is_boundary[size] = true;
+
+    for (std::size_t offset = 0; offset <= size; ++offset) {
+      if (state_at[offset] && !is_boundary[offset]) {
+        return VerificationError{"Jump into the middle of an instruction",
+                                 offset};
+      }
+    }
+    return {};
+  }
+};
+
+} // anonymous namespace
+
+auto verify(Bytecode code) -> expected<VerifiedBytecode, VerificationError>
+{
+  const auto max_depth =
+      verify_instructions(code.instructions.data(), code.instructions.size(),
+                          code.constants.data(), code.constants.size());
+  if (!max_depth) {
+    return unexpected{std::move(max_depth.error())};
+  }
+
+  code.max_stack_depth = *max_depth;
+  return VerifiedBytecode{std::move(code), *max_depth};
+}
+
+auto verify_instructions(const std::byte* instructions, std::size_t size,
+                         const Value* constants, std::size_t constant_count)
+    -> expected<std::size_t, VerificationError>
+{
+  Verifier verifier{instructions, size, constants, constant_count};
+  if (auto error = verifier.run(); error) {
+    return unexpected{std::move(*error)};
+  }
+  return verifier.max_depth;
+}
+
+} // namespace eml
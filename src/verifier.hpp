@@ -0,0 +1,106 @@
+#ifndef EML_VERIFIER_HPP
+#define EML_VERIFIER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "bytecode.hpp"
+#include "expected.hpp"
+
+/**
+ * @file verifier.hpp
+ * @brief Verification of bytecode before running it without runtime checks
+ */
+
+namespace eml {
+
+/**
+ * @brief The reason a chunk failed the verification
+ */
+struct VerificationError {
+  std::string msg;
+  std::size_t offset; ///< @brief Byte offset of the offending instruction
+
+  VerificationError(std::string msg_in, std::size_t offset_in)
+      : msg{std::move(msg_in)}, offset{offset_in}
+  {
+  }
+};
+
+/**
+ * @brief The type of a value on the stack of a verified chunk
+ */
+enum class StackType : std::uint8_t { unit, number, boolean, reference };
+
+/// @brief Returns the type of a value on the stack
+[[nodiscard]] auto stack_type_of(Value v) noexcept -> StackType;
+
+class VerifiedBytecode;
+
+/**
+ * @brief Verifies that a chunk is safe to run without runtime checks
+ *
+ * The verifier proves that:
+ * - every opcode exists and its operands are inside the instructions
+ * - constant indices are inside the constant pool
+ * - jumps land on an instruction boundary inside the chunk
+ * - no instruction pops from an empty stack
+ * - every instruction finds operands of the right types on the stack
+ * - all paths that join at an instruction have the same stack
+ *
+ * Chunks that do not come from @ref Compiler::generate_code, for example
+ * chunks loaded from disk, should be verified before running.
+ */
+[[nodiscard]] auto verify(Bytecode code)
+    -> expected<VerifiedBytecode, VerificationError>;
+
+/**
+ * @brief Verifies the size bytes of instructions against a constant pool that
+ * is not held by a @ref Bytecode, like the image of a bytecode file
+ *
+ * Proves the same properties as @ref verify.
+ *
+ * @return The maximum depth of the stack while running the instructions
+ */
+[[nodiscard]] auto verify_instructions(const std::byte* instructions,
+                                       std::size_t size, const Value* constants,
+                                       std::size_t constant_count)
+    -> expected<std::size_t, VerificationError>;
+
+/**
+ * @brief A chunk that passed the verification
+ *
+ * Only @ref verify creates verified chunks, and they are immutable afterward,
+ * so the @ref VM runs them on an interpreter loop without runtime checks.
+ */
+class VerifiedBytecode {
+public:
+  /// @brief Returns the verified chunk
+  [[nodiscard]] auto code() const noexcept -> const Bytecode&
+  {
+    return code_;
+  }
+
+  /// @brief Returns the maximum depth of the stack while running the chunk
+  [[nodiscard]] auto max_stack_depth() const noexcept -> std::size_t
+  {
+    return max_stack_depth_;
+  }
+
+private:
+  friend auto verify(Bytecode code)
+      -> expected<VerifiedBytecode, VerificationError>;
+
+  VerifiedBytecode(Bytecode code, std::size_t max_stack_depth)
+      : code_{std::move(code)}, max_stack_depth_{max_stack_depth}
+  {
+  }
+
+  Bytecode code_;
+  std::size_t max_stack_depth_;
+};
+
+} // namespace eml
+
+#endif // EML_VERIFIER_HPP
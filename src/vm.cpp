@@ -1,11 +1,18 @@
+#include <chrono>
 #include <iomanip>
 #include <iostream>
 #include <sstream>
+#include <stdexcept>
 #include <string_view>
 
 #include "common.hpp"
+#include "bytecode_file.hpp"
 #include "eml.hpp"
+#include "frozen_bytecode.hpp"
+#include "jit.hpp"
 #include "parser.hpp"
+#include "string.hpp"
+#include "verifier.hpp"
 
 #include "vm.hpp"
 
@@ -14,25 +21,24 @@ namespace eml {
 namespace {
 
 // Push value to the stack
-void push(std::vector<Value>& stack, Value value)
+// Warning: Calling push on a full stack is undefined.
+void push(Value*& stack_top, Value value)
 {
-  stack.push_back(value);
+  *stack_top++ = value;
 }
 
 // Returns the value to the last
 // Warning: Calling pop on a vm with empty stack is undefined.
-auto pop(std::vector<Value>& stack) -> Value
+auto pop(Value*& stack_top) -> Value
 {
-  Value v = stack.back();
-  stack.pop_back();
-  return v;
+  return *--stack_top;
 }
 
 // Helper for binary operations
-template <typename F> void binary_operation(std::vector<Value>& stack, F op)
+template <typename F> void binary_operation(Value*& stack_top, F op)
 {
-  Value right = pop(stack);
-  Value left = pop(stack);
+  Value right = pop(stack_top);
+  Value left = pop(stack_top);
 
   EML_ASSERT(left.is_number(),
              "The left operands of a binary operation must be a number.");
@@ -40,135 +46,649 @@ template <typename F> void binary_operation(std::vector<Value>& stack, F op)
   EML_ASSERT(right.is_number(),
              "The left operands of a binary operation must be a number.");
 
-  push(stack, Value{op(left.unsafe_as_number(), right.unsafe_as_number())});
+  push(stack_top, Value{op(left.unsafe_as_number(), right.unsafe_as_number())});
 }
 
-template <typename F> void equality_operation(std::vector<Value>& stack, F op)
+template <typename F> void equality_operation(Value*& stack_top, F op)
 {
-  Value right = pop(stack);
-  Value left = pop(stack);
+  Value right = pop(stack_top);
+  Value left = pop(stack_top);
 
-  push(stack, Value{op(left, right)});
+  push(stack_top, Value{op(left, right)});
 }
 
 // Helper for comparison operations
-template <typename F> void comparison_operation(std::vector<Value>& stack, F op)
+template <typename F> void comparison_operation(Value*& stack_top, F op)
 {
-  Value right = pop(stack);
-  Value left = pop(stack);
+  Value right = pop(stack_top);
+  Value left = pop(stack_top);
 
-  push(stack, Value{op(left.unsafe_as_number(), right.unsafe_as_number())});
+  push(stack_top, Value{op(left.unsafe_as_number(), right.unsafe_as_number())});
 }
 
+// Helper for equality of booleans
+template <typename F> void boolean_equality(Value*& stack_top, F op)
+{
+  Value right = pop(stack_top);
+  Value left = pop(stack_top);
+
+  push(stack_top,
+       Value{op(left.unsafe_as_boolean(), right.unsafe_as_boolean())});
+}
+
+// Helper for equality of strings, returns whether their contents are equal
+auto string_equality(Value*& stack_top) -> bool
+{
+  Value right = pop(stack_top);
+  Value left = pop(stack_top);
+
+  return equal_strings(left.unsafe_as_reference(), right.unsafe_as_reference());
+}
+
+// Reads the float_64 stored inline at ip and moves ip past it
+auto read_f64_operand(const std::byte*& ip) -> double
+{
+  const double value = read_f64(ip);
+  ip += sizeof(double);
+  return value;
+}
+
+// Reads the four bytes operand at ip and moves ip past it
+auto read_u32_operand(const std::byte*& ip) -> std::uint32_t
+{
+  const std::uint32_t value = read_u32(ip);
+  ip += sizeof(std::uint32_t);
+  return value;
+}
+
+// Helper for binary operations whose right operand is an immediate
+template <typename F>
+void immediate_binary_operation(Value*& stack_top, double right, F op)
+{
+  Value left = pop(stack_top);
+
+  EML_ASSERT(left.is_number(),
+             "The left operands of a binary operation must be a number.");
+
+  push(stack_top, Value{op(left.unsafe_as_number(), right)});
+}
+
+// Helper for comparisons fused with a jmp_false, returns whether to jump
+template <typename F>
+auto comparison_jump_false(Value*& stack_top, F op) -> bool
+{
+  Value right = pop(stack_top);
+  Value left = pop(stack_top);
+
+  return !op(left.unsafe_as_number(), right.unsafe_as_number());
+}
+
+// Measures the time from its construction to stop when enabled, reading the
+// clock costs more than running small chunks
+class Stopwatch {
+public:
+  using clock = std::chrono::steady_clock;
+
+  explicit Stopwatch(bool enabled) : enabled_{enabled}
+  {
+    if (enabled_) {
+      start_ = clock::now();
+    }
+  }
+
+  // Adds the elapsed time to counter
+  void stop(std::chrono::nanoseconds& counter) const
+  {
+    if (enabled_) {
+      counter += std::chrono::duration_cast<std::chrono::nanoseconds>(
+          clock::now() - start_);
+    }
+  }
+
+private:
+  bool enabled_;
+  clock::time_point start_;
+};
+
 } // anonymous namespace
 
+// The interpreter loop is written once with the following macros, and expands
+// to either a computed goto threaded dispatch or a portable switch dispatch.
+//
+// With computed goto, every handler ends with its own indirect jump through
+// the dispatch table, which gives the branch predictor one branch per opcode
+// instead of the single shared branch of the switch.
+#ifdef EML_VM_USE_COMPUTED_GOTO
+#define EML_VM_CASE(op) label_##op:
+#define EML_VM_DISPATCH()                                                      \
+  do {                                                                         \
+    if (ip == end) {                                                           \
+      goto finish;                                                             \
+    }                                                                          \
+    if constexpr (eml::build_options.debug_vm_trace_execution) {               \
+      trace_execution(ip);                                                     \
+    }                                                                          \
+    if constexpr (recording) {                                                 \
+      trace->push_back(static_cast<std::size_t>(ip - begin));                  \
+    }                                                                          \
+    goto* dispatch_table[std::to_integer<std::size_t>(*ip++)];                 \
+  } while (false)
+#define EML_VM_LOOP_BEGIN EML_VM_DISPATCH();
+#define EML_VM_LOOP_END
+#else
+#define EML_VM_CASE(op) case op:
+#define EML_VM_DISPATCH() continue
+#define EML_VM_LOOP_BEGIN                                                      \
+  for (;;) {                                                                   \
+    if (ip == end) {                                                           \
+      goto finish;                                                             \
+    }                                                                          \
+    if constexpr (eml::build_options.debug_vm_trace_execution) {               \
+      trace_execution(ip);                                                     \
+    }                                                                          \
+    if constexpr (recording) {                                                 \
+      trace->push_back(static_cast<std::size_t>(ip - begin));                  \
+    }                                                                          \
+    switch (static_cast<opcode>(*ip++)) {
+#define EML_VM_LOOP_END                                                        \
+  }                                                                            \
+  }
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+#ifdef __clang__
+#pragma clang diagnostic ignored "-Wgnu-label-as-value"
+#endif
+
 auto VM::interpret(const Bytecode& code) -> std::optional<Value>
 {
-  size_t offset = 0;
-  Value result{};
+  const auto max_stack_depth = code.max_stack_depth
+                                   ? code.max_stack_depth
+                                   : code.compute_max_stack_depth();
+  if (!max_stack_depth || !reserve_stack(*max_stack_depth)) {
+    return {};
+  }
+  return run<true>(ChunkView{code});
+}
 
-  for (auto ip = code.instructions.begin(); ip != code.instructions.end();
-       ++ip) {
-    if constexpr (eml::build_options.debug_vm_trace_execution) {
-      std::cout << "Stack: [";
+auto VM::interpret(const VerifiedBytecode& code) -> std::optional<Value>
+{
+  if (!reserve_stack(code.max_stack_depth())) {
+    return {};
+  }
+  return run<false>(ChunkView{code.code()});
+}
+
+auto VM::interpret(const FrozenBytecode& code) -> std::optional<Value>
+{
+  const auto max_stack_depth = code.max_stack_depth();
+  if (!max_stack_depth || !reserve_stack(*max_stack_depth)) {
+    return {};
+  }
+  const auto* const instructions = code.instructions();
+  return run<true>(ChunkView{instructions,
+                             instructions + code.instruction_size(),
+                             code.constants(), code.constant_count()});
+}
+
+auto VM::interpret(const MappedBytecode& code) -> std::optional<Value>
+{
+  if (!reserve_stack(code.max_stack_depth())) {
+    return {};
+  }
+  const auto* const instructions = code.instructions();
+  return run<false>(ChunkView{instructions,
+                              instructions + code.instruction_size(),
+                              code.constants(), code.constant_count()});
+}
+
+auto VM::interpret(const JitBytecode& code) -> std::optional<Value>
+{
+  if (code.is_native()) {
+    return code.run_native();
+  }
+  return interpret(code.code());
+}
 
-      for (auto i = stack_.begin(); i < stack_.end(); ++i) {
-        // std::cout << to_string(*i, PrintType::no);
-        if (i != stack_.end() - 1) {
-          std::cout << ", ";
-        }
+auto VM::interpret(TracingBytecode& code) -> std::optional<Value>
+{
+  const auto& chunk = code.code().code();
+  if (!reserve_stack(code.code().max_stack_depth())) {
+    return {};
+  }
+  auto& stats = code.stats_;
+
+  if (code.has_trace()) {
+    ++stats.trace_entries;
+    const Stopwatch native_watch{code.measure_time_};
+    std::optional<Value> result;
+    const auto exit = code.run_trace(stack_.get(), result);
+    native_watch.stop(stats.native_time);
+    if (!exit) {
+      return result;
+    }
+
+    ++stats.guard_failures;
+    const Stopwatch interpreter_watch{code.measure_time_};
+    result = run<false>(ChunkView{chunk}, exit->offset, exit->depth);
+    interpreter_watch.stop(stats.interpreted_time);
+    if (++code.guard_failures_of_trace_ >= code.hot_threshold_) {
+      code.discard_trace();
+    }
+    return result;
+  }
+
+  ++stats.interpreted_runs;
+  const Stopwatch interpreter_watch{code.measure_time_};
+  if (!build_options.jit || ++code.runs_without_trace_ < code.hot_threshold_) {
+    const auto result = run<false>(ChunkView{chunk});
+    interpreter_watch.stop(stats.interpreted_time);
+    return result;
+  }
+
+  Trace trace;
+  const auto result = run<false, true>(ChunkView{chunk}, 0, 0,
+                                      &trace.offsets);
+  interpreter_watch.stop(stats.interpreted_time);
+  code.runs_without_trace_ = 0;
+  code.install_trace(trace);
+  return result;
+}
+
+auto VM::interpret_static(const std::byte* instructions, std::size_t size,
+                          std::size_t max_stack_depth) -> std::optional<Value>
+{
+  // Static chunks push every number inline
+  if (!reserve_stack(max_stack_depth)) {
+    return {};
+  }
+  return run<false>(ChunkView{instructions, instructions + size, nullptr, 0});
+}
+
+template <bool checked, bool recording>
+auto VM::run(ChunkView chunk, std::size_t start, std::size_t depth,
+             [[maybe_unused]] std::vector<std::size_t>* trace)
+    -> std::optional<Value>
+{
+  const std::byte* const begin = chunk.begin;
+  const std::byte* const end = chunk.end;
+  const std::byte* ip = begin + start;
+  Value* stack_top = stack_.get() + depth;
+
+  // The verifier proved that every constant index of a verified chunk is
+  // inside the constant pool
+  const auto constant = [&chunk](auto index) -> Value {
+    if constexpr (checked) {
+      if (static_cast<std::size_t>(index) >= chunk.constant_count) {
+        throw std::out_of_range{"The constant index is out of the pool"};
       }
+      return chunk.constants[static_cast<std::size_t>(index)];
+    } else {
+      return chunk.constants[static_cast<std::size_t>(index)];
+    }
+  };
 
-      std::cout << "]\n";
-      std::cout << code.disassemble_instruction(ip, offset) << '\n';
-    }
-
-    const auto instruction = *ip;
-    switch (static_cast<opcode>(instruction)) {
-    case op_return:
-      std::fputs("EML: Do not know how to handle return yet\n", stderr);
-      std::exit(-1);
-    case op_push_f64: {
-      ++ip;
-      Value constant = code.read_constant(ip);
-      push(stack_, constant);
-    } break;
-    case op_pop:
-      result = pop(stack_);
-      break;
-    case op_unit:
-      push(stack_, Value{});
-      break;
-    case op_true: {
-      push(stack_, Value{true});
-    } break;
-    case op_false: {
-      push(stack_, Value{false});
-    } break;
-    case op_negate_f64: {
-      [[maybe_unused]] const Value v = stack_.back();
-      EML_ASSERT(v.is_number(), "Operand of unary - must be a number.");
-      push(stack_, Value{-pop(stack_).unsafe_as_number()});
-    } break;
-    case op_not: {
-      [[maybe_unused]] const Value v = stack_.back();
-      EML_ASSERT(v.is_boolean(), "Operand of unary ! must be a boolean.");
-      push(stack_, Value{!pop(stack_).unsafe_as_boolean()});
-    } break;
-    case op_add_f64:
-      binary_operation(stack_, std::plus<double>{});
-      break;
-    case op_subtract_f64:
-      binary_operation(stack_, std::minus<double>{});
-      break;
-    case op_multiply_f64:
-      binary_operation(stack_, std::multiplies<double>{});
-      break;
-    case op_divide_f64:
-      binary_operation(stack_, std::divides<double>{});
-      break;
-    case op_equal:
-      equality_operation(stack_, std::equal_to<Value>{});
-      break;
-    case op_not_equal:
-      equality_operation(stack_, std::not_equal_to<Value>{});
-      break;
-    case op_less_f64:
-      comparison_operation(stack_, std::less<double>{});
-      break;
-    case op_less_equal_f64:
-      comparison_operation(stack_, std::less_equal<double>{});
-      break;
-    case op_greater_f64:
-      comparison_operation(stack_, std::greater<double>{});
-      break;
-    case op_greater_equal_f64:
-      comparison_operation(stack_, std::greater_equal<double>{});
-      break;
-    case op_jmp: {
-      ++ip;
-      const auto jump_by = static_cast<int>(*ip);
-      ip += jump_by;
-    } break;
+  [[maybe_unused]] const auto trace_execution = [&](const std::byte* current_ip) {
+    std::cout << "Stack: [";
 
-    case op_jmp_false: {
-      ++ip;
-      if (!pop(stack_).unsafe_as_boolean()) {
-        const auto jump_by = static_cast<int>(*ip);
-        ip += jump_by;
+    for (auto i = stack_.get(); i < stack_top; ++i) {
+      // std::cout << to_string(*i, PrintType::no);
+      if (i != stack_top - 1) {
+        std::cout << ", ";
       }
     }
 
-    break;
+    std::cout << "]\n";
+    if (chunk.code == nullptr) {
+      return;
     }
+    const auto& code = *chunk.code;
+    const auto offset = current_ip - begin;
+    std::cout << code.disassemble_instruction(code.instructions.begin() +
+                                                  offset,
+                                              static_cast<std::size_t>(offset))
+              << '\n';
+  };
 
-    ++offset;
+#ifdef EML_VM_USE_COMPUTED_GOTO
+  static const void* const dispatch_table[] = {
+#define OPCODE_TABLE_ENTRY(op, kind, pops, pushes) &&label_##op,
+#include "opcode_table.inc"
+#undef OPCODE_TABLE_ENTRY
+  };
+  static_assert(std::size(dispatch_table) == opcode_count,
+                "The dispatch table must cover every opcode");
+#endif
+
+  EML_VM_LOOP_BEGIN
+
+  EML_VM_CASE(op_return)
+  {
+    std::fputs("EML: Do not know how to handle return yet\n", stderr);
+    std::exit(-1);
+  }
+  EML_VM_CASE(op_push_f64)
+  {
+    push(stack_top, constant(std::to_integer<std::size_t>(*ip++)));
+    EML_VM_DISPATCH();
+  }
+  EML_VM_CASE(op_push_f64_wide)
+  {
+    push(stack_top, constant(read_u32_operand(ip)));
+    EML_VM_DISPATCH();
+  }
+  EML_VM_CASE(op_push_f64_imm)
+  {
+    push(stack_top, Value{read_f64_operand(ip)});
+    EML_VM_DISPATCH();
+  }
+  EML_VM_CASE(op_push_f64_small)
+  {
+    const auto number = std::to_integer<std::int8_t>(*ip++);
+    push(stack_top, Value{static_cast<double>(number)});
+    EML_VM_DISPATCH();
+  }
+  EML_VM_CASE(op_push_f64_zero)
+  {
+    push(stack_top, Value{0.});
+    EML_VM_DISPATCH();
+  }
+  EML_VM_CASE(op_push_f64_one)
+  {
+    push(stack_top, Value{1.});
+    EML_VM_DISPATCH();
+  }
+  EML_VM_CASE(op_push_f64_minus_one)
+  {
+    push(stack_top, Value{-1.});
+    EML_VM_DISPATCH();
+  }
+  EML_VM_CASE(op_pop)
+  {
+    pop(stack_top);
+    EML_VM_DISPATCH();
+  }
+  EML_VM_CASE(op_unit)
+  {
+    push(stack_top, Value{});
+    EML_VM_DISPATCH();
+  }
+  EML_VM_CASE(op_true)
+  {
+    push(stack_top, Value{true});
+    EML_VM_DISPATCH();
+  }
+  EML_VM_CASE(op_false)
+  {
+    push(stack_top, Value{false});
+    EML_VM_DISPATCH();
+  }
+  EML_VM_CASE(op_negate_f64)
+  {
+    [[maybe_unused]] const Value v = stack_top[-1];
+    EML_ASSERT(v.is_number(), "Operand of unary - must be a number.");
+    push(stack_top, Value{-pop(stack_top).unsafe_as_number()});
+    EML_VM_DISPATCH();
+  }
+  EML_VM_CASE(op_not)
+  {
+    [[maybe_unused]] const Value v = stack_top[-1];
+    EML_ASSERT(v.is_boolean(), "Operand of unary ! must be a boolean.");
+    push(stack_top, Value{!pop(stack_top).unsafe_as_boolean()});
+    EML_VM_DISPATCH();
+  }
+  EML_VM_CASE(op_add_f64)
+  {
+    binary_operation(stack_top, std::plus<double>{});
+    EML_VM_DISPATCH();
+  }
+  EML_VM_CASE(op_subtract_f64)
+  {
+    binary_operation(stack_top, std::minus<double>{});
+    EML_VM_DISPATCH();
+  }
+  EML_VM_CASE(op_multiply_f64)
+  {
+    binary_operation(stack_top, std::multiplies<double>{});
+    EML_VM_DISPATCH();
+  }
+  EML_VM_CASE(op_divide_f64)
+  {
+    binary_operation(stack_top, std::divides<double>{});
+    EML_VM_DISPATCH();
+  }
+  EML_VM_CASE(op_equal)
+  {
+    equality_operation(stack_top, std::equal_to<Value>{});
+    EML_VM_DISPATCH();
+  }
+  EML_VM_CASE(op_not_equal)
+  {
+    equality_operation(stack_top, std::not_equal_to<Value>{});
+    EML_VM_DISPATCH();
+  }
+  EML_VM_CASE(op_equal_f64)
+  {
+    comparison_operation(stack_top, std::equal_to<double>{});
+    EML_VM_DISPATCH();
+  }
+  EML_VM_CASE(op_not_equal_f64)
+  {
+    comparison_operation(stack_top, std::not_equal_to<double>{});
+    EML_VM_DISPATCH();
+  }
+  EML_VM_CASE(op_equal_bool)
+  {
+    boolean_equality(stack_top, std::equal_to<bool>{});
+    EML_VM_DISPATCH();
+  }
+  EML_VM_CASE(op_not_equal_bool)
+  {
+    boolean_equality(stack_top, std::not_equal_to<bool>{});
+    EML_VM_DISPATCH();
+  }
+  EML_VM_CASE(op_equal_string)
+  {
+    const bool equal = string_equality(stack_top);
+    push(stack_top, Value{equal});
+    EML_VM_DISPATCH();
+  }
+  EML_VM_CASE(op_not_equal_string)
+  {
+    const bool equal = string_equality(stack_top);
+    push(stack_top, Value{!equal});
+    EML_VM_DISPATCH();
+  }
+  EML_VM_CASE(op_less_f64)
+  {
+    comparison_operation(stack_top, std::less<double>{});
+    EML_VM_DISPATCH();
+  }
+  EML_VM_CASE(op_less_equal_f64)
+  {
+    comparison_operation(stack_top, std::less_equal<double>{});
+    EML_VM_DISPATCH();
+  }
+  EML_VM_CASE(op_greater_f64)
+  {
+    comparison_operation(stack_top, std::greater<double>{});
+    EML_VM_DISPATCH();
+  }
+  EML_VM_CASE(op_greater_equal_f64)
+  {
+    comparison_operation(stack_top, std::greater_equal<double>{});
+    EML_VM_DISPATCH();
+  }
+  EML_VM_CASE(op_jmp)
+  {
+    const auto jump_by = std::to_integer<std::ptrdiff_t>(*ip++);
+    ip += jump_by;
+    EML_VM_DISPATCH();
+  }
+  EML_VM_CASE(op_jmp_false)
+  {
+    const auto jump_by = std::to_integer<std::ptrdiff_t>(*ip++);
+    if (!pop(stack_top).unsafe_as_boolean()) {
+      ip += jump_by;
+    }
+    EML_VM_DISPATCH();
+  }
+  EML_VM_CASE(op_jmp_wide)
+  {
+    const auto jump_by = read_u32_operand(ip);
+    ip += jump_by;
+    EML_VM_DISPATCH();
+  }
+  EML_VM_CASE(op_jmp_false_wide)
+  {
+    const auto jump_by = read_u32_operand(ip);
+    if (!pop(stack_top).unsafe_as_boolean()) {
+      ip += jump_by;
+    }
+    EML_VM_DISPATCH();
   }
 
-  if (stack_.empty()) {
+  EML_VM_CASE(op_push_add_f64)
+  {
+    immediate_binary_operation(stack_top, read_f64_operand(ip),
+                               std::plus<double>{});
+    EML_VM_DISPATCH();
+  }
+  EML_VM_CASE(op_push_subtract_f64)
+  {
+    immediate_binary_operation(stack_top, read_f64_operand(ip),
+                               std::minus<double>{});
+    EML_VM_DISPATCH();
+  }
+  EML_VM_CASE(op_push_multiply_f64)
+  {
+    immediate_binary_operation(stack_top, read_f64_operand(ip),
+                               std::multiplies<double>{});
+    EML_VM_DISPATCH();
+  }
+  EML_VM_CASE(op_push_divide_f64)
+  {
+    immediate_binary_operation(stack_top, read_f64_operand(ip),
+                               std::divides<double>{});
+    EML_VM_DISPATCH();
+  }
+  EML_VM_CASE(op_push_negate_f64)
+  {
+    push(stack_top, Value{-read_f64_operand(ip)});
+    EML_VM_DISPATCH();
+  }
+  EML_VM_CASE(op_less_f64_jmp_false)
+  {
+    const auto jump_by = std::to_integer<std::ptrdiff_t>(*ip++);
+    if (comparison_jump_false(stack_top, std::less<double>{})) {
+      ip += jump_by;
+    }
+    EML_VM_DISPATCH();
+  }
+  EML_VM_CASE(op_less_equal_f64_jmp_false)
+  {
+    const auto jump_by = std::to_integer<std::ptrdiff_t>(*ip++);
+    if (comparison_jump_false(stack_top, std::less_equal<double>{})) {
+      ip += jump_by;
+    }
+    EML_VM_DISPATCH();
+  }
+  EML_VM_CASE(op_greater_f64_jmp_false)
+  {
+    const auto jump_by = std::to_integer<std::ptrdiff_t>(*ip++);
+    if (comparison_jump_false(stack_top, std::greater<double>{})) {
+      ip += jump_by;
+    }
+    EML_VM_DISPATCH();
+  }
+  EML_VM_CASE(op_greater_equal_f64_jmp_false)
+  {
+    const auto jump_by = std::to_integer<std::ptrdiff_t>(*ip++);
+    if (comparison_jump_false(stack_top, std::greater_equal<double>{})) {
+      ip += jump_by;
+    }
+    EML_VM_DISPATCH();
+  }
+  EML_VM_CASE(op_less_f64_jmp_false_wide)
+  {
+    const auto jump_by = read_u32_operand(ip);
+    if (comparison_jump_false(stack_top, std::less<double>{})) {
+      ip += jump_by;
+    }
+    EML_VM_DISPATCH();
+  }
+  EML_VM_CASE(op_less_equal_f64_jmp_false_wide)
+  {
+    const auto jump_by = read_u32_operand(ip);
+    if (comparison_jump_false(stack_top, std::less_equal<double>{})) {
+      ip += jump_by;
+    }
+    EML_VM_DISPATCH();
+  }
+  EML_VM_CASE(op_greater_f64_jmp_false_wide)
+  {
+    const auto jump_by = read_u32_operand(ip);
+    if (comparison_jump_false(stack_top, std::greater<double>{})) {
+      ip += jump_by;
+    }
+    EML_VM_DISPATCH();
+  }
+  EML_VM_CASE(op_greater_equal_f64_jmp_false_wide)
+  {
+    const auto jump_by = read_u32_operand(ip);
+    if (comparison_jump_false(stack_top, std::greater_equal<double>{})) {
+      ip += jump_by;
+    }
+    EML_VM_DISPATCH();
+  }
+  EML_VM_CASE(op_push2_f64)
+  {
+    push(stack_top, Value{read_f64_operand(ip)});
+    push(stack_top, Value{read_f64_operand(ip)});
+    EML_VM_DISPATCH();
+  }
+  EML_VM_CASE(op_jmp_false_push_f64)
+  {
+    const auto jump_by = std::to_integer<std::ptrdiff_t>(*ip++);
+    const auto number = read_f64_operand(ip);
+    if (!pop(stack_top).unsafe_as_boolean()) {
+      ip += jump_by;
+    } else {
+      push(stack_top, Value{number});
+    }
+    EML_VM_DISPATCH();
+  }
+  EML_VM_CASE(op_jmp_false_push_f64_wide)
+  {
+    const auto jump_by = read_u32_operand(ip);
+    const auto number = read_f64_operand(ip);
+    if (!pop(stack_top).unsafe_as_boolean()) {
+      ip += jump_by;
+    } else {
+      push(stack_top, Value{number});
+    }
+    EML_VM_DISPATCH();
+  }
+
+  EML_VM_LOOP_END
+
+finish:
+  if (stack_top == stack_.get()) {
     return {};
   }
-  return pop(stack_);
+  return pop(stack_top);
 }
 
+#if defined(__GNUC__) || defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+#undef EML_VM_CASE
+#undef EML_VM_DISPATCH
+#undef EML_VM_LOOP_BEGIN
+#undef EML_VM_LOOP_END
+
 } // namespace eml
@@ -1,6 +1,8 @@
 #ifndef EML_VM_HPP
 #define EML_VM_HPP
 
+#include <algorithm>
+#include <memory>
 #include <vector>
 
 #include "ast.hpp"
@@ -8,21 +10,183 @@
 
 namespace eml {
 
+class VerifiedBytecode;
+class JitBytecode;
+class TracingBytecode;
+class FrozenBytecode;
+class MappedBytecode;
+template <std::size_t capacity> struct StaticBytecode;
+
 class VM {
 public:
-  VM() noexcept
+  /// @brief The default maximum number of values on the stack of a vm
+  static constexpr std::size_t default_max_stack_size = std::size_t{1} << 20;
+
+  VM() : VM{default_max_stack_size} {}
+
+  /**
+   * @brief Constructs a vm whose stack holds at most max_stack_size values
+   *
+   * Hosts with a tight memory budget can use a small maximum, the vm then
+   * refuses to run chunks that need a larger stack. Hosts can also compare
+   * @ref Bytecode::max_stack_depth with their budget before running a chunk.
+   */
+  explicit VM(std::size_t max_stack_size) : max_stack_size_{max_stack_size}
   {
-    constexpr size_t initial_stack_size = 256;
-    stack_.reserve(initial_stack_size);
+    constexpr std::size_t initial_stack_size = 256;
+    reserve_stack(std::min(initial_stack_size, max_stack_size));
   }
 
   /**
    * @brief Interpret the current code in the vm
+   *
+   * The stack is sized for the @ref Bytecode::max_stack_depth of the chunk
+   * before the execution starts, so the interpreter loop never checks or grows
+   * it. The depth is computed if the chunk does not have it.
+   *
+   * @return The result of the chunk, or nullopt if the chunk does not produce
+   * a value, is malformed, or needs more than @ref max_stack_size values on the
+   * stack
    */
   [[nodiscard]] auto interpret(const Bytecode& code) -> std::optional<Value>;
 
+  /**
+   * @brief Interpret a verified chunk
+   *
+   * Runs on a variant of the interpreter loop without the checks that
+   * @ref verify already proved, so it neither validates the chunk nor bounds
+   * checks its constant indices.
+   *
+   * @return The result of the chunk, or nullopt if the chunk does not produce
+   * a value or needs more than @ref max_stack_size values on the stack
+   */
+  [[nodiscard]] auto interpret(const VerifiedBytecode& code)
+      -> std::optional<Value>;
+
+  /**
+   * @brief Interpret a frozen chunk in place
+   *
+   * Runs straight from the shared image with the same checks as a plain
+   * chunk, so any number of vms can run one image without copying it.
+   *
+   * @return The result of the chunk, or nullopt if the chunk does not produce
+   * a value, is malformed, or needs more than @ref max_stack_size values on the
+   * stack
+   */
+  [[nodiscard]] auto interpret(const FrozenBytecode& code)
+      -> std::optional<Value>;
+
+  /**
+   * @brief Interpret a loaded bytecode file in place
+   *
+   * The loader verified the file, so it runs without checks like a verified
+   * chunk.
+   *
+   * @return The result of the chunk, or nullopt if the chunk does not produce
+   * a value or needs more than @ref max_stack_size values on the stack
+   */
+  [[nodiscard]] auto interpret(const MappedBytecode& code)
+      -> std::optional<Value>;
+
+  /**
+   * @brief Runs the native code of a chunk, or interprets it if the jit could
+   * not translate it
+   */
+  [[nodiscard]] auto interpret(const JitBytecode& code) -> std::optional<Value>;
+
+  /**
+   * @brief Runs a chunk on the tracing jit
+   *
+   * Enters the compiled trace of the chunk if it has one, and otherwise
+   * interprets it, recording a trace when the chunk gets hot. Updates the
+   * @ref TracingBytecode::stats of the chunk.
+   */
+  [[nodiscard]] auto interpret(TracingBytecode& code) -> std::optional<Value>;
+
+  /**
+   * @brief Runs a chunk compiled by @ref compile_static
+   *
+   * The chunk is well typed by construction, so it runs without checks like a
+   * verified chunk, straight from its fixed-size array.
+   *
+   * @return The result of the chunk, or nullopt if the chunk has an error or
+   * needs more than @ref max_stack_size values on the stack
+   */
+  template <std::size_t capacity>
+  [[nodiscard]] auto interpret(const StaticBytecode<capacity>& code)
+      -> std::optional<Value>
+  {
+    if (!code) {
+      return {};
+    }
+    return interpret_static(code.instructions.data(), code.size,
+                            code.max_stack_depth);
+  }
+
+  /**
+   * @brief Returns the maximum number of values on the stack of the vm
+   */
+  [[nodiscard]] auto max_stack_size() const noexcept -> std::size_t
+  {
+    return max_stack_size_;
+  }
+
 private:
-  std::vector<Value> stack_{}; // Stack of the vm
+  // The instructions and the constants that the interpreter loop runs, with
+  // the chunk that they come from to trace the execution, if there is one
+  struct ChunkView {
+    const std::byte* begin;
+    const std::byte* end;
+    const Value* constants;
+    std::size_t constant_count;
+    const Bytecode* code;
+
+    explicit ChunkView(const Bytecode& chunk) noexcept
+        : begin{chunk.instructions.data()},
+          end{begin + chunk.instructions.size()},
+          constants{chunk.constants.data()},
+          constant_count{chunk.constants.size()}, code{&chunk}
+    {
+    }
+
+    ChunkView(const std::byte* begin_in, const std::byte* end_in,
+              const Value* constants_in,
+              std::size_t constant_count_in) noexcept
+        : begin{begin_in}, end{end_in}, constants{constants_in},
+          constant_count{constant_count_in}, code{nullptr}
+    {
+    }
+  };
+
+  auto interpret_static(const std::byte* instructions, std::size_t size,
+                        std::size_t max_stack_depth) -> std::optional<Value>;
+
+  // The interpreter loop, checked selects whether it runs an unverified chunk
+  //
+  // The loop starts at the offset start with depth values already on the
+  // stack. When recording, it appends the offset of every instruction it
+  // executes to trace.
+  template <bool checked, bool recording = false>
+  auto run(ChunkView chunk, std::size_t start = 0, std::size_t depth = 0,
+           std::vector<std::size_t>* trace = nullptr) -> std::optional<Value>;
+
+  // Makes room for size values on the stack, returns false if size is above
+  // the maximum
+  auto reserve_stack(std::size_t size) -> bool
+  {
+    if (size > max_stack_size_) {
+      return false;
+    }
+    if (size > stack_size_) {
+      stack_ = std::make_unique<Value[]>(size);
+      stack_size_ = size;
+    }
+    return true;
+  }
+
+  std::unique_ptr<Value[]> stack_; // Stack of the vm
+  std::size_t stack_size_ = 0;
+  std::size_t max_stack_size_;
 };
 
 } // namespace eml
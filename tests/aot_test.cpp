@@ -0,0 +1,165 @@
+#include "aot.hpp"
+#include "compiler.hpp"
+#include "vm.hpp"
+
+#include <catch2/catch.hpp>
+
+#include "vm_test_util.hpp"
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+
+#include <dlfcn.h>
+
+namespace {
+
+auto compile(eml::Compiler& compiler, std::string_view s,
+             eml::GarbageCollector& gc) -> eml::VerifiedBytecode
+{
+  auto verified = eml::verify(compile_expression(compiler, s, gc));
+  REQUIRE(verified.has_value());
+  return std::move(*verified);
+}
+
+// Builds generated source code into a shared library and loads it
+class AotLibrary {
+public:
+  explicit AotLibrary(const std::string& source)
+  {
+    const auto directory = std::filesystem::temp_directory_path();
+    const auto stem = "eml_aot_test_" + std::to_string(counter_++);
+    source_path_ = directory / (stem + ".cpp");
+    library_path_ = directory / (stem + ".so");
+    std::ofstream{source_path_} << source;
+
+    const auto command = std::string{EML_TEST_CXX_COMPILER} +
+                         " -std=c++17 -O2 -ffp-contract=off -shared -fPIC -o " +
+                         library_path_.string() + " " + source_path_.string();
+    REQUIRE(std::system(command.c_str()) == 0);
+    handle_ = dlopen(library_path_.c_str(), RTLD_NOW | RTLD_LOCAL);
+    REQUIRE(handle_ != nullptr);
+  }
+
+  ~AotLibrary()
+  {
+    if (handle_ != nullptr) {
+      dlclose(handle_);
+    }
+    std::error_code error;
+    std::filesystem::remove(source_path_, error);
+    std::filesystem::remove(library_path_, error);
+  }
+
+  AotLibrary(const AotLibrary&) = delete;
+  auto operator=(const AotLibrary&) -> AotLibrary& = delete;
+
+  [[nodiscard]] auto symbol(const char* name) const -> void*
+  {
+    return dlsym(handle_, name);
+  }
+
+private:
+  static inline int counter_ = 0;
+  std::filesystem::path source_path_;
+  std::filesystem::path library_path_;
+  void* handle_ = nullptr;
+};
+
+} // anonymous namespace
+
+TEST_CASE("Ahead-of-time compilation of scripts", "[eml.aot]")
+{
+  eml::GarbageCollector gc{};
+  eml::Compiler compiler{gc};
+  eml::VM vm{};
+
+  const std::vector<std::string> sources{
+      "1 + 2 * 3 - 4 / 5",
+      "-(4 / 2) - -0",
+      "0 / 0",
+      "-(0 / 0)",
+      "1 / 0",
+      "0.1 + 0.2",
+      "0 / 0 == 0 / 0",
+      "0 / 0 != 0 / 0",
+      "0 / 0 < 1",
+      "1 >= 0 / 0",
+      "!(1 <= 2)",
+      "true == false",
+      "true != false",
+      "() == ()",
+      "() != ()",
+      "()",
+      "if (0 / 0 > 1) 1 else 2",
+      "if (1 < 2) if (3 > 4) 5 else 6 * 7 else 8",
+      "if (!(1 == 2)) true else false",
+      "if (true) () else ()",
+      "1 + (2 + (if (1 == 1) 3 else 4))",
+      "1 + (2 + (3 + (4 + (5 + (6 + (7 + (8 + (9 + (10 + (11 + (12 + (13 + "
+      "(14 + (15 + (if (1 != 2) 16 else 17)))))))))))))))"};
+
+  // Constant folding would take away the branches that the superinstructions
+  // on jumps need
+  eml::CompilerConfig unfolded_config;
+  unfolded_config.constant_folding = false;
+  eml::Compiler unfolded{gc, unfolded_config};
+  const std::vector<std::string> unfolded_sources{
+      "if (1 < 2 == true) 3 else 4", "if (2 < 1 == true) 3 else 4",
+      "1 + (if (1 < 2 == 2 < 3) 5 else 6)"};
+
+  std::vector<eml::AotScript> scripts;
+  for (const auto& source : sources) {
+    scripts.push_back({source, compile(compiler, source, gc)});
+  }
+  for (const auto& source : unfolded_sources) {
+    scripts.push_back({"unfolded " + source, compile(unfolded, source, gc)});
+  }
+
+  GIVEN("The scripts compiled into a shared library")
+  {
+    const auto source = eml::compile_to_cpp(scripts, "test_scripts");
+    REQUIRE(source.has_value());
+    const AotLibrary library{*source};
+
+    const auto* table =
+        static_cast<const eml::AotEntry*>(library.symbol("test_scripts"));
+    const auto* size =
+        static_cast<const std::size_t*>(library.symbol("test_scripts_size"));
+    REQUIRE(table != nullptr);
+    REQUIRE(size != nullptr);
+
+    THEN("The registration table lists every script")
+    {
+      REQUIRE(*size == scripts.size());
+      for (std::size_t i = 0; i < scripts.size(); ++i) {
+        REQUIRE(table[i].name == scripts[i].name);
+      }
+    }
+
+    THEN("The compiled scripts produce the same results as the VM")
+    {
+      for (std::size_t i = 0; i < scripts.size(); ++i) {
+        INFO(scripts[i].name);
+        const auto expected = vm.interpret(scripts[i].code);
+        const auto result = eml::value_of(table[i].function());
+        REQUIRE(expected.has_value() == result.has_value());
+        if (expected) {
+          REQUIRE(same_bits(*expected, *result));
+        }
+      }
+    }
+  }
+
+  GIVEN("A script that uses strings")
+  {
+    scripts.push_back(
+        {"strings", compile(compiler, "\"abc\" == \"abc\"", gc)});
+    THEN("It can not be compiled ahead of time")
+    {
+      const auto source = eml::compile_to_cpp(scripts);
+      REQUIRE(!source.has_value());
+      REQUIRE(source.error().script == "strings");
+    }
+  }
+}
@@ -41,6 +41,42 @@ TEST_CASE("AST visiting and printing")
     }
 
     WHEN("Compile into Bytecode")
+    {
+      eml::GarbageCollector gc{};
+      eml::VM vm{};
+      eml::CompilerConfig config;
+      config.number_encoding = eml::NumberEncoding::constant_pool;
+      config.superinstructions = false;
+      eml::Compiler compiler{gc, config};
+      const auto [c, _] = compiler.generate_code(*expr);
+      THEN("Should produces the expected instruction sets")
+      {
+        eml::Bytecode expected;
+        const eml::line_num line{1}; // Nodes built without the parser
+        push_number(expected, 3., line);
+        push_number(expected, 4., line);
+        push_number(expected, 5., line);
+        write_instruction(expected, eml::op_add_f64, line);
+        write_instruction(expected, eml::op_multiply_f64, line);
+        push_number(expected, 3., line);
+        write_instruction(expected, eml::op_negate_f64, line);
+        push_number(expected, 1., line);
+        write_instruction(expected, eml::op_subtract_f64, line);
+        write_instruction(expected, eml::op_divide_f64, line);
+
+        REQUIRE(c.disassemble() == expected.disassemble());
+      }
+
+      THEN("Evaluate to -6.75")
+      {
+        const auto result = vm.interpret(c);
+        REQUIRE(result);
+        REQUIRE(result->is_number());
+        REQUIRE(result->unsafe_as_number() == Approx(-6.75));
+      }
+    }
+
+    WHEN("Compile into Bytecode with superinstructions")
     {
       eml::GarbageCollector gc{};
       eml::VM vm{};
@@ -49,16 +85,16 @@ TEST_CASE("AST visiting and printing")
       THEN("Should produces the expected instruction sets")
       {
         eml::Bytecode expected;
-        push_number(expected, 3.);
-        push_number(expected, 4.);
-        push_number(expected, 5.);
-        write_instruction(expected, eml::op_add_f64);
-        write_instruction(expected, eml::op_multiply_f64);
-        push_number(expected, 3.);
-        write_instruction(expected, eml::op_negate_f64);
-        push_number(expected, 1.);
-        write_instruction(expected, eml::op_subtract_f64);
-        write_instruction(expected, eml::op_divide_f64);
+        const eml::line_num line{1}; // Nodes built without the parser
+        write_immediate_instruction(expected, eml::op_push2_f64, 3., line);
+        expected.write(4., line);
+        write_immediate_instruction(expected, eml::op_push_add_f64, 5., line);
+        write_instruction(expected, eml::op_multiply_f64, line);
+        write_immediate_instruction(expected, eml::op_push_negate_f64, 3.,
+                                    line);
+        write_immediate_instruction(expected, eml::op_push_subtract_f64, 1.,
+                                    line);
+        write_instruction(expected, eml::op_divide_f64, line);
 
         REQUIRE(c.disassemble() == expected.disassemble());
       }
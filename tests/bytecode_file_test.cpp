@@ -0,0 +1,216 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <vector>
+
+#include "bytecode_file.hpp"
+#include "compiler.hpp"
+#include "string.hpp"
+#include "vm.hpp"
+
+#include <catch2/catch.hpp>
+
+#include "vm_test_util.hpp"
+
+namespace {
+
+auto compile(eml::GarbageCollector& gc, std::string_view source)
+    -> std::tuple<eml::Bytecode, eml::Type>
+{
+  eml::CompilerConfig config;
+  config.constant_folding = false;
+  eml::Compiler compiler{gc, config};
+  auto result = compiler.compile(source);
+  REQUIRE(result.has_value());
+  return *std::move(result);
+}
+
+// 1.5 + 2.5 with both numbers in the constant pool
+auto forgeable_chunk() -> eml::Bytecode
+{
+  eml::Bytecode code;
+  push_number(code, 1.5);
+  push_number(code, 2.5);
+  write_instruction(code, eml::op_add_f64);
+  code.max_stack_depth = code.compute_max_stack_depth();
+  return code;
+}
+
+// Returns the start of the constant of a number in a bytecode file
+auto find_number(std::vector<std::byte>& file, double number)
+    -> std::vector<std::byte>::iterator
+{
+  std::byte bytes[sizeof(double)];
+  std::memcpy(bytes, &number, sizeof(number));
+  const auto found =
+      std::search(file.begin(), file.end(), std::begin(bytes), std::end(bytes));
+  REQUIRE(found != file.end());
+  return found;
+}
+
+} // anonymous namespace
+
+TEST_CASE("Bytecode files", "[eml.bytecode_file]")
+{
+  eml::GarbageCollector gc{};
+
+  GIVEN("A compiled chunk with string constants")
+  {
+    const auto [code, type] =
+        compile(gc, "if (\"abc\" == \"abc\") 1 + 2.5 else 3");
+    const auto file = eml::serialize(code, type);
+
+    WHEN("The file is loaded")
+    {
+      const auto loaded = eml::load_bytecode(file.data(), file.size());
+      REQUIRE(loaded.has_value());
+
+      THEN("It runs in place with the same result")
+      {
+        eml::VM vm{};
+        const auto expected = vm.interpret(code);
+        const auto result = vm.interpret(*loaded);
+        REQUIRE(expected.has_value());
+        REQUIRE(result.has_value());
+        REQUIRE(same_bits(*expected, *result));
+        REQUIRE(eml::match(loaded->type(), type));
+      }
+
+      THEN("The string constants point into the file image")
+      {
+        REQUIRE(loaded->constant_count() == code.constants.size());
+        REQUIRE(std::any_of(
+            code.constants.begin(), code.constants.end(),
+            [](const eml::Value& value) { return value.is_reference(); }));
+        for (std::size_t i = 0; i < loaded->constant_count(); ++i) {
+          const auto& constant = loaded->constants()[i];
+          REQUIRE(constant.is_reference() ==
+                  code.constants[i].is_reference());
+          if (constant.is_reference()) {
+            REQUIRE(eml::equal_strings(
+                constant.unsafe_as_reference(),
+                code.constants[i].unsafe_as_reference()));
+            REQUIRE(constant.unsafe_as_reference().get() !=
+                    code.constants[i].unsafe_as_reference().get());
+          }
+        }
+      }
+
+      THEN("Thawing gives back the chunk")
+      {
+        const auto thawed = loaded->thaw();
+        REQUIRE(thawed.instructions == code.instructions);
+        REQUIRE(thawed.max_stack_depth == code.compute_max_stack_depth());
+        for (std::size_t i = 0; i < code.instructions.size(); ++i) {
+          REQUIRE(thawed.lines[i].value == code.lines[i].value);
+        }
+        REQUIRE(eml::verify(thawed).has_value());
+      }
+    }
+  }
+
+  GIVEN("A chunk that produces a string")
+  {
+    const auto [code, type] = compile(gc, "\"hello\"");
+    constexpr auto path = "eml_bytecode_file_test.emlc";
+    REQUIRE(eml::save_bytecode(code, type, path).has_value());
+
+    THEN("It loads from the file")
+    {
+      const auto loaded = eml::load_bytecode(path);
+      REQUIRE(loaded.has_value());
+      REQUIRE(std::holds_alternative<eml::StringType>(loaded->type()));
+
+      eml::VM vm{};
+      const auto result = vm.interpret(*loaded);
+      REQUIRE(result.has_value());
+      REQUIRE(result->is_reference());
+      const auto string = result->unsafe_as_reference();
+      REQUIRE(std::string_view{reinterpret_cast<const char*>(string->data()),
+                               string->size()} == "hello");
+    }
+    std::remove(path);
+  }
+
+  GIVEN("Damaged files")
+  {
+    const auto [code, type] = compile(gc, "1 + 2");
+    auto file = eml::serialize(code, type);
+
+    THEN("A truncated file does not load")
+    {
+      REQUIRE(!eml::load_bytecode(file.data(), file.size() - 1).has_value());
+      REQUIRE(!eml::load_bytecode(file.data(), 4).has_value());
+    }
+
+    THEN("A file of another version does not load")
+    {
+      file[8] = std::byte{0xff};
+      const auto loaded = eml::load_bytecode(file.data(), file.size());
+      REQUIRE(!loaded.has_value());
+      REQUIRE(loaded.error().msg.find("version") != std::string::npos);
+    }
+
+    THEN("A constant with all of its bits set does not load")
+    {
+      auto forged = eml::serialize(forgeable_chunk(), eml::NumberType{});
+      const auto constant = find_number(forged, 1.5);
+      std::fill(constant, constant + sizeof(eml::Value), std::byte{0xff});
+      REQUIRE(!eml::load_bytecode(forged.data(), forged.size()).has_value());
+    }
+
+    THEN("A reference constant without a relocation does not load")
+    {
+      alignas(eml::Obj) std::byte storage[64] = {};
+      const eml::Value reference{eml::GarbageCollector::emplace(storage, 8)};
+      auto forged = eml::serialize(forgeable_chunk(), eml::NumberType{});
+      std::memcpy(&*find_number(forged, 1.5), &reference, sizeof(reference));
+      const auto loaded = eml::load_bytecode(forged.data(), forged.size());
+      REQUIRE(!loaded.has_value());
+      REQUIRE(loaded.error().msg.find("constant") != std::string::npos);
+    }
+
+    THEN("A file whose header claims a smaller stack does not load")
+    {
+      constexpr std::uint64_t depth = 1000;
+      eml::Bytecode deep;
+      for (std::uint64_t i = 0; i < depth; ++i) {
+        write_instruction(deep, eml::op_true);
+      }
+      for (std::uint64_t i = 1; i < depth; ++i) {
+        write_instruction(deep, eml::op_pop);
+      }
+      auto forged = eml::serialize(deep, eml::BoolType{});
+      REQUIRE(eml::load_bytecode(forged.data(), forged.size()).has_value());
+
+      std::byte bytes[sizeof(depth)];
+      std::memcpy(bytes, &depth, sizeof(depth));
+      const auto header_depth = std::search(forged.begin(), forged.end(),
+                                            std::begin(bytes), std::end(bytes));
+      REQUIRE(header_depth != forged.end());
+      constexpr std::uint64_t forged_depth = 1;
+      std::memcpy(&*header_depth, &forged_depth, sizeof(forged_depth));
+      const auto loaded = eml::load_bytecode(forged.data(), forged.size());
+      REQUIRE(!loaded.has_value());
+      REQUIRE(loaded.error().msg.find("depth") != std::string::npos);
+    }
+
+    THEN("A file of ill-typed instructions does not load")
+    {
+      eml::Bytecode ill_typed;
+      write_instruction(ill_typed, eml::op_true);
+      write_instruction(ill_typed, eml::op_true);
+      write_instruction(ill_typed, eml::op_add_f64);
+      const auto forged = eml::serialize(ill_typed, eml::NumberType{});
+      const auto loaded = eml::load_bytecode(forged.data(), forged.size());
+      REQUIRE(!loaded.has_value());
+      REQUIRE(loaded.error().msg.find("verify") != std::string::npos);
+    }
+
+    THEN("A missing file does not load")
+    {
+      REQUIRE(!eml::load_bytecode("no/such/file.emlc").has_value());
+    }
+  }
+}
@@ -0,0 +1,189 @@
+#include "bytecode_rewriter.hpp"
+#include "compiler.hpp"
+#include "vm.hpp"
+
+#include <catch2/catch.hpp>
+
+#include "vm_test_util.hpp"
+
+TEST_CASE("Maximum stack depth of compiled code", "[eml.bytecode]")
+{
+  eml::GarbageCollector gc{};
+  eml::CompilerConfig config;
+  config.superinstructions = false;
+  config.peephole = false;
+  eml::Compiler compiler{gc, config};
+
+  const auto [source, expected_depth] =
+      GENERATE(table<std::string, std::size_t>({
+          {"42", 1},
+          {"(1 + 2) * 3", 2},
+          {"1 + (2 + (3 + 4))", 4},
+          {"if (1 < 2) 1 + (2 + 3) else 4", 3},
+          {"if (true) 1 else 2 + (3 + (4 + 5))", 4},
+      }));
+
+  GIVEN(source)
+  {
+    const auto ast = parse_and_type_check(compiler, source, gc);
+    REQUIRE(ast.has_value());
+    const auto [code, type] = compiler.generate_code(**ast);
+
+    THEN("The compiler records the maximum depth of the stack")
+    {
+      REQUIRE(code.max_stack_depth == expected_depth);
+      REQUIRE(code.compute_max_stack_depth() == expected_depth);
+    }
+
+    THEN("A vm with exactly that stack size runs it")
+    {
+      eml::VM vm{expected_depth};
+      REQUIRE(vm.interpret(code));
+    }
+  }
+}
+
+TEST_CASE("Maximum stack depth follows both paths of jumps", "[eml.bytecode]")
+{
+  using eml::Bytecode;
+
+  GIVEN("A conditional jump over a deep sequence")
+  {
+    // if false then 1 + (2 + 3) else 4
+    Bytecode code;
+    write_instruction(code, eml::op_false);
+    write_jump(code, eml::op_jmp_false, 10);
+    push_number(code, 1);                     // 2
+    push_number(code, 2);                     // 2
+    push_number(code, 3);                     // 2
+    write_instruction(code, eml::op_add_f64); // 1
+    write_instruction(code, eml::op_add_f64); // 1
+    write_jump(code, eml::op_jmp, 2);         // 2
+    push_number(code, 4);
+
+    THEN("The depth of the skipped path counts")
+    {
+      REQUIRE(code.compute_max_stack_depth() == 3);
+    }
+
+    THEN("Evaluate to 4")
+    {
+      eml::VM vm{3};
+      const auto result = vm.interpret(code);
+      REQUIRE(result);
+      REQUIRE(result->unsafe_as_number() == Approx(4));
+    }
+  }
+
+  GIVEN("An unconditional jump over unreachable code")
+  {
+    Bytecode code;
+    write_jump(code, eml::op_jmp, 1);
+    write_instruction(code, eml::op_pop);
+    push_number(code, 1);
+
+    THEN("The unreachable code does not count")
+    {
+      REQUIRE(code.compute_max_stack_depth() == 1);
+    }
+  }
+}
+
+TEST_CASE("Maximum stack depth of malformed code", "[eml.bytecode]")
+{
+  using eml::Bytecode;
+
+  Bytecode code;
+  SECTION("Pops from an empty stack")
+  {
+    push_number(code, 1);
+    write_instruction(code, eml::op_add_f64);
+  }
+
+  SECTION("Jumps into the middle of an instruction")
+  {
+    write_jump(code, eml::op_jmp, 1);
+    push_number(code, 1);
+  }
+
+  SECTION("Jumps out of the chunk")
+  {
+    write_jump(code, eml::op_jmp, 3);
+    push_number(code, 1);
+  }
+
+  SECTION("The operand of the last instruction is missing")
+  {
+    write_instruction(code, eml::op_push_f64);
+  }
+
+  REQUIRE(!code.compute_max_stack_depth());
+
+  eml::VM vm{};
+  REQUIRE(!vm.interpret(code));
+}
+
+TEST_CASE("Writes clear the maximum stack depth", "[eml.bytecode]")
+{
+  eml::Bytecode code;
+  push_number(code, 1);
+  code.max_stack_depth = code.compute_max_stack_depth();
+  REQUIRE(code.max_stack_depth == 1);
+
+  push_number(code, 2);
+  REQUIRE(!code.max_stack_depth);
+}
+
+TEST_CASE("Line table", "[eml.bytecode]")
+{
+  GIVEN("Bytes from a few lines")
+  {
+    eml::LineTable lines;
+    for (std::size_t i = 0; i < 100; ++i) {
+      lines.push_back(eml::line_num{1});
+    }
+    for (std::size_t i = 0; i < 50; ++i) {
+      lines.push_back(eml::line_num{3});
+    }
+    lines.push_back(eml::line_num{1});
+
+    THEN("It stores one run per line change")
+    {
+      REQUIRE(lines.size() == 151);
+      REQUIRE(lines.run_count() == 3);
+    }
+
+    THEN("Looks up the line of every byte")
+    {
+      REQUIRE(lines[0].value == 1);
+      REQUIRE(lines[99].value == 1);
+      REQUIRE(lines[100].value == 3);
+      REQUIRE(lines[149].value == 3);
+      REQUIRE(lines[150].value == 1);
+    }
+  }
+
+  GIVEN("A script over several lines")
+  {
+    eml::GarbageCollector gc{};
+    eml::CompilerConfig config;
+    config.constant_folding = false;
+    config.superinstructions = false;
+    eml::Compiler compiler{gc, config};
+    const auto result = compiler.compile("if (1 <\n    2)\n  3.5\nelse\n  4.5");
+    REQUIRE(result.has_value());
+    const auto& code = std::get<eml::Bytecode>(*result);
+
+    THEN("Instructions have the line of the token they come from")
+    {
+      const auto decoded = eml::decode(code);
+      std::vector<std::size_t> lines;
+      for (const auto& instruction : decoded.instructions) {
+        lines.push_back(instruction.line.value);
+      }
+      // 1 < 2, the branch, 3.5, the jump over the else branch and 4.5
+      REQUIRE(lines == std::vector<std::size_t>{1, 2, 1, 1, 3, 1, 5});
+      REQUIRE(code.lines.run_count() < code.instructions.size());
+    }
+  }
+}
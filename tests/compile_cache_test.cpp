@@ -0,0 +1,139 @@
+#include "compiler.hpp"
+#include "vm.hpp"
+
+#include <catch2/catch.hpp>
+
+namespace {
+
+auto run(eml::Compiler& compiler, std::string_view source) -> double
+{
+  const auto result = compiler.compile_shared(source);
+  REQUIRE(result.has_value());
+  eml::VM vm{};
+  const auto value = vm.interpret(std::get<eml::FrozenBytecode>(*result));
+  REQUIRE(value.has_value());
+  return value->unsafe_as_number();
+}
+
+} // anonymous namespace
+
+TEST_CASE("Compile cache", "[eml.compile_cache]")
+{
+  eml::GarbageCollector gc{};
+  eml::CompilerConfig config;
+  config.shadowing_policy = eml::SameScopeShadowing::allow;
+  config.compile_cache_capacity = 4096;
+
+  GIVEN("A compiler with the compile cache")
+  {
+    eml::Compiler compiler{gc, config};
+
+    THEN("Compiling the same source twice shares the chunk")
+    {
+      const auto first = compiler.compile_shared("1 + 2 * 3");
+      const auto second = compiler.compile_shared("1 + 2 * 3");
+      REQUIRE(first.has_value());
+      REQUIRE(second.has_value());
+      REQUIRE(std::get<eml::FrozenBytecode>(*first).data() ==
+              std::get<eml::FrozenBytecode>(*second).data());
+      REQUIRE(compiler.compile_cache_stats().hits == 1);
+      REQUIRE(compiler.compile_cache_stats().misses == 1);
+    }
+
+    THEN("compile copies the cached chunk out")
+    {
+      const auto first = compiler.compile("if (1 < 2) 3 else 4");
+      const auto second = compiler.compile("if (1 < 2) 3 else 4");
+      REQUIRE(first.has_value());
+      REQUIRE(second.has_value());
+      REQUIRE(std::get<eml::Bytecode>(*first).instructions ==
+              std::get<eml::Bytecode>(*second).instructions);
+      REQUIRE(compiler.compile_cache_stats().hits == 1);
+    }
+
+    THEN("Sources with errors are not cached")
+    {
+      REQUIRE(!compiler.compile("1 + true").has_value());
+      REQUIRE(!compiler.compile("1 + true").has_value());
+      REQUIRE(compiler.compile_cache_stats().hits == 0);
+    }
+  }
+
+  GIVEN("A cached source that reads a global")
+  {
+    eml::Compiler compiler{gc, config};
+    REQUIRE(compiler.compile("let x = 1").has_value());
+    REQUIRE(compiler.compile("let y = 10").has_value());
+    REQUIRE(run(compiler, "x + 1") == Approx(2));
+
+    WHEN("An unrelated global changes")
+    {
+      compiler.add_global("y", eml::NumberType{}, eml::Value{20.});
+
+      THEN("The entry still hits")
+      {
+        REQUIRE(run(compiler, "x + 1") == Approx(2));
+        REQUIRE(compiler.compile_cache_stats().hits == 1);
+        REQUIRE(compiler.compile_cache_stats().invalidations == 0);
+      }
+    }
+
+    WHEN("The global is redefined")
+    {
+      REQUIRE(compiler.compile("let x = 5").has_value());
+
+      THEN("The entry is invalidated and the source sees the new value")
+      {
+        REQUIRE(run(compiler, "x + 1") == Approx(6));
+        REQUIRE(compiler.compile_cache_stats().hits == 0);
+        REQUIRE(compiler.compile_cache_stats().invalidations == 1);
+      }
+    }
+  }
+
+  GIVEN("A source that defines a global")
+  {
+    eml::Compiler compiler{gc, config};
+    REQUIRE(compiler.compile("let z = 1").has_value());
+    compiler.add_global("z", eml::NumberType{}, eml::Value{2.});
+    REQUIRE(compiler.compile("let z = 1").has_value());
+
+    THEN("It is compiled every time, so the definition happens again")
+    {
+      REQUIRE(compiler.compile_cache_stats().hits == 0);
+      REQUIRE(compiler.get_global("z")->second.unsafe_as_number() ==
+              Approx(1));
+    }
+  }
+
+  GIVEN("A cache smaller than its sources")
+  {
+    config.compile_cache_capacity = 1024;
+    eml::Compiler compiler{gc, config};
+    for (int i = 0; i < 32; ++i) {
+      REQUIRE(compiler.compile_shared(std::to_string(i) + " + 0.5"));
+    }
+
+    THEN("The least recently used entries are evicted")
+    {
+      REQUIRE(compiler.compile_cache_stats().evictions > 0);
+      REQUIRE(compiler.compile_shared("31 + 0.5"));
+      REQUIRE(compiler.compile_cache_stats().hits == 1);
+      REQUIRE(compiler.compile_shared("0 + 0.5"));
+      REQUIRE(compiler.compile_cache_stats().hits == 1);
+    }
+  }
+
+  GIVEN("A compiler without the compile cache")
+  {
+    eml::Compiler compiler{gc};
+    REQUIRE(compiler.compile("1 + 2").has_value());
+    REQUIRE(compiler.compile("1 + 2").has_value());
+
+    THEN("Nothing is counted")
+    {
+      REQUIRE(compiler.compile_cache_stats().hits == 0);
+      REQUIRE(compiler.compile_cache_stats().misses == 0);
+    }
+  }
+}
@@ -0,0 +1,165 @@
+#include "ast.hpp"
+#include "bytecode_rewriter.hpp"
+#include "compiler.hpp"
+#include "debug.hpp"
+
+#include <catch2/catch.hpp>
+
+#include "vm_test_util.hpp"
+
+namespace {
+
+// An identifier whose value is only known at runtime
+auto unknown(eml::Type type) -> eml::Expr_ptr
+{
+  auto id = eml::IdentifierExpr::create("y");
+  id->set_type(std::move(type));
+  return id;
+}
+
+auto number(double value) -> eml::Expr_ptr
+{
+  return eml::LiteralExpr::create(eml::Value{value});
+}
+
+auto boolean(bool value) -> eml::Expr_ptr
+{
+  return eml::LiteralExpr::create(eml::Value{value});
+}
+
+auto fold(eml::Expr_ptr expr) -> std::string
+{
+  eml::GarbageCollector gc{};
+  const eml::Compiler compiler{gc};
+  compiler.fold_constants(expr);
+  return eml::to_string(*expr, eml::AstPrintOption::flat);
+}
+
+} // anonymous namespace
+
+TEST_CASE("Constant folding", "[eml.constant_folder]")
+{
+  eml::GarbageCollector gc{};
+
+  const auto compile = [&gc](eml::Compiler& compiler,
+                             std::string_view source) {
+    const auto result = compiler.compile(source);
+    REQUIRE(result.has_value());
+    return std::get<eml::Bytecode>(*result);
+  };
+
+  GIVEN("Expressions whose operands are all constants")
+  {
+    eml::Compiler compiler{gc};
+    eml::CompilerConfig config;
+    config.constant_folding = false;
+    eml::Compiler unfolded{gc, config};
+
+    THEN("They compile to a single push with the same result")
+    {
+      for (const auto* source :
+           {"1 + 2 * 3", "-(4 / 2) - -0", "0.1 + 0.2", "0 / 0 == 0 / 0",
+            "!(1 <= 2) != true", "if (1 < 2) if (3 > 4) 5 else 6 * 7 else 8",
+            "\"abc\" == \"abc\"", "\"abc\" != \"abd\""}) {
+        INFO(source);
+        const auto folded = compile(compiler, source);
+        REQUIRE(eml::decode(folded).instructions.size() == 1);
+
+        eml::VM vm{};
+        const auto expected = vm.interpret(compile(unfolded, source));
+        const auto result = vm.interpret(folded);
+        REQUIRE(expected.has_value());
+        REQUIRE(result.has_value());
+        REQUIRE(same_bits(*expected, *result));
+      }
+    }
+  }
+
+  GIVEN("A definition of a constant expression")
+  {
+    eml::Compiler compiler{gc};
+    compile(compiler, "let day = 60 * 60 * 24");
+
+    THEN("It defines the folded value")
+    {
+      const auto global = compiler.get_global("day");
+      REQUIRE(global.has_value());
+      REQUIRE(global->second.unsafe_as_number() == 86400);
+
+      eml::VM vm{};
+      const auto result = vm.interpret(compile(compiler, "day * 2"));
+      REQUIRE(result.has_value());
+      REQUIRE(result->unsafe_as_number() == 172800);
+    }
+  }
+
+  GIVEN("Operations with one unknown operand")
+  {
+    THEN("Identities that keep every bit of the operand are removed")
+    {
+      const auto y = [] { return unknown(eml::NumberType{}); };
+      REQUIRE(fold(eml::MinusOpExpr::create(y(), number(0))) == "y");
+      REQUIRE(fold(eml::PlusOpExpr::create(number(-0.), y())) == "y");
+      REQUIRE(fold(eml::MultOpExpr::create(number(1), y())) == "y");
+      REQUIRE(fold(eml::DivOpExpr::create(y(), number(1))) == "y");
+      REQUIRE(fold(eml::UnaryNegateExpr::create(
+                  eml::UnaryNegateExpr::create(y()))) == "y");
+    }
+
+    THEN("Identities that may change the sign of zero are kept")
+    {
+      const auto y = [] { return unknown(eml::NumberType{}); };
+      REQUIRE(fold(eml::PlusOpExpr::create(y(), number(0))) == "(+ y 0)");
+      REQUIRE(fold(eml::MinusOpExpr::create(y(), number(-0.))) ==
+              "(- y -0)");
+      REQUIRE(fold(eml::MultOpExpr::create(y(), number(0))) == "(* y 0)");
+    }
+
+    THEN("Comparisons with booleans and negated conditions are simplified")
+    {
+      const auto y = [] { return unknown(eml::BoolType{}); };
+      REQUIRE(fold(eml::EqOpExpr::create(y(), boolean(true))) == "y");
+      REQUIRE(fold(eml::NeqOpExpr::create(boolean(false), y())) == "y");
+      REQUIRE(fold(eml::EqOpExpr::create(y(), boolean(false))) ==
+              "(== y false)");
+      REQUIRE(fold(eml::IfExpr::create(eml::UnaryNotExpr::create(y()),
+                                       number(1), number(2))) ==
+              "(if y 2 1)");
+    }
+  }
+}
+
+TEST_CASE("Compile-time evaluation of definitions", "[eml.constant_folder]")
+{
+  eml::GarbageCollector gc{};
+  eml::CompilerConfig config;
+  config.constant_folding = false;
+
+  GIVEN("A definition that does not fold")
+  {
+    constexpr auto source =
+        "let x = if (1 < 2) { 60 * 60 * 24 } else { 0 / 0 }";
+
+    THEN("It is evaluated once on the vm")
+    {
+      eml::Compiler compiler{gc, config};
+      REQUIRE(compiler.compile(source).has_value());
+      const auto global = compiler.get_global("x");
+      REQUIRE(global.has_value());
+      REQUIRE(global->second.unsafe_as_number() == 86400);
+
+      const auto use = compiler.compile("x");
+      REQUIRE(use.has_value());
+      const auto decoded = eml::decode(std::get<eml::Bytecode>(*use));
+      REQUIRE(decoded.instructions.size() == 1);
+    }
+
+    THEN("It is rejected if it needs more instructions than the budget")
+    {
+      config.evaluation_budget = 4;
+      eml::Compiler compiler{gc, config};
+      REQUIRE(!compiler.compile(source).has_value());
+      REQUIRE(!compiler.get_global("x").has_value());
+    }
+  }
+}
@@ -0,0 +1,139 @@
+#include "bytecode_rewriter.hpp"
+#include "compiler.hpp"
+#include "control_flow.hpp"
+#include "vm.hpp"
+
+#include <catch2/catch.hpp>
+
+#include "vm_test_util.hpp"
+
+namespace {
+
+// Compiles source with and without the control flow optimizations
+auto compile_both(std::string_view source)
+    -> std::pair<eml::Bytecode, eml::Bytecode>
+{
+  eml::GarbageCollector gc{};
+  eml::CompilerConfig config;
+  config.constant_folding = false;
+  config.superinstructions = false;
+  config.peephole = false;
+  config.control_flow = false;
+  eml::Compiler plain{gc, config};
+  config.control_flow = true;
+  eml::Compiler optimizing{gc, config};
+
+  auto plain_code = plain.compile(source);
+  auto optimized_code = optimizing.compile(source);
+  REQUIRE(plain_code.has_value());
+  REQUIRE(optimized_code.has_value());
+  return {std::get<eml::Bytecode>(*std::move(plain_code)),
+          std::get<eml::Bytecode>(*std::move(optimized_code))};
+}
+
+// Returns whether some jump of the chunk lands on an unconditional jump
+auto has_jump_to_jump(const eml::Bytecode& code) -> bool
+{
+  const auto decoded = eml::decode(code);
+  const auto& instructions = decoded.instructions;
+  return std::any_of(
+      instructions.begin(), instructions.end(), [&](const auto& instruction) {
+        return eml::operand_kind_of(instruction.op) ==
+                   eml::operand_kind::jump &&
+               instruction.target < instructions.size() &&
+               instructions[instruction.target].op == eml::op_jmp;
+      });
+}
+
+} // anonymous namespace
+
+TEST_CASE("Control flow optimization", "[eml.control_flow]")
+{
+  GIVEN("Nested if expressions and if-else chains")
+  {
+    const auto source = GENERATE(
+        as<std::string>{}, "if (1 < 2) { if (3 < 4) 5 else 6 } else 7",
+        "if (2 < 1) { if (3 < 4) 5 else 6 } else 7",
+        "if (1 < 2) { if (4 < 3) { if (5 < 6) 7 else 8 } else 9 } else 10",
+        "if (1 > 2) 1 else if (2 > 3) 2 else if (3 > 4) 3 else 4",
+        "if (1 > 2) 1 else if (3 > 2) 2 else if (3 > 4) 3 else 4");
+    const auto [plain, optimized] = compile_both(source);
+
+    THEN("No jump lands on another jump")
+    {
+      INFO(source);
+      REQUIRE(!has_jump_to_jump(optimized));
+      require_same_result(plain, optimized);
+    }
+  }
+
+  GIVEN("Branches with the same tail")
+  {
+    const auto source =
+        GENERATE(as<std::string>{}, "if (1 < 2) 3 * (4 + 5) else 6 * (4 + 5)",
+                 "if (2 < 1) 3 * (4 + 5) else 6 * (4 + 5)");
+    eml::ControlFlowStats stats;
+    const auto [plain, unused] = compile_both(source);
+    const auto optimized = eml::optimize_control_flow(plain, stats);
+
+    THEN("The then branch jumps to the tail of the else branch")
+    {
+      INFO(source);
+      REQUIRE(stats.tails_merged == 1);
+      REQUIRE(stats.instructions_removed == 4);
+      REQUIRE(optimized.instruction_count() + 4 == plain.instruction_count());
+      require_same_result(plain, optimized);
+    }
+  }
+
+  GIVEN("Code that no path reaches")
+  {
+    eml::Bytecode code;
+    write_jump(code, eml::op_jmp, 2);
+    push_number(code, 1);
+    push_number(code, 2);
+
+    eml::ControlFlowStats stats;
+    const auto optimized = eml::optimize_control_flow(code, stats);
+
+    THEN("It is removed with the jump over it")
+    {
+      const auto decoded = eml::decode(optimized);
+      REQUIRE(decoded.instructions.size() == 1);
+      REQUIRE(decoded.pushed_number(decoded.instructions[0]) == 2.);
+      REQUIRE(stats.instructions_removed == 2);
+      require_same_result(code, optimized);
+    }
+  }
+}
+
+TEST_CASE("Control flow optimization of deeply nested if expressions",
+          "[eml.control_flow]")
+{
+  // Nested if expressions whose else branches all have the same tail
+  const auto nested_ifs = [](std::size_t depth) {
+    const std::string branch = "0.5 + 1.5 + 2.5 + 3.5";
+    std::string source = branch;
+    for (std::size_t i = 0; i < depth; ++i) {
+      source = "if (" + std::to_string(i) + " < " + std::to_string(i + 1) +
+               ") (" + source + ") else " + branch;
+    }
+    return source;
+  };
+
+  GIVEN("Nested if expressions of increasing depth")
+  {
+    const auto depth = GENERATE(as<std::size_t>{}, 10, 100, 1000);
+    const auto [plain, unused] = compile_both(nested_ifs(depth));
+    eml::ControlFlowStats stats;
+    const auto optimized = eml::optimize_control_flow(plain, stats);
+
+    THEN("Every tail merges in a number of rounds independent of the depth")
+    {
+      INFO(depth);
+      REQUIRE(stats.tails_merged == depth);
+      REQUIRE(stats.rounds <= 4);
+      require_same_result(plain, optimized);
+    }
+  }
+}
@@ -0,0 +1,138 @@
+#include "compiler.hpp"
+#include "frozen_bytecode.hpp"
+#include "vm.hpp"
+
+#include <catch2/catch.hpp>
+
+#include "vm_test_util.hpp"
+
+TEST_CASE("Frozen bytecode", "[eml.frozen_bytecode]")
+{
+  GIVEN("A compiled chunk")
+  {
+    eml::GarbageCollector gc{};
+    eml::Compiler compiler{gc};
+    const auto compiled =
+        compiler.compile("if (1 < 2) 3 * (4 + 5.5) else 6 * (4 + 5)");
+    REQUIRE(compiled.has_value());
+    const auto& code = std::get<eml::Bytecode>(*compiled);
+
+    WHEN("It is frozen")
+    {
+      const auto frozen = eml::freeze(code);
+
+      THEN("The vm gets the same result from the image")
+      {
+        eml::VM vm{};
+        const auto expected = vm.interpret(code);
+        const auto result = vm.interpret(frozen);
+        REQUIRE(expected.has_value());
+        REQUIRE(result.has_value());
+        REQUIRE(same_bits(*expected, *result));
+      }
+
+      THEN("The constants are followed by the instructions")
+      {
+        REQUIRE(reinterpret_cast<std::uintptr_t>(frozen.instructions()) -
+                    reinterpret_cast<std::uintptr_t>(frozen.constants()) ==
+                frozen.constant_count() * sizeof(eml::Value));
+        REQUIRE(reinterpret_cast<std::uintptr_t>(frozen.constants()) %
+                    alignof(eml::Value) ==
+                0);
+        REQUIRE(frozen.size_in_bytes() >= code.instructions.size());
+        REQUIRE(frozen.max_stack_depth() == code.compute_max_stack_depth());
+      }
+
+      THEN("Thawing gives back the chunk")
+      {
+        const auto thawed = frozen.thaw();
+        REQUIRE(thawed.instructions == code.instructions);
+        REQUIRE(thawed.constants.size() == code.constants.size());
+        REQUIRE(thawed.lines.size() == code.lines.size());
+        for (std::size_t i = 0; i < code.instructions.size(); ++i) {
+          REQUIRE(thawed.lines[i].value == code.lines[i].value);
+          REQUIRE(frozen.line(i).value == code.lines[i].value);
+        }
+      }
+    }
+  }
+
+  GIVEN("A handmade chunk with constants on several lines")
+  {
+    eml::Bytecode code;
+    push_number(code, 1, eml::line_num{1});
+    push_number(code, 2, eml::line_num{2});
+    write_instruction(code, eml::op_add_f64, eml::line_num{4});
+
+    const auto frozen = eml::freeze(code);
+
+    THEN("Copies of the handle share the image")
+    {
+      auto copy = frozen;
+      REQUIRE(copy.instructions() == frozen.instructions());
+      REQUIRE(frozen.use_count() == 2);
+
+      const auto moved = std::move(copy);
+      REQUIRE(!copy);
+      REQUIRE(moved.instructions() == frozen.instructions());
+      REQUIRE(frozen.use_count() == 2);
+    }
+
+    THEN("The allocation is aligned to a cache line")
+    {
+      const auto address = reinterpret_cast<std::uintptr_t>(frozen.data());
+      REQUIRE(address % eml::FrozenBytecode::alignment == 0);
+      REQUIRE(frozen.constants() >=
+              reinterpret_cast<const eml::Value*>(frozen.data()));
+      REQUIRE(frozen.instructions() + frozen.instruction_size() <=
+              frozen.data() + frozen.size_in_bytes());
+      REQUIRE(frozen.constant_count() == 2);
+    }
+
+    THEN("It runs and keeps the lines")
+    {
+      eml::VM vm{};
+      const auto result = vm.interpret(frozen);
+      REQUIRE(result.has_value());
+      REQUIRE(result->unsafe_as_number() == Approx(3));
+      REQUIRE(frozen.line(0).value == 1);
+      REQUIRE(frozen.line(2).value == 2);
+      REQUIRE(frozen.line(4).value == 4);
+    }
+  }
+
+  GIVEN("A malformed chunk")
+  {
+    eml::Bytecode code;
+    write_instruction(code, eml::op_add_f64);
+
+    const auto frozen = eml::freeze(code);
+
+    THEN("The image has no stack depth and the vm refuses it")
+    {
+      REQUIRE(!frozen.max_stack_depth());
+      eml::VM vm{};
+      REQUIRE(!vm.interpret(frozen).has_value());
+    }
+  }
+
+  GIVEN("A chunk whose cached stack depth is stale")
+  {
+    eml::Bytecode code;
+    push_number(code, 1);
+    push_number(code, 2);
+    write_instruction(code, eml::op_add_f64);
+    code.max_stack_depth = 1;
+
+    const auto frozen = eml::freeze(code);
+
+    THEN("The image has the depth of its instructions")
+    {
+      REQUIRE(frozen.max_stack_depth() == 2);
+      eml::VM vm{};
+      const auto result = vm.interpret(frozen);
+      REQUIRE(result);
+      REQUIRE(result->unsafe_as_number() == Approx(3));
+    }
+  }
+}
@@ -0,0 +1,259 @@
+#include "compiler.hpp"
+#include "jit.hpp"
+#include "vm.hpp"
+
+#include <catch2/catch.hpp>
+
+#include "vm_test_util.hpp"
+
+#include <algorithm>
+
+TEST_CASE("Jit compilation of scripts", "[eml.jit]")
+{
+  eml::GarbageCollector gc{};
+  eml::Compiler compiler{gc};
+
+  const auto source = GENERATE(
+      as<std::string>{}, "1 + 2 * 3 - 4 / 5", "-(4 / 2) - -0",
+      "0 / 0 == 0 / 0", "0 / 0 != 0 / 0", "0 / 0 < 1", "1 >= 0 / 0",
+      "!(1 <= 2)", "true == false", "() != ()", "\"abc\" == \"abc\"",
+      "\"abc\" != \"abd\"", "if (0 / 0 > 1) 1 else 2",
+      "if (1 < 2) if (3 > 4) 5 else 6 * 7 else 8",
+      "if (!(1 == 2)) \"yes\" else \"no\"",
+      "1 + (2 + (3 + (4 + (5 + (6 + (7 + (8 + (9 + (10 + (11 + (12 + (13 + "
+      "(14 + (15 + (16 + (17 + 18))))))))))))))))",
+      "1 < (2 + (3 + (4 + (5 + (6 + (7 + (8 + (9 + (10 + (11 + (12 + (13 + "
+      "(14 + (15 + (16 + (17 + 18))))))))))))))))",
+      "1 + (2 + (if (\"a\" == \"a\") 3 else 4))",
+      "1 + (2 + (3 + (4 + (5 + (6 + (7 + (8 + (9 + (10 + (11 + (12 + (13 + "
+      "(14 + (15 + (if (\"a\" != \"b\") 16 else 17)))))))))))))))");
+
+  GIVEN(source)
+  {
+    const auto code = compile_expression(compiler, source, gc);
+    const auto verified = eml::verify(code);
+    REQUIRE(verified.has_value());
+    const eml::JitBytecode jit_code{*verified};
+
+    THEN("The chunk is translated to native code on supported platforms")
+    {
+      REQUIRE(jit_code.is_native() == eml::build_options.jit);
+    }
+
+    THEN("The result matches the interpreter bit for bit")
+    {
+      require_same_jit_result(code);
+    }
+  }
+}
+
+TEST_CASE("Jit compilation of superinstructions on jumps", "[eml.jit]")
+{
+  eml::GarbageCollector gc{};
+  eml::CompilerConfig config;
+  config.constant_folding = false;
+  eml::Compiler compiler{gc, config};
+
+  const auto source = GENERATE(as<std::string>{}, "if (1 < 2 == true) 3 else 4",
+                               "if (2 < 1 == true) 3 else 4",
+                               "1 + (if (1 < 2 == 2 < 3) 5 else 6)");
+
+  GIVEN(source)
+  {
+    const auto code = compile_expression(compiler, source, gc);
+    const auto opcodes = opcodes_of(code);
+    REQUIRE(std::count(opcodes.begin(), opcodes.end(),
+                       eml::op_jmp_false_push_f64) == 1);
+
+    THEN("The result matches the interpreter bit for bit")
+    {
+      require_same_jit_result(code);
+    }
+  }
+}
+
+TEST_CASE("Jit fallback to the interpreter", "[eml.jit]")
+{
+  GIVEN("A chunk whose stack is too deep for a native stack frame")
+  {
+    constexpr std::size_t depth = 5000;
+    eml::Bytecode code;
+    for (std::size_t i = 0; i < depth; ++i) {
+      code.write_number(1, eml::line_num{0});
+    }
+    for (std::size_t i = 1; i < depth; ++i) {
+      write_instruction(code, eml::op_add_f64);
+    }
+
+    const auto verified = eml::verify(code);
+    REQUIRE(verified.has_value());
+    const eml::JitBytecode jit_code{*verified};
+
+    THEN("It runs on the interpreter")
+    {
+      REQUIRE(!jit_code.is_native());
+
+      eml::VM vm{};
+      const auto result = vm.interpret(jit_code);
+      REQUIRE(result);
+      REQUIRE(result->unsafe_as_number() == Approx(depth));
+    }
+  }
+}
+
+TEST_CASE("Tracing jit", "[eml.jit]")
+{
+  eml::GarbageCollector gc{};
+  eml::Compiler compiler{gc};
+  eml::VM vm{};
+
+  GIVEN("A chunk that runs more often than the hot threshold")
+  {
+    const auto code = compile_expression(
+        compiler, "if (1 + 2 < 3 * 4) (if (5 >= 6) 1 else 2) + 3 else 4", gc);
+    const auto verified = eml::verify(code);
+    REQUIRE(verified.has_value());
+
+    constexpr std::size_t hot_threshold = 3;
+    constexpr std::size_t runs = 10;
+    eml::TracingBytecode tracing_code{*verified, hot_threshold};
+    tracing_code.measure_time(true);
+    const auto expected = vm.interpret(code);
+    REQUIRE(expected.has_value());
+
+    for (std::size_t i = 0; i < runs; ++i) {
+      const auto result = vm.interpret(tracing_code);
+      REQUIRE(result.has_value());
+      REQUIRE(same_bits(*result, *expected));
+    }
+
+    THEN("The chunk runs on a trace after it gets hot")
+    {
+      const auto& stats = tracing_code.stats();
+      REQUIRE(tracing_code.has_trace() == eml::build_options.jit);
+      if (eml::build_options.jit) {
+        REQUIRE(stats.interpreted_runs == hot_threshold);
+        REQUIRE(stats.traces_compiled == 1);
+        REQUIRE(stats.trace_entries == runs - hot_threshold);
+        REQUIRE(stats.native_time.count() > 0);
+      } else {
+        REQUIRE(stats.interpreted_runs == runs);
+      }
+      REQUIRE(stats.guard_failures == 0);
+      REQUIRE(stats.interpreted_time.count() > 0);
+    }
+  }
+
+  GIVEN("5 + (if (1 < 2) 10 else 20) with a trace through the else branch")
+  {
+    eml::Bytecode code;
+    push_number(code, 5);                          // 0
+    push_number(code, 1);                          // 2
+    push_number(code, 2);                          // 4
+    write_instruction(code, eml::op_less_f64);     // 6
+    write_jump(code, eml::op_jmp_false, 4);        // 7
+    push_number(code, 10);                         // 9
+    write_jump(code, eml::op_jmp, 2);              // 11
+    push_number(code, 20);                         // 13
+    write_instruction(code, eml::op_add_f64);      // 15
+    const auto verified = eml::verify(code);
+    REQUIRE(verified.has_value());
+
+    constexpr std::size_t hot_threshold = 2;
+    eml::TracingBytecode tracing_code{*verified, hot_threshold};
+
+    THEN("Traces that are not a path through the chunk are rejected")
+    {
+      REQUIRE(!tracing_code.install_trace(eml::Trace{{0, 2, 4, 6, 7, 11}}));
+      REQUIRE(!tracing_code.install_trace(eml::Trace{{0, 2, 4}}));
+      REQUIRE(!tracing_code.install_trace(eml::Trace{{2, 4, 6, 7, 13, 15}}));
+      REQUIRE(!tracing_code.has_trace());
+    }
+
+    if (eml::build_options.jit) {
+      REQUIRE(tracing_code.install_trace(eml::Trace{{0, 2, 4, 6, 7, 13, 15}}));
+
+      THEN("The guard fails and the interpreter resumes with the stack")
+      {
+        const auto result = vm.interpret(tracing_code);
+        REQUIRE(result);
+        REQUIRE(result->unsafe_as_number() == Approx(15));
+
+        const auto& stats = tracing_code.stats();
+        REQUIRE(stats.trace_entries == 1);
+        REQUIRE(stats.guard_failures == 1);
+        REQUIRE(tracing_code.has_trace());
+      }
+
+      THEN("The trace is discarded after failing hot threshold times")
+      {
+        for (std::size_t i = 0; i < hot_threshold; ++i) {
+          REQUIRE(vm.interpret(tracing_code));
+        }
+        REQUIRE(!tracing_code.has_trace());
+        REQUIRE(tracing_code.stats().guard_failures == hot_threshold);
+      }
+    }
+  }
+
+  GIVEN("5 + (if (a < b) 10 else 20) with the push of 10 fused into the jump")
+  {
+    const auto chunk = [](double a, double b) {
+      eml::Bytecode code;
+      push_number(code, 5);                                  // 0
+      push_number(code, a);                                  // 2
+      push_number(code, b);                                  // 4
+      write_instruction(code, eml::op_less_f64);             // 6
+      write_jump(code, eml::op_jmp_false_push_f64, 2);       // 7
+      code.write(10., eml::line_num{0});                     // 9
+      write_jump(code, eml::op_jmp, 2);                      // 17
+      push_number(code, 20);                                 // 19
+      write_instruction(code, eml::op_add_f64);              // 21
+      return code;
+    };
+
+    if (eml::build_options.jit) {
+      THEN("A trace through the fall through pushes the number")
+      {
+        const auto verified = eml::verify(chunk(1, 2));
+        REQUIRE(verified.has_value());
+        eml::TracingBytecode tracing_code{*verified, 2};
+        REQUIRE(
+            tracing_code.install_trace(eml::Trace{{0, 2, 4, 6, 7, 17, 21}}));
+
+        const auto result = vm.interpret(tracing_code);
+        REQUIRE(result);
+        REQUIRE(result->unsafe_as_number() == Approx(15));
+        REQUIRE(tracing_code.stats().guard_failures == 0);
+      }
+
+      THEN("The guard on the jump resumes without the pushed number")
+      {
+        const auto verified = eml::verify(chunk(2, 1));
+        REQUIRE(verified.has_value());
+        eml::TracingBytecode tracing_code{*verified, 2};
+        REQUIRE(
+            tracing_code.install_trace(eml::Trace{{0, 2, 4, 6, 7, 17, 21}}));
+
+        const auto result = vm.interpret(tracing_code);
+        REQUIRE(result);
+        REQUIRE(result->unsafe_as_number() == Approx(25));
+        REQUIRE(tracing_code.stats().guard_failures == 1);
+      }
+
+      THEN("The guard on the fall through resumes with the pushed number")
+      {
+        const auto verified = eml::verify(chunk(1, 2));
+        REQUIRE(verified.has_value());
+        eml::TracingBytecode tracing_code{*verified, 2};
+        REQUIRE(
+            tracing_code.install_trace(eml::Trace{{0, 2, 4, 6, 7, 19, 21}}));
+
+        const auto result = vm.interpret(tracing_code);
+        REQUIRE(result);
+        REQUIRE(result->unsafe_as_number() == Approx(15));
+        REQUIRE(tracing_code.stats().guard_failures == 1);
+      }
+    }
+  }
+}
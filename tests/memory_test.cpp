@@ -1,3 +1,353 @@
+#include <algorithm>
+#include <vector>
+
 #include <catch2/catch.hpp>
 
+#include "compiler.hpp"
+#include "jit.hpp"
 #include "memory.hpp"
+#include "string.hpp"
+#include "verifier.hpp"
+#include "vm.hpp"
+
+namespace {
+
+auto contents(eml::GcPointer string) -> std::string_view
+{
+  return {reinterpret_cast<const char*>(string->data()), string->size()};
+}
+
+} // anonymous namespace
+
+TEST_CASE("Mark and sweep garbage collection", "[eml.memory]")
+{
+  eml::GarbageCollector gc{};
+
+  GIVEN("Objects that no root reaches")
+  {
+    (void)eml::make_string("abc", gc);
+    (void)eml::make_string("defg", gc);
+    REQUIRE(gc.heap_size() == eml::GarbageCollector::object_size(3) +
+                                  eml::GarbageCollector::object_size(4));
+
+    THEN("A collection frees them")
+    {
+      gc.collect();
+      REQUIRE(gc.heap_size() == 0);
+      REQUIRE(gc.collections() == 1);
+    }
+  }
+
+  GIVEN("An object that a root marks")
+  {
+    auto live = eml::make_string("live", gc);
+    (void)eml::make_string("dead", gc);
+    auto roots = gc.add_roots(
+        [&live](eml::GarbageCollector& collector) { collector.mark(live); });
+
+    THEN("It survives collections while the roots are registered")
+    {
+      gc.collect();
+      gc.collect();
+      REQUIRE(gc.heap_size() == eml::GarbageCollector::object_size(4));
+      REQUIRE(contents(live) == "live");
+
+      roots = eml::GcRoots{};
+      gc.collect();
+      REQUIRE(gc.heap_size() == 0);
+    }
+  }
+
+  GIVEN("An object that no collector owns")
+  {
+    alignas(eml::Obj) std::byte storage[64] = {};
+    auto object = eml::GarbageCollector::emplace(storage, 8);
+
+    THEN("Marking it does not write to it")
+    {
+      gc.mark(object);
+      REQUIRE(std::all_of(object->data(), object->data() + 8,
+                          [](std::byte b) { return b == std::byte{0}; }));
+      REQUIRE(object->size() == 8);
+    }
+  }
+
+  GIVEN("A compiler")
+  {
+    eml::Compiler compiler{gc};
+    REQUIRE(compiler.compile("let greeting = \"hello\"").has_value());
+    auto chunk = compiler.compile("\"temporary\"");
+    REQUIRE(chunk.has_value());
+    auto& code = std::get<eml::Bytecode>(*chunk);
+
+    WHEN("The chunk is registered as a root")
+    {
+      auto roots = gc.add_roots([&code](eml::GarbageCollector& collector) {
+        eml::mark(collector, code);
+      });
+      gc.collect();
+
+      THEN("Its constants and the globals survive")
+      {
+        const auto global = compiler.get_global("greeting");
+        REQUIRE(global.has_value());
+        REQUIRE(contents(global->second.unsafe_as_reference()) == "hello");
+        REQUIRE(code.constants.size() == 1);
+        for (const auto& constant : code.constants) {
+          if (constant.is_reference()) {
+            REQUIRE(contents(constant.unsafe_as_reference()) == "temporary");
+          }
+        }
+      }
+    }
+
+    WHEN("Nothing refers to the chunk")
+    {
+      const auto before = gc.heap_size();
+      gc.collect();
+
+      THEN("Only the globals survive")
+      {
+        REQUIRE(gc.heap_size() < before);
+        REQUIRE(gc.heap_size() == eml::GarbageCollector::object_size(5));
+        const auto global = compiler.get_global("greeting");
+        REQUIRE(contents(global->second.unsafe_as_reference()) == "hello");
+      }
+    }
+  }
+
+  GIVEN("A compiler under sustained load")
+  {
+    eml::Compiler compiler{gc};
+    const std::string literal(4096, 'x');
+    const auto source = "\"" + literal + "\"";
+    for (int i = 0; i < 1000; ++i) {
+      REQUIRE(compiler.compile(source).has_value());
+    }
+
+    THEN("The collector keeps the heap bounded")
+    {
+      REQUIRE(gc.collections() > 0);
+      REQUIRE(gc.heap_size() <= eml::GarbageCollector::initial_threshold +
+                                    eml::GarbageCollector::object_size(4096));
+      REQUIRE(gc.next_collection() >=
+              eml::GarbageCollector::initial_threshold);
+    }
+  }
+}
+
+TEST_CASE("Size-class arena allocation", "[eml.memory]")
+{
+  eml::GarbageCollector gc{};
+
+  GIVEN("A dead small object")
+  {
+    const auto first = gc.allocate(10);
+    gc.collect();
+    REQUIRE(gc.heap_size() == 0);
+
+    THEN("An object of the same size class reuses its cell")
+    {
+      const auto second = gc.allocate(12);
+      REQUIRE(second.get() == first.get());
+      REQUIRE(second->size() == 12);
+      REQUIRE(gc.heap_size() == eml::GarbageCollector::object_size(12));
+    }
+  }
+
+  GIVEN("Blocks full of dead small objects")
+  {
+    constexpr std::size_t count = 3 * eml::GarbageCollector::block_size / 64;
+    for (std::size_t i = 0; i < count; ++i) {
+      (void)gc.allocate(32);
+    }
+    REQUIRE(gc.block_count() > 1);
+
+    THEN("A collection releases all but the block that allocation bumps in")
+    {
+      gc.collect();
+      REQUIRE(gc.heap_size() == 0);
+      REQUIRE(gc.block_count() == 1);
+    }
+  }
+
+  GIVEN("Live and dead objects of every size")
+  {
+    std::vector<eml::GcPointer> live;
+    std::size_t live_size = 0;
+    for (std::size_t bytes = 1; bytes <= 4096; bytes += 37) {
+      const auto object = gc.allocate(bytes);
+      if (bytes % 2 == 0) {
+        live.push_back(object);
+        live_size += eml::GarbageCollector::object_size(bytes);
+      }
+    }
+    auto roots = gc.add_roots([&live](eml::GarbageCollector& collector) {
+      for (auto& object : live) {
+        collector.mark(object);
+      }
+    });
+
+    THEN("Only the live objects of both spaces survive")
+    {
+      gc.collect();
+      REQUIRE(gc.heap_size() == live_size);
+      gc.collect();
+      REQUIRE(gc.heap_size() == live_size);
+      for (const auto object : live) {
+        REQUIRE(object->size() % 2 == 0);
+      }
+    }
+  }
+}
+
+TEST_CASE("Generational garbage collection", "[eml.memory]")
+{
+  eml::GarbageCollectorConfig config;
+  config.generational = true;
+  config.nursery_size = 4096;
+  eml::GarbageCollector gc{config};
+
+  GIVEN("Objects that no root reaches")
+  {
+    const auto young = eml::make_string("young", gc);
+    REQUIRE(gc.in_nursery(young));
+    REQUIRE(gc.nursery_heap_size() == eml::GarbageCollector::object_size(5));
+
+    THEN("A nursery collection frees them without touching the blocks")
+    {
+      gc.collect_nursery();
+      REQUIRE(gc.heap_size() == 0);
+      REQUIRE(gc.nursery_heap_size() == 0);
+      REQUIRE(gc.block_count() == 0);
+      REQUIRE(gc.nursery_collections() == 1);
+      REQUIRE(gc.collections() == 0);
+    }
+  }
+
+  GIVEN("Two references to a live object")
+  {
+    auto first = eml::make_string("survivor", gc);
+    auto second = first;
+    (void)eml::make_string("dead", gc);
+    auto roots = gc.add_roots([&](eml::GarbageCollector& collector) {
+      collector.mark(first);
+      collector.mark(second);
+    });
+
+    WHEN("The nursery is collected")
+    {
+      gc.collect_nursery();
+
+      THEN("The object is promoted once and both references follow it")
+      {
+        REQUIRE(!gc.in_nursery(first));
+        REQUIRE(first == second);
+        REQUIRE(contents(first) == "survivor");
+        REQUIRE(gc.heap_size() == eml::GarbageCollector::object_size(8));
+      }
+
+      THEN("A new object can take its place in the nursery")
+      {
+        const auto young = eml::make_string("survivor", gc);
+        REQUIRE(gc.in_nursery(young));
+        REQUIRE(young.get() != first.get());
+        REQUIRE(contents(first) == "survivor");
+      }
+    }
+
+    WHEN("The heap is collected")
+    {
+      gc.collect();
+
+      THEN("The promoted object survives and the nursery is empty")
+      {
+        REQUIRE(!gc.in_nursery(first));
+        REQUIRE(contents(second) == "survivor");
+        REQUIRE(gc.heap_size() == eml::GarbageCollector::object_size(8));
+
+        roots = eml::GcRoots{};
+        gc.collect();
+        REQUIRE(gc.heap_size() == 0);
+      }
+    }
+  }
+
+  GIVEN("A full nursery")
+  {
+    const std::string text(1000, 'x');
+    for (int i = 0; i < 5; ++i) {
+      (void)eml::make_string(text, gc);
+    }
+
+    THEN("Objects are allocated outside of it until the next collection")
+    {
+      const auto object = eml::make_string(text, gc);
+      REQUIRE(!gc.in_nursery(object));
+      REQUIRE(gc.heap_size() == 6 * eml::GarbageCollector::object_size(1000));
+      gc.collect();
+      REQUIRE(gc.heap_size() == 0);
+    }
+  }
+
+  GIVEN("A string constant of chunks that the verifier and the jits copy")
+  {
+    eml::Compiler compiler{gc};
+    auto chunk = compiler.compile("\"hello world\"");
+    REQUIRE(chunk.has_value());
+    auto& code = std::get<eml::Bytecode>(*chunk);
+    auto roots = gc.add_roots([&code](eml::GarbageCollector& collector) {
+      eml::mark(collector, code);
+    });
+    REQUIRE(code.constants.size() == 1);
+    REQUIRE(!gc.in_nursery(code.constants[0].unsafe_as_reference()));
+
+    const auto verified = eml::verify(code);
+    REQUIRE(verified.has_value());
+    const eml::JitBytecode jit_code{*verified};
+    eml::TracingBytecode tracing_code{*verified, 1};
+
+    WHEN("The nursery is collected and then reused")
+    {
+      gc.collect_nursery();
+      for (int i = 0; i < 8; ++i) {
+        (void)eml::make_string(std::string(16, 'X'), gc);
+      }
+
+      THEN("Every form of the chunk still returns the string")
+      {
+        eml::VM vm{};
+        const std::optional<eml::Value> results[] = {
+            vm.interpret(code), vm.interpret(*verified),
+            vm.interpret(jit_code), vm.interpret(tracing_code),
+            vm.interpret(tracing_code)};
+        for (const auto& result : results) {
+          REQUIRE(result.has_value());
+          REQUIRE(contents(result->unsafe_as_reference()) == "hello world");
+        }
+      }
+    }
+  }
+
+  GIVEN("A compiler under sustained load")
+  {
+    eml::Compiler compiler{gc};
+    REQUIRE(compiler.compile("let greeting = \"hello\"").has_value());
+    for (int i = 0; i < 1000; ++i) {
+      REQUIRE(compiler.compile("\"temporary\"").has_value());
+    }
+
+    THEN("Nursery collections run and the globals are promoted")
+    {
+      // The constants of the chunks are tenured, so they wait for a full
+      // collection
+      REQUIRE(gc.nursery_collections() > 0);
+      REQUIRE(gc.heap_size() <= eml::GarbageCollector::initial_threshold +
+                                    config.nursery_size);
+      const auto global = compiler.get_global("greeting");
+      REQUIRE(global.has_value());
+      REQUIRE(!gc.in_nursery(global->second.unsafe_as_reference()));
+      REQUIRE(contents(global->second.unsafe_as_reference()) == "hello");
+    }
+  }
+}
@@ -0,0 +1,175 @@
+#include "bytecode_rewriter.hpp"
+#include "compiler.hpp"
+#include "peephole.hpp"
+#include "vm.hpp"
+
+#include <catch2/catch.hpp>
+
+#include "vm_test_util.hpp"
+
+TEST_CASE("Peephole optimization", "[eml.peephole]")
+{
+  using eml::Bytecode;
+
+  GIVEN("if (!(1 < 2)) 1 else 2")
+  {
+    Bytecode code;
+    push_number(code, 1);
+    push_number(code, 2);
+    write_instruction(code, eml::op_less_f64);
+    write_instruction(code, eml::op_not);
+    write_jump(code, eml::op_jmp_false, 4);
+    push_number(code, 1);
+    write_jump(code, eml::op_jmp, 2);
+    push_number(code, 2);
+
+    eml::PeepholeStats stats;
+    const auto optimized = eml::optimize_peephole(code, stats);
+
+    THEN("The branch jumps on the comparison with the branches swapped")
+    {
+      REQUIRE(opcodes_of(optimized) ==
+              std::vector{eml::op_push_f64, eml::op_push_f64, eml::op_less_f64,
+                          eml::op_jmp_false, eml::op_push_f64, eml::op_jmp,
+                          eml::op_push_f64});
+      const auto decoded = eml::decode(optimized);
+      REQUIRE(decoded.instructions[3].target == 6);
+      REQUIRE(decoded.instructions[5].target == 7);
+      REQUIRE(stats.instructions_removed == 1);
+      REQUIRE(stats.bytes_removed == 1);
+      require_same_result(code, optimized);
+    }
+  }
+
+  GIVEN("A branch on a constant true condition")
+  {
+    Bytecode code;
+    write_instruction(code, eml::op_true);
+    write_jump(code, eml::op_jmp_false, 4);
+    push_number(code, 1);
+    write_jump(code, eml::op_jmp, 2);
+    push_number(code, 2);
+
+    eml::PeepholeStats stats;
+    const auto optimized = eml::optimize_peephole(code, stats);
+
+    THEN("The condition and the conditional jump are removed")
+    {
+      REQUIRE(opcodes_of(optimized) ==
+              std::vector{eml::op_push_f64, eml::op_jmp, eml::op_push_f64});
+      REQUIRE(stats.instructions_removed == 2);
+      REQUIRE(stats.bytes_removed == 3);
+      require_same_result(code, optimized);
+    }
+  }
+
+  GIVEN("A branch on a constant false condition")
+  {
+    Bytecode code;
+    write_instruction(code, eml::op_false);
+    write_jump(code, eml::op_jmp_false, 4);
+    push_number(code, 1);
+    write_jump(code, eml::op_jmp, 2);
+    push_number(code, 2);
+
+    const auto optimized = eml::optimize_peephole(code);
+
+    THEN("It becomes an unconditional jump")
+    {
+      REQUIRE(opcodes_of(optimized) ==
+              std::vector{eml::op_jmp, eml::op_push_f64, eml::op_jmp,
+                          eml::op_push_f64});
+      require_same_result(code, optimized);
+    }
+  }
+
+  GIVEN("Jumps to the next instruction")
+  {
+    Bytecode code;
+    push_number(code, 1);
+    write_jump(code, eml::op_jmp, 0);
+    push_number(code, 2);
+    push_number(code, 3);
+    write_instruction(code, eml::op_less_f64);
+    write_jump(code, eml::op_jmp_false, 0);
+
+    const auto optimized = eml::optimize_peephole(code);
+
+    THEN("The jump is removed and the conditional jump pops its condition")
+    {
+      REQUIRE(opcodes_of(optimized) ==
+              std::vector{eml::op_push_f64, eml::op_push_f64, eml::op_push_f64,
+                          eml::op_less_f64, eml::op_pop});
+      require_same_result(code, optimized);
+    }
+  }
+
+  GIVEN("Double negations")
+  {
+    Bytecode code;
+    push_number(code, -0.);
+    write_instruction(code, eml::op_negate_f64);
+    write_instruction(code, eml::op_negate_f64);
+    write_instruction(code, eml::op_pop);
+    write_instruction(code, eml::op_false);
+    write_instruction(code, eml::op_not);
+    write_instruction(code, eml::op_not);
+
+    eml::PeepholeStats stats;
+    const auto optimized = eml::optimize_peephole(code, stats);
+
+    THEN("They are removed")
+    {
+      REQUIRE(opcodes_of(optimized) ==
+              std::vector{eml::op_push_f64, eml::op_pop, eml::op_false});
+      REQUIRE(stats.instructions_removed == 4);
+      REQUIRE(stats.bytes_removed == 4);
+      require_same_result(code, optimized);
+    }
+  }
+
+  GIVEN("A double negation with a jump between the negations")
+  {
+    Bytecode code;
+    push_number(code, 3);
+    push_number(code, 1);
+    push_number(code, 2);
+    write_instruction(code, eml::op_less_f64);
+    write_jump(code, eml::op_jmp_false, 1);
+    write_instruction(code, eml::op_negate_f64);
+    write_instruction(code, eml::op_negate_f64);
+
+    const auto optimized = eml::optimize_peephole(code);
+
+    THEN("It is kept")
+    {
+      REQUIRE(optimized.instructions == code.instructions);
+    }
+  }
+
+  GIVEN("Compiled nested negated branches")
+  {
+    eml::GarbageCollector gc{};
+    eml::CompilerConfig config;
+    config.constant_folding = false;
+    config.superinstructions = false;
+    config.peephole = false;
+    eml::Compiler plain{gc, config};
+    config.peephole = true;
+    eml::Compiler optimizing{gc, config};
+
+    constexpr auto source = "if (!(1 > 2)) { if (!(3 <= 4)) 5 else 6 } else 7";
+    const auto plain_code = plain.compile(source);
+    const auto optimized_code = optimizing.compile(source);
+    REQUIRE(plain_code.has_value());
+    REQUIRE(optimized_code.has_value());
+
+    THEN("Every not is removed and the result is the same")
+    {
+      const auto& optimized = std::get<Bytecode>(*optimized_code);
+      const auto ops = opcodes_of(optimized);
+      REQUIRE(std::find(ops.begin(), ops.end(), eml::op_not) == ops.end());
+      require_same_result(std::get<Bytecode>(*plain_code), optimized);
+    }
+  }
+}
@@ -0,0 +1,159 @@
+#include "compiler.hpp"
+#include "register_vm.hpp"
+#include "vm.hpp"
+
+#include <catch2/catch.hpp>
+
+#include "vm_test_util.hpp"
+
+#include <functional>
+#include <string>
+
+TEST_CASE("Register-based code generation", "[eml.register_vm]")
+{
+  eml::GarbageCollector gc{};
+  eml::Compiler compiler{gc};
+
+  GIVEN("1 + 2 * 3")
+  {
+    const auto ast = parse_and_type_check(compiler, "1 + 2 * 3", gc);
+    REQUIRE(ast.has_value());
+
+    WHEN("Generates register-based code")
+    {
+      const auto result = compiler.generate_register_code(**ast);
+      REQUIRE(result.has_value());
+      const auto& [code, type] = *result;
+
+      THEN("Uses constant operands directly in three instructions")
+      {
+        REQUIRE(code.instructions.size() == 3);
+        REQUIRE(code.register_count == 1);
+        REQUIRE(code.disassemble() == "0000    mult<f64> r0, k1, k2\n"
+                                      "0001    add<f64> r0, k0, r0\n"
+                                      "0002    return r0\n");
+      }
+
+      THEN("Evaluate to 7")
+      {
+        eml::RegisterVM vm;
+        const auto result = vm.interpret(code);
+        REQUIRE(result);
+        REQUIRE(result->unsafe_as_number() == Approx(7));
+      }
+    }
+  }
+}
+
+TEST_CASE("Register VM agrees with the stack VM", "[eml.register_vm]")
+{
+  eml::GarbageCollector gc{};
+  eml::Compiler compiler{gc};
+
+  const auto source = GENERATE(as<std::string>{}, "((2 + 3) / 4) - (2 * 5)",
+                               "-(1 + 2) * -3", "1 < 2", "!(2 >= 3)",
+                               "1 == 1", "true != false", "() == ()",
+                               "\"abc\" == \"abc\"", "\"abc\" != \"abd\"",
+                               "0 / 0 == 0 / 0", "(1 < 2) == true",
+                               "if (5 > 1) 2 + 3 else 4 - 6",
+                               "if (5 < 1) 2 + 3 else 4 - 6",
+                               "if (1 < 2) if (2 < 1) 1 else 2 else 3",
+                               "(if (true) 1 else 2) + (if (false) 3 else 4)");
+
+  GIVEN(source)
+  {
+    const auto ast = parse_and_type_check(compiler, source, gc);
+    REQUIRE(ast.has_value());
+
+    const auto [stack_code, stack_type] = compiler.generate_code(**ast);
+    const auto register_chunk = compiler.generate_register_code(**ast);
+    REQUIRE(register_chunk.has_value());
+    const auto& [register_code, register_type] = *register_chunk;
+    REQUIRE(eml::match(stack_type, register_type));
+
+    eml::VM vm;
+    eml::RegisterVM register_vm;
+    const auto stack_result = vm.interpret(stack_code);
+    const auto register_result = register_vm.interpret(register_code);
+
+    THEN("Both back ends produce the same result")
+    {
+      REQUIRE(stack_result);
+      REQUIRE(register_result);
+      REQUIRE(eml::to_string(stack_type, *stack_result) ==
+              eml::to_string(register_type, *register_result));
+    }
+  }
+}
+
+TEST_CASE("Register code generation reports chunks that are too large",
+          "[eml.register_vm]")
+{
+  eml::GarbageCollector gc{};
+  eml::Compiler compiler{gc};
+
+  GIVEN("An expression that keeps more than 256 temporaries alive")
+  {
+    std::string source = "1";
+    for (std::size_t i = 0; i <= eml::max_registers; ++i) {
+      source = "(-1) + (" + source + ")";
+    }
+    const auto ast = parse_and_type_check(compiler, source, gc);
+    REQUIRE(ast.has_value());
+
+    THEN("It has no register code but still runs on the stack VM")
+    {
+      REQUIRE(!compiler.generate_register_code(**ast).has_value());
+
+      const auto [code, type] = compiler.generate_code(**ast);
+      eml::VM vm;
+      const auto result = vm.interpret(code);
+      REQUIRE(result.has_value());
+      REQUIRE(result->unsafe_as_number() ==
+              Approx(1. - static_cast<double>(eml::max_registers + 1)));
+    }
+  }
+
+  // A balanced sum of count terms, so that the depth of the AST stays small
+  std::function<std::string(std::size_t, const std::string&)> sum =
+      [&sum](std::size_t count, const std::string& term) -> std::string {
+    if (count == 1) {
+      return term;
+    }
+    return "(" + sum(count / 2, term) + " + " +
+           sum(count - count / 2, term) + ")";
+  };
+
+  GIVEN("An expression with more literals than a chunk has constants")
+  {
+    const auto source = sum(eml::max_register_constants + 1, "1");
+    const auto ast = parse_and_type_check(compiler, source, gc);
+    REQUIRE(ast.has_value());
+
+    THEN("It has no register code")
+    {
+      REQUIRE(!compiler.generate_register_code(**ast).has_value());
+    }
+  }
+
+  GIVEN("A branch longer than the distance a jump can cover")
+  {
+    // Every term takes five instructions and a single constant
+    const auto source =
+        "if (false) " + sum(eml::max_register_jump / 5 + 1, "(- - - - 1)") +
+        " else 7";
+    const auto ast = parse_and_type_check(compiler, source, gc);
+    REQUIRE(ast.has_value());
+
+    THEN("It has no register code but still runs on the stack VM")
+    {
+      REQUIRE(!compiler.generate_register_code(**ast).has_value());
+
+      const auto [code, type] = compiler.generate_code(**ast);
+      eml::VM vm;
+      const auto result = vm.interpret(code);
+      REQUIRE(result.has_value());
+      REQUIRE(result->unsafe_as_number() == Approx(7));
+    }
+  }
+}
@@ -0,0 +1,114 @@
+#include "compiler.hpp"
+#include "static_compiler.hpp"
+#include "vm.hpp"
+
+#include <catch2/catch.hpp>
+
+#include "vm_test_util.hpp"
+
+namespace {
+
+constexpr std::array globals{eml::StaticGlobal{"x", 4.},
+                             eml::StaticGlobal{"half", 0.5},
+                             eml::StaticGlobal{"negative_zero", -0.},
+                             eml::StaticGlobal{"yes", true}};
+
+constexpr auto arithmetic = eml::compile_static("1 + 2 * x", globals);
+static_assert(arithmetic);
+static_assert(arithmetic.type == eml::StackType::number);
+static_assert(arithmetic.max_stack_depth == 3);
+
+constexpr auto branch = eml::compile_static("if (x < 5) 1.5 else 0.1");
+static_assert(!branch, "Globals are only visible when passed");
+static_assert(branch.error.msg == "Undefined identifier");
+
+constexpr auto string = eml::compile_static("\"abc\" == \"abc\"");
+static_assert(!string);
+
+constexpr auto mismatch = eml::compile_static("if (true) 1 else false");
+static_assert(!mismatch);
+static_assert(mismatch.error.msg == "Type mismatch in branching!");
+
+constexpr auto too_small = eml::compile_static<4>("1 + 2 + 3");
+static_assert(!too_small);
+
+// Compiles source at runtime with the same globals as the static chunks
+auto compile(std::string_view source) -> eml::Bytecode
+{
+  eml::GarbageCollector gc{};
+  eml::CompilerConfig config;
+  config.superinstructions = false;
+  eml::Compiler compiler{gc, config};
+  for (const auto& global : globals) {
+    if (global.type == eml::StackType::boolean) {
+      compiler.add_global(std::string{global.name}, eml::BoolType{},
+                          eml::Value{global.boolean});
+    } else {
+      compiler.add_global(std::string{global.name}, eml::NumberType{},
+                          eml::Value{global.number});
+    }
+  }
+  auto result = compiler.compile(source);
+  REQUIRE(result.has_value());
+  return std::get<eml::Bytecode>(*std::move(result));
+}
+
+template <std::size_t capacity>
+void require_same_result(const eml::StaticBytecode<capacity>& chunk,
+                         std::string_view source)
+{
+  INFO(source);
+  REQUIRE(chunk);
+  eml::VM vm{};
+  const auto expected = vm.interpret(compile(source));
+  const auto result = vm.interpret(chunk);
+  REQUIRE(expected.has_value());
+  REQUIRE(result.has_value());
+  REQUIRE(same_bits(*expected, *result));
+
+  const auto verified = eml::verify(chunk.to_bytecode());
+  REQUIRE(verified.has_value());
+  REQUIRE(verified->max_stack_depth() == chunk.max_stack_depth);
+}
+
+#define REQUIRE_SAME_STATIC_RESULT(source)                                     \
+  do {                                                                         \
+    constexpr auto chunk = eml::compile_static(source, globals);               \
+    require_same_result(chunk, source);                                        \
+  } while (false)
+
+} // anonymous namespace
+
+TEST_CASE("Compile-time compilation of scripts", "[eml.static]")
+{
+  GIVEN("Scripts compiled at compile time")
+  {
+    THEN("They produce the same results as the scripts compiled at runtime")
+    {
+      REQUIRE_SAME_STATIC_RESULT("1 + 2 * x");
+      REQUIRE_SAME_STATIC_RESULT("-(4 / 2) - -0");
+      REQUIRE_SAME_STATIC_RESULT("0.1 + 0.2");
+      REQUIRE_SAME_STATIC_RESULT("3.14159265358979 * 100.25");
+      REQUIRE_SAME_STATIC_RESULT("100000000000000000000 / 0.000001");
+      REQUIRE_SAME_STATIC_RESULT("200 - 127.0 - 128 - 0.00");
+      REQUIRE_SAME_STATIC_RESULT("0 / 0 == 0 / 0");
+      REQUIRE_SAME_STATIC_RESULT("half * negative_zero");
+      REQUIRE_SAME_STATIC_RESULT("!(1 <= 2) != yes");
+      REQUIRE_SAME_STATIC_RESULT("() == ()");
+      REQUIRE_SAME_STATIC_RESULT("if (x >= 4) { x * half } else x");
+      REQUIRE_SAME_STATIC_RESULT("if (1 < 2) if (3 > 4) 5 else 6 * 7 else 8");
+    }
+  }
+
+  GIVEN("A number literal with too many significant digits")
+  {
+    constexpr auto chunk = eml::compile_static("0.1000000000000000055511151");
+    THEN("It is rejected with its position")
+    {
+      REQUIRE(!chunk);
+      REQUIRE(chunk.error.position.column == 1);
+      eml::VM vm{};
+      REQUIRE(!vm.interpret(chunk).has_value());
+    }
+  }
+}
@@ -0,0 +1,249 @@
+#include "bytecode_rewriter.hpp"
+#include "superinstruction.hpp"
+#include "vm.hpp"
+
+#include <catch2/catch.hpp>
+
+#include "vm_test_util.hpp"
+
+TEST_CASE("Superinstruction fusion", "[eml.superinstruction]")
+{
+  using eml::Bytecode;
+
+  GIVEN("(- (* (+ 2 3) 4))")
+  {
+    Bytecode code;
+    push_number(code, 2);
+    push_number(code, 3);
+    write_instruction(code, eml::op_add_f64);
+    push_number(code, 4);
+    write_instruction(code, eml::op_multiply_f64);
+    write_instruction(code, eml::op_negate_f64);
+
+    WHEN("Fuse superinstructions")
+    {
+      const auto fused = eml::fuse_superinstructions(code);
+
+      THEN("Pushes followed by arithmetics are fused")
+      {
+        const auto decoded = eml::decode(fused);
+        REQUIRE(decoded.instructions.size() == 4);
+        REQUIRE(decoded.instructions[1].op == eml::op_push_add_f64);
+        REQUIRE(decoded.instructions[1].immediate == 3);
+        REQUIRE(decoded.instructions[2].op == eml::op_push_multiply_f64);
+        REQUIRE(decoded.instructions[2].immediate == 4);
+      }
+
+      THEN("Evaluate to -20")
+      {
+        eml::VM machine{};
+        const auto result = machine.interpret(fused);
+        REQUIRE(result);
+        REQUIRE(result->unsafe_as_number() == Approx(-20));
+      }
+    }
+  }
+
+  GIVEN("(if (< 5 1) (+ 2 3) (- 4 6))")
+  {
+    Bytecode code;
+    push_number(code, 5);
+    push_number(code, 1);
+    write_instruction(code, eml::op_less_f64);
+    write_jump(code, eml::op_jmp_false, 7);
+    push_number(code, 2);                          // 2
+    push_number(code, 3);                          // 2
+    write_instruction(code, eml::op_add_f64);      // 1
+    write_jump(code, eml::op_jmp, 5);              // 2
+    push_number(code, 4);                          // 2
+    push_number(code, 6);                          // 2
+    write_instruction(code, eml::op_subtract_f64); // 1
+
+    WHEN("Fuse superinstructions")
+    {
+      const auto fused = eml::fuse_superinstructions(code);
+
+      THEN("Fuses the comparison with the jump and keeps the jumps correct")
+      {
+        const auto decoded = eml::decode(fused);
+        REQUIRE(decoded.instructions.size() == 7);
+        REQUIRE(decoded.instructions[0].op == eml::op_push2_f64);
+        REQUIRE(decoded.instructions[0].immediate == 5);
+        REQUIRE(decoded.instructions[0].second_immediate == 1);
+        REQUIRE(decoded.instructions[1].op == eml::op_less_f64_jmp_false);
+
+        eml::VM machine{};
+        const auto result = machine.interpret(fused);
+        REQUIRE(result);
+        REQUIRE(result->unsafe_as_number() == Approx(-2));
+      }
+    }
+  }
+
+  GIVEN("A jump that lands between a push and an add")
+  {
+    // (if false 1 else 2) with the else branch continues to add 3
+    Bytecode code;
+    write_instruction(code, eml::op_false);
+    write_jump(code, eml::op_jmp_false, 4);
+    push_number(code, 1);
+    write_jump(code, eml::op_jmp, 2);
+    push_number(code, 2);
+    push_number(code, 3);
+    write_instruction(code, eml::op_add_f64);
+
+    WHEN("Fuse superinstructions")
+    {
+      const auto fused = eml::fuse_superinstructions(code);
+
+      THEN("Only fuses the sequence that no one jumps into")
+      {
+        const auto decoded = eml::decode(fused);
+        REQUIRE(decoded.instructions.size() == 5);
+        REQUIRE(decoded.instructions[1].op == eml::op_jmp_false_push_f64);
+        REQUIRE(decoded.instructions[1].immediate == 1);
+        REQUIRE(decoded.instructions[3].op == eml::op_push_f64);
+        REQUIRE(decoded.instructions[4].op == eml::op_push_add_f64);
+
+        eml::VM machine{};
+        const auto result = machine.interpret(fused);
+        REQUIRE(result);
+        REQUIRE(result->unsafe_as_number() == Approx(5));
+      }
+    }
+  }
+}
+
+TEST_CASE("Superinstruction fusion of pushes and jumps",
+          "[eml.superinstruction]")
+{
+  GIVEN("(< 1.5 2.5)")
+  {
+    eml::Bytecode code;
+    push_number(code, 1.5);
+    push_number(code, 2.5);
+    write_instruction(code, eml::op_less_f64);
+
+    WHEN("Fuse superinstructions")
+    {
+      const auto fused = eml::fuse_superinstructions(code);
+
+      THEN("The two pushes are fused")
+      {
+        const auto decoded = eml::decode(fused);
+        REQUIRE(decoded.instructions.size() == 2);
+        REQUIRE(decoded.instructions[0].op == eml::op_push2_f64);
+        REQUIRE(decoded.instructions[0].immediate == 1.5);
+        REQUIRE(decoded.instructions[0].second_immediate == 2.5);
+        REQUIRE(fused.compute_max_stack_depth() == 2);
+      }
+
+      THEN("Evaluate to true")
+      {
+        require_same_result(code, fused);
+        require_same_jit_result(fused);
+      }
+    }
+  }
+
+  GIVEN("A jump on false over a branch longer than a narrow jump")
+  {
+    // (if c 1 else 2) where the then branch runs 200 times true and pop
+    const auto chunk = [](eml::opcode condition) {
+      eml::Bytecode code;
+      write_instruction(code, condition);
+      write_instruction(code, eml::op_jmp_false_wide);
+      code.write(std::uint32_t{2 + 2 + 200 * 2}, eml::line_num{0});
+      push_number(code, 1);
+      for (int i = 0; i < 200; ++i) {
+        write_instruction(code, eml::op_true);
+        write_instruction(code, eml::op_pop);
+      }
+      write_jump(code, eml::op_jmp, 2);
+      push_number(code, 2);
+      return code;
+    };
+
+    WHEN("Fuse superinstructions")
+    {
+      const auto on_false = chunk(eml::op_false);
+      const auto on_true = chunk(eml::op_true);
+      const auto fused_on_false = eml::fuse_superinstructions(on_false);
+      const auto fused_on_true = eml::fuse_superinstructions(on_true);
+
+      THEN("The push is fused into the wide jump")
+      {
+        REQUIRE(static_cast<eml::opcode>(fused_on_false.instructions[1]) ==
+                eml::op_jmp_false_push_f64_wide);
+        const auto decoded = eml::decode(fused_on_false);
+        REQUIRE(decoded.instructions[1].op == eml::op_jmp_false_push_f64);
+        REQUIRE(decoded.instructions[1].immediate == 1);
+        REQUIRE(fused_on_false.compute_max_stack_depth() == 2);
+      }
+
+      THEN("Both branches evaluate as before")
+      {
+        require_same_result(on_false, fused_on_false);
+        require_same_result(on_true, fused_on_true);
+        require_same_jit_result(fused_on_false);
+        require_same_jit_result(fused_on_true);
+      }
+    }
+  }
+}
+
+TEST_CASE("Superinstruction fusion of inline numbers", "[eml.superinstruction]")
+{
+  GIVEN("(/ (- (+ 100 1) 0.5) -1)")
+  {
+    eml::Bytecode code;
+    code.write_number(100, eml::line_num{0});
+    code.write_number(1, eml::line_num{0});
+    write_instruction(code, eml::op_add_f64);
+    code.write_number(0.5, eml::line_num{0});
+    write_instruction(code, eml::op_subtract_f64);
+    code.write_number(-1, eml::line_num{0});
+    write_instruction(code, eml::op_divide_f64);
+
+    WHEN("Fuse superinstructions")
+    {
+      const auto fused = eml::fuse_superinstructions(code);
+
+      THEN("Every encoding of a number push is fused")
+      {
+        const auto decoded = eml::decode(fused);
+        REQUIRE(decoded.instructions.size() == 4);
+        REQUIRE(decoded.instructions[0].op == eml::op_push_f64_small);
+        REQUIRE(decoded.instructions[1].op == eml::op_push_add_f64);
+        REQUIRE(decoded.instructions[2].op == eml::op_push_subtract_f64);
+        REQUIRE(decoded.instructions[3].op == eml::op_push_divide_f64);
+        REQUIRE(decoded.instructions[3].immediate == -1);
+      }
+
+      THEN("Evaluate to -100.5")
+      {
+        eml::VM machine{};
+        const auto result = machine.interpret(fused);
+        REQUIRE(result);
+        REQUIRE(result->unsafe_as_number() == Approx(-100.5));
+      }
+    }
+  }
+}
+
+TEST_CASE("Opcode pair profile", "[eml.superinstruction]")
+{
+  eml::Bytecode code;
+  push_number(code, 1);
+  push_number(code, 2);
+  write_instruction(code, eml::op_add_f64);
+  push_number(code, 3);
+  write_instruction(code, eml::op_add_f64);
+
+  eml::OpcodePairProfile profile;
+  eml::profile_opcode_pairs(code, profile);
+
+  REQUIRE(profile[{eml::op_push_f64, eml::op_add_f64}] == 2);
+  REQUIRE(profile[{eml::op_push_f64, eml::op_push_f64}] == 1);
+  REQUIRE(profile[{eml::op_add_f64, eml::op_push_f64}] == 1);
+}
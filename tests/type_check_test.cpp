@@ -3,12 +3,7 @@
 
 #include <catch2/catch.hpp>
 
-auto parse_and_type_check(eml::Compiler& compiler, std::string_view s,
-                          eml::GarbageCollector& gc)
-{
-  return eml::parse(s, gc).and_then(
-      [&compiler](auto&& ast) { return compiler.type_check(ast); });
-}
+#include "vm_test_util.hpp"
 
 TEST_CASE("Type check on unary expressions")
 {
@@ -2,7 +2,9 @@
 #include "value.hpp"
 
 #include <catch2/catch.hpp>
+#include <cstdint>
 #include <functional>
+#include <limits>
 #include <sstream>
 
 TEST_CASE("Values' RTTI 'unsafe_as_xxx' and 'is_xxx' function")
@@ -84,6 +86,101 @@ TEST_CASE("Values' RTTI 'unsafe_as_xxx' and 'is_xxx' function")
   }
 }
 
+TEST_CASE("Values of special floating point numbers are still numbers")
+{
+  GIVEN("NaN, infinity and negative zero")
+  {
+    const eml::Value nan{std::numeric_limits<double>::quiet_NaN()};
+    const eml::Value computed_nan{0. / std::numeric_limits<double>::infinity() *
+                                  std::numeric_limits<double>::infinity()};
+    const eml::Value inf{-std::numeric_limits<double>::infinity()};
+    const eml::Value negative_zero{-0.};
+
+    THEN("Are numbers")
+    {
+      REQUIRE(nan.is_number());
+      REQUIRE(computed_nan.is_number());
+      REQUIRE(inf.is_number());
+      REQUIRE(negative_zero.is_number());
+    }
+
+    THEN("Are not any other type")
+    {
+      REQUIRE(!nan.is_unit());
+      REQUIRE(!nan.is_boolean());
+      REQUIRE(!nan.is_reference());
+      REQUIRE(!inf.is_reference());
+    }
+
+    THEN("Compare with IEEE 754 semantics")
+    {
+      REQUIRE(nan != nan);
+      REQUIRE(negative_zero == eml::Value{0.});
+      REQUIRE(inf.unsafe_as_number() ==
+              -std::numeric_limits<double>::infinity());
+    }
+  }
+}
+
+TEST_CASE("NaNs with any payload are still numbers")
+{
+  GIVEN("NaNs whose bits look like the tags of other values")
+  {
+    const std::uint64_t payloads[] = {
+        0x7ffc000000000001, // unit
+        0x7ffc000000000003, // true
+        0xfffc00000000abc0, // reference
+        0xffffffffffffffff,
+    };
+
+    THEN("Values constructed from them are NaN numbers")
+    {
+      for (const auto payload : payloads) {
+        const auto number = eml::bit_cast<double>(payload);
+        REQUIRE(number != number);
+
+        const eml::Value value{number};
+        REQUIRE(value.is_number());
+        REQUIRE(!value.is_unit());
+        REQUIRE(!value.is_boolean());
+        REQUIRE(!value.is_reference());
+        REQUIRE(value != value);
+      }
+    }
+  }
+}
+
+TEST_CASE("Reference values")
+{
+  eml::GarbageCollector gc{};
+  const auto hello = eml::make_string("Hello", gc);
+  const eml::Value v{hello};
+
+  THEN("Is a reference")
+  {
+    REQUIRE(v.is_reference());
+    REQUIRE(!v.is_number());
+    REQUIRE(!v.is_boolean());
+    REQUIRE(!v.is_unit());
+  }
+
+  THEN("Refers to the same object")
+  {
+    REQUIRE(v.unsafe_as_reference() == hello);
+    REQUIRE(v == eml::Value{hello});
+    REQUIRE(v != eml::Value{eml::make_string("Hello", gc)});
+  }
+}
+
+TEST_CASE("Value representation")
+{
+  if constexpr (eml::build_options.nan_boxing) {
+    REQUIRE(sizeof(eml::Value) == sizeof(double));
+  } else {
+    REQUIRE(sizeof(eml::Value) == 2 * sizeof(double));
+  }
+}
+
 TEST_CASE("Value printing")
 {
   std::stringstream ss;
@@ -0,0 +1,162 @@
+#include "compiler.hpp"
+#include "verifier.hpp"
+#include "vm.hpp"
+
+#include <catch2/catch.hpp>
+
+#include "vm_test_util.hpp"
+
+TEST_CASE("Verification of compiled code", "[eml.verifier]")
+{
+  eml::GarbageCollector gc{};
+  eml::Compiler compiler{gc};
+  eml::VM vm{};
+
+  const auto source =
+      GENERATE(as<std::string>{}, "1 + 2 * 3", "-(4 / 2) - 1", "!(1 < 2)",
+               "2 >= 2 == true", "() == ()", "if (1 <= 2) 3 else 4",
+               "if (true) if (false) 1 else 2 else 3");
+
+  GIVEN(source)
+  {
+    const auto ast = parse_and_type_check(compiler, source, gc);
+    REQUIRE(ast.has_value());
+    const auto [code, type] = compiler.generate_code(**ast);
+
+    const auto verified = eml::verify(code);
+    THEN("The chunk passes the verification")
+    {
+      REQUIRE(verified.has_value());
+      REQUIRE(verified->max_stack_depth() == code.max_stack_depth);
+    }
+
+    THEN("The verified chunk evaluates to the same result")
+    {
+      REQUIRE(verified.has_value());
+      const auto expected = vm.interpret(code);
+      const auto result = vm.interpret(*verified);
+      REQUIRE(expected.has_value());
+      REQUIRE(result.has_value());
+      REQUIRE(*result == *expected);
+    }
+  }
+}
+
+TEST_CASE("Verification of malformed code", "[eml.verifier]")
+{
+  using eml::Bytecode;
+
+  Bytecode code;
+  std::size_t offset = 0;
+
+  SECTION("Unknown opcode")
+  {
+    code.write(std::byte{0xff}, eml::line_num{0});
+  }
+
+  SECTION("The operand of the last instruction is missing")
+  {
+    write_instruction(code, eml::op_push_f64_imm);
+  }
+
+  SECTION("Constant index out of the constant pool")
+  {
+    write_instruction(code, eml::op_push_f64);
+    code.write(std::byte{0}, eml::line_num{0});
+  }
+
+  SECTION("Pops from an empty stack")
+  {
+    push_number(code, 1);
+    write_instruction(code, eml::op_add_f64);
+    offset = 2;
+  }
+
+  SECTION("Arithmetic on a boolean")
+  {
+    push_number(code, 1);
+    write_instruction(code, eml::op_true);
+    write_instruction(code, eml::op_add_f64);
+    offset = 3;
+  }
+
+  SECTION("Not on a number")
+  {
+    push_number(code, 1);
+    write_instruction(code, eml::op_not);
+    offset = 2;
+  }
+
+  SECTION("Conditional jump on a number")
+  {
+    push_number(code, 1);
+    write_jump(code, eml::op_jmp_false, 0);
+    offset = 2;
+  }
+
+  SECTION("Equality between different types")
+  {
+    push_number(code, 1);
+    write_instruction(code, eml::op_true);
+    write_instruction(code, eml::op_equal);
+    offset = 3;
+  }
+
+  SECTION("Typed equality on operands of another type")
+  {
+    write_instruction(code, eml::op_true);
+    write_instruction(code, eml::op_false);
+    write_instruction(code, eml::op_equal_f64);
+    offset = 2;
+  }
+
+  SECTION("Jumps into the middle of an instruction")
+  {
+    write_jump(code, eml::op_jmp, 1);
+    push_number(code, 1);
+    offset = 3;
+  }
+
+  SECTION("Jumps out of the chunk")
+  {
+    write_jump(code, eml::op_jmp, 3);
+    push_number(code, 1);
+  }
+
+  SECTION("Paths join with different stacks")
+  {
+    // if true then 1 else false
+    write_instruction(code, eml::op_true);
+    write_jump(code, eml::op_jmp_false, 4);
+    push_number(code, 1);
+    write_jump(code, eml::op_jmp, 1);
+    write_instruction(code, eml::op_false);
+    offset = 7;
+  }
+
+  SECTION("Return")
+  {
+    write_instruction(code, eml::op_return);
+  }
+
+  const auto result = eml::verify(code);
+  REQUIRE(!result.has_value());
+  REQUIRE(result.error().offset == offset);
+}
+
+TEST_CASE("Verification skips unreachable code", "[eml.verifier]")
+{
+  eml::Bytecode code;
+  write_jump(code, eml::op_jmp, 1);
+  write_instruction(code, eml::op_pop);
+  push_number(code, 1);
+
+  const auto verified = eml::verify(code);
+  REQUIRE(verified.has_value());
+  REQUIRE(verified->max_stack_depth() == 1);
+
+  eml::VM vm{1};
+  const auto result = vm.interpret(*verified);
+  REQUIRE(result.has_value());
+  REQUIRE(result->unsafe_as_number() == Approx(1));
+}
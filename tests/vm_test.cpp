@@ -1,3 +1,4 @@
+#include "compiler.hpp"
 #include "vm.hpp"
 
 #include <catch2/catch.hpp>
@@ -43,6 +44,11 @@ TEST_CASE("Arithmatic instructions", "[eml.vm]")
       REQUIRE(result);
       REQUIRE(result->unsafe_as_number() == Approx(expected));
     }
+
+    THEN("The jit produces the same result")
+    {
+      require_same_jit_result(code);
+    }
   }
 }
 
@@ -83,6 +89,11 @@ TEST_CASE("Jumps", "[eml.vm]")
       REQUIRE(result);
       REQUIRE(result->unsafe_as_number() == Approx(expected));
     }
+
+    THEN("The jit produces the same result")
+    {
+      require_same_jit_result(code);
+    }
   }
 
   GIVEN("(if (< 5 1) (+ 2 3) (- 4 6))")
@@ -116,5 +127,161 @@ TEST_CASE("Jumps", "[eml.vm]")
       REQUIRE(result);
       REQUIRE(result->unsafe_as_number() == Approx(expected));
     }
+
+    THEN("The jit produces the same result")
+    {
+      require_same_jit_result(code);
+    }
+  }
+}
+
+TEST_CASE("Inline number pushes", "[eml.vm]")
+{
+  using eml::Bytecode;
+  using eml::line_num;
+
+  const auto [number, expected_op] = GENERATE(table<double, eml::opcode>({
+      {0., eml::op_push_f64_zero},
+      {-0., eml::op_push_f64_imm},
+      {1., eml::op_push_f64_one},
+      {-1., eml::op_push_f64_minus_one},
+      {2., eml::op_push_f64_small},
+      {127., eml::op_push_f64_small},
+      {-128., eml::op_push_f64_small},
+      {128., eml::op_push_f64_imm},
+      {0.5, eml::op_push_f64_imm},
+      {-3.25, eml::op_push_f64_imm},
+      {1e300, eml::op_push_f64_imm},
+  }));
+
+  GIVEN("A push of " + std::to_string(number))
+  {
+    Bytecode code;
+    code.write_number(number, line_num{0});
+
+    THEN("Uses the shortest encoding")
+    {
+      REQUIRE(static_cast<eml::opcode>(code.instructions.front()) ==
+              expected_op);
+      REQUIRE(code.constants.empty());
+    }
+
+    THEN("Pushes the same number")
+    {
+      eml::VM machine{};
+      const auto result = machine.interpret(code);
+      REQUIRE(result);
+      REQUIRE(result->is_number());
+      REQUIRE(result->unsafe_as_number() == number);
+      REQUIRE(std::signbit(result->unsafe_as_number()) == std::signbit(number));
+    }
+
+    THEN("The jit pushes the same number")
+    {
+      require_same_jit_result(code);
+    }
+  }
+}
+
+TEST_CASE("Maximum stack size", "[eml.vm]")
+{
+  using eml::Bytecode;
+
+  GIVEN("(1 + 2) * 3")
+  {
+    Bytecode code;
+    push_number(code, 1);
+    push_number(code, 2);
+    write_instruction(code, eml::op_add_f64);
+    push_number(code, 3);
+    write_instruction(code, eml::op_multiply_f64);
+
+    THEN("A vm with a large enough stack evaluates it to 9")
+    {
+      eml::VM machine{code.instructions.size()};
+      REQUIRE(machine.max_stack_size() == code.instructions.size());
+
+      const auto result = machine.interpret(code);
+      REQUIRE(result);
+      REQUIRE(result->unsafe_as_number() == Approx(9));
+    }
+
+    THEN("The jit produces the same result")
+    {
+      require_same_jit_result(code);
+    }
+
+    THEN("A vm with a too small stack refuses to run it")
+    {
+      eml::VM machine{1};
+      REQUIRE(!machine.interpret(code));
+    }
+  }
+}
+
+TEST_CASE("Typed equality", "[eml.vm]")
+{
+  eml::GarbageCollector gc{};
+  eml::CompilerConfig config;
+  config.constant_folding = false;
+  eml::Compiler compiler{gc, config};
+
+  const auto compile = [&](std::string_view source) {
+    const auto result = compiler.compile(source);
+    REQUIRE(result.has_value());
+    return std::get<eml::Bytecode>(*result);
+  };
+  const auto contains = [](const eml::Bytecode& code, eml::opcode op) {
+    return std::find(code.instructions.begin(), code.instructions.end(),
+                     std::byte{op}) != code.instructions.end();
+  };
+
+  GIVEN("Equality of operands of every type")
+  {
+    const auto numbers = compile("0 / 0 != 0 / 0");
+    const auto booleans = compile("true == (1 < 2)");
+    const auto units = compile("() != ()");
+    const auto strings = compile("\"abc\" == \"abc\"");
+    const auto different_strings = compile("\"abc\" != \"abd\"");
+
+    THEN("The code generator emits the equality of their type")
+    {
+      REQUIRE(contains(numbers, eml::op_not_equal_f64));
+      REQUIRE(contains(booleans, eml::op_equal_bool));
+      REQUIRE(contains(strings, eml::op_equal_string));
+      REQUIRE(contains(different_strings, eml::op_not_equal_string));
+      REQUIRE(!contains(numbers, eml::op_not_equal));
+      REQUIRE(!contains(different_strings, eml::op_push2_f64));
+    }
+
+    THEN("Equality of units folds to a constant")
+    {
+      eml::Bytecode expected;
+      write_instruction(expected, eml::op_false, eml::line_num{1});
+      REQUIRE(units.disassemble() == expected.disassemble());
+    }
+
+    THEN("Evaluates them")
+    {
+      eml::VM vm{};
+      REQUIRE(vm.interpret(numbers)->unsafe_as_boolean());
+      REQUIRE(vm.interpret(booleans)->unsafe_as_boolean());
+      REQUIRE(!vm.interpret(units)->unsafe_as_boolean());
+      REQUIRE(vm.interpret(different_strings)->unsafe_as_boolean());
+    }
+
+    THEN("Strings are compared by their contents")
+    {
+      eml::VM vm{};
+      REQUIRE(vm.interpret(strings)->unsafe_as_boolean());
+    }
+
+    THEN("The jit produces the same results")
+    {
+      require_same_jit_result(numbers);
+      require_same_jit_result(booleans);
+      require_same_jit_result(strings);
+      require_same_jit_result(different_strings);
+    }
   }
 }
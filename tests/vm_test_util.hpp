@@ -3,8 +3,57 @@
 
 // Test Utility functions
 
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+#include <catch2/catch.hpp>
+
+#include "bytecode_rewriter.hpp"
+#include "compiler.hpp"
+#include "jit.hpp"
+#include "verifier.hpp"
 #include "vm.hpp"
 
+// Parses s and checks its types
+inline auto parse_and_type_check(eml::Compiler& compiler, std::string_view s,
+                                 eml::GarbageCollector& gc)
+{
+  return eml::parse(s, gc).and_then(
+      [&compiler](auto&& parsed) { return compiler.type_check(parsed); });
+}
+
+// Generates the bytecode of s, which must compile
+inline auto compile_expression(eml::Compiler& compiler, std::string_view s,
+                               eml::GarbageCollector& gc) -> eml::Bytecode
+{
+  const auto ast = parse_and_type_check(compiler, s, gc);
+  REQUIRE(ast.has_value());
+  return std::get<eml::Bytecode>(compiler.generate_code(**ast));
+}
+
+// Returns the opcodes of a chunk, with the narrow form of wide instructions
+inline auto opcodes_of(const eml::Bytecode& code) -> std::vector<eml::opcode>
+{
+  std::vector<eml::opcode> result;
+  for (const auto& instruction : eml::decode(code).instructions) {
+    result.push_back(instruction.op);
+  }
+  return result;
+}
+
+// Returns the opcodes of a chunk in their encoded form
+inline auto encoded_opcodes_of(const eml::Bytecode& code)
+    -> std::vector<eml::opcode>
+{
+  std::vector<eml::opcode> result;
+  for (std::size_t i = 0; i < code.instructions.size();
+       i += eml::instruction_size(result.back())) {
+    result.push_back(static_cast<eml::opcode>(code.instructions[i]));
+  }
+  return result;
+}
+
 // Write an instruction to vm
 inline void write_jump(eml::Bytecode& chunk, eml::opcode instruction,
                        std::underlying_type_t<eml::opcode> amount,
@@ -25,9 +74,63 @@ inline void write_instruction(eml::Bytecode& chunk, eml::opcode instruction,
 inline void push_number(eml::Bytecode& chunk, double value,
                         eml::line_num linum = eml::line_num{0})
 {
-  chunk.write(eml::op_push_f64, linum);
   const auto offset = chunk.add_constant(eml::Value{value});
-  chunk.write(eml::opcode{*offset}, linum);
+  chunk.write_with_constant(eml::op_push_f64, *offset, linum);
+}
+
+// Write an instruction with an inline number operand to vm
+inline void write_immediate_instruction(eml::Bytecode& chunk,
+                                        eml::opcode instruction, double value,
+                                        eml::line_num linum = eml::line_num{0})
+{
+  chunk.write(instruction, linum);
+  chunk.write(value, linum);
+}
+
+// Returns whether two values have the same type and the same bits
+inline auto same_bits(const eml::Value& lhs, const eml::Value& rhs) -> bool
+{
+  if (lhs.is_number() && rhs.is_number()) {
+    const double l = lhs.unsafe_as_number();
+    const double r = rhs.unsafe_as_number();
+    return std::memcmp(&l, &r, sizeof(double)) == 0;
+  }
+  if (lhs.is_boolean() && rhs.is_boolean()) {
+    return lhs.unsafe_as_boolean() == rhs.unsafe_as_boolean();
+  }
+  if (lhs.is_reference() && rhs.is_reference()) {
+    return lhs.unsafe_as_reference() == rhs.unsafe_as_reference();
+  }
+  return lhs.is_unit() && rhs.is_unit();
+}
+
+// Requires the jit to produce the same result as the interpreter
+inline void require_same_jit_result(const eml::Bytecode& chunk)
+{
+  const auto verified = eml::verify(chunk);
+  REQUIRE(verified.has_value());
+  const eml::JitBytecode jit_code{*verified};
+
+  eml::VM vm{};
+  const auto expected = vm.interpret(chunk);
+  const auto result = vm.interpret(jit_code);
+  REQUIRE(expected.has_value() == result.has_value());
+  if (expected) {
+    REQUIRE(same_bits(*expected, *result));
+  }
+}
+
+// Requires the optimized chunk to produce the same result as the original one
+inline void require_same_result(const eml::Bytecode& original,
+                                const eml::Bytecode& optimized)
+{
+  eml::VM vm{};
+  const auto expected = vm.interpret(original);
+  const auto result = vm.interpret(optimized);
+  REQUIRE(expected.has_value());
+  REQUIRE(result.has_value());
+  REQUIRE(same_bits(*expected, *result));
+  REQUIRE(eml::verify(optimized).has_value());
 }
 
 #endif // EML_VM_TEST_UTIL_HPP
@@ -0,0 +1,168 @@
+#include "bytecode_rewriter.hpp"
+#include "compiler.hpp"
+#include "vm.hpp"
+
+#include <algorithm>
+
+#include <catch2/catch.hpp>
+
+#include "vm_test_util.hpp"
+
+namespace {
+
+auto contains(const std::vector<eml::opcode>& opcodes, eml::opcode op) -> bool
+{
+  return std::find(opcodes.begin(), opcodes.end(), op) != opcodes.end();
+}
+
+// Returns the sum 0.5 + 1.5 + 2.5 + ... with count terms
+auto sum_script(std::size_t count) -> std::string
+{
+  std::string result = "0.5";
+  for (std::size_t i = 1; i < count; ++i) {
+    result += " + " + std::to_string(i) + ".5";
+  }
+  return result;
+}
+
+} // anonymous namespace
+
+TEST_CASE("Constant pool beyond 256 entries", "[eml.wide_operand]")
+{
+  eml::GarbageCollector gc{};
+  eml::CompilerConfig config;
+  config.number_encoding = eml::NumberEncoding::constant_pool;
+  config.superinstructions = GENERATE(false, true);
+  eml::Compiler compiler{gc, config};
+
+  constexpr std::size_t count = 1000;
+  const auto ast = parse_and_type_check(compiler, sum_script(count), gc);
+  REQUIRE(ast.has_value());
+
+  WHEN("Generates code")
+  {
+    const auto [code, type] = compiler.generate_code(**ast);
+
+    THEN("The first 256 constants use the narrow push and the rest the wide")
+    {
+      REQUIRE(code.constants.size() == count);
+      if (!config.superinstructions) {
+        const auto opcodes = encoded_opcodes_of(code);
+        REQUIRE(std::count(opcodes.begin(), opcodes.end(), eml::op_push_f64) ==
+                256);
+        REQUIRE(std::count(opcodes.begin(), opcodes.end(),
+                           eml::op_push_f64_wide) == count - 256);
+      }
+    }
+
+    THEN("Evaluate to the sum")
+    {
+      eml::VM vm{};
+      const auto result = vm.interpret(code);
+      REQUIRE(result);
+      REQUIRE(result->unsafe_as_number() == Approx(count * count / 2.));
+    }
+  }
+}
+
+TEST_CASE("Jumps beyond 255 bytes", "[eml.wide_operand]")
+{
+  eml::GarbageCollector gc{};
+  eml::CompilerConfig config;
+  config.superinstructions = GENERATE(false, true);
+  config.control_flow = false; // Would merge the identical branches
+  eml::Compiler compiler{gc, config};
+
+  GIVEN("An if expression with small branches")
+  {
+    const auto ast =
+        parse_and_type_check(compiler, "if (1 < 2) 3.5 else 4.5", gc);
+    REQUIRE(ast.has_value());
+    const auto [code, type] = compiler.generate_code(**ast);
+
+    THEN("Keeps the narrow jumps")
+    {
+      const auto opcodes = encoded_opcodes_of(code);
+      REQUIRE(contains(opcodes, eml::op_jmp));
+      REQUIRE(!contains(opcodes, eml::op_jmp_wide));
+      REQUIRE(!contains(opcodes, eml::op_jmp_false_wide));
+      REQUIRE(!contains(opcodes, eml::op_less_f64_jmp_false_wide));
+    }
+  }
+
+  GIVEN("Nested if expressions with large branches")
+  {
+    const auto branch = sum_script(100);
+    const auto source = "if (1 < 2) (if (3 > 4) " + branch + " else 1 + " +
+                        branch + ") else " + branch;
+    const auto ast = parse_and_type_check(compiler, source, gc);
+    REQUIRE(ast.has_value());
+    const auto [code, type] = compiler.generate_code(**ast);
+
+    THEN("Uses wide jumps")
+    {
+      const auto opcodes = encoded_opcodes_of(code);
+      REQUIRE(contains(opcodes, eml::op_jmp_wide));
+      if (config.superinstructions) {
+        REQUIRE(contains(opcodes, eml::op_less_f64_jmp_false_wide));
+        REQUIRE(contains(opcodes, eml::op_greater_f64_jmp_false_wide));
+      } else {
+        REQUIRE(contains(opcodes, eml::op_jmp_false_wide));
+      }
+    }
+
+    THEN("Evaluate to the else branch of the inner if")
+    {
+      eml::VM vm{};
+      const auto result = vm.interpret(code);
+      REQUIRE(result);
+      REQUIRE(result->unsafe_as_number() == Approx(1 + 100 * 100 / 2.));
+    }
+  }
+}
+
+TEST_CASE("Widening a jump can widen the jumps over it", "[eml.wide_operand]")
+{
+  // The first jump goes over the second one and 253 bytes of pushes, so it
+  // only fits in one byte while the second jump is narrow. The second jump
+  // goes 9 bytes further, which does not fit.
+  eml::DecodedBytecode decoded;
+  const auto jump = [&](eml::opcode op, std::size_t target) {
+    eml::DecodedInstruction instruction;
+    instruction.op = op;
+    instruction.target = target;
+    decoded.instructions.push_back(instruction);
+  };
+  const auto push = [&](double number) {
+    eml::DecodedInstruction instruction;
+    instruction.op = eml::op_push_f64_imm;
+    instruction.immediate = number;
+    decoded.instructions.push_back(instruction);
+  };
+
+  constexpr std::size_t pushes = 28; // 252 bytes
+  jump(eml::op_jmp, 2 + pushes + 1);
+  jump(eml::op_jmp, 2 + pushes + 2);
+  for (std::size_t i = 0; i < pushes; ++i) {
+    push(static_cast<double>(i));
+  }
+  decoded.instructions.push_back(eml::DecodedInstruction{eml::op_pop});
+  push(100);
+  push(200);
+
+  const auto code = eml::encode(decoded);
+  const auto opcodes = encoded_opcodes_of(code);
+  REQUIRE(opcodes[0] == eml::op_jmp_wide);
+  REQUIRE(opcodes[1] == eml::op_jmp_wide);
+
+  const auto redecoded = eml::decode(code);
+  REQUIRE(redecoded.instructions.size() == decoded.instructions.size());
+  REQUIRE(redecoded.instructions[0].op == eml::op_jmp);
+  REQUIRE(redecoded.instructions[0].target == 2 + pushes + 1);
+  REQUIRE(redecoded.instructions[1].target == 2 + pushes + 2);
+
+  eml::VM vm{};
+  const auto result = vm.interpret(code);
+  REQUIRE(result);
+  REQUIRE(result->unsafe_as_number() == 200);
+}